@@ -1,5 +1,7 @@
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <thread>
 #define INCLUDEAI_IMPLEMENTATION
 #include <assert.h>
 #include <unistd.h>
@@ -163,7 +165,7 @@ public:
         return networkInputs;
     }
 
-    constexpr void randomize() {}
+    constexpr void randomize(unsigned) {}
 
     int getStone(int idx) const
     {
@@ -356,21 +358,22 @@ struct Connect6AiNeural : Connect6PlayerBase
     static constexpr int INPUTS = Connect6Board::MaxNetworkInputs;
     static constexpr int OUTPUTS = 1, LAYERS = 3, HIDDEN_WIDTH = 96;
     using MyNetwork = Neural<INPUTS, OUTPUTS, LAYERS, HIDDEN_WIDTH, NetRng>;
+    using TrainedNetwork = FeedForward32<INPUTS, OUTPUTS, LAYERS, HIDDEN_WIDTH, NetRng>; // The Trainer needs the FP32 weights
     std::unique_ptr<MyNetwork> nn_ptr;
     std::unique_ptr<Ai_ctx<280000, Connect6Board::Move, UQWORD>> ai_ctx;
     struct NNAdapter
     {
-        MyNetwork *net;
+        IncrementalEvaluator<MyNetwork> eval; // Own activations and first layer, the weights are shared
         FLOAT *evaluate(const FLOAT* inputs, [[maybe_unused]] const FLOAT boardScore)
         {
-            return net->evaluate(inputs);
+            return eval.evaluate(inputs);
         }
     } nn_adapter;
 
     Connect6AiNeural()
       : nn_ptr(std::make_unique<MyNetwork>(netRng)),
         ai_ctx(std::make_unique<Ai_ctx<280000, Connect6Board::Move, UQWORD>>()),
-        nn_adapter{nn_ptr.get()}
+        nn_adapter{IncrementalEvaluator<MyNetwork>(*nn_ptr)}
     {}
 
 
@@ -464,79 +467,67 @@ void playRegular()
 
 void playTraining()
 {
-    struct TrainingSample
-    {
-        float boardState[Connect6Board::MaxNetworkInputs];
-        float gameOutcome; // Will be +1.0 (win), -1.0 (loss)
-    };
-    Connect6PlayerLocal h1;
-    Connect6AiMCTS aiMCTS;
-    Connect6AiNeural aiNeural;
-    int scores[3] = {0, 0, 0};
-    int lastMove = -1, prevMove = -1;
-    std::deque<TrainingSample> win_samples;
-    std::deque<TrainingSample> loss_samples;
-    for (int round=0; round<8000; ++round)
-    {
-        Connect6Board board;
-        std::vector<std::pair<std::vector<float>, int>> single_game_history;
-        Outcome outcome = Outcome::running;
-        Connect6PlayerBase *players[3] = { nullptr, &aiMCTS, &aiNeural };
-        if (round == 0)
-            players[1] = &h1;
-        while (outcome == Outcome::running)
+    // Self-play: producer threads play mcts games against themselves with
+    // the newest published network and fill the replay buffer. The trainer
+    // thread learns from random mini-batches of it and publishes.
+    using Net = Connect6AiNeural::TrainedNetwork;
+    constexpr int Producers = 2;
+    using Buffer = ReplayBuffer<Connect6Board::MaxNetworkInputs, 1, 50000>;
+    using Exchange = ModelExchange<Net, Producers+3>; // Producers, this thread, current, one free
+    Connect6AiNeural::NetRng netRng;
+    auto trained = std::make_unique<Net>(netRng);
+    trained->load("connect6.model"); // Continue where the last run stopped, if there was one
+    auto buffer = std::make_unique<Buffer>();
+    auto exchange = std::make_unique<Exchange>(*trained, netRng);
+    auto trainer = std::make_unique<BackgroundTrainer<Net, Buffer, Exchange>>(*trained, *buffer, *exchange);
+    trainer->start();
+
+    std::atomic<int> games{0};
+    std::atomic<int> draws{0};
+    std::atomic<bool> quit{false};
+    std::thread producers[Producers];
+    for (int p=0; p<Producers; ++p)
+        producers[p] = std::thread([&]
         {
-            const int currentPlayer = board.getCurrentPlayer();
-
-            const float *currentInputs = board.getNetworkInputs();
-
-            single_game_history.emplace_back(
-                std::vector<float>(currentInputs, currentInputs + board.MaxNetworkInputs),
-                currentPlayer
-            );
-
-            const Connect6Board::Move mv = players[currentPlayer]->selectMove(board);
-            outcome = board.doMove(mv);
-
-            // "prevMove" and "lastMove" used for highlight last moves:
-            prevMove = lastMove;
-            lastMove = mv;
-            //if (outcome == Outcome::fin)
-                //{
-                const int h2 = (board.getStone(prevMove) == board.getStone(lastMove)) ? prevMove : -1;
-                board.drawBoard(lastMove, h2);
-                //}
-
-                if (outcome == Outcome::draw)
+            auto ctx = std::make_unique<Ai_ctx<280000, Connect6Board::Move, UQWORD>>();
+            const Net *model = &exchange->acquire();
+            auto eval = std::make_unique<IncrementalEvaluator<Net>>(*model);
+            UQWORD version = exchange->version();
+            while (!quit.load())
             {
-                board.drawBoard(lastMove, -1);
+                if (exchange->version() != version) // Newer weights
+                {
+                    exchange->release(*model);
+                    version = exchange->version();
+                    model = &exchange->acquire();
+                    eval->setNetwork(*model);
+                }
+                Connect6Board board;
+                const int game = games.fetch_add(1);
+                const Outcome outcome = selfPlayGame<150, 5, 2, Connect6Board::Move, UQWORD, Connect6Board::CELLS>(board, *ctx, *eval, *buffer, game);
+                if (outcome == Outcome::draw)
+                    draws += 1;
             }
-            board.switchPlayer();
-        } // while (running == Outcome::running)
+            exchange->release(*model);
+        });
 
-        if (outcome == Outcome::fin)
+    for (int round=0; round<8000; ++round)
+    {
+        sleep(5);
+        std::printf("games: %d (draws %d) | samples: %llu | training steps: %llu | MSE: %f\n",
+                    games.load(), draws.load(), static_cast<unsigned long long>(buffer->totalPushed()),
+                    static_cast<unsigned long long>(trainer->stepsDone()), trainer->meanSquaredError());
+        if (round % 12 == 11)
         {
-            const auto w = board.getWinner();
-            scores[w] += 1;
-            std::printf("\033[1;3%dmwinner: %d \033[0m scre: %d %d\n", w+1, w, scores[1], scores[2]);
-            float learning_rate = 0.001f;
-            float total_mse = 0.f;
-            for (auto& step : single_game_history)
-            {
-                const auto& [boardState, player] = step;
-                const float target = (player == board.getWinner()) ? 1.f : -1.f;
-                total_mse += aiNeural.nn_ptr->train(boardState.data(), &target, learning_rate);
-            }
-            std::printf("training MSE: %f\n", total_mse / single_game_history.size());
+            const Net& newest = exchange->acquire();
+            newest.save("connect6.model");
+            exchange->release(newest);
         }
-        sleep(4+(pcgRand<UDWORD>()&1));
-
-        // Prevent samples from getting too big:
-        while (win_samples.size() > 2500)
-            win_samples.pop_front();
-        while (loss_samples.size() > 2500)
-            loss_samples.pop_front();
-    } // for round
+    }
+    quit.store(true);
+    for (auto& producer : producers)
+        producer.join();
+    trainer->stop();
 }
 
 
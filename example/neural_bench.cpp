@@ -0,0 +1,229 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#define INCLUDEAI_IMPLEMENTATION
+#include "../includeai.hpp"
+
+
+using namespace include_ai;
+
+
+/****************************************/
+/*                Dense vs sparse (CSR) */
+/* Network sized like the Connect6      */
+/* example: 170 inputs, 2x96 hidden     */
+/****************************************/
+    struct NetRng { UDWORD operator()() { return pcgRand<UDWORD>(); } };
+    static constexpr int INPUTS = 170, OUTPUTS = 1, LAYERS = 3, HIDDEN_WIDTH = 96;
+    using MyNetwork = FeedForward32<INPUTS, OUTPUTS, LAYERS, HIDDEN_WIDTH, NetRng>;
+    using MyNetwork16 = FeedForward16<INPUTS, OUTPUTS, LAYERS, HIDDEN_WIDTH, NetRng>;
+    using MyNetwork8 = FeedForward8<INPUTS, OUTPUTS, LAYERS, HIDDEN_WIDTH, NetRng>;
+
+    template <typename Fn>
+    double microsPerCall(Fn fn, const int calls)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (int i=0; i<calls; ++i)
+            fn(i);
+        const auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::micro>(end - start).count() / calls;
+    }
+
+
+int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[])
+{
+    const NeuralKernels& kernels = neuralKernels();
+    const bool kernelsOk = neuralKernelsSelfTest(kernels);
+    std::printf("kernels: %s | self-test: %s\n", kernels.name, kernelsOk ? "ok" : "FAILED");
+
+    NetRng rng;
+    auto nn = std::make_unique<MyNetwork>(rng);
+    constexpr int Positions = 64;
+    static FLOAT inputs[Positions][INPUTS];
+    for (int p=0; p<Positions; ++p)
+        for (int i=0; i<INPUTS; ++i)
+            inputs[p][i] = (rng() % 3) - 1.f;
+
+    // Both paths must agree:
+    FLOAT maxDiff = 0.f;
+    for (int p=0; p<Positions; ++p)
+    {
+        const FLOAT sparse = nn->evaluate(inputs[p])[MyNetwork::columns-1];
+        const FLOAT dense  = nn->evaluateDense(inputs[p])[MyNetwork::columns-1];
+        maxDiff = aiMax(maxDiff, aiAbs(sparse - dense));
+    }
+
+    constexpr int Calls = 2000;
+    volatile FLOAT sink = 0.f;
+    const double dense  = microsPerCall([&](int i) { sink = sink + nn->evaluateDense(inputs[i % Positions])[MyNetwork::columns-1]; }, Calls);
+    const double sparse = microsPerCall([&](int i) { sink = sink + nn->evaluate(inputs[i % Positions])[MyNetwork::columns-1]; }, Calls);
+    const int possibleEdges = MyNetwork::columns * (INPUTS + (LAYERS-1)*MyNetwork::columns);
+    std::printf("columns: %d | edges: %d of %d (%.1f%%) | max diff: %g\n",
+                MyNetwork::columns, nn->countEdges(), possibleEdges, 100.0 * nn->countEdges() / possibleEdges, maxDiff);
+    std::printf("dense: %.1f us/eval | sparse: %.1f us/eval | speedup: %.2fx\n", dense, sparse, dense / sparse);
+
+    // Without the random flips every layer is a band of full tiles:
+    auto band = std::make_unique<MyNetwork>(rng, false);
+    const double banded = microsPerCall([&](int i) { sink = sink + band->evaluate(inputs[i % Positions])[MyNetwork::columns-1]; }, Calls);
+    std::printf("network: %zu KB | band topology: %d edges, %.1f us/eval\n", sizeof(MyNetwork) / 1024, band->countEdges(), banded);
+    // The weights are kept for the tiles that have edges only:
+    constexpr size_t denseBytes = sizeof(FLOAT) * MyNetwork::columns * MyNetwork::columns;
+    std::printf("weights: %zu KB, band %zu KB | dense: %zu KB\n", static_cast<size_t>(nn->weightBytes()) / 1024,
+                static_cast<size_t>(band->weightBytes()) / 1024, denseBytes / 1024);
+
+    // Binary16 copy of an fp32 network (the fp32 one keeps training, see below):
+    auto nn32 = std::make_unique<MyNetwork>(rng);
+    nn32->prepare();
+    auto nn16 = std::make_unique<MyNetwork16>(*nn32);
+    FLOAT maxDiff16 = 0.f;
+    for (int p=0; p<Positions; ++p)
+    {
+        const FLOAT full = nn32->evaluate(inputs[p])[MyNetwork::columns-1];
+        const FLOAT half = nn16->evaluate(inputs[p])[MyNetwork::columns-1];
+        maxDiff16 = aiMax(maxDiff16, aiAbs(full - half));
+    }
+    const double half = microsPerCall([&](int i) { sink = sink + nn16->evaluate(inputs[i % Positions])[MyNetwork::columns-1]; }, Calls);
+    std::printf("sparse, fp16 weights: %.1f us/eval, %zu KB | max diff to fp32: %g\n", half,
+                static_cast<size_t>(nn16->weightBytes()) / 1024, maxDiff16);
+
+    // Quantized copy of the fp32 network:
+    auto nn8 = std::make_unique<MyNetwork8>(*nn32);
+    FLOAT maxDiff8 = 0.f;
+    for (int p=0; p<Positions; ++p)
+    {
+        const FLOAT full  = nn32->evaluate(inputs[p])[MyNetwork::columns-1];
+        const FLOAT quant = nn8->evaluate(inputs[p])[MyNetwork::columns-1];
+        maxDiff8 = aiMax(maxDiff8, aiAbs(full - quant));
+    }
+    const double int8 = microsPerCall([&](int i) { sink = sink + nn8->evaluate(inputs[i % Positions])[MyNetwork::columns-1]; }, Calls);
+    std::printf("int8 weights: %.1f us/eval | speedup over sparse fp32: %.2fx | max diff to fp32: %g\n", int8, sparse / int8, maxDiff8);
+
+    // One shared network, one Evaluator per thread:
+    constexpr int Threads = 4;
+    FLOAT expected[Positions];
+    for (int p=0; p<Positions; ++p)
+        expected[p] = nn32->evaluate(inputs[p])[MyNetwork::columns-1];
+    int mismatches[Threads] = {0};
+    std::thread threads[Threads];
+    const MyNetwork& shared = *nn32;
+    for (int t=0; t<Threads; ++t)
+        threads[t] = std::thread([&, t]
+        {
+            Evaluator<MyNetwork> eval(shared);
+            for (int round=0; round<50; ++round)
+                for (int p=0; p<Positions; ++p)
+                    mismatches[t] += eval.evaluate(inputs[p])[MyNetwork::columns-1] != expected[p];
+        });
+    int totalMismatches = 0;
+    for (int t=0; t<Threads; ++t)
+    {
+        threads[t].join();
+        totalMismatches += mismatches[t];
+    }
+    std::printf("shared network, %d threads: %d mismatches\n", Threads, totalMismatches);
+
+    // The same threads through one InferenceServer, which batches their requests:
+    const FLOAT *batchInputs[Positions];
+    static FLOAT batchScratch[Positions][MyNetwork::activationSize];
+    FLOAT *batchRows[Positions];
+    for (int p=0; p<Positions; ++p)
+    {
+        batchInputs[p] = inputs[p];
+        batchRows[p] = batchScratch[p];
+    }
+    const double batched = microsPerCall([&](int) { shared.evaluateBatch(batchInputs, batchRows, Positions); }, Calls / Positions) / Positions;
+    const double batched16 = microsPerCall([&](int) { nn16->evaluateBatch(batchInputs, batchRows, Positions); }, Calls / Positions) / Positions;
+    using MyServer = InferenceServer<MyNetwork>;
+    MyServer server(shared);
+    server.start();
+    for (int t=0; t<Threads; ++t)
+    {
+        mismatches[t] = 0;
+        threads[t] = std::thread([&, t]
+        {
+            auto client = std::make_unique<InferenceClient<MyServer>>(server);
+            for (int round=0; round<50; ++round)
+                for (int p=0; p<Positions; ++p)
+                    mismatches[t] += client->evaluate(inputs[p])[MyNetwork::columns-1] != expected[p];
+        });
+    }
+    totalMismatches = 0;
+    for (int t=0; t<Threads; ++t)
+    {
+        threads[t].join();
+        totalMismatches += mismatches[t];
+    }
+    server.stop();
+    std::printf("evaluateBatch: %.1f us/eval, fp16 %.1f us/eval | inference server, %d threads: mean batch %.1f, %d mismatches\n",
+                batched, batched16, Threads, double(server.requestsServed()) / server.batchesRun(), totalMismatches);
+
+    // One cell changes per position, the incremental evaluator only redoes that part of the first layer:
+    static FLOAT walk[Positions][INPUTS];
+    for (int i=0; i<INPUTS; ++i)
+        walk[0][i] = inputs[0][i];
+    for (int p=1; p<Positions; ++p)
+    {
+        for (int i=0; i<INPUTS; ++i)
+            walk[p][i] = walk[p-1][i];
+        walk[p][rng() % INPUTS] = (rng() % 3) - 1.f;
+    }
+    Evaluator<MyNetwork> fullEval(*nn32);
+    IncrementalEvaluator<MyNetwork> incEval(*nn32);
+    FLOAT maxDiffInc = 0.f;
+    for (int p=0; p<Positions; ++p)
+        maxDiffInc = aiMax(maxDiffInc, aiAbs(incEval.evaluate(walk[p])[MyNetwork::columns-1] - fullEval.evaluate(walk[p])[MyNetwork::columns-1]));
+    const double full = microsPerCall([&](int i) { sink = sink + fullEval.evaluate(walk[i % Positions])[MyNetwork::columns-1]; }, Calls);
+    const double incremental = microsPerCall([&](int i) { sink = sink + incEval.evaluate(walk[i % Positions])[MyNetwork::columns-1]; }, Calls);
+    std::printf("one input changed: full %.1f us/eval | incremental %.1f us/eval | max diff %g\n", full, incremental, maxDiffInc);
+
+    // Mini-batch training, the batch split over the pool:
+    static FLOAT targets[Positions][OUTPUTS];
+    const FLOAT *inputPtrs[Positions], *targetPtrs[Positions];
+    for (int p=0; p<Positions; ++p)
+    {
+        targets[p][0] = (p % 2) ? 0.5f : -0.5f;
+        inputPtrs[p] = inputs[p];
+        targetPtrs[p] = targets[p];
+    }
+    WorkerPool pool;
+    auto trainer = std::make_unique<Trainer<MyNetwork>>(*nn32);
+    constexpr int Batch = 16, Epochs = 20;
+    FLOAT firstMse = 0.f, lastMse = 0.f;
+    const double perBatch = microsPerCall([&](int i)
+    {
+        const int first = (i * Batch) % Positions;
+        lastMse = trainer->trainBatch(&inputPtrs[first], &targetPtrs[first], Batch, pool);
+        if (i == 0)
+            firstMse = lastMse;
+    }, Epochs * Positions / Batch);
+    std::printf("adam, batch %d, %d threads: %.1f us/sample | mse %g -> %g\n", Batch, pool.size(), perBatch / Batch, firstMse, lastMse);
+
+    // Save, then load into a differently seeded network:
+    const char *modelPath = "neural_bench.model";
+    auto loaded = std::make_unique<MyNetwork>(rng);
+    const bool saved = nn32->save(modelPath);
+    bool loadedOk = false;
+    const double loadMicros = microsPerCall([&](int) { loadedOk = loaded->load(modelPath); }, 1);
+    int loadMismatches = 0;
+    for (int p=0; p<Positions; ++p)
+        loadMismatches += loaded->evaluate(inputs[p])[MyNetwork::columns-1] != nn32->evaluate(inputs[p])[MyNetwork::columns-1];
+    std::remove(modelPath);
+    std::printf("save: %s | load: %s, %.2f ms | %d mismatches\n", saved ? "ok" : "FAILED", loadedOk ? "ok" : "FAILED", loadMicros / 1000, loadMismatches);
+
+    // Activations, a whole row per call (std::tanh per element vs the kernel):
+    constexpr int RowLen = 1024;
+    static FLOAT row[RowLen], rowIn[RowLen];
+    for (int i=0; i<RowLen; ++i)
+        rowIn[i] = ((rng() % 2001) - 1000.f) / 200.f;
+    const double stdTanh = microsPerCall([&](int) { for (int i=0; i<RowLen; ++i) row[i] = std::tanh(rowIn[i]); sink = sink + row[7]; }, Calls);
+    const double rowTanh = microsPerCall([&](int) { for (int i=0; i<RowLen; ++i) row[i] = rowIn[i]; kernels.tanhRow(row, RowLen); sink = sink + row[7]; }, Calls);
+    const double rowExp  = microsPerCall([&](int) { for (int i=0; i<RowLen; ++i) row[i] = rowIn[i]; kernels.expRow(row, RowLen); sink = sink + row[7]; }, Calls);
+    std::printf("tanh, %d values: std %.2f us | kernel %.2f us | speedup: %.2fx | exp kernel %.2f us\n",
+                RowLen, stdTanh, rowTanh, stdTanh / rowTanh, rowExp);
+
+    nn->setKernels(scalarKernels());
+    const double scalar = microsPerCall([&](int i) { sink = sink + nn->evaluate(inputs[i % Positions])[MyNetwork::columns-1]; }, Calls);
+    std::printf("sparse, scalar kernels: %.1f us/eval\n", scalar);
+    return (maxDiff < 1e-4f && kernelsOk && totalMismatches == 0 && loadedOk && loadMismatches == 0) ? 0 : 1;
+}
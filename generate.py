@@ -12,10 +12,14 @@ source_paths = [
     "src/asmtypes.hpp",
     "src/bitalloc.hpp",
     "src/bitalloc.cpp",
+    "src/bitvec.hpp",
+    "src/bitvec.cpp",
     "src/micro_math.hpp",
     "src/micro_math.cpp",
     "src/neural.hpp",
     "src/neural.cpp",
+    "src/workers.hpp",
+    "src/workers.cpp",
     "src/ai.hpp",
     "src/ai.cpp"
 ]
@@ -257,25 +261,38 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 merge_result += "#ifndef INCLUDEAI_HPP\n#define INCLUDEAI_HPP\n\n"
 merge_result += "#ifdef INCLUDEAI_IMPLEMENTATION\n\n\n"
-merge_result += """#include <cmath>
+merge_result += """#include <assert.h>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <compare>
 #include <concepts>
-#if defined(AI_DEBUG)
-  #include <assert.h>
-#endif
-#if defined(__AVX__) || defined(__AVX2__) || defined(__AVX512F__) || defined(__SSSE3__)
-  #include <immintrin.h>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h> // Wider kernels are picked at runtime, no -march needed
 #elif defined(__ARM_NEON)
   #include <arm_neon.h>
 #elif defined(__wasm_simd128__)
   #include <wasm_simd128.h>
-#else
-  #error "unknown arch! (if compiling for wasm try using '-msimd128', on intel '-march=native')"
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+  #include <fcntl.h> // Model files are mapped where there is mmap
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
 #endif\n\n
 namespace include_ai {\n\n\n
 """
 
 remove = ["#include", "_HPP", "double include", "AVX", "NEON", "defined(__wasm_simd128__)", "nothing?", "unknown", "namespace include_ai"]
-dontRemove = ["__AVX512FP16"]
+dontRemove = ["__AVX512FP16", "INCLUDEAI_SIMD"]
 
 for filename, _ in unique: # 'unique' tuple is unpacked as (filename, dependencies)
     f = open(filename, "r")
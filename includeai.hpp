@@ -20,19 +20,32 @@
 #ifdef INCLUDEAI_IMPLEMENTATION
 
 
+#include <assert.h>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <cmath>
+#include <compare>
 #include <concepts>
-#if defined(AI_DEBUG)
-  #include <assert.h>
-#endif
-#if defined(__AVX__) || defined(__AVX2__) || defined(__AVX512F__) || defined(__SSSE3__)
-  #include <immintrin.h>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h> // Wider kernels are picked at runtime, no -march needed
 #elif defined(__ARM_NEON)
   #include <arm_neon.h>
 #elif defined(__wasm_simd128__)
   #include <wasm_simd128.h>
-#else
-  #error "unknown arch! (if compiling for wasm try using '-msimd128', on intel '-march=native')"
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+  #include <fcntl.h> // Model files are mapped where there is mmap
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
 #endif
 
 
@@ -372,6 +385,41 @@ static_assert(sizeof(DOUBLE) == sizeof(UQWORD));
             for (int i=0; i<NumberOfBuckets; ++i)
                 bucketPool[i] = 0;
         }
+
+        // Statistics (not meant for the hot path). Bit 'Intbits-1' of a bucket is
+        // position 0, padding bits past 'Size' are never counted:
+        constexpr int countAvail() const
+        {
+            int avail = 0;
+            for (int pos=0; pos<Size; ++pos)
+                avail += isAvail(pos);
+            return avail;
+        }
+
+        constexpr int largestAvailRun() const
+        {
+            int best = 0, run = 0;
+            for (int pos=0; pos<Size; ++pos)
+            {
+                if (pos % Intbits == 0 && bucketPool[pos/Intbits] == 0 && pos+Intbits <= Size)
+                {
+                    run += Intbits; // Fast path for empty buckets
+                    pos += Intbits - 1;
+                }
+                else
+                {
+                    run = isAvail(pos) ? run+1 : 0;
+                }
+                best = bitAllocatorMax(best, run);
+            }
+            return best;
+        }
+
+    private:
+        constexpr bool isAvail(const int pos) const
+        {
+            return ((bucketPool[pos/Intbits] >> (Intbits - 1 - (pos%Intbits))) & 1) == 0;
+        }
     };
 
 
@@ -572,676 +620,5220 @@ static_assert(sizeof(DOUBLE) == sizeof(UQWORD));
                   }()
                  );
 
+    static_assert([]
+                  {
+                      constexpr bool comptime = true;
+                      BitAlloc<20, UBYTE, BitAlloc_Mode::FAST, comptime> testAlloc; // 3 buckets, 4 padding bits
+                      bool ok = testAlloc.countAvail() == 20 && testAlloc.largestAvailRun() == 20;
+                      testAlloc.largestAvailChunk(6);  // 0..5
+                      testAlloc.largestAvailChunk(10); // 8..17
+                      ok = ok && testAlloc.countAvail() == 4;
+                      ok = ok && testAlloc.largestAvailRun() == 2;
+                      testAlloc.free(10, 4);
+                      ok = ok && testAlloc.countAvail() == 8;
+                      ok = ok && testAlloc.largestAvailRun() == 4;
+                      testAlloc.free(0, 6);
+                      ok = ok && testAlloc.largestAvailRun() == 8; // 0..7
+                      return ok;
+                  }()
+                 );
 
 
 
 
-/****************************************/
-/*                 Fisher-Yates shuffle */
-/****************************************/
-    template <typename Container>
-    constexpr void FisherYates(Container& container, const int len, const int s)
-    {
-        for (int k = 0; k < len; ++k)
-        {
-            const int r = k + s % (len - k);
-            auto temp = container[k];
-            container[k] = container[r];
-            container[r] = temp;
-        }
-    }
-
 
 /****************************************/
-/*                           PCG Random */
+/*                      Wide bulk paths */
+/* Bitvecs of 256 bits and more do |=,  */
+/* &=, ^=, ~, ==, bool and popcnt() a   */
+/* vector at a time when the build      */
+/* targets it (-mavx2, 64 bytes at a    */
+/* time with avx-512f, vpopcntq, arm64) */
+/* Picked at compile time: these run    */
+/* inside rollouts, a dispatch per call */
+/* would cost more than the work.       */
+/* Constant evaluation always takes the */
+/* word loops. Define                   */
+/* INCLUDEAI_SIMD_OFF for word loops    */
+/* everywhere                           */
 /****************************************/
-    class pcg32
-    {
-    private:
-        static constexpr auto PCG_DEFAULT_MULTIPLIER = 6364136223846793005ull;
-        UQWORD state, inc;
-    public:
-        explicit constexpr pcg32(const UQWORD seed = 0);
-
-        constexpr UDWORD operator()();
-    };
-
-    class pcg16
-    {
-    private:
-        static constexpr auto PCG_DEFAULT_MULTIPLIER = 747796405u;
-        UDWORD state, inc;
-    public:
-        explicit constexpr pcg16(const UDWORD seed = 0);
-
-        constexpr UWORD operator()();
-    };
-
-    UDWORD pcg32rand(const UQWORD seed=0);
-    UWORD  pcg16rand(const UDWORD seed=0);
-
-    template <typename Int>
-    auto pcgRand(const Int seed=0)
-    {
-        if constexpr (sizeof(Int) == sizeof(UQWORD))
-            return pcg32rand(seed);
-        else
-            return pcg16rand(seed);
-    }
-
+#if !defined(INCLUDEAI_SIMD_OFF) && defined(__AVX2__)
+  #define INCLUDEAI_SIMD_BITVEC 256
+#elif !defined(INCLUDEAI_SIMD_OFF) && defined(__ARM_NEON) && defined(__aarch64__)
+  #define INCLUDEAI_SIMD_BITVEC 128
+#else
+  #define INCLUDEAI_SIMD_BITVEC 0
+#endif
+#if INCLUDEAI_SIMD_BITVEC == 256 && defined(__AVX512F__)
+  #define INCLUDEAI_SIMD_BITVEC512 1
+#else
+  #define INCLUDEAI_SIMD_BITVEC512 0
+#endif
+#if INCLUDEAI_SIMD_BITVEC512 && defined(__AVX512VPOPCNTDQ__) && defined(__AVX512BW__)
+  #define INCLUDEAI_SIMD_POPCNT512 1
+#else
+  #define INCLUDEAI_SIMD_POPCNT512 0
+#endif
 
-/****************************************/
-/*                                fibon */
-/****************************************/
-    template <typename Int>
-    constexpr Int fib(const Int i)
+#if INCLUDEAI_SIMD_BITVEC == 256
+    // Set bits of each 64 bit lane (Mula: nibble lookup, then psadbw):
+    inline __m256i bitvecPopcount256(const __m256i v)
     {
-        if (i<=1) return i;
-        return fib(i-1) + fib(i-2);
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        const __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, nibble));
+        const __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
     }
 
-
-
-
-
-
-/****************************************/
-/*                           PCG Random */
-/****************************************/
-    constexpr pcg32::pcg32(const UQWORD seed)
-      : state(0), inc(0)
+    // Carry-save adder: a + b + c = 2*high + low, bitwise
+    inline void bitvecCsa(__m256i& high, __m256i& low, const __m256i a, const __m256i b, const __m256i c)
     {
-        const UQWORD initstate = seed << 31 | seed;
-        const UQWORD initseq   = seed << 31 | seed;
-        inc = (initseq << 1) | 1;
-        state = initstate + inc;
-        state = state * PCG_DEFAULT_MULTIPLIER + inc;
+        const __m256i u = _mm256_xor_si256(a, b);
+        high = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+        low = _mm256_xor_si256(u, c);
     }
 
-    constexpr UDWORD pcg32::operator()()
+    inline UQWORD bitvecSum256(const __m256i v)
     {
-        // PCG Random number generation (http://www.pcg-random.org):
-        const UQWORD oldstate = state;
-        // Advance internal state:
-        state = oldstate * PCG_DEFAULT_MULTIPLIER + (inc | 1);
-        // Calculate output function (XSH RR), uses old state for max ILP:
-        const UDWORD xorshifted = UDWORD(((oldstate >> 18u) ^ oldstate) >> 27u);
-        const UDWORD rot = oldstate >> 59u;
-        return (xorshifted >> rot) | (xorshifted << ((~rot) & 31));
+        const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        return static_cast<UQWORD>(_mm_cvtsi128_si64(s)) + static_cast<UQWORD>(_mm_extract_epi64(s, 1));
     }
 
-    UDWORD pcg32rand(const UQWORD seed)
+    // Set bits in 'n' vectors at 'p'. Harley-Seal: 16 vectors go through
+    // a tree of carry-save adders, only the carries out of it are counted;
+    // the rest (and short vectors) are counted one vector at a time
+    inline UQWORD bitvecPopcountBytes(const UBYTE *p, const int n)
     {
-        static bool initialized = false;
-        static pcg32 generator;
-        if (seed != 0 || !initialized) {
-            generator = pcg32(seed);
-            initialized = true;
+        auto load = [p](const int v) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p) + v); };
+        __m256i total = _mm256_setzero_si256();
+        int v = 0;
+        if (n >= 16)
+        {
+            __m256i ones = total, twos = total, fours = total, eights = total, sixteens;
+            __m256i twosA, twosB, foursA, foursB, eightsA, eightsB;
+            for (; v + 16 <= n; v += 16)
+            {
+                bitvecCsa(twosA, ones, ones, load(v), load(v+1));
+                bitvecCsa(twosB, ones, ones, load(v+2), load(v+3));
+                bitvecCsa(foursA, twos, twos, twosA, twosB);
+                bitvecCsa(twosA, ones, ones, load(v+4), load(v+5));
+                bitvecCsa(twosB, ones, ones, load(v+6), load(v+7));
+                bitvecCsa(foursB, twos, twos, twosA, twosB);
+                bitvecCsa(eightsA, fours, fours, foursA, foursB);
+                bitvecCsa(twosA, ones, ones, load(v+8), load(v+9));
+                bitvecCsa(twosB, ones, ones, load(v+10), load(v+11));
+                bitvecCsa(foursA, twos, twos, twosA, twosB);
+                bitvecCsa(twosA, ones, ones, load(v+12), load(v+13));
+                bitvecCsa(twosB, ones, ones, load(v+14), load(v+15));
+                bitvecCsa(foursB, twos, twos, twosA, twosB);
+                bitvecCsa(eightsB, fours, fours, foursA, foursB);
+                bitvecCsa(sixteens, eights, eights, eightsA, eightsB);
+                total = _mm256_add_epi64(total, bitvecPopcount256(sixteens));
+            }
+            total = _mm256_slli_epi64(total, 4);
+            total = _mm256_add_epi64(total, _mm256_slli_epi64(bitvecPopcount256(eights), 3));
+            total = _mm256_add_epi64(total, _mm256_slli_epi64(bitvecPopcount256(fours), 2));
+            total = _mm256_add_epi64(total, _mm256_slli_epi64(bitvecPopcount256(twos), 1));
+            total = _mm256_add_epi64(total, bitvecPopcount256(ones));
         }
-        return generator();
+        for (; v < n; ++v)
+            total = _mm256_add_epi64(total, bitvecPopcount256(load(v)));
+        return bitvecSum256(total);
     }
+#endif
 
 
-    constexpr pcg16::pcg16(const UDWORD seed)
-      : state(0), inc(0)
+/****************************************/
+/*                     Select in a word */
+/* Position of the n-th (from 0) set    */
+/* bit of a word in constant time: one  */
+/* pdep with BMI2. Otherwise a bytewise */
+/* compare against the running byte     */
+/* counts finds the byte, the nibble,   */
+/* pair and bit counts the rest. pdep   */
+/* is slow on Zen 1/2, build without    */
+/* -mbmi2 or with INCLUDEAI_SIMD_OFF    */
+/****************************************/
+#if !defined(INCLUDEAI_SIMD_OFF) && defined(__BMI2__)
+  #define INCLUDEAI_BMI2_SELECT 1
+#else
+  #define INCLUDEAI_BMI2_SELECT 0
+#endif
+    // 'n' must be below the popcount of 'word':
+    constexpr int bitvecSelect64(const UQWORD word, int n)
     {
-        const UDWORD initstate = seed << 15 | seed;
-        const UDWORD initseq   = seed << 15 | seed;
-        inc = (initseq << 1) | 1;
-        state = initstate + inc;
-        state = state * PCG_DEFAULT_MULTIPLIER + inc;
+    #if INCLUDEAI_BMI2_SELECT
+        if (!std::is_constant_evaluated())
+            return std::countr_zero(_pdep_u64(UQWORD(1) << n, word));
+    #endif
+        constexpr UQWORD ones = 0x0101010101010101ull, highs = 0x8080808080808080ull;
+        const UQWORD c1 = word - ((word >> 1) & 0x5555555555555555ull);
+        const UQWORD c2 = (c1 & 0x3333333333333333ull) + ((c1 >> 2) & 0x3333333333333333ull);
+        const UQWORD c4 = (c2 + (c2 >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        // Byte i of 'upTo' counts the set bits in bytes 0..i, the target
+        // byte is the number of bytes whose count does not exceed n:
+        const UQWORD upTo = c4 * ones;
+        const UQWORD notAbove = ((static_cast<UQWORD>(n) * ones | highs) - upTo) & highs;
+        int pos = static_cast<int>(((notAbove >> 7) * ones) >> 56) * 8;
+        n -= static_cast<int>(((upTo << 8) >> pos) & 0xFF);
+        auto descend = [&](const UQWORD counts, const UQWORD fieldMask, const int half)
+        {
+            const int below = static_cast<int>((counts >> pos) & fieldMask);
+            const bool upper = n >= below;
+            pos += upper * half;
+            n -= upper * below;
+        };
+        descend(c2, 0xF, 4);
+        descend(c1, 0x3, 2);
+        descend(word, 0x1, 1);
+        return pos;
     }
 
-    constexpr UWORD pcg16::operator()()
+/****************************************/
+/*                           Bit vector */
+/****************************************/
+    template <class Int, int Size, int Charbits=CHARBITS>
+    class Bitvec
     {
-        // PCG Random number generation (http://www.pcg-random.org):
-        const UDWORD oldstate = state;
-        // Advance internal state:
-        state = oldstate * PCG_DEFAULT_MULTIPLIER + (inc | 1);
-        // Calculate output function (XSH RR), uses old state for max ILP:
-        const UWORD xorshifted = UWORD(((oldstate >> 10u) ^ oldstate) >> 12u);
-        const UWORD rot = oldstate >> 28u;
-        return (xorshifted >> rot) | (xorshifted << ((~rot) & 15));
-    }
+    private:
+        static constexpr Int w = sizeof(Int)*Charbits;
+        static constexpr Int shift = []{ Int p=0, b=sizeof(Int)*Charbits; while (b>>=1) p++; return p; }();
+        static constexpr int N_INTS = (Size + w - 1) / w;
+        Int mem[N_INTS] = {};
+    private:
+        // See "Wide bulk paths". Vectors cover mem[0 .. VecInts*nVecs),
+        // nFullVecs of them lie before the last (partly used) word:
+        static constexpr bool Wide = INCLUDEAI_SIMD_BITVEC > 0 && Size >= 256;
+        static constexpr int VecBytes = INCLUDEAI_SIMD_BITVEC > 0 ? INCLUDEAI_SIMD_BITVEC / 8 : 16;
+        static constexpr int VecInts = VecBytes / static_cast<int>(sizeof(Int));
+        static constexpr int nVecs = N_INTS / VecInts;
+        static constexpr int nFullVecs = (N_INTS-1) / VecInts;
+        enum class WideOp { orOp, andOp, xorOp, notOp };
+
+        UBYTE *bytes() { return reinterpret_cast<UBYTE *>(mem); }
+        const UBYTE *bytes() const { return reinterpret_cast<const UBYTE *>(mem); }
+
+        static constexpr Int lastMask()
+        {
+            if constexpr (Size % w != 0)
+                return (Int(1) << (Size % w)) - 1;
+            else
+                return static_cast<Int>(~Int(0));
+        }
 
-    UWORD pcg16rand(const UDWORD seed)
-    {
-        static bool initialized = false;
-        static pcg16 generator;
-        if (seed != 0 || !initialized) {
-            generator = pcg16(seed);
-            initialized = true;
+        // Word 'i' without the padding bits:
+        constexpr std::make_unsigned_t<Int> maskedWord(const int i) const
+        {
+            return static_cast<std::make_unsigned_t<Int>>(i == N_INTS-1 ? mem[i] & lastMask() : mem[i]);
         }
-        return generator();
-    }
 
+        // dst = this op rhs (rhs unused for notOp), all words:
+        template <WideOp Op>
+        void wide(Bitvec& dst, const Bitvec& rhs) const
+        {
+            int i = 0;
+        #if INCLUDEAI_SIMD_BITVEC512
+            // Pairs of vectors, the rest below. No masked tail: the next
+            // operation on the board would wait for a masked store
+            for (int v = 0; v + 2 <= nVecs; v += 2)
+            {
+                const __m512i a = _mm512_loadu_si512(bytes() + v*VecBytes);
+                __m512i r;
+                if constexpr (Op == WideOp::orOp)
+                    r = _mm512_or_si512(a, _mm512_loadu_si512(rhs.bytes() + v*VecBytes));
+                else if constexpr (Op == WideOp::andOp)
+                    r = _mm512_and_si512(a, _mm512_loadu_si512(rhs.bytes() + v*VecBytes));
+                else if constexpr (Op == WideOp::xorOp)
+                    r = _mm512_xor_si512(a, _mm512_loadu_si512(rhs.bytes() + v*VecBytes));
+                else
+                    r = _mm512_ternarylogic_epi64(a, a, a, 0x55); // ~a
+                _mm512_storeu_si512(dst.bytes() + v*VecBytes, r);
+            }
+            i = (nVecs & ~1) * VecInts;
+        #endif
+        #if INCLUDEAI_SIMD_BITVEC == 256
+            for (int v = i / VecInts; v < nVecs; ++v)
+            {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes()) + v);
+                const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs.bytes()) + v);
+                __m256i r;
+                if constexpr (Op == WideOp::orOp)
+                    r = _mm256_or_si256(a, b);
+                else if constexpr (Op == WideOp::andOp)
+                    r = _mm256_and_si256(a, b);
+                else if constexpr (Op == WideOp::xorOp)
+                    r = _mm256_xor_si256(a, b);
+                else
+                    r = _mm256_xor_si256(a, _mm256_set1_epi32(-1));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst.bytes()) + v, r);
+            }
+            i = nVecs * VecInts;
+        #elif INCLUDEAI_SIMD_BITVEC == 128
+            for (int v = 0; v < nVecs; ++v)
+            {
+                const uint8x16_t a = vld1q_u8(bytes() + v*16);
+                const uint8x16_t b = vld1q_u8(rhs.bytes() + v*16);
+                uint8x16_t r;
+                if constexpr (Op == WideOp::orOp)
+                    r = vorrq_u8(a, b);
+                else if constexpr (Op == WideOp::andOp)
+                    r = vandq_u8(a, b);
+                else if constexpr (Op == WideOp::xorOp)
+                    r = veorq_u8(a, b);
+                else
+                    r = vmvnq_u8(a);
+                vst1q_u8(dst.bytes() + v*16, r);
+            }
+            i = nVecs * VecInts;
+        #endif
+            for (; i < N_INTS; ++i)
+            {
+                if constexpr (Op == WideOp::orOp)
+                    dst.mem[i] = mem[i] | rhs.mem[i];
+                else if constexpr (Op == WideOp::andOp)
+                    dst.mem[i] = mem[i] & rhs.mem[i];
+                else if constexpr (Op == WideOp::xorOp)
+                    dst.mem[i] = mem[i] ^ rhs.mem[i];
+                else
+                    dst.mem[i] = ~mem[i];
+            }
+        }
 
+        // Any bit set in this (xor rhs, if Xor) in the words before the last:
+        template <bool Xor>
+        bool wideAny(const Bitvec& rhs) const
+        {
+            int i = 0;
+            bool any = false;
+        #if INCLUDEAI_SIMD_BITVEC512
+            __m512i acc512 = _mm512_setzero_si512();
+            for (int v = 0; v + 2 <= nFullVecs; v += 2)
+            {
+                __m512i a = _mm512_loadu_si512(bytes() + v*VecBytes);
+                if constexpr (Xor)
+                    a = _mm512_xor_si512(a, _mm512_loadu_si512(rhs.bytes() + v*VecBytes));
+                acc512 = _mm512_or_si512(acc512, a);
+            }
+            any = _mm512_test_epi64_mask(acc512, acc512) != 0;
+            i = (nFullVecs & ~1) * VecInts;
+        #endif
+        #if INCLUDEAI_SIMD_BITVEC == 256
+            __m256i acc = _mm256_setzero_si256();
+            for (int v = i / VecInts; v < nFullVecs; ++v)
+            {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes()) + v);
+                if constexpr (Xor)
+                    a = _mm256_xor_si256(a, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs.bytes()) + v));
+                acc = _mm256_or_si256(acc, a);
+            }
+            any = any || !_mm256_testz_si256(acc, acc);
+            i = nFullVecs * VecInts;
+        #elif INCLUDEAI_SIMD_BITVEC == 128
+            uint8x16_t acc = vdupq_n_u8(0);
+            for (int v = 0; v < nFullVecs; ++v)
+            {
+                uint8x16_t a = vld1q_u8(bytes() + v*16);
+                if constexpr (Xor)
+                    a = veorq_u8(a, vld1q_u8(rhs.bytes() + v*16));
+                acc = vorrq_u8(acc, a);
+            }
+            any = vmaxvq_u8(acc) != 0;
+            i = nFullVecs * VecInts;
+        #endif
+            for (; i < N_INTS-1; ++i)
+                any = any || (Xor ? mem[i] != rhs.mem[i] : mem[i] != 0);
+            return any;
+        }
 
+        // Set bits in the words before the last:
+        UQWORD widePopcnt() const
+        {
+            UQWORD cnt = 0;
+            int i = 0;
+        #if INCLUDEAI_SIMD_POPCNT512
+            // Whole 64 bytes only, the rest by word (a masked tail waits for
+            // the store of the last operation, see wide()):
+            __m512i acc = _mm512_setzero_si512();
+            for (int v = 0; v + 2 <= nFullVecs; v += 2)
+                acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512(bytes() + v*VecBytes)));
+            // The halves through bitvecSum256. Full-mask maskz: the plain cast and
+            // extract trip -Wuninitialized in gcc 12's headers, same instruction
+            cnt = bitvecSum256(_mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(0xf, acc, 0), _mm512_maskz_extracti64x4_epi64(0xf, acc, 1)));
+            i = (nFullVecs & ~1) * VecInts;
+        #elif INCLUDEAI_SIMD_BITVEC == 256
+            cnt = bitvecPopcountBytes(bytes(), nFullVecs);
+            i = nFullVecs * VecInts;
+        #elif INCLUDEAI_SIMD_BITVEC == 128
+            for (int v = 0; v < nFullVecs; ++v)
+                cnt += vaddvq_u8(vcntq_u8(vld1q_u8(bytes() + v*16))); // At most 128 per vector
+            i = nFullVecs * VecInts;
+        #endif
+            for (; i < N_INTS-1; ++i)
+                cnt += static_cast<UQWORD>(std::popcount(static_cast<std::make_unsigned_t<Int>>(mem[i])));
+            return cnt;
+        }
+    public:
+        // Helper for operator[]:
+        class BitProxy
+        {
+            friend class Bitvec;
+        private:
+            Bitvec& m_vec;
+            int m_pos;
+            // Private constructor: only Bitvec can create a proxy:
+            constexpr BitProxy(Bitvec& vec, int pos) : m_vec(vec), m_pos(pos) {}
+        public:
+            BitProxy(const BitProxy&) = default;
+            // Assignment from a boolean or integer value. This is called for `a[i] = true;` or `a[i] = 1;`
+            constexpr BitProxy& operator=(const bool val)
+            {
+                m_vec.set(m_pos, val);
+                return *this;
+            }
+            // Assignment from another bit proxy, for expressions like `a[i] = a[j];`:
+            constexpr BitProxy& operator=(const BitProxy& other)
+            {
+                if (this != &other)
+                     m_vec.set(m_pos, static_cast<bool>(other));
+                return *this;
+            }
+            // Implicit conversion to bool for reading the bit's value, e.g., `if (a[i]) ...`:
+            constexpr operator bool() const
+            {
+                return m_vec.check(m_pos);
+            }
+        };
+    public:
+        static constexpr int NumBits = Size; // number of usable bits
+    public:
+        constexpr Bitvec() = default;
 
-/****************************************/
-/*                                Tests */
-/****************************************/
-    static_assert([]
-                  {
-                      char srcAlphaA[8] = {'a','b','c','d','e','f','g','h'};
-                      FisherYates(srcAlphaA, 8, 1337);
-                      bool ok = srcAlphaA[0] == 'b';
-                      ok = ok && srcAlphaA[1] == 'a';
-                      ok = ok && srcAlphaA[2] == 'h';
-                      ok = ok && srcAlphaA[3] == 'f';
-                      ok = ok && srcAlphaA[4] == 'd';
-                      ok = ok && srcAlphaA[5] == 'c';
-                      ok = ok && srcAlphaA[6] == 'e';
-                      ok = ok && srcAlphaA[7] == 'g';
+        constexpr Bitvec(const Bitvec& other) = default;
 
-                      char srcAlphaB[8] = {'a','b','c','d','e','f','g','h'};
-                      FisherYates(srcAlphaB, 8, 696963);
-                      ok = ok && srcAlphaB[0] == 'd';
-                      ok = ok && srcAlphaB[1] == 'c';
-                      ok = ok && srcAlphaB[2] == 'f';
-                      ok = ok && srcAlphaB[3] == 'g';
-                      ok = ok && srcAlphaB[4] == 'h';
-                      ok = ok && srcAlphaB[5] == 'b';
-                      ok = ok && srcAlphaB[6] == 'e';
-                      ok = ok && srcAlphaB[7] == 'a';
+        constexpr explicit Bitvec(Int v) { mem[0] = v; }
 
-                      return ok;
-                  }()
-                 );
+        constexpr Bitvec& operator=(const Bitvec& rhs)
+        {
+            if (this == &rhs)
+                return *this;
+            for (int i=0; i<N_INTS; ++i)
+                mem[i] = rhs.mem[i];
+            return *this;
+        }
 
+        constexpr explicit operator bool() const
+        {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                    return wideAny<false>(*this) || (mem[N_INTS-1] & lastMask()) != 0;
+            }
+            for (int i = 0; i < N_INTS - 1; ++i)
+                if (mem[i] != 0) return true;
 
+            Int last_val = mem[N_INTS - 1];
+            constexpr int remainingBits = Size % w;
+            if constexpr (remainingBits != 0)
+            {
+                constexpr Int mask = (static_cast<Int>(1) << remainingBits) - 1;
+                last_val &= mask;
+            }
+            return last_val != 0;
+        }
 
+        constexpr bool operator==(const Bitvec& rhs) const
+        {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                    return !wideAny<true>(rhs) && ((mem[N_INTS-1] ^ rhs.mem[N_INTS-1]) & lastMask()) == 0;
+            }
+            int same = 0;
+            for (int i=0; i<(N_INTS-1); ++i)
+                same += mem[i] == rhs.mem[i];
+            if (same != (N_INTS-1))
+                return false;
+
+            constexpr int remainingBits = Size % w;
+            if constexpr (remainingBits == 0)
+            {
+                return mem[N_INTS - 1] == rhs.mem[N_INTS - 1];
+            }
+            else
+            {
+                constexpr Int mask = (Int(1) << remainingBits) - 1;
+                return (mem[N_INTS-1] & mask) == (rhs.mem[N_INTS-1] & mask);
+            }
+        }
 
+        constexpr std::strong_ordering operator<=>(const Bitvec& rhs) const
+        {
+            constexpr int remainingBits = Size % w;
+            for (int i = N_INTS - 1; i >= 0; --i)
+            {
+                Int a = mem[i], b = rhs.mem[i];
+                if constexpr (remainingBits != 0)
+                {
+                    if (i == N_INTS - 1)
+                    {
+                        constexpr Int mask = (Int(1) << remainingBits) - 1;
+                        a &= mask; b &= mask;
+                    }
+                }
+                if (a != b) return a < b ? std::strong_ordering::less
+                                         : std::strong_ordering::greater;
+            }
+            return std::strong_ordering::equal;
+        }
 
+        constexpr void set(const int pos)
+        {
+            const Int bit = Int(1) << (pos&(w-1));
+            mem[pos>>shift] |= bit;
+        }
 
-/****************************************/
-/*                             Research */
-/****************************************/
-/*
-    GCD, LCM
-    greatest common divisor  24,60 ⇒ 12
-    lowest common multiple    8,10 ⇒ 40
+        constexpr Bitvec& operator|=(const Bitvec& rhs)
+        {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                {
+                    wide<WideOp::orOp>(*this, rhs);
+                    return *this;
+                }
+            }
+            for (int i=0; i<N_INTS; ++i)
+                mem[i] |= rhs.mem[i];
+            return *this;
+        }
 
+        constexpr Bitvec operator|(const Bitvec& rhs) const
+        {
+            Bitvec result = *this;
+            result |= rhs;
+            return result;
+        }
 
-    matmul:
-    https://learnopengl.com/Getting-started/Transformations
-    for (int y=0; y<4; ++y)
-    for (int x=0; x<4; ++x)
-    for (int k=0; k<4; ++k)
-        product[(y*4)+x] += mat[(y*4)+k] + mat[(k*4)+x];
-*/
+        constexpr Bitvec& operator&=(const Bitvec& rhs)
+        {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                {
+                    wide<WideOp::andOp>(*this, rhs);
+                    return *this;
+                }
+            }
+            for (int i=0; i<N_INTS; ++i)
+                mem[i] &= rhs.mem[i];
+            return *this;
+        }
 
+        constexpr Bitvec operator&(const Bitvec& rhs) const
+        {
+            Bitvec result = *this;
+            result &= rhs;
+            return result;
+        }
 
+        constexpr Bitvec& operator^=(const Bitvec& rhs)
+        {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                {
+                    wide<WideOp::xorOp>(*this, rhs);
+                    return *this;
+                }
+            }
+            for (int i=0; i<N_INTS; ++i)
+                mem[i] ^= rhs.mem[i];
+            return *this;
+        }
 
+        constexpr Bitvec operator^(const Bitvec& rhs) const
+        {
+            Bitvec result = *this;
+            result ^= rhs;
+            return result;
+        }
 
+        constexpr Bitvec operator~() const
+        {
+            Bitvec result;
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                    wide<WideOp::notOp>(result, *this);
+                else
+                    for (int i = 0; i < N_INTS; ++i)
+                        result.mem[i] = ~mem[i];
+            }
+            else
+            {
+                for (int i = 0; i < N_INTS; ++i)
+                    result.mem[i] = ~mem[i];
+            }
 
-inline float sigmoid(float x) { return 1.0f / (1.0f + std::exp(-x)); }
-inline float sigmoid_derivative(float x) { return x * (1.0f - x); }
-inline float relu(float x) { return x > 0 ? x : 0.0001*x; }
-//inline float relu_derivative(float x) { return x > 0 ? 1 : 0.0001*x; }
-inline float relu_derivative(float x) { return x > 0 ? 1.0f : 0.0001f; }
-using std::tanh;
-inline float tanh_derivative(float y) { return 1.0f - y * y; }
+            // Safely mask off the trailing unused bits in the final word.
+            // This prevents issues with popcnt() or == accidentally counting
+            // the inverted padding bits.
+            constexpr int remainingBits = Size % w;
+            if constexpr (remainingBits != 0)
+            {
+                constexpr Int mask = (static_cast<Int>(1) << remainingBits) - 1;
+                result.mem[N_INTS - 1] &= mask;
+            }
 
+            return result;
+        }
 
-/****************************************/
-/*  feed forward 32 (this one is worse) */
-/****************************************/
-    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng, int batchSize = 1>
-    class FeedForward32
-    {
-    public:
-        static constexpr int columns = InputSize+((Max_layers-1)*HiddenWidth)+OutputSize;
-        template <int Size>
-        struct BitArray
+        constexpr Bitvec& operator+=(const Bitvec& rhs)
         {
-            UQWORD data[(Size+63) / 64] = {0};
-            bool operator[](int idx) const
+            Int carry = 0;
+            for (int i=0; i<N_INTS; ++i)
             {
-                const int word = idx / 64;
-                const int bit  = idx % 64;
-                return (data[word] >> (63 - bit)) & 1;
+                Int a = mem[i];
+                Int b = rhs.mem[i];
+                Int sum = a + b + carry;
+                carry = carry ? (sum <= a) : (sum < a);
+                mem[i] = sum;
             }
-            void set(int idx, bool value)
+            constexpr int remainingBits = Size % w;
+            if constexpr (remainingBits != 0)
             {
-                const int word = idx / 64;
-                const int bit  = idx % 64;
-                if (value)
-                    data[word] |= (UQWORD(1) << (63 - bit));
-                else
-                    data[word] &= ~(UQWORD(1) << (63 - bit));
+                constexpr Int mask = (Int(1) << remainingBits) - 1;
+                mem[N_INTS-1] &= mask;
             }
-            bool operator==(const BitArray& other) const
+            return *this;
+        }
+
+        constexpr Bitvec operator+(const Bitvec& rhs) const
+        {
+            Bitvec result = *this;
+            result += rhs;
+            return result;
+        }
+
+        constexpr Bitvec& operator-=(const Bitvec& rhs)
+        {
+            Int borrow = 0;
+            for (int i=0; i<N_INTS; ++i)
             {
-                for (int i = 0; i < (Size+63) / 64; ++i)
-                {
-                    if (data[i] != other.data[i])
-                        return false;
-                }
-                return true;
+                Int a = mem[i];
+                Int b = rhs.mem[i];
+                Int diff = a - b - borrow;
+                borrow = borrow ? (diff >= a) : (diff > a);
+                mem[i] = diff;
             }
-        };
-    private:
-        static constexpr int nLayers = Max_layers;
-        FLOAT weights[columns * columns];
-        FLOAT biases[columns * Max_layers];
-        BitArray<columns*columns> topologies[ Max_layers ];
-        FLOAT activations[columns * Max_layers];
-    private:
-        static FLOAT u64_to_float(const UQWORD i)
+            constexpr int remainingBits = Size % w;
+            if constexpr (remainingBits != 0)
+            {
+                constexpr Int mask = (Int(1) << remainingBits) - 1;
+                mem[N_INTS-1] &= mask;
+            }
+            return *this;
+        }
+
+        constexpr Bitvec operator-(const Bitvec& rhs) const
         {
-            union { UQWORD i; DOUBLE d; } u;
-            // This generates a double in [1.0, 2.0) by setting the exponent bits
-            // and using the top 52 bits of the UQWORD for the mantissa.
-            u.i = (0x3FFULL << 52) | (i >> 12);
-            return static_cast<FLOAT>(u.d - 1.0);
+            Bitvec result = *this;
+            result -= rhs;
+            return result;
         }
-    private:
-        template <FLOAT (*Act)(FLOAT)>
-        void forward567(const int layer, const FLOAT *input, int inputSize)
+
+        // Shifts across word boundaries, bits moved past Size are dropped:
+        constexpr Bitvec& operator<<=(const int n)
         {
-            #if 0
-            FLOAT tops[columns*columns];
-            for (int dst = 0; dst < columns; ++dst)
+            if (n >= Size)
             {
-                for (int src = 0; src < inputSize; ++src)
-                {
-                    const int i = dst * columns + src;
-                    tops[dst * columns + src] = topologies[layer][i];
-                }
+                clearAll();
+                return *this;
+            }
+            const int words = n >> shift, bits = n & (w-1);
+            for (int i = N_INTS-1; i >= words; --i)
+            {
+                Int v = static_cast<Int>(mem[i-words] << bits);
+                if (bits && i > words)
+                    v |= static_cast<Int>(mem[i-words-1] >> (w-bits));
+                mem[i] = v;
+            }
+            for (int i = 0; i < words; ++i)
+                mem[i] = 0;
+            mem[N_INTS-1] &= lastMask();
+            return *this;
+        }
+
+        constexpr Bitvec operator<<(const int n) const
+        {
+            Bitvec result = *this;
+            result <<= n;
+            return result;
+        }
+
+        constexpr Bitvec& operator>>=(const int n)
+        {
+            if (n >= Size)
+            {
+                clearAll();
+                return *this;
             }
+            const int words = n >> shift, bits = n & (w-1);
+            mem[N_INTS-1] &= lastMask();
+            for (int i = 0; i < N_INTS-words; ++i)
+            {
+                Int v = static_cast<Int>(mem[i+words] >> bits);
+                if (bits && i+words+1 < N_INTS)
+                    v |= static_cast<Int>(mem[i+words+1] << (w-bits));
+                mem[i] = v;
+            }
+            for (int i = N_INTS-words; i < N_INTS; ++i)
+                mem[i] = 0;
+            return *this;
+        }
 
-            for (int dst = 0; dst < columns; ++dst)
-                {
-                    __m256 v_sum = _mm256_setzero_ps();
-                    int src = 0;
-                    const int weight_row_start = dst * columns;
-
-
-                    //__m256 v_connected[inputSize/8];
-                    //int pos = 0;
-                    //for (int src2=src; src2 <= inputSize - 8; src2 += 8)
-                    //{
-                    //    const float connected_mask[8] = {
-                    //        (float)topologies[layer][weight_row_start + src2 + 0],
-                    //        (float)topologies[layer][weight_row_start + src2 + 1],
-                    //        (float)topologies[layer][weight_row_start + src2 + 2],
-                    //        (float)topologies[layer][weight_row_start + src2 + 3],
-                    //        (float)topologies[layer][weight_row_start + src2 + 4],
-                    //        (float)topologies[layer][weight_row_start + src2 + 5],
-                    //        (float)topologies[layer][weight_row_start + src2 + 6],
-                    //        (float)topologies[layer][weight_row_start + src2 + 7]
-                    //    };
-                    //    v_connected[pos++] = _mm256_loadu_ps(connected_mask);
-                    //}
-                    //pos = 0;
-
-                    for (; src <= inputSize - 8; src += 8)
-                    {
-                        // Build the connection mask for 8 elements
-                        //const float connected_mask[8] = {
-                        //    (float)topologies[layer][weight_row_start + src + 0],
-                        //    (float)topologies[layer][weight_row_start + src + 1],
-                        //    (float)topologies[layer][weight_row_start + src + 2],
-                        //    (float)topologies[layer][weight_row_start + src + 3],
-                        //    (float)topologies[layer][weight_row_start + src + 4],
-                        //    (float)topologies[layer][weight_row_start + src + 5],
-                        //    (float)topologies[layer][weight_row_start + src + 6],
-                        //    (float)topologies[layer][weight_row_start + src + 7]
-                        //};
-
-                        const __m256 v_connected = _mm256_loadu_ps(&tops[weight_row_start+src]);
-                        //const __m256 v_connected = _mm256_loadu_ps(connected_mask);
-
-                        // Load 8 contiguous inputs and weights (use 'loadu' for unaligned access)
-                        const __m256 v_input = _mm256_loadu_ps(&input[src]);
-                        const __m256 v_weight = _mm256_loadu_ps(&weights[weight_row_start + src]);
-
-                        __m256 v_prod = _mm256_mul_ps(v_connected, v_weight);
-                        v_sum = _mm256_fmadd_ps(v_prod, v_input, v_sum);
-                    }
+        constexpr Bitvec operator>>(const int n) const
+        {
+            Bitvec result = *this;
+            result >>= n;
+            return result;
+        }
 
-                    // Horizontal sum of the 8 floats in the v_sum vector
-                    __m128 v_low = _mm256_castps256_ps128(v_sum);
-                    __m128 v_high = _mm256_extractf128_ps(v_sum, 1);
-                    v_low = _mm_add_ps(v_low, v_high);
-                    __m128 h_sum = _mm_hadd_ps(v_low, v_low);
-                    h_sum = _mm_hadd_ps(h_sum, h_sum);
-                    float sum = _mm_cvtss_f32(h_sum);
+        constexpr void set(const int pos, const bool val)
+        {
+            const Int mask = Int(1) << (pos&(w-1));
+            if (val)
+                mem[pos>>shift] |= mask;
+            else
+                mem[pos>>shift] &= ~mask;
+        }
 
-                    // Handle any remaining elements (if inputSize is not a multiple of 8)
-                    for (; src < inputSize; ++src)
-                    {
-                        const int i = weight_row_start + src;
-                        if (topologies[layer][i])
-                        {
-                            sum += input[src] * weights[i];
-                        }
-                    }
+        constexpr void setRange(const int startInclusive, const int endInclusive)
+        {
+            int startPos = startInclusive>>shift;
+            const int endPos = endInclusive>>shift;
 
-                    // Apply bias and activation function
-                    activations[(layer * columns) + dst] = Act(sum + biases[(layer * columns) + dst]);
-                }
-            #endif
+            Int bitsStart = ~0;
+            bitsStart <<= startInclusive&(w-1);
+            Int bitsEnd = ~0;
+            bitsEnd <<= (endInclusive+1)&(w-1);
+            bitsEnd = ~bitsEnd;
+
+            const Int bitsOverlap = bitsStart & bitsEnd;
+            const bool overlap = (startPos==endPos) && bitsOverlap;
+
+            mem[startPos] |= (bitsStart * !overlap);
+
+            const int middlePos = endPos - 1;
+            constexpr Int allSet = ~0;
+            for (startPos+=1; startPos <= middlePos; ++startPos)
+                mem[startPos] = allSet;
+
+            mem[endPos] |= (bitsEnd * !overlap) + (bitsOverlap * overlap);
         }
 
+        constexpr void clear(const int pos)
+        {
+            const Int bit = Int(1) << (pos&(w-1));
+            mem[pos>>shift] &= ~bit;
+        }
 
-        template <FLOAT (*Act)(FLOAT)>
-        void forward3455(const int layer, const FLOAT *input, int inputSize)
+        constexpr void clearRange(const int startInclusive, const int endInclusive)
         {
-            int cntW = 0;
-            float sparseWeights[columns+columns];
-            float sparseSrc[columns+columns];
-            float sparseDst[columns+columns];
-            for (int dst = 0; dst < columns; ++dst)
-            {
-                for (int src = 0; src < inputSize; ++src)
-                {
-                    const int i = dst * columns + src;
-                    if (topologies[layer][i] != 0)
-                    {
-                        sparseWeights[cntW] = weights[i];
-                      //  sparseSrc[cntSrc++] = src;
-                    }
-                }
-            }
+            int startPos = startInclusive>>shift;
+            const int endPos = endInclusive>>shift;
 
+            Int bitsStart = ~0;
+            bitsStart <<= startInclusive&(w-1);
+            Int bitsEnd = ~0;
+            bitsEnd <<= (endInclusive+1)&(w-1);
+            bitsEnd = ~bitsEnd;
 
+            const Int bitsOverlap = bitsStart & bitsEnd;
+            const bool overlap = (startPos==endPos) && bitsOverlap;
 
+            mem[startPos] &= ~(bitsStart * !overlap);
 
+            const int middlePos = endPos - 1;
+            for (startPos+=1; startPos <= middlePos; ++startPos)
+                mem[startPos] = 0;
 
-            for (int dst = 0; dst < columns; ++dst)
+            mem[endPos] &= ~((bitsEnd * !overlap) + (bitsOverlap * overlap));
+        }
+
+        constexpr void clearAll()
+        {
+            for (int i=0; i<N_INTS; ++i)
+                mem[i] = 0;
+        }
+
+        constexpr Int check(const int pos) const
+        {
+            const Int bit = mem[pos>>shift];
+            return (bit >> (pos&(w-1))) & 1;
+        }
+
+        constexpr Int checkRange(const int startInclusive, const int endInclusive) const
+        {
+            Int maskA = ~0, maskB = ~0;
+            maskA <<= startInclusive&(w-1);
+            maskB <<= (endInclusive+1)&(w-1);
+            maskB = ~maskB;
+
+            int startPos = startInclusive>>shift;
+            const int endPos = endInclusive>>shift;
+            const Int maskOverlap = maskA & maskB;
+            const bool overlap = (startPos==endPos) && maskOverlap;
+
+            bool identical = (mem[startPos]&maskA) == maskA;
+
+            const int middlePos = endPos - 1;
+            constexpr Int allSet = ~0;
+            for (startPos+=1; startPos <= middlePos; ++startPos)
             {
-                float sum = 0.0f;
-                for (int src = 0; src < inputSize; ++src)
-                {
-                    const int i = dst * columns + src;
-                    const float connected = topologies[layer][i];
-                    sum += input[src] * weights[i] * connected;
-                }
-                activations[(layer*columns) + dst] = Act(sum + biases[(layer*columns) + dst]);
+                identical = identical && ((mem[startPos] & allSet) == allSet);
+                const int isNotIdentical = !identical;
+                startPos += middlePos & -isNotIdentical;
             }
+
+            identical = identical && ((mem[endPos] & maskB) == maskB);
+
+            identical = identical || (overlap && ((mem[endPos] & maskOverlap) == maskOverlap));
+
+            return (Int)identical;
         }
 
+        constexpr BitProxy operator[](const int pos)
+        {
+            return BitProxy(*this, pos);
+        }
 
+        constexpr Int operator[](const int pos) const
+        {
+            return check(pos);
+        }
 
-        template <FLOAT (*Act)(FLOAT)>
-        void forward(const int layer, const FLOAT *input, int inputSize)
+        template <bool Comptime=false>
+        constexpr Int popcnt() const
         {
-            for (int dst = 0; dst < columns; ++dst)
+            if constexpr (Wide && !Comptime)
             {
-                FLOAT tops[columns];
-                for (int src = 0; src < inputSize; ++src)
+                if (!std::is_constant_evaluated())
+                    return static_cast<Int>(widePopcnt() + static_cast<UQWORD>(std::popcount(static_cast<std::make_unsigned_t<Int>>(mem[N_INTS-1] & lastMask()))));
+            }
+            Int cnt = 0;
+            for (int i=0; i<(N_INTS-1); ++i)
+            {
+                Int val = mem[i];
+                if constexpr (Comptime)
                 {
-                    const int i = dst * columns + src;
-                    tops[src] = topologies[layer][i];
+                    while (val)
+                    {
+                        cnt += val & 1;
+                        val >>= 1;
+                    }
                 }
-
-                FLOAT sum = 0.0f;
-                for (int src = 0; src < inputSize; ++src)
+                else
                 {
-                    const int i = dst * columns + src;
-                    sum += input[src] * weights[i] * tops[src];
-                }
-                activations[(layer*columns) + dst] = Act(sum + biases[(layer*columns) + dst]);
-            }
-        }
-
-
-
-            //for (int dst = 0; dst < columns; ++dst)
-            //    {
-            //        // Vector accumulator for the dot product.
-            //        float32x4_t v_sum = vdupq_n_f32(0.0f);
-            //        int src = 0;
-            //        const int weight_row_start = dst * columns;
-            //
-            //        for (; src <= inputSize - 4; src += 4)
-            //        {
-            //            // 1. Load 4 contiguous inputs. (FAST)
-            //            const float32x4_t v_input = vld1q_f32(&input[src]);
-            //
-            //            // 2. Load 4 contiguous weights. (FAST)
-            //            const float32x4_t v_weight = vld1q_f32(&weights[weight_row_start + src]);
-            //
-            //            // 3. Handle the 'connected' bits. This remains a bottleneck.
-            //            //    We still need to build the mask on the fly.
-            //            const float connected_mask[4] = {
-            //                (float)topologies[layer][weight_row_start + src + 0],
-            //                (float)topologies[layer][weight_row_start + src + 1],
-            //                (float)topologies[layer][weight_row_start + src + 2],
-            //                (float)topologies[layer][weight_row_start + src + 3]
-            //            };
-            //            const float32x4_t v_connected = vld1q_f32(connected_mask);
-            //
-            //            // 4. Multiply weights and inputs.
-            //            float32x4_t v_prod = vmulq_f32(v_input, v_weight);
-            //            v_sum = vmlaq_f32(v_sum, v_prod, v_connected);
-            //        }
-            //
-            //        // 7. Horizontally add the 4 lanes of the sum vector to get a single float.
-            //        float sum = vgetq_lane_f32(v_sum, 0) + vgetq_lane_f32(v_sum, 1) +
-            //                    vgetq_lane_f32(v_sum, 2) + vgetq_lane_f32(v_sum, 3);
-            //
-            //        // 8. Handle any remaining elements (if inputSize is not a multiple of 4).
-            //        for (; src < inputSize; ++src)
-            //        {
-            //            const int i = weight_row_start + src;
-            //            if (topologies[layer][i])
-            //            {
-            //                sum += input[src] * weights[i];
-            //            }
-            //        }
-            //
-            //        // 9. Apply bias and activation function.
-            //        activations[(layer * columns) + dst] = Act(sum + biases[(layer * columns) + dst]);
-            //    }
+                    if constexpr (sizeof(Int) == sizeof(UQWORD))
+                        cnt += __builtin_popcountll( val );
+                    else
+                        cnt += __builtin_popcount( val );
+                }
+            }
 
+            // Remaining bits:
+            constexpr int remainingBits = Size % w;
+            Int last_val = mem[N_INTS-1];
+            if constexpr (remainingBits != 0)
+            {
+                constexpr Int mask = (Int(1) << remainingBits) - 1;
+                last_val &= mask;
+            }
 
-        template <FLOAT (*Deriv)(FLOAT)>
-        void backward(const int topologyIdx, FLOAT *deltas, const FLOAT *inputs, const FLOAT *activations, FLOAT learning_rate)
-        {
-            FLOAT hidden_error[columns] = {0.0f};
-            for (int input_idx = 0; input_idx < columns; ++input_idx)
+            if constexpr (Comptime)
             {
-                const FLOAT common = inputs[input_idx] * learning_rate;
-                for (int hidden_idx = 0; hidden_idx < columns; ++hidden_idx)
+                while (last_val)
                 {
-                    const int weight_idx = input_idx * columns + hidden_idx;
-                    const auto connected = topologies[topologyIdx][weight_idx];
-                    hidden_error[hidden_idx] += inputs[input_idx] * weights[weight_idx] * connected;
-                    weights[weight_idx] += activations[hidden_idx] * common * connected;
+                    cnt += last_val & 1;
+                    last_val >>= 1;
                 }
             }
-            for (int h = 0; h < columns; ++h)
+            else
             {
-                deltas[h] = hidden_error[h] * Deriv(activations[h]);
-                const int biasIdx = (topologyIdx - 1) * columns + h;
-                biases[biasIdx] += deltas[h] * learning_rate;
+                if constexpr (sizeof(Int) == sizeof(UQWORD))
+                    cnt += __builtin_popcountll( last_val );
+                else
+                    cnt += __builtin_popcount( last_val );
             }
+            return cnt;
         }
 
-    public:
-        explicit FeedForward32(Rng& rng, bool randomizeTopology = true)
+        // An int index: an Int one cannot reach past bit 255 of a UBYTE vector:
+        template <bool Comptime=false>
+        constexpr int getNthSetBit(int idx) const
         {
-            // Initialize weights/biases with random values in range [-1.0, 1.0]
-            // should be ~symmetric around zero
-            //for (int i = 0; i < columns * columns; ++i)
-            //    weights[i] = 2.0f * u64_to_float(rng()) - 1.0f;
-            //for (int i = 0; i < columns * Max_layers; ++i)
-            //    biases[i] = 2.0f * u64_to_float(rng()) - 1.0f;
+            if constexpr (Comptime)
+            {
+                for (int i = 0; i < Size; ++i)
+                {
+                    if (check(i))
+                    {
+                        if (idx == 0)
+                            return i;
+                        idx--;
+                    }
+                }
+                return -1; // Not found
+            }
+            else
+            {
+                for (int i = 0; i < N_INTS; ++i)
+                {
+                    Int word = mem[i];
+                    // Correctly mask the last word if it's not full:
+                    if constexpr (Size % w != 0)
+                    {
+                        if (i == N_INTS - 1)
+                        {
+                            constexpr Int mask = (static_cast<Int>(1) << (Size % w)) - 1;
+                            word &= mask;
+                        }
+                    }
 
+                    int bits_in_word;
+                    if constexpr (sizeof(Int) == sizeof(UQWORD))
+                        bits_in_word = __builtin_popcountll(word);
+                    else
+                        bits_in_word = __builtin_popcount(word);
 
+                    if (idx < bits_in_word)
+                        return (i * w) + bitvecSelect64(static_cast<std::make_unsigned_t<Int>>(word), idx);
+                    idx -= bits_in_word;
+                }
+                return -1; // Not found
+            }
+        }
 
+        // Cumulative popcounts per word of a Bitvec, so that repeated
+        // select and rank queries skip the word walk. Refers to the Bitvec
+        // and is stale once it changes, like BitProxy:
+        class RankIndex
+        {
+            friend class Bitvec;
+        private:
+            const Bitvec& m_vec;
+            int m_before[N_INTS+1] = {}; // Set bits in the words before i
+            constexpr explicit RankIndex(const Bitvec& vec) : m_vec(vec)
+            {
+                for (int i = 0; i < N_INTS; ++i)
+                    m_before[i+1] = m_before[i] + std::popcount(m_vec.maskedWord(i));
+            }
+        public:
+            constexpr int popcnt() const { return m_before[N_INTS]; }
 
+            // Set bits below 'pos':
+            constexpr int rank(const int pos) const
+            {
+                if (pos >= Size)
+                    return popcnt();
+                const auto below = (std::make_unsigned_t<Int>(1) << (pos & (w-1))) - 1;
+                return m_before[pos >> shift] + std::popcount(static_cast<std::make_unsigned_t<Int>>(m_vec.mem[pos >> shift] & below));
+            }
 
+            // Same as getNthSetBit(), e.g. select(rand % popcnt()) picks a
+            // uniformly random set bit:
+            constexpr int select(const int idx) const
+            {
+                if (idx < 0 || idx >= popcnt())
+                    return -1;
+                int lo = 0, hi = N_INTS - 1; // Last word with m_before <= idx
+                while (lo < hi)
+                {
+                    const int mid = (lo + hi + 1) / 2;
+                    if (m_before[mid] <= idx)
+                        lo = mid;
+                    else
+                        hi = mid - 1;
+                }
+                return lo * w + bitvecSelect64(m_vec.maskedWord(lo), idx - m_before[lo]);
+            }
+        };
 
+        constexpr RankIndex rankIndex() const
+        {
+            return RankIndex(*this);
+        }
+
+        // f(i) for every set bit, ascending. An 'f' that returns bool stops
+        // the walk by returning false:
+        template <typename F>
+        constexpr void forEachSetBit(F&& f) const
+        {
+            for (int i = 0; i < N_INTS; ++i)
+            {
+                Int word = mem[i];
+                if constexpr (Size % w != 0)
+                {
+                    if (i == N_INTS - 1)
+                    {
+                        constexpr Int mask = (Int(1) << (Size % w)) - 1;
+                        word &= mask;
+                    }
+                }
+                while (word)
+                {
+                    int bit = (sizeof(Int) == sizeof(UQWORD)) ? __builtin_ctzll(word)
+                                                              : __builtin_ctz(word);
+                    if constexpr (std::is_same_v<decltype(f(0)), bool>)
+                    {
+                        if (!f(i * w + bit))
+                            return;
+                    }
+                    else
+                        f(i * w + bit);
+                    word &= word - 1;
+                }
+            }
+        }
+
+        // 64 bit hash of the used bits (padding ignored, like ==), e.g. for
+        // transposition tables. Multiply-xorshift over the words in two
+        // independent lanes, so that the multiplies overlap, then the
+        // splitmix64 finalizer. Same value at compile time and at runtime:
+        constexpr UQWORD hashValue() const
+        {
+            auto mix = [](const UQWORD h, const UQWORD word)
+            {
+                return std::rotl(h ^ (word * 0xbf58476d1ce4e5b9ull), 29) * 0x94d049bb133111ebull;
+            };
+            UQWORD a = 0x9e3779b97f4a7c15ull ^ static_cast<UQWORD>(Size);
+            UQWORD b = 0x6a09e667f3bcc909ull;
+            int i = 0;
+            for (; i + 1 < N_INTS; i += 2)
+            {
+                a = mix(a, maskedWord(i));
+                b = mix(b, maskedWord(i+1));
+            }
+            if (i < N_INTS)
+                a = mix(a, maskedWord(i));
+            UQWORD h = a ^ std::rotl(b, 32);
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+            return h ^ (h >> 31);
+        }
+    };
+
+
+/****************************************/
+/*                    Bitboard geometry */
+/* A Width x Height board stored row by */
+/* row in a Bitvec, cell = y*Width + x. */
+/* shift() moves all stones some steps  */
+/* in one direction with one multi-word */
+/* shift, then masks out whatever left  */
+/* the board: wrapped around a row end  */
+/* or landed outside 'cells'. Hex       */
+/* boards use axial coordinates in the  */
+/* same layout (neighbours +-1, +-Width */
+/* and +-(Width-1)), a hexagonal board  */
+/* is that rhombus with the corners     */
+/* left out of 'cells'                  */
+/****************************************/
+    enum class GridShape { square, hex };
+
+    template <class Bv, int Width, int Height, GridShape Shape=GridShape::square, int MaxSteps=4>
+    class BitGrid
+    {
+        static_assert(Bv::NumBits >= Width * Height, "Bitvec too small for the board");
+    public:
+        // y grows downwards. Opposite directions are neighbours, so lines
+        // run along 2*i and 2*i+1. Hex boards use the first six:
+        enum Direction : int { east, west, south, north, northEast, southWest, southEast, northWest };
+        static constexpr int nDirections = Shape == GridShape::square ? 8 : 6;
+        static constexpr int dx[8] = {1, -1, 0,  0,  1, -1, 1, -1};
+        static constexpr int dy[8] = {0,  0, 1, -1, -1,  1, 1, -1};
+    private:
+        Bv board;
+        // Cells whose source 'steps' cells back is on the board:
+        Bv masks[nDirections][MaxSteps];
+
+        static constexpr Bv wholeGrid()
+        {
+            Bv all;
+            all.setRange(0, Width * Height - 1);
+            return all;
+        }
+    public:
+        constexpr BitGrid() : BitGrid(wholeGrid()) {}
+
+        constexpr explicit BitGrid(const Bv& cells) : board(cells)
+        {
+            for (int d = 0; d < nDirections; ++d)
+                for (int steps = 1; steps <= MaxSteps; ++steps)
+                    for (int y = 0; y < Height; ++y)
+                        for (int x = 0; x < Width; ++x)
+                        {
+                            const int fromX = x - steps * dx[d], fromY = y - steps * dy[d];
+                            if (fromX < 0 || fromX >= Width || fromY < 0 || fromY >= Height)
+                                continue;
+                            if (board.check(y * Width + x) && board.check(fromY * Width + fromX))
+                                masks[d][steps-1].set(y * Width + x);
+                        }
+        }
+
+        constexpr const Bv& cells() const { return board; }
+
+        // Every stone moved 'steps' cells towards 'dir', those leaving the board dropped:
+        constexpr Bv shift(const Bv& b, const int dir, const int steps=1) const
+        {
+            const int offset = steps * (dy[dir] * Width + dx[dir]);
+            return (offset >= 0 ? b << offset : b >> -offset) & masks[dir][steps-1];
+        }
+
+        // Cells that end a run of K stones pointing towards 'dir', i.e. the
+        // cell and the K-1 behind it are all set. Doubling: while 'r' holds
+        // the ends of runs of n, r & shift(r, s) holds those of n+s (s <= n)
+        template <int K>
+        constexpr Bv kInARow(const Bv& b, const int dir) const
+        {
+            static_assert(K >= 1 && K / 2 <= MaxSteps, "kInARow<K> shifts by up to K/2 steps, raise MaxSteps");
+            Bv r = b & board;
+            for (int n = 1; n < K;)
+            {
+                const int s = n < K - n ? n : K - n;
+                r &= shift(r, dir, s);
+                n += s;
+            }
+            return r;
+        }
+
+        // Any run of K stones on any line of the board:
+        template <int K>
+        constexpr bool anyInARow(const Bv& b) const
+        {
+            for (int d = 0; d < nDirections; d += 2)
+                if (kInARow<K>(b, d))
+                    return true;
+            return false;
+        }
+    };
+
+
+
+
+
+
+
+/****************************************/
+/*                                Tests */
+/****************************************/
+    static_assert([]
+                  {
+                      Bitvec<UDWORD, 128, CHARBITS> testVecA;
+                      testVecA.set(32);
+                      testVecA.set(63);
+                      testVecA.set(127);
+
+                      bool ok = testVecA.check(32);
+                      ok = ok && testVecA.check(63);
+                      ok = ok && testVecA.check(127);
+                      ok = ok && (testVecA.check(1) == 0);
+                      ok = ok && (testVecA.template popcnt<true>() == 3);
+
+                      Bitvec<UQWORD, 256, CHARBITS> testVecB;
+                      ok = ok && (testVecB.checkRange(64, 127) == 0);
+                      testVecB.set(32);
+                      ok = ok && testVecB.check(32);
+                      testVecB.setRange(100, 101);
+                      ok = ok && (testVecB.check(99) == 0);
+                      ok = ok && testVecB.check(100);
+                      ok = ok && testVecB.check(101);
+                      ok = ok && (testVecB.check(102) == 0);
+                      ok = ok && testVecB.checkRange(100, 101);
+                      ok = ok && (testVecB.checkRange(100, 200) == 0);
+                      testVecB.clear(100);
+                      ok = ok && (testVecB.check(100) == 0);
+                      testVecB.set(255);
+                      ok = ok && testVecB.check(255);
+                      testVecB.setRange(104, 194);
+                      ok = ok && (testVecB.check(103) == 0);
+                      ok = ok && testVecB.check(104);
+                      ok = ok && testVecB.check(194);
+                      ok = ok && (testVecB.check(195) == 0);
+
+                      Bitvec<UBYTE, 16, CHARBITS> testVecC;
+                      testVecC.setRange(7, 10);
+                      ok = ok && (testVecC.check(6) == 0);
+                      ok = ok && testVecC.check(7);
+                      ok = ok && testVecC.check(8);
+                      ok = ok && testVecC.check(9);
+                      ok = ok && testVecC.check(10);
+                      ok = ok && (testVecC.check(11) == 0);
+                      ok = ok && (testVecC.checkRange(6, 8) == 0);
+                      ok = ok && testVecC.checkRange(7, 10);
+                      ok = ok && (testVecC.checkRange(8, 11) == 0);
+                      testVecC.clearRange(6, 10);
+                      ok = ok && (testVecC.checkRange(6, 10) == 0);
+
+                      return ok;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UQWORD, 128, CHARBITS> a,b;
+                      a.set(64);
+                      b = a;
+                      return b.check(64);
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UQWORD, 128, CHARBITS> a,b,c;
+                      a.set(64);
+                      c = a | b;
+                      return c.check(64);
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UDWORD, 64> a;
+                      a[33] = 1;
+                      return a.check(33);
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UBYTE, 8> a;
+                      a.set(1);
+                      a.set(7);
+                      return a.getNthSetBit(0)==1 && a.getNthSetBit(1)==7;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      // 19x19 board, at compile time the word loops stand in for the wide paths:
+                      Bitvec<UQWORD, 361> a, b;
+                      a.setRange(0, 200);
+                      b.setRange(150, 360);
+                      bool ok = (a | b).popcnt() == 361 && (a & b).popcnt() == 51 && (a ^ b).popcnt() == 310;
+                      ok = ok && (~a).popcnt() == 160 && (~a | a) == ~Bitvec<UQWORD, 361>() && !(~(a | b));
+                      ok = ok && static_cast<bool>(b) && !Bitvec<UQWORD, 361>() && a != b;
+                      Bitvec<UDWORD, 4100> big;
+                      big.setRange(3, 4098);
+                      return ok && big.popcnt() == 4096 && (~big).popcnt() == 4;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UQWORD, 200> a;
+                      a.set(3);
+                      a.set(130);
+                      bool ok = (a << 0) == a && (a >> 0) == a;
+                      ok = ok && (a << 70).popcnt() == 1 && (a << 70).check(73);
+                      ok = ok && (a >> 4).popcnt() == 1 && (a >> 4).check(126);
+                      ok = ok && (a << 64).check(67) && (a << 64).check(194) && !(a << 200) && !(a >> 131);
+                      Bitvec<UBYTE, 20> b;
+                      b.setRange(0, 19);
+                      ok = ok && (b << 5).popcnt() == 15 && (b << 5).check(5) && !(b << 5).check(4);
+                      return ok && (b >> 13).popcnt() == 7 && ((b << 13) >> 13).popcnt() == 7;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      using Board = Bitvec<UQWORD, 169>;
+                      using Grid = BitGrid<Board, 13, 13>;
+                      constexpr Grid grid;
+                      Board stones;
+                      // Three at the end of row 2 and three at the start of row 3 lie
+                      // next to each other in memory, but are not six in a row:
+                      stones.setRange(2*13+10, 3*13+2);
+                      bool ok = !grid.anyInARow<6>(stones) && grid.anyInARow<3>(stones);
+                      ok = ok && !grid.shift(stones, Grid::east).check(3*13);
+                      ok = ok && grid.shift(stones, Grid::west, 2).popcnt() == 4;
+                      for (int i = 0; i < 6; ++i)
+                          stones.set((5+i)*13 + i);
+                      const Board ends = grid.kInARow<6>(stones, Grid::southEast);
+                      ok = ok && ends.popcnt() == 1 && ends.check(10*13 + 5);
+                      ok = ok && grid.kInARow<6>(stones, Grid::northWest).check(5*13);
+                      return ok && grid.anyInARow<6>(stones) && !grid.anyInARow<7>(stones);
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      // Hexagon with 5 cells a side in an 11x11 layout (rows shifted by one each):
+                      using Board = Bitvec<UQWORD, 121>;
+                      using Hex = BitGrid<Board, 11, 11, GridShape::hex>;
+                      Board cells;
+                      for (int y = 1; y < 10; ++y)
+                          cells.setRange(y*11 + (y < 5 ? 6-y : 1), y*11 + (y < 5 ? 9 : 14-y));
+                      const Hex hex(cells);
+                      bool ok = cells.popcnt() == 61 && hex.shift(cells, Hex::east).popcnt() == 61-9;
+                      Board stones;
+                      for (int i = 0; i < 4; ++i)
+                          stones.set((5-i)*11 + 1+i); // Towards north-east from the west corner
+                      ok = ok && hex.anyInARow<4>(stones) && hex.kInARow<4>(stones, Hex::northEast).check(2*11 + 4);
+                      stones.clear(2*11 + 4);
+                      stones.set(1*11 + 5);
+                      return ok && !hex.anyInARow<4>(stones) && hex.kInARow<3>(stones, Hex::southWest).check(5*11 + 1);
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      bool ok = bitvecSelect64(1, 0) == 0 && bitvecSelect64(~0ull, 63) == 63;
+                      ok = ok && bitvecSelect64(0x8000000100010000ull, 1) == 32 && bitvecSelect64(0x8000000100010000ull, 2) == 63;
+                      Bitvec<UQWORD, 200> a;
+                      a.set(5); a.set(64); a.set(100); a.set(199);
+                      ok = ok && a.getNthSetBit(2) == 100 && a.getNthSetBit(3) == 199 && a.getNthSetBit(4) == -1;
+                      const auto ranks = a.rankIndex();
+                      ok = ok && ranks.popcnt() == 4 && ranks.select(0) == 5 && ranks.select(1) == 64 && ranks.select(3) == 199;
+                      ok = ok && ranks.select(4) == -1 && ranks.rank(64) == 1 && ranks.rank(65) == 2 && ranks.rank(200) == 4;
+                      Bitvec<UBYTE, 12> b;
+                      b.setRange(3, 10);
+                      const auto byteRanks = b.rankIndex();
+                      return ok && byteRanks.select(5) == 8 && byteRanks.rank(9) == 6 && b.getNthSetBit(7) == 10;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UQWORD, 200> a;
+                      a.set(5); a.set(64); a.set(100); a.set(199);
+                      int sum = 0, visited = 0;
+                      a.forEachSetBit([&](int bit) { sum += bit; });
+                      a.forEachSetBit([&](int bit) { visited += 1; return bit < 64; }); // Stops after 64
+                      return sum == 5 + 64 + 100 + 199 && visited == 2;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UQWORD, 361> a, b;
+                      a.setRange(10, 300);
+                      b = ~(~a); // Same bits, built differently
+                      bool ok = a.hashValue() == b.hashValue() && a.hashValue() != Bitvec<UQWORD, 361>().hashValue();
+                      b.clear(299);
+                      ok = ok && a.hashValue() != b.hashValue();
+                      Bitvec<UBYTE, 12> c, d;
+                      c.set(3);
+                      d = c;
+                      d.set(14); // Padding, ignored like by ==
+                      return ok && c == d && c.hashValue() == d.hashValue() && (c << 1).hashValue() != c.hashValue();
+                  }()
+                 );
+
+
+
+/****************************************/
+/*                        Runtime tests */
+/* Constant evaluation takes the word   */
+/* loops, these compare the vector      */
+/* paths against them at start-up in    */
+/* builds that define                   */
+/* INCLUDEAI__RUNTIME_TESTS             */
+/****************************************/
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    inline UQWORD bitvecTestRandom(UQWORD& state) // splitmix64
+    {
+        UQWORD z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Ops, ==, bool and popcnt() of random vectors (padding bits too, they
+    // must not leak into the results) against the same words one by one.
+    // The words go in and out through set() and check(), bit by bit:
+    template <class Int, int Size>
+    bool bitvecWideMatchesWords(UQWORD& state)
+    {
+        using Vec = Bitvec<Int, Size>;
+        using UInt = std::make_unsigned_t<Int>;
+        constexpr int w = int(sizeof(Int)*CHARBITS);
+        constexpr int nInts = (Size + w - 1) / w;
+        constexpr int lastBits = Size - (nInts-1) * w;
+        constexpr UInt lastMask = lastBits == w ? UInt(~UInt(0)) : UInt((UInt(1) << lastBits) - 1);
+        auto load = [](Vec& vec, const UInt *words)
+        {
+            for (int pos=0; pos<nInts*w; ++pos)
+                vec.set(pos, (words[pos / w] >> (pos % w)) & 1);
+        };
+        auto word = [](const Vec& vec, const int i)
+        {
+            UInt result = 0;
+            for (int bit=0; bit<w; ++bit)
+                result |= static_cast<UInt>(vec.check(i*w + bit) ? UInt(1) << bit : 0);
+            return result;
+        };
+        bool ok = true;
+        for (int round=0; round<32; ++round)
+        {
+            UInt wa[nInts], wb[nInts];
+            for (int i=0; i<nInts; ++i)
+            {
+                wa[i] = static_cast<UInt>(bitvecTestRandom(state));
+                wb[i] = static_cast<UInt>(bitvecTestRandom(state));
+                if (round % 4 == 1) // Sparse
+                    wa[i] &= static_cast<UInt>(bitvecTestRandom(state) & bitvecTestRandom(state));
+                if (round % 4 == 2) // Empty but for the padding
+                    wa[i] = i == nInts-1 ? static_cast<UInt>(~lastMask) : 0;
+            }
+            if (round % 8 == 2) // One bit
+            {
+                const int pos = static_cast<int>(bitvecTestRandom(state) % Size);
+                wa[pos / w] |= static_cast<UInt>(UInt(1) << (pos % w));
+            }
+            Vec a, b;
+            load(a, wa);
+            load(b, wb);
+
+            const Vec orV = a | b, andV = a & b, xorV = a ^ b, notV = ~a;
+            UQWORD cnt = 0;
+            bool any = false;
+            for (int i=0; i<nInts; ++i)
+            {
+                const UInt masked = i == nInts-1 ? static_cast<UInt>(wa[i] & lastMask) : wa[i];
+                ok = ok && word(orV, i) == static_cast<UInt>(wa[i] | wb[i]);
+                ok = ok && word(andV, i) == static_cast<UInt>(wa[i] & wb[i]);
+                ok = ok && word(xorV, i) == static_cast<UInt>(wa[i] ^ wb[i]);
+                ok = ok && word(notV, i) == static_cast<UInt>(i == nInts-1 ? ~wa[i] & lastMask : ~wa[i]);
+                cnt += static_cast<UQWORD>(std::popcount(masked));
+                any = any || masked != 0;
+            }
+            ok = ok && a.popcnt() == static_cast<Int>(cnt) && static_cast<bool>(a) == any;
+
+            Vec c = a;
+            ok = ok && c == a;
+            if constexpr (lastBits != w)
+            {
+                c.set(Size, !a.check(Size)); // Padding only
+                ok = ok && c == a;
+            }
+            const int pos = static_cast<int>(bitvecTestRandom(state) % Size);
+            c.set(pos, !a.check(pos));
+            ok = ok && !(c == a) && (a ^ c).popcnt() == 1;
+        }
+        return ok;
+    }
+
+    [[maybe_unused]] static const bool bitvecWideChecked = []
+    {
+        UQWORD state = 2024;
+        bool ok = true;
+    #if INCLUDEAI_SIMD_BITVEC == 256
+        {
+            // Lanes of bitvecPopcount256(), then Harley-Seal below, at and past
+            // 16 vectors, with every remainder:
+            alignas(32) UQWORD words[48 * 4];
+            for (UQWORD& word : words)
+                word = bitvecTestRandom(state) & (bitvecTestRandom(state) % 3 == 0 ? ~0ull : bitvecTestRandom(state));
+            for (int v=0; v<48; ++v)
+            {
+                alignas(32) UQWORD lanes[4];
+                _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), bitvecPopcount256(_mm256_load_si256(reinterpret_cast<const __m256i *>(words) + v)));
+                for (int lane=0; lane<4; ++lane)
+                    ok = ok && lanes[lane] == static_cast<UQWORD>(std::popcount(words[v*4 + lane]));
+            }
+            UQWORD expected = 0;
+            for (int n=0; n<=48; ++n)
+            {
+                ok = ok && bitvecPopcountBytes(reinterpret_cast<const UBYTE *>(words), n) == expected;
+                if (n < 48)
+                    for (int lane=0; lane<4; ++lane)
+                        expected += static_cast<UQWORD>(std::popcount(words[n*4 + lane]));
+            }
+        }
+    #endif
+        // Whole vectors (512, 1024), tails of every kind (257, 361, 777, 1000)
+        // and enough for Harley-Seal in popcnt() (4500):
+        ok = ok && bitvecWideMatchesWords<UQWORD, 361>(state) && bitvecWideMatchesWords<UQWORD, 512>(state);
+        ok = ok && bitvecWideMatchesWords<UQWORD, 1024>(state) && bitvecWideMatchesWords<UQWORD, 257>(state);
+        ok = ok && bitvecWideMatchesWords<UQWORD, 1000>(state) && bitvecWideMatchesWords<UQWORD, 4500>(state);
+        ok = ok && bitvecWideMatchesWords<UDWORD, 361>(state) && bitvecWideMatchesWords<UDWORD, 777>(state);
+        ok = ok && bitvecWideMatchesWords<UDWORD, 1024>(state) && bitvecWideMatchesWords<UWORD, 361>(state);
+        ok = ok && bitvecWideMatchesWords<UWORD, 1000>(state) && bitvecWideMatchesWords<UBYTE, 361>(state);
+        ok = ok && bitvecWideMatchesWords<UBYTE, 512>(state) && bitvecWideMatchesWords<UBYTE, 1000>(state);
+        ok = ok && bitvecWideMatchesWords<UBYTE, 4500>(state);
+        assert(ok);
+        return ok;
+    }();
+
+    // getNthSetBit() and RankIndex::select() against the set bits listed
+    // by check(), on random vectors with padding bits set:
+    template <class Int, int Size>
+    bool bitvecSelectMatchesNaive(UQWORD& state)
+    {
+        constexpr int w = int(sizeof(Int)*CHARBITS);
+        constexpr int nBits = (Size + w - 1) / w * w;
+        bool ok = true;
+        for (int round=0; round<16; ++round)
+        {
+            Bitvec<Int, Size> vec;
+            for (int pos=0; pos<nBits; ++pos)
+                vec.set(pos, bitvecTestRandom(state) % 8 < static_cast<UQWORD>(round % 8)); // Empty to dense
+            int setBits[Size];
+            int nSet = 0;
+            for (int pos=0; pos<Size; ++pos)
+                if (vec.check(pos))
+                    setBits[nSet++] = pos;
+            const auto ranks = vec.rankIndex();
+            ok = ok && ranks.popcnt() == nSet;
+            for (int n=0; n<=nSet; ++n)
+            {
+                const int expected = n < nSet ? setBits[n] : -1;
+                ok = ok && vec.getNthSetBit(n) == expected && ranks.select(n) == expected;
+                ok = ok && (n == nSet || ranks.rank(expected) == n);
+            }
+        }
+        return ok;
+    }
+
+    [[maybe_unused]] static const bool bitvecSelectChecked = []
+    {
+        UQWORD state = 4711;
+        bool ok = true;
+        // bitvecSelect64() (pdep in -mbmi2 builds) against the n-th set bit
+        // found bit by bit, every n of words from sparse to full:
+        for (int round=0; round<4096; ++round)
+        {
+            UQWORD word = bitvecTestRandom(state);
+            for (int thin=0; thin<round%4; ++thin)
+                word &= bitvecTestRandom(state);
+            if (round % 64 == 0)
+                word = ~0ull;
+            int n = 0;
+            for (int pos=0; pos<64; ++pos)
+                if ((word >> pos) & 1)
+                    ok = ok && bitvecSelect64(word, n++) == pos;
+        }
+        ok = ok && bitvecSelectMatchesNaive<UQWORD, 1000>(state) && bitvecSelectMatchesNaive<UQWORD, 361>(state);
+        ok = ok && bitvecSelectMatchesNaive<UDWORD, 361>(state) && bitvecSelectMatchesNaive<UWORD, 200>(state);
+        ok = ok && bitvecSelectMatchesNaive<UBYTE, 361>(state) && bitvecSelectMatchesNaive<UBYTE, 12>(state);
+        assert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
+
+
+
+
+
+/****************************************/
+/*                 Fisher-Yates shuffle */
+/****************************************/
+    template <typename Container>
+    constexpr void FisherYates(Container& container, const int len, const int s)
+    {
+        for (int k = 0; k < len; ++k)
+        {
+            const int r = k + s % (len - k);
+            auto temp = container[k];
+            container[k] = container[r];
+            container[r] = temp;
+        }
+    }
+
+
+/****************************************/
+/*                           PCG Random */
+/****************************************/
+    class pcg32
+    {
+    private:
+        static constexpr auto PCG_DEFAULT_MULTIPLIER = 6364136223846793005ull;
+        UQWORD state, inc;
+    public:
+        explicit constexpr pcg32(const UQWORD seed = 0);
+
+        constexpr UDWORD operator()();
+    };
+
+    class pcg16
+    {
+    private:
+        static constexpr auto PCG_DEFAULT_MULTIPLIER = 747796405u;
+        UDWORD state, inc;
+    public:
+        explicit constexpr pcg16(const UDWORD seed = 0);
+
+        constexpr UWORD operator()();
+    };
+
+    // Convenience generators with hidden state. The state is per thread,
+    // so threads don't race but also don't share a sequence:
+    UDWORD pcg32rand(const UQWORD seed=0);
+    UWORD  pcg16rand(const UDWORD seed=0);
+
+    template <typename Int>
+    auto pcgRand(const Int seed=0)
+    {
+        if constexpr (sizeof(Int) == sizeof(UQWORD))
+            return pcg32rand(seed);
+        else
+            return pcg16rand(seed);
+    }
+
+
+/****************************************/
+/*                                fibon */
+/****************************************/
+    template <typename Int>
+    constexpr Int fib(const Int i)
+    {
+        if (i<=1) return i;
+        return fib(i-1) + fib(i-2);
+    }
+
+
+
+
+
+
+/****************************************/
+/*                           PCG Random */
+/****************************************/
+    constexpr pcg32::pcg32(const UQWORD seed)
+      : state(0), inc(0)
+    {
+        const UQWORD initstate = seed << 31 | seed;
+        const UQWORD initseq   = seed << 31 | seed;
+        inc = (initseq << 1) | 1;
+        state = initstate + inc;
+        state = state * PCG_DEFAULT_MULTIPLIER + inc;
+    }
+
+    constexpr UDWORD pcg32::operator()()
+    {
+        // PCG Random number generation (http://www.pcg-random.org):
+        const UQWORD oldstate = state;
+        // Advance internal state:
+        state = oldstate * PCG_DEFAULT_MULTIPLIER + (inc | 1);
+        // Calculate output function (XSH RR), uses old state for max ILP:
+        const UDWORD xorshifted = UDWORD(((oldstate >> 18u) ^ oldstate) >> 27u);
+        const UDWORD rot = oldstate >> 59u;
+        return (xorshifted >> rot) | (xorshifted << ((~rot) & 31));
+    }
+
+    UDWORD pcg32rand(const UQWORD seed)
+    {
+        thread_local bool initialized = false;
+        thread_local pcg32 generator;
+        if (seed != 0 || !initialized) {
+            generator = pcg32(seed);
+            initialized = true;
+        }
+        return generator();
+    }
+
+
+    constexpr pcg16::pcg16(const UDWORD seed)
+      : state(0), inc(0)
+    {
+        const UDWORD initstate = seed << 15 | seed;
+        const UDWORD initseq   = seed << 15 | seed;
+        inc = (initseq << 1) | 1;
+        state = initstate + inc;
+        state = state * PCG_DEFAULT_MULTIPLIER + inc;
+    }
+
+    constexpr UWORD pcg16::operator()()
+    {
+        // PCG Random number generation (http://www.pcg-random.org):
+        const UDWORD oldstate = state;
+        // Advance internal state:
+        state = oldstate * PCG_DEFAULT_MULTIPLIER + (inc | 1);
+        // Calculate output function (XSH RR), uses old state for max ILP:
+        const UWORD xorshifted = UWORD(((oldstate >> 10u) ^ oldstate) >> 12u);
+        const UWORD rot = oldstate >> 28u;
+        return (xorshifted >> rot) | (xorshifted << ((~rot) & 15));
+    }
+
+    UWORD pcg16rand(const UDWORD seed)
+    {
+        thread_local bool initialized = false;
+        thread_local pcg16 generator;
+        if (seed != 0 || !initialized) {
+            generator = pcg16(seed);
+            initialized = true;
+        }
+        return generator();
+    }
+
+
+
+
+/****************************************/
+/*                                Tests */
+/****************************************/
+    static_assert([]
+                  {
+                      char srcAlphaA[8] = {'a','b','c','d','e','f','g','h'};
+                      FisherYates(srcAlphaA, 8, 1337);
+                      bool ok = srcAlphaA[0] == 'b';
+                      ok = ok && srcAlphaA[1] == 'a';
+                      ok = ok && srcAlphaA[2] == 'h';
+                      ok = ok && srcAlphaA[3] == 'f';
+                      ok = ok && srcAlphaA[4] == 'd';
+                      ok = ok && srcAlphaA[5] == 'c';
+                      ok = ok && srcAlphaA[6] == 'e';
+                      ok = ok && srcAlphaA[7] == 'g';
+
+                      char srcAlphaB[8] = {'a','b','c','d','e','f','g','h'};
+                      FisherYates(srcAlphaB, 8, 696963);
+                      ok = ok && srcAlphaB[0] == 'd';
+                      ok = ok && srcAlphaB[1] == 'c';
+                      ok = ok && srcAlphaB[2] == 'f';
+                      ok = ok && srcAlphaB[3] == 'g';
+                      ok = ok && srcAlphaB[4] == 'h';
+                      ok = ok && srcAlphaB[5] == 'b';
+                      ok = ok && srcAlphaB[6] == 'e';
+                      ok = ok && srcAlphaB[7] == 'a';
+
+                      return ok;
+                  }()
+                 );
+
+
+
+
+
+
+/****************************************/
+/*                             Research */
+/****************************************/
+/*
+    GCD, LCM
+    greatest common divisor  24,60 ⇒ 12
+    lowest common multiple    8,10 ⇒ 40
+
+
+    matmul:
+    https://learnopengl.com/Getting-started/Transformations
+    for (int y=0; y<4; ++y)
+    for (int x=0; x<4; ++x)
+    for (int k=0; k<4; ++k)
+        product[(y*4)+x] += mat[(y*4)+k] + mat[(k*4)+x];
+*/
+
+
+
+
+
+/****************************************/
+/*                          Worker pool */
+/* A fixed set of threads that all work */
+/* on the same job: run(job) calls      */
+/* job(workerIdx) once on every worker  */
+/* (the calling thread is worker 0) and */
+/* returns when all of them are done.   */
+/* The threads are started once and     */
+/* then sleep in between jobs.          */
+/****************************************/
+    class WorkerPool
+    {
+    public:
+        static constexpr int MaxWorkers = 64;
+    private:
+        using Job = void (*)(void *, int);
+        std::thread threads[MaxWorkers];
+        std::mutex mutex;
+        std::condition_variable wake, finished;
+        Job job = nullptr;
+        void *jobCtx = nullptr;
+        unsigned long long generation = 0;
+        int pending = 0;
+        int nWorkers = 1;
+        bool quit = false;
+    private:
+        void loop(int workerIdx);
+        void dispatch(Job fn, void *ctx);
+    public:
+        explicit WorkerPool(int workers = 0); // 0 = one per hardware thread
+        ~WorkerPool();
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        int size() const { return nWorkers; }
+
+        template <typename F>
+        void run(F& fn)
+        {
+            dispatch([](void *ctx, int workerIdx) { (*static_cast<F *>(ctx))(workerIdx); }, &fn);
+        }
+    };
+
+
+
+
+
+
+
+inline float sigmoid(float x) { return 1.0f / (1.0f + std::exp(-x)); }
+inline float sigmoid_derivative(float x) { return x * (1.0f - x); }
+inline float relu(float x) { return x > 0 ? x : 0.0001*x; }
+//inline float relu_derivative(float x) { return x > 0 ? 1 : 0.0001*x; }
+inline float relu_derivative(float x) { return x > 0 ? 1.0f : 0.0001f; }
+using std::tanh;
+inline float tanh_derivative(float y) { return 1.0f - y * y; }
+
+
+/****************************************/
+/*   Half precision (IEEE 754 binary16) */
+/* Software conversion, round to        */
+/* nearest even. Used to fill the half  */
+/* weights and where there is no f16c   */
+/****************************************/
+    constexpr UWORD halfFromFloat(const FLOAT f)
+    {
+        UDWORD x = std::bit_cast<UDWORD>(f);
+        const UWORD sign = static_cast<UWORD>((x >> 16) & 0x8000u);
+        x &= 0x7fffffffu;
+        if (x >= 0x7f800000u) // inf, nan (stays a quiet nan)
+            return sign | 0x7c00u | (x > 0x7f800000u ? 0x200u : 0u);
+        if (x >= 0x477ff000u) // Rounds to >= 65536
+            return sign | 0x7c00u;
+        if (x < 0x38800000u) // Below 2^-14: subnormal or zero
+        {
+            if (x < 0x33000000u)
+                return sign;
+            const UDWORD e = x >> 23;
+            const UDWORD m = (x & 0x7fffffu) | 0x800000u;
+            const UDWORD shift = 126u - e;
+            UDWORD h = m >> shift;
+            const UDWORD rem  = m & ((1u << shift) - 1u);
+            const UDWORD half = 1u << (shift - 1u);
+            h += (rem > half) || (rem == half && (h & 1u));
+            return sign | static_cast<UWORD>(h);
+        }
+        UDWORD h = (x - 0x38000000u) >> 13;
+        const UDWORD rem = x & 0x1fffu;
+        h += (rem > 0x1000u) || (rem == 0x1000u && (h & 1u));
+        return sign | static_cast<UWORD>(h);
+    }
+
+    constexpr FLOAT floatFromHalf(const UWORD h)
+    {
+        const UDWORD sign = static_cast<UDWORD>(h & 0x8000u) << 16;
+        const UDWORD e = (h >> 10) & 0x1fu;
+        const UDWORD m = h & 0x3ffu;
+        if (e == 0)
+        {
+            const FLOAT sub = (m-0.f) * 5.9604644775390625e-8f; // m * 2^-24
+            return sign ? -sub : sub;
+        }
+        if (e == 31)
+            return std::bit_cast<FLOAT>(sign | 0x7f800000u | (m << 13));
+        return std::bit_cast<FLOAT>(sign | ((e + 112u) << 23) | (m << 13));
+    }
+
+
+/****************************************/
+/*                          Activations */
+/* Approximations that the kernels also */
+/* compute vectorized, one pass over a  */
+/* whole row. Max error against the     */
+/* exact double results:                */
+/* - fastTanh: 4.0e-7 absolute          */
+/*   (std::tanh in float: 1.0e-7)       */
+/* - fastSigmoid: 2.3e-7 absolute       */
+/* - fastExp: 8.0e-8 relative in        */
+/*   [-87.3, 88.3], clamped outside     */
+/****************************************/
+    enum class Activation { relu, tanh, sigmoid };
+
+    inline constexpr FLOAT ReluSlope = 0.0001f; // Leaky, for x <= 0
+    // tanh(x) = x * P(x^2) / Q(x^2), exact to float precision beyond the clamp:
+    inline constexpr FLOAT TanhClamp = 7.90531110763549805f;
+    inline constexpr FLOAT TanhP[7] = { -2.76076847742355e-16f, 2.00018790482477e-13f, -8.60467152213735e-11f,
+                                        5.12229709037114e-08f, 1.48572235717979e-05f, 6.37261928875436e-04f,
+                                        4.89352455891786e-03f };
+    inline constexpr FLOAT TanhQ[4] = { 1.19825839466702e-06f, 1.18534705686654e-04f, 2.26843463243900e-03f,
+                                        4.89352518554385e-03f };
+    // exp(x) = 2^n * exp(r), r = x - n*ln2 (in two parts), exp(r) as a polynomial:
+    inline constexpr FLOAT ExpMin = -87.3f, ExpMax = 88.3f;
+    inline constexpr FLOAT Log2e = 1.44269504088896341f;
+    inline constexpr FLOAT Ln2Hi = 0.693359375f, Ln2Lo = -2.12194440e-4f;
+    inline constexpr FLOAT ExpP[6] = { 1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f,
+                                       4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f };
+
+    constexpr FLOAT fastRelu(const FLOAT x) { return x > 0.0f ? x : ReluSlope * x; }
+
+    constexpr FLOAT fastTanh(FLOAT x)
+    {
+        x = x < -TanhClamp ? -TanhClamp : (x > TanhClamp ? TanhClamp : x);
+        const FLOAT x2 = x * x;
+        FLOAT p = TanhP[0];
+        for (int k=1; k<7; ++k)
+            p = p * x2 + TanhP[k];
+        FLOAT q = TanhQ[0];
+        for (int k=1; k<4; ++k)
+            q = q * x2 + TanhQ[k];
+        return x * p / q;
+    }
+
+    constexpr FLOAT fastSigmoid(const FLOAT x) { return 0.5f + 0.5f * fastTanh(0.5f * x); }
+
+    constexpr FLOAT fastExp(FLOAT x)
+    {
+        x = x < ExpMin ? ExpMin : (x > ExpMax ? ExpMax : x);
+        const FLOAT t = x * Log2e + 0.5f;
+        SDWORD n = static_cast<SDWORD>(t);
+        n -= t < (n-0.f); // floor
+        x = x - (n-0.f) * Ln2Hi;
+        x = x - (n-0.f) * Ln2Lo;
+        FLOAT y = ExpP[0];
+        for (int k=1; k<6; ++k)
+            y = y * x + ExpP[k];
+        y = y * (x * x) + x + 1.0f;
+        return y * std::bit_cast<FLOAT>(static_cast<UDWORD>(n + 127) << 23);
+    }
+
+
+/****************************************/
+/*                              Kernels */
+/* The inner loops of the networks. One */
+/* table per instruction set, the best  */
+/* one for the cpu we are running on is */
+/* picked once at startup (cpuid), so a */
+/* binary built without -march=... uses */
+/* the wide units where there are any.  */
+/* The tile kernels take one row of 8x8 */
+/* tiles, see "Topology, 8x8 tiles"     */
+/****************************************/
+    struct NeuralKernels
+    {
+        const char *name;
+        // sum(a[i] * b[i])
+        FLOAT (*dot)(const FLOAT *a, const FLOAT *b, int n);
+        // sum(a[i] * b[i] * mask[i])
+        FLOAT (*maskedDot)(const FLOAT *a, const FLOAT *b, const FLOAT *mask, int n);
+        // y[i] += alpha * x[i]
+        void (*axpy)(FLOAT *y, const FLOAT *x, FLOAT alpha, int n);
+        // One row of tiles: tiles[b] for the bits b set in occupied[0..nWords).
+        // 'w' holds 64 weights per tile set in 'stored' (a superset of
+        // 'occupied'), those of tile b start at wb = w + 64*storedTileRank(
+        // stored, b). 'x' and 'err' are padded to whole tiles and 32 byte
+        // aligned. Over the edges (bit r*8+c of tiles[b] set, i = b*8+c):
+        // y[r] = sum(x[i] * wb[r*8 + c])
+        void (*tileRow)(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x, const UQWORD *tiles, const UQWORD *occupied, int nWords);
+        // tileRow with the weights stored as binary16
+        void (*tileRowHalf)(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x, const UQWORD *tiles, const UQWORD *occupied, int nWords);
+        // err[i] += delta[r] * wb[r*8 + c] (unless 'err' is null), then
+        // gb[r*8 + c] += delta[r] * scale * x[i], 'grad' laid out like 'w'
+        // (it may be 'w')
+        void (*tileBackward)(FLOAT *err, FLOAT *grad, const FLOAT *w, const UQWORD *stored, const FLOAT *x, const FLOAT *delta, FLOAT scale,
+                             const UQWORD *tiles, const UQWORD *occupied, int nWords);
+        // sum(x[i] * w[i]), n a multiple of 64. x in [0,127] so that no
+        // pair of products can saturate a 16 bit lane (pmaddubsw)
+        SDWORD (*dotU8S8)(const UBYTE *x, const SBYTE *w, int n);
+        // x[i] = fastRelu(x[i]), fastTanh(x[i]), ... in place
+        void (*reluRow)(FLOAT *x, int n);
+        void (*tanhRow)(FLOAT *x, int n);
+        void (*sigmoidRow)(FLOAT *x, int n);
+        void (*expRow)(FLOAT *x, int n);
+
+        void activate(const Activation a, FLOAT *x, const int n) const
+        {
+            if (a == Activation::relu)
+                reluRow(x, n);
+            else if (a == Activation::tanh)
+                tanhRow(x, n);
+            else
+                sigmoidRow(x, n);
+        }
+    };
+
+    const NeuralKernels& scalarKernels();
+    const NeuralKernels& neuralKernels(); // Best for this cpu
+
+    // Runs 'kernels' against the scalar reference on random data, true if
+    // all results agree (within rounding, the wide kernels sum in another order):
+    bool neuralKernelsSelfTest(const NeuralKernels& kernels);
+
+
+/****************************************/
+/*                          Model files */
+/* A header, then the sections (weights */
+/* biases, topology tiles) each on      */
+/* a 64 byte boundary, in the byte      */
+/* order of the machine that wrote it.  */
+/* The checksum (FNV-1a) covers all the */
+/* bytes after the header. Loading maps */
+/* the file (copy on write) where there */
+/* is mmap and uses the weights in      */
+/* place, else it is read with fread.   */
+/* The weights section has 64 floats    */
+/* per stored tile, its size gives the  */
+/* number of stored tiles               */
+/****************************************/
+    constexpr UQWORD fnv1a(const UBYTE *bytes, const UQWORD n, UQWORD hash = 0xcbf29ce484222325ull)
+    {
+        for (UQWORD i=0; i<n; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    struct NeuralFileHeader
+    {
+        static constexpr UQWORD Magic = 0x4e4e2d4941434e49ull; // "INCAI-NN"
+        static constexpr UDWORD Version = 3; // 2: topologies as 8x8 tiles, 3: weights per stored tile
+        static constexpr UDWORD ByteOrder = 0x01020304u;
+        static constexpr int MaxSections = 4;
+        static constexpr UQWORD SectionAlign = 64;
+
+        UQWORD magic = Magic;
+        UDWORD version = Version;
+        UDWORD byteOrder = ByteOrder;
+        UDWORD inputSize = 0, outputSize = 0, layers = 0, hiddenWidth = 0;
+        UDWORD columns = 0, nSections = 0;
+        UQWORD offsets[MaxSections] = {0};
+        UQWORD sizes[MaxSections] = {0};
+        UQWORD fileSize = 0;
+        UQWORD checksum = 0;
+    };
+
+    struct NeuralSection
+    {
+        void *data;
+        UQWORD size;
+    };
+
+    // Fills in the offsets and the file size from the section sizes:
+    void neuralFileLayout(NeuralFileHeader& header);
+    // Writes header and sections, filling in the checksum. 'header' as
+    // returned by neuralFileLayout():
+    bool neuralFileWrite(const char *path, NeuralFileHeader header, const NeuralSection *sections);
+    // True if the file image matches 'expected' (everything but the
+    // checksum) and its checksum is right:
+    bool neuralFileValid(const UBYTE *bytes, UQWORD size, const NeuralFileHeader& expected);
+    // Just the header, unchecked. For the section sizes that depend on the
+    // network (the expected header is built from them):
+    bool neuralFileHeaderRead(const char *path, NeuralFileHeader& header);
+    // The fread path: checks the whole file first, then reads the sections.
+    // Leaves 'sections' alone if the file does not match:
+    bool neuralFileRead(const char *path, const NeuralFileHeader& expected, const NeuralSection *sections);
+
+    // A whole file mapped private (writes stay in this process). open() is
+    // false where there is no mmap, or the file cannot be mapped:
+    class MappedFile
+    {
+    private:
+        UBYTE *data = nullptr;
+        UQWORD size = 0;
+    public:
+        MappedFile() = default;
+        ~MappedFile() { close(); }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const char *path);
+        void close();
+        void swap(MappedFile& other)
+        {
+            UBYTE *d = data; data = other.data; other.data = d;
+            const UQWORD s = size; size = other.size; other.size = s;
+        }
+
+        UBYTE *bytes() const { return data; }
+        UQWORD length() const { return size; }
+    };
+
+
+/****************************************/
+/*                      Frozen networks */
+/* A trained FeedForward32 written out  */
+/* as C++ (exportFrozen), its edges as  */
+/* a constexpr table. FrozenEvaluator   */
+/* unrolls that table at compile time:  */
+/* one multiply-add per edge with the   */
+/* weight and both columns as constants */
+/* and no topology, loops or branches   */
+/* left. Compile time grows with the    */
+/* edges, meant for small shipped nets  */
+/****************************************/
+    struct FrozenEdge
+    {
+        UWORD dst, src;
+        FLOAT weight;
+    };
+
+    // Edges sorted by layer, dst, src; those of layer l are
+    // edges[layerStart[l]] .. edges[layerStart[l+1]-1]:
+    template <int InputSize, int OutputSize, int Layers, int Columns, int Edges>
+    struct FrozenNetwork
+    {
+        static constexpr int inputSize = InputSize;
+        static constexpr int outputSize = OutputSize;
+        static constexpr int layers = Layers;
+        static constexpr int columns = Columns;
+        static constexpr int nEdges = Edges;
+
+        int layerStart[Layers + 1];
+        FrozenEdge edges[Edges > 0 ? Edges : 1];
+        FLOAT biases[Columns * Layers];
+    };
+
+    // Writes 'inline constexpr FrozenNetwork<...> name = {...};' to 'path',
+    // the network given as in its model file (see FeedForward32::exportFrozen):
+    bool neuralExportFrozen(const char *path, const char *name, const NeuralFileHeader& shape,
+                            const FLOAT *weights, const UQWORD *tiles, const FLOAT *biases);
+
+    // Same results as FeedForward32::evaluate (up to rounding, the sums
+    // are in another order) for the network it was exported from:
+    template <const auto& Net>
+    class FrozenEvaluator
+    {
+        using Shape = std::remove_cvref_t<decltype(Net)>;
+        static_assert(Shape::layers >= 2, "an input and an output layer");
+    public:
+        static constexpr int inputSize = Shape::inputSize;
+        static constexpr int outputSize = Shape::outputSize;
+        static constexpr int columns = Shape::columns;
+        static constexpr int activationSize = columns * Shape::layers;
+    private:
+        static constexpr int Chunk = 256; // Edges per fold expression
+
+        FLOAT activations[activationSize];
+
+        template <int First, int... E>
+        static constexpr void addEdges(const FLOAT *in, FLOAT *out, std::integer_sequence<int, E...>)
+        {
+            ((out[Net.edges[First+E].dst] += Net.edges[First+E].weight * in[Net.edges[First+E].src]), ...);
+        }
+
+        // Halves [First, Last) down to chunks, the instantiations stay shallow:
+        template <int First, int Last>
+        static constexpr void sumEdges(const FLOAT *in, FLOAT *out)
+        {
+            if constexpr (Last - First <= Chunk)
+                addEdges<First>(in, out, std::make_integer_sequence<int, Last - First>());
+            else
+            {
+                constexpr int Mid = First + (Last - First) / 2;
+                sumEdges<First, Mid>(in, out);
+                sumEdges<Mid, Last>(in, out);
+            }
+        }
+
+        template <int Layer>
+        static constexpr void forward(const FLOAT *in, FLOAT *scratch)
+        {
+            FLOAT *out = &scratch[Layer*columns];
+            FLOAT sums[columns]; // Not aliased by 'in', stays out of memory where it can
+            for (int c = 0; c < columns; ++c)
+                sums[c] = Net.biases[Layer*columns + c];
+            sumEdges<Net.layerStart[Layer], Net.layerStart[Layer+1]>(in, sums);
+            if constexpr (Layer+1 < Shape::layers)
+            {
+                for (int c = 0; c < columns; ++c)
+                    out[c] = fastRelu(sums[c]);
+                forward<Layer+1>(out, scratch);
+            }
+            else
+            {
+                for (int c = 0; c < columns; ++c)
+                    out[c] = fastTanh(sums[c]);
+            }
+        }
+    public:
+        // The outputs are the last outputSize columns of the returned
+        // row, as with FeedForward32. Also usable in constant expressions:
+        static constexpr FLOAT *evaluate(const FLOAT *inputs, FLOAT *scratch)
+        {
+            forward<0>(inputs, scratch);
+            return &scratch[(Shape::layers-1)*columns];
+        }
+
+        FLOAT *evaluate(const FLOAT *inputs) { return evaluate(inputs, activations); }
+    };
+
+
+/****************************************/
+/*                    First layer, NNUE */
+/* Between two positions only a few     */
+/* inputs change. An Accumulator holds  */
+/* the first layer before activation;   */
+/* a changed input adds change * (its   */
+/* weight column), the deeper layers    */
+/* are recomputed from there. Turns the */
+/* O(inputs x hidden) first layer into  */
+/* O(changed x hidden)                  */
+/****************************************/
+    struct NetworkInputDelta
+    {
+        int input;
+        FLOAT change; // New value - old value
+    };
+
+
+/****************************************/
+/*                  Topology, 8x8 tiles */
+/* The connections of a layer form a    */
+/* columns x columns bit matrix that is */
+/* mostly empty, a layer only connects  */
+/* a band of the columns. It is kept as */
+/* 8x8 tiles (one UQWORD each) plus, by */
+/* row of tiles, a bitmap of the tiles  */
+/* that have any edge. The kernels skip */
+/* the empty tiles and take a full one  */
+/* a row of 8 weights at a time         */
+/* Only the tiles with an edge (in any  */
+/* layer) have weights: 64 floats each, */
+/* row by row, found by counting the    */
+/* stored tiles before them in a bitmap */
+/****************************************/
+    // Where the weights of tile b are among those of its row of tiles:
+    inline int storedTileRank(const UQWORD *stored, const int b)
+    {
+        int rank = std::popcount(stored[b/64] & ((UQWORD(1) << (b%64)) - 1));
+        for (int k=0; k<b/64; ++k)
+            rank += std::popcount(stored[k]);
+        return rank;
+    }
+
+
+/****************************************/
+/*  feed forward 32 (this one is worse) */
+/****************************************/
+    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
+    class FeedForward16;
+
+    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
+    class FeedForward8;
+
+    template <typename Net, int MaxThreads>
+    class Trainer;
+
+    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng, int batchSize = 1>
+    class FeedForward32
+    {
+        template <int, int, int, int, typename> friend class FeedForward16;
+        template <int, int, int, int, typename> friend class FeedForward8;
+        template <typename, int> friend class Trainer;
+    public:
+        static constexpr int columns = InputSize+((Max_layers-1)*HiddenWidth)+OutputSize;
+        template <int Size>
+        struct BitArray
+        {
+            UQWORD data[(Size+63) / 64] = {0};
+            bool operator[](int idx) const
+            {
+                const int word = idx / 64;
+                const int bit  = idx % 64;
+                return (data[word] >> (63 - bit)) & 1;
+            }
+            void set(int idx, bool value)
+            {
+                const int word = idx / 64;
+                const int bit  = idx % 64;
+                if (value)
+                    data[word] |= (UQWORD(1) << (63 - bit));
+                else
+                    data[word] &= ~(UQWORD(1) << (63 - bit));
+            }
+            bool operator==(const BitArray& other) const
+            {
+                for (int i = 0; i < (Size+63) / 64; ++i)
+                {
+                    if (data[i] != other.data[i])
+                        return false;
+                }
+                return true;
+            }
+        };
+    private:
+        static constexpr int nLayers = Max_layers;
+        static constexpr int blocks = (columns+7) / 8; // Tiles per row/column
+        static constexpr int occupiedWords = (blocks+63) / 64;
+        static constexpr int BatchTile = 8; // Samples per pass of evaluateBatch()
+        static constexpr int TileWeights = 64;
+        // Layer 0 by input, see update(). The column of input i holds its
+        // weights into the rows first[i/8] .. first[i/8]+length[i/8] (0
+        // where there is no edge), those rows of tiles that have any edge
+        // from the inputs of its tile:
+        static constexpr int inputBlocks = (InputSize+7) / 8;
+        struct InputColumns
+        {
+            std::unique_ptr<FLOAT[]> weights;
+            int size = 0;
+            int start[InputSize];
+            int first[inputBlocks];
+            int length[inputBlocks];
+        };
+        std::unique_ptr<FLOAT[]> ownWeights; // TileWeights per stored tile, see "Topology, 8x8 tiles"
+        FLOAT *weights = nullptr; // ownWeights, or the weights in the mapped model file, see load()
+        MappedFile mapped;
+        UQWORD weightSeed; // See initialWeight()
+        FLOAT biases[columns * Max_layers];
+        // Bit r*8+c of tiles[layer][rb*blocks + cb] is the edge from column
+        // cb*8+c to column rb*8+r. All layers share the weights, one per
+        // dst and src (and training updates them)
+        UQWORD tiles[Max_layers][blocks * blocks];
+        // Compiled from the tiles: bit cb of occupied[layer][rb] is set if
+        // tile (rb, cb) has any edge
+        UQWORD occupied[Max_layers][blocks][occupiedWords];
+        // The tiles that have weights, those occupied in any layer. Row rb
+        // starts at weights[rowStart[rb] * TileWeights]
+        UQWORD stored[blocks][occupiedWords] = {};
+        int rowStart[blocks+1] = {0};
+        InputColumns firstLayer;
+        int nEdges = 0;
+        FLOAT activations[columns * Max_layers]; // Scratch of evaluate(inputs)/train() only
+        bool topologyDirty = true;
+        bool columnsDirty = true; // 'firstLayer' is behind the weights, see prepare()
+        const NeuralKernels *kernels = &neuralKernels();
+    private:
+        static FLOAT u64_to_float(const UQWORD i)
+        {
+            union { UQWORD i; DOUBLE d; } u;
+            // This generates a double in [1.0, 2.0) by setting the exponent bits
+            // and using the top 52 bits of the UQWORD for the mantissa.
+            u.i = (0x3FFULL << 52) | (i >> 12);
+            return static_cast<FLOAT>(u.d - 1.0);
+        }
+
+        static NeuralFileHeader fileHeader(const int nStoredTiles)
+        {
+            NeuralFileHeader header;
+            header.inputSize = InputSize;
+            header.outputSize = OutputSize;
+            header.layers = Max_layers;
+            header.hiddenWidth = HiddenWidth;
+            header.columns = columns;
+            header.nSections = 3;
+            header.sizes[0] = UQWORD(nStoredTiles) * TileWeights * sizeof(FLOAT);
+            header.sizes[1] = sizeof(biases);
+            header.sizes[2] = sizeof(tiles);
+            neuralFileLayout(header);
+            return header;
+        }
+    private:
+        // Reference path, multiplies by every topology bit:
+        template <FLOAT (*Act)(FLOAT)>
+        void forwardDense(const int layer, const FLOAT *input, int inputSize, FLOAT *acts) const
+        {
+            for (int dst = 0; dst < columns; ++dst)
+            {
+                FLOAT tops[columns], row[columns];
+                for (int src = 0; src < inputSize; ++src)
+                {
+                    tops[src] = isConnected(layer, dst, src);
+                    row[src] = weightAt(dst, src);
+                }
+
+                const FLOAT sum = kernels->maskedDot(input, row, tops, inputSize);
+                acts[(layer*columns) + dst] = Act(sum + biases[(layer*columns) + dst]);
+            }
+        }
+
+        // The tile kernels read whole tiles of their vectors:
+        static void padToTiles(FLOAT *padded, const FLOAT *x, const int n)
+        {
+            for (int i=0; i<n; ++i)
+                padded[i] = x[i];
+            for (int i=n; i<blocks*8; ++i)
+                padded[i] = 0.0f;
+        }
+
+        // The weights of row of tiles rb, TileWeights per stored tile:
+        FLOAT *rowWeights(const int rb) const { return &weights[rowStart[rb] * TileWeights]; }
+
+        // The 64 weights of a stored tile, weight r*8+c for edge bit r*8+c:
+        FLOAT *tileWeights(const int rb, const int cb) const
+        {
+            return &rowWeights(rb)[storedTileRank(stored[rb], cb) * TileWeights];
+        }
+
+        // The same for every network of this seed, so an edge that gets a
+        // new tile starts like the edges of the constructor did:
+        FLOAT initialWeight(const int dst, const int src) const
+        {
+            UQWORD z = weightSeed + UQWORD(dst*columns + src + 1) * 0x9e3779b97f4a7c15ull; // splitmix64
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            // He/Xavier Initialization: scale weights down so massive summations
+            // don't blow out the Tanh Output derivative into 0.0!
+            return (2.0f * u64_to_float(z ^ (z >> 31)) - 1.0f) * std::sqrt(2.0f / columns);
+        }
+
+        // Tiles with an edge in any layer, by row:
+        static int markStored(const UQWORD (*tileBits)[blocks * blocks], UQWORD (&bits)[blocks][occupiedWords], int (&start)[blocks+1])
+        {
+            start[0] = 0;
+            for (int rb=0; rb<blocks; ++rb)
+            {
+                for (int k=0; k<occupiedWords; ++k)
+                    bits[rb][k] = 0;
+                for (int layer=0; layer<Max_layers; ++layer)
+                    for (int cb=0; cb<blocks; ++cb)
+                        if (tileBits[layer][rb*blocks + cb])
+                            bits[rb][cb/64] |= UQWORD(1) << (cb%64);
+                start[rb+1] = start[rb];
+                for (int k=0; k<occupiedWords; ++k)
+                    start[rb+1] += std::popcount(bits[rb][k]);
+            }
+            return start[blocks];
+        }
+
+        // After the topology changed: a tile that lost its last edge gives
+        // its weights back, one that got its first edge gets initial weights
+        void restoreWeights()
+        {
+            UQWORD bits[blocks][occupiedWords];
+            int start[blocks+1];
+            const int n = markStored(tiles, bits, start);
+            bool same = weights != nullptr;
+            for (int rb=0; same && rb<blocks; ++rb)
+                for (int k=0; k<occupiedWords; ++k)
+                    same = same && bits[rb][k] == stored[rb][k];
+            if (same)
+                return;
+            auto fresh = std::make_unique_for_overwrite<FLOAT[]>(n > 0 ? n * TileWeights : 1);
+            for (int rb=0; rb<blocks; ++rb)
+            {
+                for (int cb=0; cb<blocks; ++cb)
+                {
+                    if (!((bits[rb][cb/64] >> (cb%64)) & 1))
+                        continue;
+                    FLOAT *dst = &fresh[(start[rb] + storedTileRank(bits[rb], cb)) * TileWeights];
+                    const bool kept = weights && ((stored[rb][cb/64] >> (cb%64)) & 1);
+                    const FLOAT *src = kept ? tileWeights(rb, cb) : nullptr;
+                    for (int i=0; i<TileWeights; ++i)
+                        dst[i] = kept ? src[i] : initialWeight(rb*8 + i/8, cb*8 + i%8);
+                }
+                for (int k=0; k<occupiedWords; ++k)
+                    stored[rb][k] = bits[rb][k];
+            }
+            for (int rb=0; rb<=blocks; ++rb)
+                rowStart[rb] = start[rb];
+            ownWeights = std::move(fresh);
+            weights = ownWeights.get();
+            mapped.close();
+        }
+
+        // 'weightOf(rb, cb, bit)' reads the stored tile (rb, cb):
+        template <typename WeightOf>
+        void transposeFirstLayer(InputColumns& out, WeightOf weightOf) const
+        {
+            int size = 0;
+            for (int cb = 0; cb < inputBlocks; ++cb)
+            {
+                int firstRow = blocks, lastRow = -1;
+                for (int rb = 0; rb < blocks; ++rb)
+                    if (tiles[0][rb*blocks + cb])
+                    {
+                        firstRow = firstRow < rb ? firstRow : rb;
+                        lastRow = rb;
+                    }
+                const int end = (lastRow+1)*8 < columns ? (lastRow+1)*8 : columns;
+                out.first[cb] = lastRow < 0 ? 0 : firstRow*8;
+                out.length[cb] = lastRow < 0 ? 0 : end - firstRow*8;
+                for (int c = 0; c < 8 && cb*8 + c < InputSize; ++c)
+                {
+                    out.start[cb*8 + c] = size;
+                    size += out.length[cb];
+                }
+            }
+            if (!out.weights || out.size != size)
+                out.weights = std::make_unique_for_overwrite<FLOAT[]>(size > 0 ? size : 1);
+            out.size = size;
+            for (int cb = 0; cb < inputBlocks; ++cb)
+                for (int dst = out.first[cb]; dst < out.first[cb] + out.length[cb]; ++dst)
+                {
+                    const UQWORD tile = tiles[0][(dst/8)*blocks + cb];
+                    for (int c = 0; c < 8 && cb*8 + c < InputSize; ++c)
+                    {
+                        const int bit = (dst%8)*8 + c;
+                        out.weights[out.start[cb*8 + c] + dst - out.first[cb]] = (tile >> bit) & 1 ? weightOf(dst/8, cb, bit) : 0.0f;
+                    }
+                }
+        }
+
+        // Accumulator updates are one axpy per changed input:
+        static void applyDeltas(const NeuralKernels& k, const InputColumns& in, FLOAT *sums, const NetworkInputDelta *deltas, const int n)
+        {
+            for (int d = 0; d < n; ++d)
+            {
+                const int src = deltas[d].input;
+                k.axpy(&sums[in.first[src/8]], &in.weights[in.start[src]], deltas[d].change, in.length[src/8]);
+            }
+        }
+
+        // out[dst] = the edges of 'layer' into dst + its bias, 'x' padded:
+        void sumEdges(const int layer, const FLOAT *x, FLOAT *out) const
+        {
+            for (int rb = 0; rb < blocks; ++rb)
+            {
+                FLOAT y[8];
+                kernels->tileRow(y, rowWeights(rb), stored[rb], x, &tiles[layer][rb*blocks], occupied[layer][rb], occupiedWords);
+                for (int r = 0; r < 8 && rb*8 + r < columns; ++r)
+                    out[rb*8 + r] = y[r] + biases[(layer*columns) + rb*8 + r];
+            }
+        }
+
+        // Same result as forwardDense (the absent edges only ever added
+        // zeros), but only reads the tiles that have edges. Layer 0 only
+        // has edges from the inputs. The activation is a second pass over
+        // the whole row
+        template <Activation Act>
+        void forward(const int layer, const FLOAT *input, FLOAT *acts) const
+        {
+            alignas(32) FLOAT x[blocks*8];
+            padToTiles(x, input, layer == 0 ? InputSize : columns);
+            FLOAT *row = &acts[layer*columns];
+            sumEdges(layer, x, row);
+            kernels->activate(Act, row, columns);
+        }
+
+        // forward() for n <= BatchTile samples, layer 0 reads 'inputs' and
+        // the others the previous layer in their 'scratch':
+        template <Activation Act>
+        void forwardBatch(const int layer, const FLOAT *const *inputs, FLOAT *const *scratch, const int n) const
+        {
+            alignas(32) FLOAT x[BatchTile][blocks*8];
+            for (int s = 0; s < n; ++s)
+            {
+                if (layer == 0)
+                    padToTiles(x[s], inputs[s], InputSize);
+                else
+                    padToTiles(x[s], &scratch[s][(layer-1)*columns], columns);
+            }
+            for (int rb = 0; rb < blocks; ++rb)
+            {
+                for (int s = 0; s < n; ++s)
+                {
+                    FLOAT y[8];
+                    kernels->tileRow(y, rowWeights(rb), stored[rb], x[s], &tiles[layer][rb*blocks], occupied[layer][rb], occupiedWords);
+                    for (int r = 0; r < 8 && rb*8 + r < columns; ++r)
+                        scratch[s][(layer*columns) + rb*8 + r] = y[r] + biases[(layer*columns) + rb*8 + r];
+                }
+            }
+            for (int s = 0; s < n; ++s)
+                kernels->activate(Act, &scratch[s][layer*columns], columns);
+        }
+
+        // Layers 1.. on top of the layer 0 activations in 'scratch':
+        FLOAT *forwardHidden(FLOAT *scratch) const
+        {
+            for (int i=1; i<nLayers-1; ++i)
+                forward<Activation::relu>(i, &scratch[(i-1)*columns], scratch);
+            // todo: tahn or softmax?
+            forward<Activation::tanh>(nLayers-1, &scratch[(nLayers-2)*columns], scratch);
+            return &scratch[(nLayers-1)*columns];
+        }
+
+
+
+        // 'inputs' (the deltas of 'topologyIdx') padded to whole tiles:
+        template <FLOAT (*Deriv)(FLOAT)>
+        void backward(const int topologyIdx, FLOAT *deltas, const FLOAT *inputs, const FLOAT *activations, FLOAT learning_rate)
+        {
+            alignas(32) FLOAT hidden_error[blocks*8] = {0.0f};
+            alignas(32) FLOAT x[blocks*8];
+            padToTiles(x, activations, columns);
+            for (int rb = 0; rb < blocks; ++rb)
+                kernels->tileBackward(hidden_error, rowWeights(rb), rowWeights(rb), stored[rb], x, &inputs[rb*8], learning_rate,
+                                      &tiles[topologyIdx][rb*blocks], occupied[topologyIdx][rb], occupiedWords);
+            for (int h = 0; h < columns; ++h)
+            {
+                deltas[h] = hidden_error[h] * Deriv(activations[h]);
+                const int biasIdx = (topologyIdx - 1) * columns + h;
+                biases[biasIdx] += deltas[h] * learning_rate;
+            }
+        }
+
+    public:
+        explicit FeedForward32(Rng& rng, bool randomizeTopology = true)
+        {
+            // Initialize weights/biases with random values in range [-1.0, 1.0]
+            // should be ~symmetric around zero
+            //for (int i = 0; i < columns * columns; ++i)
+            //    weights[i] = 2.0f * u64_to_float(rng()) - 1.0f;
+            //for (int i = 0; i < columns * Max_layers; ++i)
+            //    biases[i] = 2.0f * u64_to_float(rng()) - 1.0f;
+
+
+
+
+
+
+
+            // 1. Weights, only for the tiles that end up with edges (see initialWeight()):
+                  weightSeed = (UQWORD(rng()) << 32) ^ UQWORD(rng());
+
+                  // 2. Initialize biases slightly positive to ensure ReLUs aren't born "dead"
+                  for (int i = 0; i < columns * Max_layers; ++i)
+                      biases[i] = 0.01f;
+
+
+
+
+
+
+
+
+
+
+            // Initialize DAG:
+            int from = InputSize*columns;
+            const int hiddenSize = (columns-(InputSize+OutputSize)) / (nLayers-1);
+            for (int i=0; i<hiddenSize; ++i)
+            {
+                for (int j=0; j<InputSize; ++j)
+                    setConnection(0, (from + j) / columns, (from + j) % columns, true);
+                from += columns;
+            }
+            from += InputSize;
+            for (int layer=1; layer<nLayers-1; ++layer)
+            {
+                for (int i=0; i<hiddenSize; ++i)
+                {
+                    for (int j=0; j<hiddenSize; ++j)
+                        setConnection(layer, (from + j) / columns, (from + j) % columns, true);
+                    from += columns;
+                }
+                from += hiddenSize;
+            }
+            const int current_src = from % columns; // Preserve previous layer's src offset
+            from = (columns - OutputSize) * columns + current_src; // Hard-align the dst
+            for (int i=0; i<OutputSize; ++i)
+            {
+                for (int j=0; j<hiddenSize; ++j)
+                    setConnection(nLayers-1, (from + j) / columns, (from + j) % columns, true);
+                from += columns;
+            }
+
+            // Randomize connections a bit:
+            for (int layer=0; randomizeTopology && layer<nLayers; ++layer)
+            {
+                for (int i=0; i<columns*columns; ++i)
+                {
+                    const int dst = i / columns, src = i % columns;
+                    if (rng() % 100 < 25 && (layer > 0 || src < InputSize)) // 25% chance to flip
+                        setConnection(layer, dst, src, !isConnected(layer, dst, src));
+                }
+            }
+            compileTopology();
+        }
+
+        FeedForward32(const FeedForward32&) = delete; // 'weights' may point into this one
+        FeedForward32& operator=(const FeedForward32&) = delete;
+
+        // Weights (of the stored tiles), biases and topology tiles, see "Model files":
+        bool save(const char *path) const
+        {
+            const NeuralSection sections[3] = { { weights, fileHeader(rowStart[blocks]).sizes[0] },
+                                                { const_cast<FLOAT *>(biases), sizeof(biases) },
+                                                { const_cast<UQWORD *>(&tiles[0][0]), sizeof(tiles) } };
+            return neuralFileWrite(path, fileHeader(rowStart[blocks]), sections);
+        }
+
+        // Replace the network by the one in 'path'. False (and the network
+        // unchanged) if the file is missing, damaged, or of another shape.
+        // Where possible the weights are used straight from the mapped
+        // file: no copy, and processes loading the same file share its
+        // pages until one of them trains (copy on write)
+        bool load(const char *path)
+        {
+            // The size of the weights section gives the number of stored
+            // tiles, the topology in the file must need exactly these:
+            constexpr UQWORD TileBytes = TileWeights * sizeof(FLOAT);
+            NeuralFileHeader found;
+            if (!neuralFileHeaderRead(path, found) || found.sizes[0] % TileBytes != 0 || found.sizes[0] > TileBytes * blocks * blocks)
+                return false;
+            const int nStored = static_cast<int>(found.sizes[0] / TileBytes);
+            const NeuralFileHeader expected = fileHeader(nStored);
+            auto fileTiles = std::make_unique_for_overwrite<UQWORD[][blocks * blocks]>(Max_layers);
+            auto fileBiases = std::make_unique_for_overwrite<FLOAT[]>(columns * Max_layers);
+            std::unique_ptr<FLOAT[]> fileWeights;
+            MappedFile file;
+            if (file.open(path))
+            {
+                if (!neuralFileValid(file.bytes(), file.length(), expected))
+                    return false;
+                const UBYTE *biasBytes = file.bytes() + expected.offsets[1];
+                const UBYTE *tileBytes = file.bytes() + expected.offsets[2];
+                for (UQWORD i=0; i<sizeof(biases); ++i)
+                    reinterpret_cast<UBYTE *>(fileBiases.get())[i] = biasBytes[i];
+                for (UQWORD i=0; i<sizeof(tiles); ++i)
+                    reinterpret_cast<UBYTE *>(fileTiles.get())[i] = tileBytes[i];
+            }
+            else
+            {
+                fileWeights = std::make_unique_for_overwrite<FLOAT[]>(nStored > 0 ? nStored * TileWeights : 1);
+                const NeuralSection sections[3] = { { fileWeights.get(), expected.sizes[0] },
+                                                    { fileBiases.get(), sizeof(biases) },
+                                                    { fileTiles.get(), sizeof(tiles) } };
+                if (!neuralFileRead(path, expected, sections))
+                    return false;
+            }
+            UQWORD bits[blocks][occupiedWords];
+            int start[blocks+1];
+            if (markStored(fileTiles.get(), bits, start) != nStored)
+                return false;
+
+            for (int i=0; i<columns * Max_layers; ++i)
+                biases[i] = fileBiases[i];
+            for (int layer=0; layer<Max_layers; ++layer)
+                for (int t=0; t<blocks*blocks; ++t)
+                    tiles[layer][t] = fileTiles[layer][t];
+            for (int rb=0; rb<blocks; ++rb)
+                for (int k=0; k<occupiedWords; ++k)
+                    stored[rb][k] = bits[rb][k];
+            for (int rb=0; rb<=blocks; ++rb)
+                rowStart[rb] = start[rb];
+            if (fileWeights)
+            {
+                ownWeights = std::move(fileWeights);
+                weights = ownWeights.get();
+                mapped.close();
+            }
+            else
+            {
+                weights = reinterpret_cast<FLOAT *>(file.bytes() + expected.offsets[0]);
+                mapped.swap(file); // The old mapping (if any) goes with 'file'
+                ownWeights.reset();
+            }
+            compileTopology(); // Same stored tiles, so the weights stay where they are
+            return true;
+        }
+
+        // The network as a C++ header for FrozenEvaluator, see "Frozen
+        // networks". 'name' becomes the name of the constexpr table:
+        bool exportFrozen(const char *path, const char *name) const
+        {
+            auto dense = std::make_unique<FLOAT[]>(columns * columns);
+            for (int dst=0; dst<columns; ++dst)
+                for (int src=0; src<columns; ++src)
+                    dense[dst*columns + src] = weightAt(dst, src);
+            return neuralExportFrozen(path, name, fileHeader(rowStart[blocks]), dense.get(), &tiles[0][0], biases);
+        }
+
+        // Take over weights, biases and topology of 'other' (same shape).
+        // Prepared afterwards: readers of a copy, e.g. the players of a
+        // ModelExchange, only have a const network and cannot prepare():
+        void copyFrom(const FeedForward32& other)
+        {
+            const int n = other.rowStart[blocks] * TileWeights;
+            if (weights != ownWeights.get() || rowStart[blocks] != other.rowStart[blocks])
+                ownWeights = std::make_unique_for_overwrite<FLOAT[]>(n > 0 ? n : 1);
+            for (int i=0; i<n; ++i)
+                ownWeights[i] = other.weights[i];
+            weights = ownWeights.get();
+            mapped.close();
+            weightSeed = other.weightSeed;
+            for (int i=0; i<columns * Max_layers; ++i)
+                biases[i] = other.biases[i];
+            for (int layer=0; layer<nLayers; ++layer)
+                for (int t=0; t<blocks*blocks; ++t)
+                    tiles[layer][t] = other.tiles[layer][t];
+            for (int rb=0; rb<blocks; ++rb)
+                for (int k=0; k<occupiedWords; ++k)
+                    stored[rb][k] = other.stored[rb][k];
+            for (int rb=0; rb<=blocks; ++rb)
+                rowStart[rb] = other.rowStart[rb];
+            compileTopology();
+            prepare();
+        }
+
+        // Add/remove the edge src->dst in 'layer' (layer 0: src an input).
+        // The occupancy bitmap (and which tiles have weights) is rebuilt on the
+        // next evaluate()/train()/prepare():
+        void setConnection(const int layer, const int dst, const int src, const bool connected)
+        {
+            assert((layer > 0 || src < InputSize) && "layer 0 connects the inputs only");
+            UQWORD& tile = tiles[layer][(dst/8)*blocks + src/8];
+            const UQWORD bit = UQWORD(1) << ((dst%8)*8 + src%8);
+            tile = connected ? (tile | bit) : (tile & ~bit);
+            topologyDirty = true;
+        }
+
+        void compileTopology()
+        {
+            nEdges = 0;
+            for (int layer=0; layer<nLayers; ++layer)
+            {
+                for (int rb=0; rb<blocks; ++rb)
+                {
+                    for (int k=0; k<occupiedWords; ++k)
+                        occupied[layer][rb][k] = 0;
+                    for (int cb=0; cb<blocks; ++cb)
+                    {
+                        const UQWORD tile = tiles[layer][rb*blocks + cb];
+                        if (tile)
+                            occupied[layer][rb][cb/64] |= UQWORD(1) << (cb%64);
+                        nEdges += std::popcount(tile);
+                    }
+                }
+            }
+            restoreWeights();
+            topologyDirty = false;
+            columnsDirty = true;
+        }
+
+        // Bring everything derived (compiled topology, the first layer by
+        // input) up to date. Needed after setConnection()/train() before the
+        // network is shared with Evaluators, which only read it:
+        void prepare()
+        {
+            if (topologyDirty)
+                compileTopology();
+            if (columnsDirty)
+            {
+                transposeFirstLayer(firstLayer, [this](const int rb, const int cb, const int bit) { return tileWeights(rb, cb)[bit]; });
+                columnsDirty = false;
+            }
+        }
+
+        bool isConnected(const int layer, const int dst, const int src) const
+        {
+            return (tiles[layer][(dst/8)*blocks + src/8] >> ((dst%8)*8 + src%8)) & 1;
+        }
+
+        // The weight of src->dst, 0 where no layer has its tile:
+        FLOAT weightAt(const int dst, const int src) const
+        {
+            const int rb = dst/8, cb = src/8;
+            if (!((stored[rb][cb/64] >> (cb%64)) & 1))
+                return 0.0f;
+            return tileWeights(rb, cb)[(dst%8)*8 + src%8];
+        }
+
+        // Bytes of weights held, TileWeights floats per stored tile:
+        UQWORD weightBytes() const { return UQWORD(rowStart[blocks]) * TileWeights * sizeof(FLOAT); }
+
+        // Pin the kernels, e.g. scalarKernels() for a reference run:
+        void setKernels(const NeuralKernels& k) { kernels = &k; }
+
+        int countEdges() const { return nEdges; }
+
+        static constexpr int activationSize = columns * Max_layers;
+        static constexpr int inputSize = InputSize;
+        static constexpr int outputSize = OutputSize;
+
+        // Read-only evaluation into the caller's 'scratch' (activationSize
+        // floats). Any number of threads may do this at the same time:
+        FLOAT *evaluate(const FLOAT *inputs, FLOAT *scratch) const
+        {
+            assert(!topologyDirty && "call prepare() first");
+            forward<Activation::relu>(0, inputs, scratch);
+            return forwardHidden(scratch);
+        }
+
+        // Layer 0 before the activation, see "First layer, NNUE":
+        struct Accumulator
+        {
+            FLOAT sums[columns];
+        };
+
+        void refresh(Accumulator& acc, const FLOAT *inputs) const
+        {
+            assert(!topologyDirty && "call prepare() first");
+            alignas(32) FLOAT x[blocks*8];
+            padToTiles(x, inputs, InputSize);
+            sumEdges(0, x, acc.sums);
+        }
+
+        // A changed input adds change * (its column of layer 0), contiguous
+        // in 'firstLayer':
+        void update(Accumulator& acc, const NetworkInputDelta *deltas, const int n) const
+        {
+            assert(!topologyDirty && !columnsDirty && "call prepare() first");
+            applyDeltas(*kernels, firstLayer, acc.sums, deltas, n);
+        }
+
+        FLOAT *evaluate(const Accumulator& acc, FLOAT *scratch) const
+        {
+            for (int dst = 0; dst < columns; ++dst)
+                scratch[dst] = acc.sums[dst];
+            kernels->reluRow(scratch, columns);
+            return forwardHidden(scratch);
+        }
+
+        FLOAT *evaluate(const FLOAT *inputs)
+        {
+            prepare();
+            return evaluate(inputs, activations);
+        }
+
+        // Same as evaluate() using the dense reference path. For testing and
+        // benchmarking only:
+        FLOAT *evaluateDense(const FLOAT *inputs)
+        {
+            forwardDense<relu>(0, inputs, InputSize, activations);
+            for (int i=1; i<nLayers-1; ++i)
+                forwardDense<relu>(i, &activations[(i-1)*columns], columns, activations);
+            forwardDense<tanh>(nLayers-1, &activations[(nLayers-2)*columns], columns, activations);
+            return &activations[(nLayers-1)*columns];
+        }
+
+        // evaluate(inputs[s], scratch[s]) for 'n' samples, same results.
+        // BatchTile samples go through a layer together, so each row of
+        // tiles is read from memory once for all of them instead of once
+        // per sample. Read-only like evaluate(inputs, scratch)
+        void evaluateBatch(const FLOAT *const *inputs, FLOAT *const *scratch, const int n) const
+        {
+            assert(!topologyDirty && "call prepare() first");
+            for (int first = 0; first < n; first += BatchTile)
+            {
+                const int m = n - first < BatchTile ? n - first : BatchTile;
+                forwardBatch<Activation::relu>(0, &inputs[first], &scratch[first], m);
+                for (int i=1; i<nLayers-1; ++i)
+                    forwardBatch<Activation::relu>(i, nullptr, &scratch[first], m);
+                forwardBatch<Activation::tanh>(nLayers-1, nullptr, &scratch[first], m);
+            }
+        }
+
+        FLOAT train(const FLOAT *inputs, const FLOAT *targets, FLOAT learning_rate)
+        {
+            if (topologyDirty)
+                compileTopology();
+            columnsDirty = true;
+            forward<Activation::relu>(0, inputs, activations);
+            for (int i=1; i<nLayers-1; ++i)
+                forward<Activation::relu>(i, &activations[(i-1)*columns], activations);
+            // last layer:
+            // todo: tahn or softmax?
+            forward<Activation::tanh>(nLayers-1, &activations[(nLayers-2)*columns], activations);
+
+            // Output to last hidden (sigmoid):
+            FLOAT squared_error_sum = 0.0f;
+            alignas(32) FLOAT output_delta[blocks*8] = {0.0f};
+            const int lastLayerIdx = (nLayers-1) * columns;
+            for (int j=0; j<OutputSize; ++j)
+            {
+                const int output_neuron_idx = (columns - OutputSize) + j;
+                const FLOAT output_error = targets[j] - activations[lastLayerIdx + output_neuron_idx];
+                output_delta[output_neuron_idx] = output_error * tanh_derivative(activations[lastLayerIdx + output_neuron_idx]);
+                biases[lastLayerIdx + output_neuron_idx] += output_delta[output_neuron_idx] * learning_rate;
+
+                // this line has nothing to do with anything, just for the return at the end:
+                squared_error_sum += output_error * output_error;
+            }
+
+
+            // Hidden (relu):
+            FLOAT *next_layer_deltas = output_delta;
+            alignas(32) FLOAT delta_buffer[blocks*8] = {0.0f};
+            for (int l = nLayers-1; l > 1; --l)
+            {
+                backward<relu_derivative>(l, delta_buffer, next_layer_deltas, &activations[(l-1)*columns], learning_rate);
+                next_layer_deltas = delta_buffer;
+            }
+
+
+            // Hidden to input (sigmoid):
+            backward<relu_derivative>(1, delta_buffer, next_layer_deltas, activations, learning_rate);
+
+
+            // Update weights (hidden to input):
+            alignas(32) FLOAT x[blocks*8];
+            padToTiles(x, inputs, InputSize);
+            for (int rb = 0; rb < blocks; ++rb)
+                kernels->tileBackward(nullptr, rowWeights(rb), rowWeights(rb), stored[rb], x, &delta_buffer[rb*8], learning_rate,
+                                      &tiles[0][rb*blocks], occupied[0][rb], occupiedWords);
+            return squared_error_sum / OutputSize; // mean squared error
+        }
+
+    private:
+        // The gradient of one sample, added to gradW/gradB. Same sign as the
+        // steps train() takes (target - output), but the weights are left
+        // alone, so several threads can do this on one network. 'acts' is
+        // activationSize of scratch. Returns the squared error sum
+        FLOAT gradient(const FLOAT *inputs, const FLOAT *targets, FLOAT *acts, FLOAT *gradW, FLOAT *gradB) const
+        {
+            evaluate(inputs, acts);
+
+            FLOAT squared_error_sum = 0.0f;
+            alignas(32) FLOAT deltaBuffers[2][blocks*8];
+            alignas(32) FLOAT x[blocks*8];
+            FLOAT *deltas = deltaBuffers[0];
+            FLOAT *prevDeltas = deltaBuffers[1];
+            const int lastLayerIdx = (nLayers-1) * columns;
+            for (int i=0; i<blocks*8; ++i)
+                deltas[i] = 0.0f;
+            for (int j=0; j<OutputSize; ++j)
+            {
+                const int o = (columns - OutputSize) + j;
+                const FLOAT output_error = targets[j] - acts[lastLayerIdx + o];
+                deltas[o] = output_error * tanh_derivative(acts[lastLayerIdx + o]);
+                gradB[lastLayerIdx + o] += deltas[o];
+                squared_error_sum += output_error * output_error;
+            }
+
+            for (int l = nLayers-1; l > 0; --l)
+            {
+                const FLOAT *prevActs = &acts[(l-1)*columns];
+                padToTiles(x, prevActs, columns);
+                for (int i=0; i<blocks*8; ++i)
+                    prevDeltas[i] = 0.0f;
+                // Hidden error into prevDeltas, the rows without delta (most
+                // of the output layer) are skipped:
+                for (int rb = 0; rb < blocks; ++rb)
+                    kernels->tileBackward(prevDeltas, &gradW[rowStart[rb] * TileWeights], rowWeights(rb), stored[rb], x, &deltas[rb*8], 1.0f,
+                                          &tiles[l][rb*blocks], occupied[l][rb], occupiedWords);
+                for (int h = 0; h < columns; ++h)
+                {
+                    prevDeltas[h] *= relu_derivative(prevActs[h]);
+                    gradB[(l-1)*columns + h] += prevDeltas[h];
+                }
+                FLOAT *swap = deltas;
+                deltas = prevDeltas;
+                prevDeltas = swap;
+            }
+
+            // Input layer:
+            padToTiles(x, inputs, InputSize);
+            for (int rb = 0; rb < blocks; ++rb)
+                kernels->tileBackward(nullptr, &gradW[rowStart[rb] * TileWeights], rowWeights(rb), stored[rb], x, &deltas[rb*8], 1.0f,
+                                      &tiles[0][rb*blocks], occupied[0][rb], occupiedWords);
+            return squared_error_sum;
+        }
+    };
+
+
+/****************************************/
+/*           feed forward 16 (IEEE 754) */
+/* Inference only. Made from a trained  */
+/* FeedForward32 like FeedForward8, its */
+/* weights are binary16: half the bytes */
+/* of the FP32 network, same topology   */
+/* and tile layout. The FP32 network    */
+/* stays with the training side, call   */
+/* copyFrom() after it trained          */
+/****************************************/
+    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
+    class FeedForward16
+    {
+        using Master = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
+    public:
+        static constexpr int columns = Master::columns;
+    private:
+        static constexpr int nLayers = Max_layers;
+        static constexpr int blocks = Master::blocks;
+        static constexpr int occupiedWords = Master::occupiedWords;
+        static constexpr int BatchTile = Master::BatchTile;
+        static constexpr int TileWeights = Master::TileWeights;
+        std::unique_ptr<UWORD[]> weights; // binary16, the stored tiles of the master, same layout
+        FLOAT biases[columns * Max_layers];
+        UQWORD tiles[Max_layers][blocks * blocks];
+        UQWORD occupied[Max_layers][blocks][occupiedWords];
+        UQWORD stored[blocks][occupiedWords];
+        int rowStart[blocks+1];
+        typename Master::InputColumns firstLayer; // From the half weights, see Master::update()
+        int nEdges = 0;
+        FLOAT activations[columns * Max_layers];
+        const NeuralKernels *kernels = &neuralKernels();
+    private:
+        const UWORD *rowWeights(const int rb) const { return &weights[rowStart[rb] * TileWeights]; }
+
+        void sumEdges(const int layer, const FLOAT *x, FLOAT *out) const
+        {
+            for (int rb = 0; rb < blocks; ++rb)
+            {
+                FLOAT y[8];
+                kernels->tileRowHalf(y, rowWeights(rb), stored[rb], x, &tiles[layer][rb*blocks], occupied[layer][rb], occupiedWords);
+                for (int r = 0; r < 8 && rb*8 + r < columns; ++r)
+                    out[rb*8 + r] = y[r] + biases[(layer*columns) + rb*8 + r];
+            }
+        }
+
+        template <Activation Act>
+        void forward(const int layer, const FLOAT *input, FLOAT *acts) const
+        {
+            alignas(32) FLOAT x[blocks*8];
+            Master::padToTiles(x, input, layer == 0 ? InputSize : columns);
+            FLOAT *row = &acts[layer*columns];
+            sumEdges(layer, x, row);
+            kernels->activate(Act, row, columns);
+        }
+
+        // See Master::forwardBatch():
+        template <Activation Act>
+        void forwardBatch(const int layer, const FLOAT *const *inputs, FLOAT *const *scratch, const int n) const
+        {
+            alignas(32) FLOAT x[BatchTile][blocks*8];
+            for (int s = 0; s < n; ++s)
+            {
+                if (layer == 0)
+                    Master::padToTiles(x[s], inputs[s], InputSize);
+                else
+                    Master::padToTiles(x[s], &scratch[s][(layer-1)*columns], columns);
+            }
+            for (int rb = 0; rb < blocks; ++rb)
+            {
+                for (int s = 0; s < n; ++s)
+                {
+                    FLOAT y[8];
+                    kernels->tileRowHalf(y, rowWeights(rb), stored[rb], x[s], &tiles[layer][rb*blocks], occupied[layer][rb], occupiedWords);
+                    for (int r = 0; r < 8 && rb*8 + r < columns; ++r)
+                        scratch[s][(layer*columns) + rb*8 + r] = y[r] + biases[(layer*columns) + rb*8 + r];
+                }
+            }
+            for (int s = 0; s < n; ++s)
+                kernels->activate(Act, &scratch[s][layer*columns], columns);
+        }
+
+        FLOAT *forwardHidden(FLOAT *scratch) const
+        {
+            for (int i=1; i<nLayers-1; ++i)
+                forward<Activation::relu>(i, &scratch[(i-1)*columns], scratch);
+            forward<Activation::tanh>(nLayers-1, &scratch[(nLayers-2)*columns], scratch);
+            return &scratch[(nLayers-1)*columns];
+        }
+
+    public:
+        explicit FeedForward16(const Master& trained) { copyFrom(trained); }
+
+        // Quantize 'trained' again, e.g. after the training side took some
+        // steps. Its topology must be compiled (trained.prepare()):
+        void copyFrom(const Master& trained)
+        {
+            assert(!trained.topologyDirty && "call prepare() on the FP32 network first");
+            const int n = trained.rowStart[blocks] * TileWeights;
+            if (!weights || rowStart[blocks] != trained.rowStart[blocks])
+                weights = std::make_unique_for_overwrite<UWORD[]>(n > 0 ? n : 1);
+            for (int i = 0; i < n; ++i)
+                weights[i] = halfFromFloat(trained.weights[i]);
+            for (int i=0; i<columns * Max_layers; ++i)
+                biases[i] = trained.biases[i];
+            for (int layer=0; layer<nLayers; ++layer)
+                for (int t=0; t<blocks*blocks; ++t)
+                    tiles[layer][t] = trained.tiles[layer][t];
+            for (int layer=0; layer<nLayers; ++layer)
+                for (int rb=0; rb<blocks; ++rb)
+                    for (int k=0; k<occupiedWords; ++k)
+                        occupied[layer][rb][k] = trained.occupied[layer][rb][k];
+            for (int rb=0; rb<blocks; ++rb)
+                for (int k=0; k<occupiedWords; ++k)
+                    stored[rb][k] = trained.stored[rb][k];
+            for (int rb=0; rb<=blocks; ++rb)
+                rowStart[rb] = trained.rowStart[rb];
+            nEdges = trained.nEdges;
+            // Same tiles, so the master can lay out the columns:
+            trained.transposeFirstLayer(firstLayer, [this](const int rb, const int cb, const int bit)
+            {
+                return floatFromHalf(weights[(rowStart[rb] + storedTileRank(stored[rb], cb))*TileWeights + bit]);
+            });
+        }
+
+        bool isConnected(const int layer, const int dst, const int src) const
+        {
+            return (tiles[layer][(dst/8)*blocks + src/8] >> ((dst%8)*8 + src%8)) & 1;
+        }
+
+        int countEdges() const { return nEdges; }
+
+        // Bytes of weights, half of the FP32 network's:
+        UQWORD weightBytes() const { return UQWORD(rowStart[blocks]) * TileWeights * sizeof(UWORD); }
+
+        void setKernels(const NeuralKernels& k) { kernels = &k; }
+
+        void prepare() {} // Never changes after quantization
+
+        static constexpr int activationSize = columns * Max_layers;
+        static constexpr int inputSize = InputSize;
+        static constexpr int outputSize = OutputSize;
+
+        FLOAT *evaluate(const FLOAT *inputs, FLOAT *scratch) const
+        {
+            forward<Activation::relu>(0, inputs, scratch);
+            return forwardHidden(scratch);
+        }
+
+        using Accumulator = typename Master::Accumulator;
+
+        void refresh(Accumulator& acc, const FLOAT *inputs) const
+        {
+            alignas(32) FLOAT x[blocks*8];
+            Master::padToTiles(x, inputs, InputSize);
+            sumEdges(0, x, acc.sums);
+        }
+
+        void update(Accumulator& acc, const NetworkInputDelta *deltas, const int n) const
+        {
+            Master::applyDeltas(*kernels, firstLayer, acc.sums, deltas, n);
+        }
+
+        FLOAT *evaluate(const Accumulator& acc, FLOAT *scratch) const
+        {
+            for (int dst = 0; dst < columns; ++dst)
+                scratch[dst] = acc.sums[dst];
+            kernels->reluRow(scratch, columns);
+            return forwardHidden(scratch);
+        }
+
+        FLOAT *evaluate(const FLOAT *inputs) { return evaluate(inputs, activations); }
+
+        // evaluate(inputs[s], scratch[s]) for 'n' samples, BatchTile at a
+        // time like FeedForward32::evaluateBatch():
+        void evaluateBatch(const FLOAT *const *inputs, FLOAT *const *scratch, const int n) const
+        {
+            for (int first = 0; first < n; first += BatchTile)
+            {
+                const int m = n - first < BatchTile ? n - first : BatchTile;
+                forwardBatch<Activation::relu>(0, &inputs[first], &scratch[first], m);
+                for (int i=1; i<nLayers-1; ++i)
+                    forwardBatch<Activation::relu>(i, nullptr, &scratch[first], m);
+                forwardBatch<Activation::tanh>(nLayers-1, nullptr, &scratch[first], m);
+            }
+        }
+    };
+
+
+/****************************************/
+/*                feed forward 8 (int8) */
+/* Inference only. Made from a trained  */
+/* FeedForward32 by quantize-on-copy:   */
+/* - weights: int8, one scale per row   */
+/* - inputs of each layer: 7 bit, one   */
+/*   scale per vector, stored +64 as    */
+/*   unsigned (pmaddubsw takes u8 x s8) */
+/*   the +64 is taken back out with a   */
+/*   precomputed 64*sum(row) per row    */
+/* - accumulation: int32                */
+/* Each layer gets its own dense int8   */
+/* matrix (absent edges are 0), rows    */
+/* padded to 64 bytes                   */
+/****************************************/
+    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
+    class FeedForward8
+    {
+        using Master = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
+    public:
+        static constexpr int columns = Master::columns;
+    private:
+        static constexpr int nLayers = Max_layers;
+        static constexpr int stride = (columns + 63) & ~63;
+        static constexpr int inputStride = (InputSize + 63) & ~63;
+        static constexpr int ActMax = 63;
+        static constexpr int ActOffset = 64;
+        alignas(64) SBYTE weights[Max_layers][columns][stride];
+        FLOAT rowScale[columns];
+        SDWORD rowOffset[Max_layers][columns]; // ActOffset * sum(row)
+        FLOAT biases[columns * Max_layers];
+        FLOAT activations[columns * Max_layers];
+        const NeuralKernels *kernels = &neuralKernels();
+    private:
+        template <Activation Act>
+        void forward(const int layer, const FLOAT *input, const int inputSize, const int rowLen, FLOAT *acts) const
+        {
+            FLOAT maxAbs = 0.0f;
+            for (int i=0; i<inputSize; ++i)
+            {
+                const FLOAT a = std::fabs(input[i]);
+                maxAbs = a > maxAbs ? a : maxAbs;
+            }
+            const FLOAT inScale = maxAbs > 0.0f ? maxAbs / ActMax : 1.0f;
+            const FLOAT toInt = 1.0f / inScale;
+            alignas(64) UBYTE q[stride];
+            for (int i=0; i<inputSize; ++i)
+            {
+                // |input/inScale| <= ActMax by construction, round half away from zero:
+                const FLOAT v = input[i] * toInt;
+                q[i] = static_cast<UBYTE>(static_cast<int>(v + (v < 0.0f ? -0.5f : 0.5f)) + ActOffset);
+            }
+            for (int i=inputSize; i<rowLen; ++i)
+                q[i] = ActOffset;
+            FLOAT *row = &acts[layer*columns];
+            for (int dst = 0; dst < columns; ++dst)
+            {
+                const SDWORD acc = kernels->dotU8S8(q, weights[layer][dst], rowLen) - rowOffset[layer][dst];
+                row[dst] = (acc-0.f) * inScale * rowScale[dst] + biases[(layer*columns) + dst];
+            }
+            kernels->activate(Act, row, columns);
+        }
+
+    public:
+        explicit FeedForward8(const Master& trained)
+        {
+            for (int dst=0; dst<columns; ++dst)
+            {
+                FLOAT maxAbs = 0.0f;
+                for (int src=0; src<columns; ++src)
+                    maxAbs = std::fmax(maxAbs, std::fabs(trained.weightAt(dst, src)));
+                rowScale[dst] = maxAbs > 0.0f ? maxAbs / 127.0f : 1.0f;
+            }
+            for (int layer=0; layer<nLayers; ++layer)
+            {
+                const int inputSize = layer == 0 ? InputSize : columns;
+                for (int dst=0; dst<columns; ++dst)
+                {
+                    SDWORD rowSum = 0;
+                    for (int src=0; src<stride; ++src)
+                    {
+                        SBYTE w = 0;
+                        if (src < inputSize && trained.isConnected(layer, dst, src))
+                            w = static_cast<SBYTE>(std::lround(trained.weightAt(dst, src) / rowScale[dst]));
+                        weights[layer][dst][src] = w;
+                        rowSum += w;
+                    }
+                    rowOffset[layer][dst] = ActOffset * rowSum;
+                }
+            }
+            for (int i=0; i<columns * Max_layers; ++i)
+                biases[i] = trained.biases[i];
+        }
+
+        void setKernels(const NeuralKernels& k) { kernels = &k; }
+
+        void prepare() {} // Never changes after quantization
+
+        static constexpr int activationSize = columns * Max_layers;
+
+        FLOAT *evaluate(const FLOAT *inputs, FLOAT *scratch) const
+        {
+            forward<Activation::relu>(0, inputs, InputSize, inputStride, scratch);
+            for (int i=1; i<nLayers-1; ++i)
+                forward<Activation::relu>(i, &scratch[(i-1)*columns], columns, stride, scratch);
+            forward<Activation::tanh>(nLayers-1, &scratch[(nLayers-2)*columns], columns, stride, scratch);
+            return &scratch[(nLayers-1)*columns];
+        }
+
+        FLOAT *evaluate(const FLOAT *inputs) { return evaluate(inputs, activations); }
+    };
+
+
+/****************************************/
+/*                            Evaluator */
+/* Per-thread activations for a network */
+/* that is shared read-only, e.g. one   */
+/* model for all players/search threads */
+/* Call net.prepare() after changing    */
+/* the network, before evaluating it    */
+/****************************************/
+    template <typename Net>
+    class Evaluator
+    {
+    private:
+        const Net *net;
+        FLOAT activations[Net::activationSize];
+    public:
+        explicit Evaluator(const Net& network) : net(&network) {}
+
+        FLOAT *evaluate(const FLOAT *inputs) { return net->evaluate(inputs, activations); }
+
+        void setNetwork(const Net& network) { net = &network; }
+
+        const Net& network() const { return *net; }
+    };
+
+
+/****************************************/
+/*                Incremental evaluator */
+/* An Evaluator that keeps the first    */
+/* layer (Accumulator) of the previous  */
+/* position. evaluate(inputs) compares  */
+/* the inputs with the previous ones    */
+/* and only applies the differences,    */
+/* consecutive mcts leaves are mostly   */
+/* close relatives. Games that know     */
+/* what their move changed can report   */
+/* it via update() instead, or relative */
+/* to a base position (mcts: the root)  */
+/* via evaluateFromBase()               */
+/* Call invalidate() after the network  */
+/* changed (training, load())           */
+/****************************************/
+    template <typename Net>
+    class IncrementalEvaluator
+    {
+    private:
+        static constexpr int MaxDeltas = Net::inputSize / 4; // More changes: cheaper to start over
+        static constexpr int RefreshInterval = 256; // Updates in a row, bounds the rounding drift
+        const Net *net;
+        typename Net::Accumulator accumulator;
+        typename Net::Accumulator baseAccumulator; // See setBase()
+        FLOAT lastInputs[Net::inputSize];
+        FLOAT baseInputs[Net::inputSize];
+        FLOAT activations[Net::activationSize];
+        int updatesLeft = 0; // Until the next refresh
+        bool valid = false;  // 'accumulator' and 'lastInputs' belong together
+    public:
+        explicit IncrementalEvaluator(const Net& network) : net(&network) {}
+
+        FLOAT *evaluate(const FLOAT *inputs)
+        {
+            NetworkInputDelta deltas[MaxDeltas];
+            int n = 0;
+            bool incremental = valid && updatesLeft > 0;
+            for (int i=0; incremental && i<Net::inputSize; ++i)
+            {
+                if (inputs[i] == lastInputs[i])
+                    continue;
+                if (n == MaxDeltas)
+                {
+                    incremental = false;
+                    break;
+                }
+                deltas[n++] = { i, inputs[i] - lastInputs[i] };
+            }
+            if (incremental)
+            {
+                net->update(accumulator, deltas, n);
+                updatesLeft -= 1;
+            }
+            else
+            {
+                net->refresh(accumulator, inputs);
+                updatesLeft = RefreshInterval;
+                valid = true;
+            }
+            for (int i=0; i<Net::inputSize; ++i)
+                lastInputs[i] = inputs[i];
+            return net->evaluate(accumulator, activations);
+        }
+
+        // Changes reported by the game since the last evaluation, then
+        // evaluate() without inputs. Only after a first evaluate(inputs):
+        void update(const NetworkInputDelta *deltas, const int n)
+        {
+            assert(valid && "evaluate(inputs) first");
+            net->update(accumulator, deltas, n);
+            for (int d=0; d<n; ++d)
+                lastInputs[deltas[d].input] += deltas[d].change;
+            updatesLeft -= 1;
+        }
+
+        FLOAT *evaluate() { return net->evaluate(accumulator, activations); }
+
+        // The position evaluateFromBase() starts from, e.g. the root of a
+        // search. Its first layer is computed in full here, set it again
+        // after the network changed:
+        void setBase(const FLOAT *inputs)
+        {
+            net->refresh(baseAccumulator, inputs);
+            for (int i=0; i<Net::inputSize; ++i)
+                baseInputs[i] = inputs[i];
+        }
+
+        // The base position changed by 'deltas' (all changes since the
+        // base, not since the last evaluation). Starts over from the base
+        // each time, so there is no drift and other evaluations in between
+        // do not matter:
+        FLOAT *evaluateFromBase(const NetworkInputDelta *deltas, const int n)
+        {
+            accumulator = baseAccumulator;
+            net->update(accumulator, deltas, n);
+            for (int i=0; i<Net::inputSize; ++i)
+                lastInputs[i] = baseInputs[i];
+            for (int d=0; d<n; ++d)
+                lastInputs[deltas[d].input] += deltas[d].change;
+            updatesLeft = RefreshInterval;
+            valid = true;
+            return net->evaluate(accumulator, activations);
+        }
+
+        void invalidate() { valid = false; }
+
+        void setNetwork(const Net& network)
+        {
+            net = &network;
+            valid = false;
+        }
+
+        const Net& network() const { return *net; }
+    };
+
+
+/****************************************/
+/*                     Inference server */
+/* Search threads that each evaluate    */
+/* one leaf run the network at batch    */
+/* size 1. Here they hand their inputs  */
+/* to one server thread and park: it    */
+/* waits for up to batchSize requests   */
+/* (at most timeoutMicros after it saw  */
+/* the first one), evaluates them all   */
+/* with one evaluateBatch() and wakes   */
+/* their threads. An InferenceClient is */
+/* the per-thread side, used like an    */
+/* Evaluator                            */
+/****************************************/
+    template <typename Net, int MaxBatch = 32>
+    class InferenceServer
+    {
+    public:
+        // One in flight per client, it also holds the result:
+        struct Request
+        {
+            const FLOAT *inputs = nullptr;
+            FLOAT *scratch = nullptr; // Net::activationSize
+            FLOAT *result = nullptr;
+            Request *next = nullptr;
+            bool done = true;
+            std::condition_variable answered; // Signalled with the server's mutex held
+        };
+        static constexpr int activationSize = Net::activationSize;
+    private:
+        const Net *net;
+        const int batchSize;     // 1..MaxBatch
+        const int timeoutMicros; // The longest a request waits for others
+        std::mutex mutex;
+        std::condition_variable queued;
+        Request *head = nullptr, *tail = nullptr;
+        int nQueued = 0;
+        bool running = false, stopping = false;
+        std::thread thread;
+        UQWORD batches = 0, served = 0;
+    private:
+        void run(Request *const *batch, const int n) const
+        {
+            const FLOAT *inputs[MaxBatch];
+            FLOAT *scratch[MaxBatch];
+            for (int i=0; i<n; ++i)
+            {
+                inputs[i] = batch[i]->inputs;
+                scratch[i] = batch[i]->scratch;
+            }
+            if constexpr (requires { net->evaluateBatch(inputs, scratch, n); })
+                net->evaluateBatch(inputs, scratch, n);
+            else
+                for (int i=0; i<n; ++i)
+                    net->evaluate(inputs[i], scratch[i]);
+        }
+
+        void loop()
+        {
+            Request *batch[MaxBatch];
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                queued.wait(lock, [&] { return stopping || head; });
+                if (!head)
+                    return; // Stopping, and all answered
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutMicros);
+                queued.wait_until(lock, deadline, [&] { return stopping || nQueued >= batchSize; });
+                int n = 0;
+                for (; head && n < batchSize; head = head->next)
+                    batch[n++] = head;
+                if (!head)
+                    tail = nullptr;
+                nQueued -= n;
+
+                lock.unlock();
+                run(batch, n);
+                lock.lock();
+                for (int i=0; i<n; ++i)
+                {
+                    batch[i]->result = &batch[i]->scratch[Net::activationSize - Net::columns]; // As evaluate() returns
+                    batch[i]->done = true;
+                    batch[i]->answered.notify_one();
+                }
+                batches += 1;
+                served += n;
+            }
+        }
+    public:
+        // 'network' prepared, and unchanged while the server runs. Batches
+        // of up to 'maxRequests' (at most MaxBatch):
+        explicit InferenceServer(const Net& network, const int maxRequests = MaxBatch, const int timeout = 200)
+          : net(&network), batchSize(maxRequests < 1 ? 1 : maxRequests < MaxBatch ? maxRequests : MaxBatch), timeoutMicros(timeout)
+        {}
+        ~InferenceServer() { stop(); }
+        InferenceServer(const InferenceServer&) = delete;
+        InferenceServer& operator=(const InferenceServer&) = delete;
+
+        void start()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (running)
+                return;
+            running = true;
+            stopping = false;
+            thread = std::thread([this] { loop(); });
+        }
+
+        // Answers what is queued, then joins the thread:
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            queued.notify_one();
+            if (thread.joinable())
+                thread.join();
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+
+        // Queues 'request' and returns at once. While the server is not
+        // running it is evaluated right here instead:
+        void submit(Request& request, const FLOAT *inputs, FLOAT *scratch)
+        {
+            assert(request.done && "one request at a time");
+            request.inputs = inputs;
+            request.scratch = scratch;
+            request.next = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (running && !stopping)
+                {
+                    request.done = false;
+                    (tail ? tail->next : head) = &request;
+                    tail = &request;
+                    nQueued += 1;
+                    if (nQueued == 1 || nQueued >= batchSize)
+                        queued.notify_one();
+                    return;
+                }
+            }
+            request.result = net->evaluate(inputs, scratch);
+        }
+
+        bool ready(const Request& request)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return request.done;
+        }
+
+        // Parks until the server answered 'request', returns the result:
+        FLOAT *wait(Request& request)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            request.answered.wait(lock, [&] { return request.done; });
+            return request.result;
+        }
+
+        const Net& network() const { return *net; }
+
+        // Mean batch size = requestsServed() / batchesRun():
+        UQWORD batchesRun()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return batches;
+        }
+        UQWORD requestsServed()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return served;
+        }
+    };
+
+    template <typename Server>
+    class InferenceClient
+    {
+    private:
+        Server *server;
+        typename Server::Request request;
+        FLOAT activations[Server::activationSize];
+    public:
+        explicit InferenceClient(Server& s) : server(&s) {}
+        ~InferenceClient() { server->wait(request); }
+        InferenceClient(const InferenceClient&) = delete;
+        InferenceClient& operator=(const InferenceClient&) = delete;
+
+        // Blocks until the server evaluated it:
+        FLOAT *evaluate(const FLOAT *inputs)
+        {
+            server->submit(request, inputs, activations);
+            return server->wait(request);
+        }
+
+        // Or do other work in between; 'inputs' must stay valid until
+        // result() returns:
+        void submit(const FLOAT *inputs) { server->submit(request, inputs, activations); }
+        bool ready() { return server->ready(request); }
+        FLOAT *result() { return server->wait(request); }
+    };
+
+
+/****************************************/
+/*                              Trainer */
+/* Mini-batch training of FeedForward32 */
+/* The batch is split over the threads  */
+/* of a WorkerPool, each one sums the   */
+/* gradients of its samples into its    */
+/* own buffer (no sharing, no locks).   */
+/* Then every thread reduces a slice of */
+/* the parameters over all the buffers  */
+/* and takes the optimiser step for it  */
+/* The Trainer holds the optimiser      */
+/* state, keep one per network. Large,  */
+/* allocate it like the network itself  */
+/****************************************/
+    enum class Optimiser { sgd, momentum, adam };
+
+    template <typename Net, int MaxThreads = 8>
+    class Trainer
+    {
+    private:
+        static constexpr int nBiases = Net::columns * Net::nLayers;
+        static constexpr int SliceAlign = 16; // Floats per cache line
+        struct alignas(64) Gradients
+        {
+            std::unique_ptr<FLOAT[]> params; // Weights, then biases
+            FLOAT activations[Net::activationSize];
+            FLOAT squaredErrors;
+        };
+        Net *net;
+        // The weights follow the stored tiles of the network, see reset():
+        int nWeights = 0;
+        int nParams = 0;
+        UQWORD layout[Net::blocks][Net::occupiedWords] = {};
+        Gradients grads[MaxThreads];
+        std::unique_ptr<FLOAT[]> moment1; // Momentum, or Adam's mean
+        std::unique_ptr<FLOAT[]> moment2; // Adam's uncentered variance
+        UQWORD steps = 0;
+    private:
+        void step(const int begin, const int end, const int nThreads, const FLOAT scale)
+        {
+            // Adam bias correction folded into the step size:
+            const FLOAT t = static_cast<FLOAT>(steps);
+            const FLOAT adamRate = learningRate * std::sqrt(1.0f - std::pow(beta2, t)) / (1.0f - std::pow(beta1, t));
+            for (int i = begin; i < end; ++i)
+            {
+                FLOAT g = grads[0].params[i];
+                for (int w = 1; w < nThreads; ++w)
+                    g += grads[w].params[i];
+                g *= scale; // Mean over the batch
+                FLOAT& param = i < nWeights ? net->weights[i] : net->biases[i - nWeights];
+                switch (optimiser)
+                {
+                case Optimiser::sgd:
+                    param += learningRate * g;
+                    break;
+                case Optimiser::momentum:
+                    moment1[i] = beta1 * moment1[i] + g;
+                    param += learningRate * moment1[i];
+                    break;
+                case Optimiser::adam:
+                    moment1[i] = beta1 * moment1[i] + (1.0f - beta1) * g;
+                    moment2[i] = beta2 * moment2[i] + (1.0f - beta2) * g * g;
+                    param += adamRate * moment1[i] / (std::sqrt(moment2[i]) + epsilon);
+                    break;
+                }
+            }
+        }
+
+    public:
+        Optimiser optimiser = Optimiser::adam;
+        FLOAT learningRate = 0.001f;
+        FLOAT beta1 = 0.9f;    // Momentum / Adam first moment decay
+        FLOAT beta2 = 0.999f;  // Adam second moment decay
+        FLOAT epsilon = 1e-8f;
+
+        explicit Trainer(Net& network) : net(&network)
+        {
+            reset();
+        }
+
+        // Forget the optimiser state. trainBatch() does this by itself when
+        // the topology changed which tiles have weights:
+        void reset()
+        {
+            if (net->topologyDirty)
+                net->compileTopology();
+            nWeights = net->rowStart[Net::blocks] * Net::TileWeights;
+            nParams = nWeights + nBiases;
+            for (int rb=0; rb<Net::blocks; ++rb)
+                for (int k=0; k<Net::occupiedWords; ++k)
+                    layout[rb][k] = net->stored[rb][k];
+            for (Gradients& g : grads)
+                g.params = std::make_unique_for_overwrite<FLOAT[]>(nParams);
+            moment1 = std::make_unique<FLOAT[]>(nParams);
+            moment2 = std::make_unique<FLOAT[]>(nParams);
+            steps = 0;
+        }
+
+        // One optimiser step on the mean gradient of 'n' samples, using up
+        // to MaxThreads threads of 'pool'. Returns the mean squared error
+        // of the batch (before the step)
+        FLOAT trainBatch(const FLOAT *const *inputs, const FLOAT *const *targets, const int n, WorkerPool& pool)
+        {
+            assert(n > 0);
+            if (net->topologyDirty)
+                net->compileTopology();
+            bool sameLayout = true;
+            for (int rb=0; rb<Net::blocks; ++rb)
+                for (int k=0; k<Net::occupiedWords; ++k)
+                    sameLayout = sameLayout && layout[rb][k] == net->stored[rb][k];
+            if (!sameLayout)
+                reset();
+            const int nThreads = pool.size() < MaxThreads ? pool.size() : MaxThreads;
+            ++steps;
+
+            auto accumulate = [&](const int workerIdx)
+            {
+                if (workerIdx >= nThreads)
+                    return;
+                Gradients& g = grads[workerIdx];
+                for (int i=0; i<nParams; ++i)
+                    g.params[i] = 0.0f;
+                g.squaredErrors = 0.0f;
+                const int first = n * workerIdx / nThreads;
+                const int last  = n * (workerIdx+1) / nThreads;
+                for (int s = first; s < last; ++s)
+                    g.squaredErrors += net->gradient(inputs[s], targets[s], g.activations, g.params.get(), &g.params[nWeights]);
+            };
+            pool.run(accumulate);
+
+            auto reduce = [&](const int workerIdx)
+            {
+                if (workerIdx >= nThreads)
+                    return;
+                const int slices = (nParams + SliceAlign - 1) / SliceAlign;
+                const int begin = slices * workerIdx / nThreads * SliceAlign;
+                const int end   = workerIdx == nThreads-1 ? nParams : slices * (workerIdx+1) / nThreads * SliceAlign;
+                step(begin, end, nThreads, 1.0f / n);
+            };
+            pool.run(reduce);
+            net->columnsDirty = true;
+
+            FLOAT squaredErrors = 0.0f;
+            for (int w=0; w<nThreads; ++w)
+                squaredErrors += grads[w].squaredErrors;
+            return squaredErrors / (n * Net::outputSize);
+        }
+    };
+
+
+/****************************************/
+/*                        Replay buffer */
+/* The last 'Capacity' training samples */
+/* (ring, the oldest are overwritten).  */
+/* Any number of threads push, trainers */
+/* copy out random mini-batches         */
+/****************************************/
+    template <int InputSize, int OutputSize, int Capacity>
+    class ReplayBuffer
+    {
+    private:
+        FLOAT inputs[Capacity][InputSize];
+        FLOAT targets[Capacity][OutputSize];
+        UQWORD pushed = 0;
+        bool closed = false;
+        mutable std::mutex mutex;
+        std::condition_variable grown;
+    public:
+        static constexpr int inputSize = InputSize;
+        static constexpr int outputSize = OutputSize;
+        static constexpr int capacity = Capacity;
+
+        void push(const FLOAT *sampleInputs, const FLOAT *sampleTargets)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                const int slot = static_cast<int>(pushed % Capacity);
+                for (int i=0; i<InputSize; ++i)
+                    inputs[slot][i] = sampleInputs[i];
+                for (int i=0; i<OutputSize; ++i)
+                    targets[slot][i] = sampleTargets[i];
+                pushed += 1;
+            }
+            grown.notify_all();
+        }
+
+        int size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return pushed < Capacity ? static_cast<int>(pushed) : Capacity;
+        }
+
+        UQWORD totalPushed() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return pushed;
+        }
+
+        // Blocks until 'n' samples were pushed in all (see totalPushed()) or
+        // close() was called. False if closed:
+        bool waitFor(const UQWORD n)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            grown.wait(lock, [&] { return closed || pushed >= n; });
+            return !closed;
+        }
+
+        // Wakes up and fails all waitFor() until open() again:
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+            }
+            grown.notify_all();
+        }
+
+        void open()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = false;
+        }
+
+        // Copies 'n' samples drawn uniformly (with replacement) into the
+        // caller's arrays, 'rng.nextInt(max)' is uniform in [0,max) like
+        // Xoroshiro128Plus::nextInt. Returns the number copied, 0 while empty
+        template <typename Rng>
+        int sample(Rng& rng, const int n, FLOAT (*batchInputs)[InputSize], FLOAT (*batchTargets)[OutputSize]) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const UQWORD available = pushed < Capacity ? pushed : Capacity;
+            if (available == 0)
+                return 0;
+            for (int s=0; s<n; ++s)
+            {
+                const UDWORD slot = rng.nextInt(static_cast<UDWORD>(available));
+                for (int i=0; i<InputSize; ++i)
+                    batchInputs[s][i] = inputs[slot][i];
+                for (int i=0; i<OutputSize; ++i)
+                    batchTargets[s][i] = targets[slot][i];
+            }
+            return n;
+        }
+    };
+
+
+/****************************************/
+/*                       Model exchange */
+/* The trainer publishes a copy of its  */
+/* network, players pick up the newest  */
+/* one with an atomic pointer load and  */
+/* hold it (reader count) until done.   */
+/* publish() writes into a slot that is */
+/* neither current nor held, then swaps */
+/* the pointer. With Slots = players+2  */
+/* there always is such a slot          */
+/****************************************/
+    template <typename Net, int Slots = 3>
+    class ModelExchange
+    {
+        static_assert(Slots >= 2);
+    private:
+        struct Slot
+        {
+            Net net;
+            std::atomic<int> readers{0};
+            template <typename Rng>
+            explicit Slot(Rng& rng) : net(rng, false) {}
+        };
+        Slot slots[Slots];
+        std::atomic<Slot *> current;
+        std::atomic<UQWORD> published{0};
+    private:
+        template <typename Rng, std::size_t... I>
+        ModelExchange(const Net& initial, Rng& rng, std::index_sequence<I...>)
+          : slots{ Slot(((void)I, rng))... }
+        {
+            slots[0].net.copyFrom(initial);
+            current.store(&slots[0]);
+        }
+    public:
+        // 'rng' only to construct the slots, they are overwritten with 'initial':
+        template <typename Rng>
+        ModelExchange(const Net& initial, Rng& rng)
+          : ModelExchange(initial, rng, std::make_index_sequence<Slots>{})
+        {}
+
+        // The newest network, valid until release()
+        const Net& acquire()
+        {
+            for (;;)
+            {
+                Slot *slot = current.load();
+                slot->readers.fetch_add(1);
+                if (slot == current.load())
+                    return slot->net;
+                slot->readers.fetch_sub(1); // Swapped in between, try the new one
+            }
+        }
+
+        void release(const Net& net)
+        {
+            for (Slot& slot : slots)
+                if (&slot.net == &net)
+                    slot.readers.fetch_sub(1);
+        }
 
-            // 1. Calculate hidden width to determine weight scaling
-                  const int hiddenSizex = (columns-(InputSize+OutputSize)) / (nLayers-1);
+        // Copies 'trained' (prepared) into a free slot and makes it current.
+        // False if every slot is current or held:
+        bool publish(const Net& trained)
+        {
+            Slot *const active = current.load();
+            for (Slot& slot : slots)
+            {
+                if (&slot == active || slot.readers.load() != 0)
+                    continue;
+                slot.net.copyFrom(trained);
+                current.store(&slot);
+                published.fetch_add(1);
+                return true;
+            }
+            return false;
+        }
 
-                  // 2. He/Xavier Initialization: scale weights down so massive summations
-                  // don't blow out the Tanh Output derivative into 0.0!
-                  const FLOAT weight_scale = std::sqrt(2.0f / (FLOAT)(columns));
+        // Bumped by every publish(), to see cheaply whether to acquire() again:
+        UQWORD version() const { return published.load(); }
+    };
 
-                  for (int i = 0; i < columns * columns; ++i)
-                      weights[i] = (2.0f * u64_to_float(rng()) - 1.0f) * weight_scale;
 
-                  // 3. Initialize biases slightly positive to ensure ReLUs aren't born "dead"
-                  for (int i = 0; i < columns * Max_layers; ++i)
-                      biases[i] = 0.01f;
+/****************************************/
+/*                   Background trainer */
+/* The consumer side of self-play: one  */
+/* thread that draws mini-batches from  */
+/* a ReplayBuffer, takes Trainer steps  */
+/* (on the threads of its own pool) and */
+/* publishes the network every few      */
+/* steps. Producers (threads playing    */
+/* mcts games, see selfPlayGame() in    */
+/* ai.hpp) only push to the buffer and  */
+/* acquire() from the exchange          */
+/****************************************/
+    template <typename Net, typename Buffer, typename Exchange, int Batch = 64, int MaxThreads = 8>
+    class BackgroundTrainer
+    {
+        static_assert(Buffer::inputSize == Net::inputSize && Buffer::outputSize == Net::outputSize);
+    public:
+        // Fixed at construction, the thread reads them:
+        struct Schedule
+        {
+            int minSamples = 4 * Batch;  // Before the first step
+            int newSamples = Batch / 4;  // Pushed since the previous step, before the next one
+            int publishEvery = 16;       // Steps
+        };
+    private:
+        Net *net;
+        Buffer *buffer;
+        Exchange *exchange;
+        Trainer<Net, MaxThreads> trainer;
+        WorkerPool pool;
+        const Schedule schedule; // Each at least 1 (newSamples at least 0)
+        std::thread thread;
+        std::atomic<bool> stopping{false};
+        std::atomic<UQWORD> steps{0};
+        std::atomic<FLOAT> lastMse{0.0f};
+        FLOAT batchInputs[Batch][Net::inputSize];
+        FLOAT batchTargets[Batch][Net::outputSize];
+        // splitmix64 (Xoroshiro128Plus lives in ai.hpp, which includes this file)
+        struct SampleRng
+        {
+            UQWORD state = 0x9e3779b97f4a7c15ull;
+
+            UQWORD operator()()
+            {
+                UQWORD z = (state += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                return z ^ (z >> 31);
+            }
+
+            // Lemire's multiply-shift, see Xoroshiro128Plus::nextInt:
+            UDWORD nextInt(const UDWORD max)
+            {
+                UQWORD m = (operator()() >> 32) * max;
+                if (static_cast<UDWORD>(m) < max)
+                {
+                    const UDWORD threshold = static_cast<UDWORD>(-max) % max;
+                    while (static_cast<UDWORD>(m) < threshold)
+                        m = (operator()() >> 32) * max;
+                }
+                return static_cast<UDWORD>(m >> 32);
+            }
+        } sampleRng;
+
+        void loop()
+        {
+            const FLOAT *inputPtrs[Batch], *targetPtrs[Batch];
+            for (int s=0; s<Batch; ++s)
+            {
+                inputPtrs[s] = batchInputs[s];
+                targetPtrs[s] = batchTargets[s];
+            }
+            // Every step waits for newSamples pushes since the previous one,
+            // so it does not keep training on the same samples when the
+            // producers are slow:
+            UQWORD wanted = static_cast<UQWORD>(schedule.minSamples);
+            while (!stopping.load() && buffer->waitFor(wanted))
+            {
+                wanted = buffer->totalPushed() + static_cast<UQWORD>(schedule.newSamples);
+                if (buffer->sample(sampleRng, Batch, batchInputs, batchTargets) == 0)
+                    continue;
+                lastMse.store(trainer.trainBatch(inputPtrs, targetPtrs, Batch, pool));
+                const UQWORD done = steps.fetch_add(1) + 1;
+                if (done % static_cast<UQWORD>(schedule.publishEvery) == 0)
+                    exchange->publish(*net);
+            }
+        }
+
+        static Schedule validated(const Schedule& s)
+        {
+            Schedule v = s;
+            v.minSamples = s.minSamples < 1 ? 1 : s.minSamples;
+            v.newSamples = s.newSamples < 0 ? 0 : s.newSamples;
+            v.publishEvery = s.publishEvery < 1 ? 1 : s.publishEvery;
+            return v;
+        }
+    public:
+        // 'network' is the trainer's own copy, 'threads' for the gradients:
+        BackgroundTrainer(Net& network, Buffer& replay, Exchange& models, const int threads = 0, const Schedule& when = Schedule{})
+          : net(&network), buffer(&replay), exchange(&models), trainer(network), pool(threads), schedule(validated(when))
+        {}
+
+        ~BackgroundTrainer() { stop(); }
+
+        Trainer<Net, MaxThreads>& settings() { return trainer; } // Optimiser, learning rate, ...
+
+        void start()
+        {
+            stopping.store(false);
+            buffer->open();
+            thread = std::thread([this] { loop(); });
+        }
+
+        // Wakes the thread (closes the buffer for waiting) and joins it:
+        void stop()
+        {
+            stopping.store(true);
+            buffer->close();
+            if (thread.joinable())
+                thread.join();
+        }
+
+        UQWORD stepsDone() const { return steps.load(); }
+        FLOAT meanSquaredError() const { return lastMse.load(); }
+    };
+
+
+/****************************************/
+/*              "Neural Network" 🙄🙄🙄 */
+/****************************************/
+  // Of course not... 🙄 It trains, so FP32. FeedForward16/FeedForward8
+  // are made from it for inference
+  template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
+  using Neural = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
+
+
+
+
+
+
+
+//extern "C" int is_prime(int n);
+
+
+/****************************************/
+/*                      Kernels, scalar */
+/* Reference for all the others         */
+/****************************************/
+    static FLOAT dotScalar(const FLOAT *a, const FLOAT *b, const int n)
+    {
+        FLOAT sum = 0.0f;
+        for (int i=0; i<n; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    static FLOAT maskedDotScalar(const FLOAT *a, const FLOAT *b, const FLOAT *mask, const int n)
+    {
+        FLOAT sum = 0.0f;
+        for (int i=0; i<n; ++i)
+            sum += a[i] * b[i] * mask[i];
+        return sum;
+    }
+
+    static void axpyScalar(FLOAT *y, const FLOAT *x, const FLOAT alpha, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            y[i] += alpha * x[i];
+    }
+
+    template <typename Weight, FLOAT (*Convert)(Weight)>
+    static void tileRowGeneric(FLOAT *y, const Weight *w, const UQWORD *stored, const FLOAT *x,
+                               const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        FLOAT acc[8] = {0.0f};
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const Weight *wb = &w[storedTileRank(stored, b) * 64];
+                for (UQWORD m = tiles[b]; m; m &= m - 1)
+                {
+                    const int bit = std::countr_zero(m);
+                    acc[bit >> 3] += x[b*8 + (bit & 7)] * Convert(wb[bit]);
+                }
+            }
+        for (int r=0; r<8; ++r)
+            y[r] = acc[r];
+    }
+
+    static FLOAT asFloat(const FLOAT w) { return w; }
+
+    static void tileRowScalar(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                              const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        tileRowGeneric<FLOAT, asFloat>(y, w, stored, x, tiles, occupied, nWords);
+    }
+
+    static void tileRowHalfScalar(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x,
+                                  const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        tileRowGeneric<UWORD, floatFromHalf>(y, w, stored, x, tiles, occupied, nWords);
+    }
+
+    static void tileBackwardScalar(FLOAT *err, FLOAT *grad, const FLOAT *w, const UQWORD *stored, const FLOAT *x, const FLOAT *delta,
+                                   const FLOAT scale, const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        UQWORD live = 0; // The rows with a delta
+        for (int r=0; r<8; ++r)
+            live |= delta[r] != 0.0f ? UQWORD(0xff) << (r*8) : 0;
+        for (int k=0; live && k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const int at = storedTileRank(stored, b) * 64;
+                for (UQWORD m = tiles[b] & live; m; m &= m - 1)
+                {
+                    const int bit = std::countr_zero(m);
+                    const int r = bit >> 3;
+                    const int i = b*8 + (bit & 7);
+                    if (err)
+                        err[i] += delta[r] * w[at + bit];
+                    grad[at + bit] += delta[r] * scale * x[i];
+                }
+            }
+    }
+
+    static SDWORD dotU8S8Scalar(const UBYTE *x, const SBYTE *w, const int n)
+    {
+        SDWORD sum = 0;
+        for (int i=0; i<n; ++i)
+            sum += static_cast<SDWORD>(x[i]) * w[i];
+        return sum;
+    }
+
+    static void reluRowScalar(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            x[i] = fastRelu(x[i]);
+    }
+
+    static void tanhRowScalar(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            x[i] = fastTanh(x[i]);
+    }
+
+    static void sigmoidRowScalar(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            x[i] = fastSigmoid(x[i]);
+    }
+
+    static void expRowScalar(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            x[i] = fastExp(x[i]);
+    }
+
+    const NeuralKernels& scalarKernels()
+    {
+        static const NeuralKernels kernels = { "scalar", dotScalar, maskedDotScalar, axpyScalar,
+                                               tileRowScalar, tileRowHalfScalar, tileBackwardScalar, dotU8S8Scalar,
+                                               reluRowScalar, tanhRowScalar, sigmoidRowScalar, expRowScalar };
+        return kernels;
+    }
+
+
+#if defined(__x86_64__) || defined(__i386__)
+/****************************************/
+/*                    Kernels, x86 avx2 */
+/* Compiled for avx2+fma regardless of  */
+/* the -m flags, only ever called after */
+/* the cpuid check below                */
+/****************************************/
+    __attribute__((target("avx2,fma"))) static FLOAT hsum256(const __m256 v)
+    {
+        __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+        lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+        return _mm_cvtss_f32(lo);
+    }
+
+    __attribute__((target("avx2,fma"))) static FLOAT dotAvx2(const FLOAT *a, const FLOAT *b, const int n)
+    {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i+16<=n; i+=16)
+        {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i]),   _mm256_loadu_ps(&b[i]),   sum0);
+            sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i+8]), _mm256_loadu_ps(&b[i+8]), sum1);
+        }
+        for (; i+8<=n; i+=8)
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]), sum0);
+        FLOAT sum = hsum256(_mm256_add_ps(sum0, sum1));
+        for (; i<n; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    __attribute__((target("avx2,fma"))) static FLOAT maskedDotAvx2(const FLOAT *a, const FLOAT *b, const FLOAT *mask, const int n)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        int i = 0;
+        for (; i+8<=n; i+=8)
+        {
+            const __m256 ab = _mm256_mul_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]));
+            sum = _mm256_fmadd_ps(ab, _mm256_loadu_ps(&mask[i]), sum);
+        }
+        FLOAT result = hsum256(sum);
+        for (; i<n; ++i)
+            result += a[i] * b[i] * mask[i];
+        return result;
+    }
+
+    __attribute__((target("avx2,fma"))) static void axpyAvx2(FLOAT *y, const FLOAT *x, const FLOAT alpha, const int n)
+    {
+        const __m256 va = _mm256_set1_ps(alpha);
+        int i = 0;
+        for (; i+8<=n; i+=8)
+            _mm256_storeu_ps(&y[i], _mm256_fmadd_ps(va, _mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&y[i])));
+        for (; i<n; ++i)
+            y[i] += alpha * x[i];
+    }
+
+    // Lane c all ones if bit r*8+c of the tile is set, for the masked loads.
+    // A stored tile has all 64 weights, the mask picks the edges of the
+    // layer (the others belong to other layers or are unused):
+    __attribute__((target("avx2,fma"))) static __m256i tileRowMask(const UQWORD tile, const int r)
+    {
+        const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        const __m256i row = _mm256_set1_epi32(static_cast<int>((tile >> (r*8)) & 0xff));
+        return _mm256_cmpeq_epi32(_mm256_and_si256(row, bits), bits);
+    }
+
+    // Lane r = the sum of acc[r]:
+    __attribute__((target("avx2,fma"))) static __m256 hsum256x8(const __m256 *acc)
+    {
+        const __m256 s01 = _mm256_hadd_ps(acc[0], acc[1]);
+        const __m256 s23 = _mm256_hadd_ps(acc[2], acc[3]);
+        const __m256 s45 = _mm256_hadd_ps(acc[4], acc[5]);
+        const __m256 s67 = _mm256_hadd_ps(acc[6], acc[7]);
+        const __m256 s0123 = _mm256_hadd_ps(s01, s23); // Low half rows 0-3 of lanes 0-3, high half of lanes 4-7
+        const __m256 s4567 = _mm256_hadd_ps(s45, s67);
+        return _mm256_add_ps(_mm256_permute2f128_ps(s0123, s4567, 0x20), _mm256_permute2f128_ps(s0123, s4567, 0x31));
+    }
+
+    __attribute__((target("avx2,fma"))) static void tileRowAvx2(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                                                                const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        __m256 acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = _mm256_setzero_ps();
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const FLOAT *wb = &w[storedTileRank(stored, b) * 64];
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                for (int r=0; r<8; ++r)
+                    acc[r] = _mm256_fmadd_ps(_mm256_maskload_ps(&wb[r*8], tileRowMask(tiles[b], r)), vx, acc[r]);
+            }
+        _mm256_storeu_ps(y, hsum256x8(acc));
+    }
+
+    // Every cpu with avx2 also has f16c (checked anyway). No masked 16 bit
+    // loads: the empty rows are skipped, the others loaded whole and masked
+    __attribute__((target("avx2,fma,f16c"))) static void tileRowHalfF16c(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x,
+                                                                         const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        __m256 acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = _mm256_setzero_ps();
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const UWORD *wb = &w[storedTileRank(stored, b) * 64];
+                const UQWORD tile = tiles[b];
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                for (int r=0; r<8; ++r)
+                {
+                    if (((tile >> (r*8)) & 0xff) == 0)
+                        continue;
+                    const __m256 vw = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&wb[r*8])));
+                    acc[r] = _mm256_fmadd_ps(_mm256_and_ps(vw, _mm256_castsi256_ps(tileRowMask(tile, r))), vx, acc[r]);
+                }
+            }
+        _mm256_storeu_ps(y, hsum256x8(acc));
+    }
+
+    __attribute__((target("avx2,fma"))) static void tileBackwardAvx2(FLOAT *err, FLOAT *grad, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                                                                     const FLOAT *delta, const FLOAT scale,
+                                                                     const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        UQWORD live = 0; // The rows with a delta
+        for (int r=0; r<8; ++r)
+            live |= delta[r] != 0.0f ? UQWORD(0xff) << (r*8) : 0;
+        for (int k=0; live && k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const int at = storedTileRank(stored, b) * 64;
+                const UQWORD tile = tiles[b] & live;
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                __m256 verr = _mm256_setzero_ps();
+                for (int r=0; r<8; ++r)
+                {
+                    if (((tile >> (r*8)) & 0xff) == 0)
+                        continue;
+                    const __m256i mask = tileRowMask(tile, r);
+                    verr = _mm256_fmadd_ps(_mm256_maskload_ps(&w[at + r*8], mask), _mm256_set1_ps(delta[r]), verr);
+                    const __m256 g = _mm256_maskload_ps(&grad[at + r*8], mask);
+                    _mm256_maskstore_ps(&grad[at + r*8], mask, _mm256_fmadd_ps(_mm256_set1_ps(delta[r] * scale), vx, g));
+                }
+                if (err)
+                    _mm256_store_ps(&err[b*8], _mm256_add_ps(_mm256_load_ps(&err[b*8]), verr));
+            }
+    }
+
+    __attribute__((target("avx2"))) static SDWORD dotU8S8Avx2(const UBYTE *x, const SBYTE *w, const int n)
+    {
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i sum = _mm256_setzero_si256();
+        for (int i=0; i<n; i+=32)
+        {
+            const __m256i vx = _mm256_load_si256(reinterpret_cast<const __m256i *>(&x[i]));
+            const __m256i vw = _mm256_load_si256(reinterpret_cast<const __m256i *>(&w[i]));
+            const __m256i pairs = _mm256_maddubs_epi16(vx, vw);            // u8*s8, pairwise -> s16
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pairs, ones)); // s16 pairs -> s32
+        }
+        __m128i r = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        r = _mm_add_epi32(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(1, 0, 3, 2)));
+        r = _mm_add_epi32(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(r);
+    }
+
+    // Same polynomials as fastTanh/fastExp, eight lanes at a time:
+    __attribute__((target("avx2,fma"))) static __m256 tanh256(__m256 x)
+    {
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-TanhClamp)), _mm256_set1_ps(TanhClamp));
+        const __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 p = _mm256_set1_ps(TanhP[0]);
+        for (int k=1; k<7; ++k)
+            p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(TanhP[k]));
+        __m256 q = _mm256_set1_ps(TanhQ[0]);
+        for (int k=1; k<4; ++k)
+            q = _mm256_fmadd_ps(q, x2, _mm256_set1_ps(TanhQ[k]));
+        return _mm256_div_ps(_mm256_mul_ps(x, p), q);
+    }
+
+    __attribute__((target("avx2,fma"))) static __m256 exp256(__m256 x)
+    {
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(ExpMin)), _mm256_set1_ps(ExpMax));
+        const __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(Log2e), _mm256_set1_ps(0.5f)));
+        x = _mm256_fnmadd_ps(n, _mm256_set1_ps(Ln2Hi), x);
+        x = _mm256_fnmadd_ps(n, _mm256_set1_ps(Ln2Lo), x);
+        __m256 y = _mm256_set1_ps(ExpP[0]);
+        for (int k=1; k<6; ++k)
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(ExpP[k]));
+        y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, _mm256_set1_ps(1.0f)));
+        const __m256i scale = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(y, _mm256_castsi256_ps(scale));
+    }
+
+    __attribute__((target("avx2,fma"))) static void reluRowAvx2(FLOAT *x, const int n)
+    {
+        const __m256 slope = _mm256_set1_ps(ReluSlope);
+        int i = 0;
+        for (; i+8<=n; i+=8)
+        {
+            const __m256 v = _mm256_loadu_ps(&x[i]);
+            _mm256_storeu_ps(&x[i], _mm256_max_ps(v, _mm256_mul_ps(v, slope)));
+        }
+        reluRowScalar(&x[i], n-i);
+    }
+
+    __attribute__((target("avx2,fma"))) static void tanhRowAvx2(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+8<=n; i+=8)
+            _mm256_storeu_ps(&x[i], tanh256(_mm256_loadu_ps(&x[i])));
+        tanhRowScalar(&x[i], n-i);
+    }
+
+    __attribute__((target("avx2,fma"))) static void sigmoidRowAvx2(FLOAT *x, const int n)
+    {
+        const __m256 half = _mm256_set1_ps(0.5f);
+        int i = 0;
+        for (; i+8<=n; i+=8)
+            _mm256_storeu_ps(&x[i], _mm256_fmadd_ps(half, tanh256(_mm256_mul_ps(half, _mm256_loadu_ps(&x[i]))), half));
+        sigmoidRowScalar(&x[i], n-i);
+    }
+
+    __attribute__((target("avx2,fma"))) static void expRowAvx2(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+8<=n; i+=8)
+            _mm256_storeu_ps(&x[i], exp256(_mm256_loadu_ps(&x[i])));
+        expRowScalar(&x[i], n-i);
+    }
+
+
+/****************************************/
+/*                 Kernels, x86 avx-512 */
+/****************************************/
+    // gcc 12's own gather/reduce intrinsics trip -Wuninitialized:
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wuninitialized"
+    #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    __attribute__((target("avx512f"))) static FLOAT dotAvx512(const FLOAT *a, const FLOAT *b, const int n)
+    {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        int i = 0;
+        for (; i+32<=n; i+=32)
+        {
+            sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(&a[i]),    _mm512_loadu_ps(&b[i]),    sum0);
+            sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(&a[i+16]), _mm512_loadu_ps(&b[i+16]), sum1);
+        }
+        sum0 = _mm512_add_ps(sum0, sum1);
+        if (i+16 <= n)
+        {
+            sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(&a[i]), _mm512_loadu_ps(&b[i]), sum0);
+            i += 16;
+        }
+        const __mmask16 tail = static_cast<__mmask16>((1u << (n-i)) - 1);
+        sum0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, &a[i]), _mm512_maskz_loadu_ps(tail, &b[i]), sum0);
+        return _mm512_reduce_add_ps(sum0);
+    }
+
+    __attribute__((target("avx512f"))) static FLOAT maskedDotAvx512(const FLOAT *a, const FLOAT *b, const FLOAT *mask, const int n)
+    {
+        __m512 sum = _mm512_setzero_ps();
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            const __m512 ab = _mm512_mul_ps(_mm512_maskz_loadu_ps(m, &a[i]), _mm512_maskz_loadu_ps(m, &b[i]));
+            sum = _mm512_fmadd_ps(ab, _mm512_maskz_loadu_ps(m, &mask[i]), sum);
+        }
+        return _mm512_reduce_add_ps(sum);
+    }
+
+    __attribute__((target("avx512f"))) static void axpyAvx512(FLOAT *y, const FLOAT *x, const FLOAT alpha, const int n)
+    {
+        const __m512 va = _mm512_set1_ps(alpha);
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            const __m512 r = _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, &x[i]), _mm512_maskz_loadu_ps(m, &y[i]));
+            _mm512_mask_storeu_ps(&y[i], m, r);
+        }
+    }
+
+    // With avx512vl the mask of a tile row is just its byte of the tile:
+    __attribute__((target("avx512f,avx512vl,fma"))) static void tileRowAvx512(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                                                                              const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        __m256 acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = _mm256_setzero_ps();
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const FLOAT *wb = &w[storedTileRank(stored, b) * 64];
+                const UQWORD tile = tiles[b];
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                for (int r=0; r<8; ++r)
+                    acc[r] = _mm256_fmadd_ps(_mm256_maskz_loadu_ps(static_cast<__mmask8>(tile >> (r*8)), &wb[r*8]), vx, acc[r]);
+            }
+        _mm256_storeu_ps(y, hsum256x8(acc));
+    }
+
+    __attribute__((target("avx512f,avx512vl,avx512bw,fma,f16c"))) static void tileRowHalfAvx512(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x,
+                                                                                                const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        __m256 acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = _mm256_setzero_ps();
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const UWORD *wb = &w[storedTileRank(stored, b) * 64];
+                const UQWORD tile = tiles[b];
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                for (int r=0; r<8; ++r)
+                {
+                    const __m128i half = _mm_maskz_loadu_epi16(static_cast<__mmask8>(tile >> (r*8)), &wb[r*8]);
+                    acc[r] = _mm256_fmadd_ps(_mm256_cvtph_ps(half), vx, acc[r]);
+                }
+            }
+        _mm256_storeu_ps(y, hsum256x8(acc));
+    }
+
+    __attribute__((target("avx512f,avx512vl,fma"))) static void tileBackwardAvx512(FLOAT *err, FLOAT *grad, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                                                                                   const FLOAT *delta, const FLOAT scale,
+                                                                                   const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        UQWORD live = 0; // The rows with a delta
+        for (int r=0; r<8; ++r)
+            live |= delta[r] != 0.0f ? UQWORD(0xff) << (r*8) : 0;
+        for (int k=0; live && k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const int at = storedTileRank(stored, b) * 64;
+                const UQWORD tile = tiles[b] & live;
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                __m256 verr = _mm256_setzero_ps();
+                for (int r=0; r<8; ++r)
+                {
+                    const __mmask8 mask = static_cast<__mmask8>(tile >> (r*8));
+                    if (mask == 0)
+                        continue;
+                    verr = _mm256_fmadd_ps(_mm256_maskz_loadu_ps(mask, &w[at + r*8]), _mm256_set1_ps(delta[r]), verr);
+                    const __m256 g = _mm256_maskz_loadu_ps(mask, &grad[at + r*8]);
+                    _mm256_mask_storeu_ps(&grad[at + r*8], mask, _mm256_fmadd_ps(_mm256_set1_ps(delta[r] * scale), vx, g));
+                }
+                if (err)
+                    _mm256_store_ps(&err[b*8], _mm256_add_ps(_mm256_load_ps(&err[b*8]), verr));
+            }
+    }
+
+    // vpdpbusd: u8*s8, four products at a time straight into s32
+    __attribute__((target("avx512f,avx512bw,avx512vnni"))) static SDWORD dotU8S8Vnni(const UBYTE *x, const SBYTE *w, const int n)
+    {
+        __m512i sum = _mm512_setzero_si512();
+        for (int i=0; i<n; i+=64)
+        {
+            const __m512i vx = _mm512_load_si512(&x[i]);
+            const __m512i vw = _mm512_load_si512(&w[i]);
+            sum = _mm512_dpbusd_epi32(sum, vx, vw);
+        }
+        return _mm512_reduce_add_epi32(sum);
+    }
+
+    __attribute__((target("avx512f"))) static __m512 tanh512(__m512 x)
+    {
+        x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-TanhClamp)), _mm512_set1_ps(TanhClamp));
+        const __m512 x2 = _mm512_mul_ps(x, x);
+        __m512 p = _mm512_set1_ps(TanhP[0]);
+        for (int k=1; k<7; ++k)
+            p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(TanhP[k]));
+        __m512 q = _mm512_set1_ps(TanhQ[0]);
+        for (int k=1; k<4; ++k)
+            q = _mm512_fmadd_ps(q, x2, _mm512_set1_ps(TanhQ[k]));
+        return _mm512_div_ps(_mm512_mul_ps(x, p), q);
+    }
+
+    __attribute__((target("avx512f"))) static __m512 exp512(__m512 x)
+    {
+        x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(ExpMin)), _mm512_set1_ps(ExpMax));
+        const __m512 n = _mm512_roundscale_ps(_mm512_fmadd_ps(x, _mm512_set1_ps(Log2e), _mm512_set1_ps(0.5f)),
+                                              _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        x = _mm512_fnmadd_ps(n, _mm512_set1_ps(Ln2Hi), x);
+        x = _mm512_fnmadd_ps(n, _mm512_set1_ps(Ln2Lo), x);
+        __m512 y = _mm512_set1_ps(ExpP[0]);
+        for (int k=1; k<6; ++k)
+            y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(ExpP[k]));
+        y = _mm512_fmadd_ps(y, _mm512_mul_ps(x, x), _mm512_add_ps(x, _mm512_set1_ps(1.0f)));
+        return _mm512_scalef_ps(y, n); // y * 2^n
+    }
+
+    // The tails run masked instead of falling back to scalar:
+    __attribute__((target("avx512f"))) static void reluRowAvx512(FLOAT *x, const int n)
+    {
+        const __m512 slope = _mm512_set1_ps(ReluSlope);
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            const __m512 v = _mm512_maskz_loadu_ps(m, &x[i]);
+            _mm512_mask_storeu_ps(&x[i], m, _mm512_max_ps(v, _mm512_mul_ps(v, slope)));
+        }
+    }
+
+    __attribute__((target("avx512f"))) static void tanhRowAvx512(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            _mm512_mask_storeu_ps(&x[i], m, tanh512(_mm512_maskz_loadu_ps(m, &x[i])));
+        }
+    }
+
+    __attribute__((target("avx512f"))) static void sigmoidRowAvx512(FLOAT *x, const int n)
+    {
+        const __m512 half = _mm512_set1_ps(0.5f);
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            const __m512 v = _mm512_maskz_loadu_ps(m, &x[i]);
+            _mm512_mask_storeu_ps(&x[i], m, _mm512_fmadd_ps(half, tanh512(_mm512_mul_ps(half, v)), half));
+        }
+    }
+
+    __attribute__((target("avx512f"))) static void expRowAvx512(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            _mm512_mask_storeu_ps(&x[i], m, exp512(_mm512_maskz_loadu_ps(m, &x[i])));
+        }
+    }
+    #pragma GCC diagnostic pop
+#endif // __x86_64__ || __i386__
 
 
+#if defined(__aarch64__)
+/****************************************/
+/*                  Kernels, arm64 simd */
+/* Always present on arm64, no check    */
+/* needed. No masked loads, the tile    */
+/* rows are loaded whole and masked     */
+/****************************************/
+    static FLOAT dotArm64(const FLOAT *a, const FLOAT *b, const int n)
+    {
+        float32x4_t sum0 = vdupq_n_f32(0.0f);
+        float32x4_t sum1 = vdupq_n_f32(0.0f);
+        int i = 0;
+        for (; i+8<=n; i+=8)
+        {
+            sum0 = vfmaq_f32(sum0, vld1q_f32(&a[i]),   vld1q_f32(&b[i]));
+            sum1 = vfmaq_f32(sum1, vld1q_f32(&a[i+4]), vld1q_f32(&b[i+4]));
+        }
+        FLOAT sum = vaddvq_f32(vaddq_f32(sum0, sum1));
+        for (; i<n; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    static FLOAT maskedDotArm64(const FLOAT *a, const FLOAT *b, const FLOAT *mask, const int n)
+    {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            sum = vfmaq_f32(sum, vmulq_f32(vld1q_f32(&a[i]), vld1q_f32(&b[i])), vld1q_f32(&mask[i]));
+        FLOAT result = vaddvq_f32(sum);
+        for (; i<n; ++i)
+            result += a[i] * b[i] * mask[i];
+        return result;
+    }
 
+    static void axpyArm64(FLOAT *y, const FLOAT *x, const FLOAT alpha, const int n)
+    {
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            vst1q_f32(&y[i], vfmaq_n_f32(vld1q_f32(&y[i]), vld1q_f32(&x[i]), alpha));
+        for (; i<n; ++i)
+            y[i] += alpha * x[i];
+    }
 
+    static SDWORD dotU8S8Arm64(const UBYTE *x, const SBYTE *w, const int n)
+    {
+        int32x4_t sum = vdupq_n_s32(0);
+        for (int i=0; i<n; i+=16)
+        {
+            const int16x8_t vx0 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(&x[i])));
+            const int16x8_t vx1 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(&x[i+8])));
+            const int16x8_t vw0 = vmovl_s8(vld1_s8(&w[i]));
+            const int16x8_t vw1 = vmovl_s8(vld1_s8(&w[i+8]));
+            sum = vmlal_s16(sum, vget_low_s16(vx0), vget_low_s16(vw0));
+            sum = vmlal_high_s16(sum, vx0, vw0);
+            sum = vmlal_s16(sum, vget_low_s16(vx1), vget_low_s16(vw1));
+            sum = vmlal_high_s16(sum, vx1, vw1);
+        }
+        return vaddvq_s32(sum);
+    }
 
+    static float32x4_t tanhArm64(float32x4_t x)
+    {
+        x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-TanhClamp)), vdupq_n_f32(TanhClamp));
+        const float32x4_t x2 = vmulq_f32(x, x);
+        float32x4_t p = vdupq_n_f32(TanhP[0]);
+        for (int k=1; k<7; ++k)
+            p = vfmaq_f32(vdupq_n_f32(TanhP[k]), p, x2);
+        float32x4_t q = vdupq_n_f32(TanhQ[0]);
+        for (int k=1; k<4; ++k)
+            q = vfmaq_f32(vdupq_n_f32(TanhQ[k]), q, x2);
+        return vdivq_f32(vmulq_f32(x, p), q);
+    }
 
+    static float32x4_t expArm64(float32x4_t x)
+    {
+        x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(ExpMin)), vdupq_n_f32(ExpMax));
+        const float32x4_t n = vrndmq_f32(vfmaq_n_f32(vdupq_n_f32(0.5f), x, Log2e));
+        x = vfmsq_n_f32(x, n, Ln2Hi);
+        x = vfmsq_n_f32(x, n, Ln2Lo);
+        float32x4_t y = vdupq_n_f32(ExpP[0]);
+        for (int k=1; k<6; ++k)
+            y = vfmaq_f32(vdupq_n_f32(ExpP[k]), y, x);
+        y = vfmaq_f32(vaddq_f32(x, vdupq_n_f32(1.0f)), y, vmulq_f32(x, x));
+        const int32x4_t scale = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+        return vmulq_f32(y, vreinterpretq_f32_s32(scale));
+    }
 
+    static void reluRowArm64(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+4<=n; i+=4)
+        {
+            const float32x4_t v = vld1q_f32(&x[i]);
+            vst1q_f32(&x[i], vmaxq_f32(v, vmulq_n_f32(v, ReluSlope)));
+        }
+        reluRowScalar(&x[i], n-i);
+    }
 
+    static void tanhRowArm64(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            vst1q_f32(&x[i], tanhArm64(vld1q_f32(&x[i])));
+        tanhRowScalar(&x[i], n-i);
+    }
 
+    static void sigmoidRowArm64(FLOAT *x, const int n)
+    {
+        const float32x4_t half = vdupq_n_f32(0.5f);
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            vst1q_f32(&x[i], vfmaq_f32(half, half, tanhArm64(vmulq_f32(half, vld1q_f32(&x[i])))));
+        sigmoidRowScalar(&x[i], n-i);
+    }
 
-            // Initialize DAG:
-            int from = InputSize*columns;
-            const int hiddenSize = (columns-(InputSize+OutputSize)) / (nLayers-1);
-            for (int i=0; i<hiddenSize; ++i)
+    static void expRowArm64(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            vst1q_f32(&x[i], expArm64(vld1q_f32(&x[i])));
+        expRowScalar(&x[i], n-i);
+    }
+    static void tileRowArm64(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                             const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        const uint32x4_t bitsLo = {1u, 2u, 4u, 8u};
+        const uint32x4_t bitsHi = {16u, 32u, 64u, 128u};
+        float32x4_t acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = vdupq_n_f32(0.0f);
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
             {
-                for (int j=0; j<InputSize; ++j)
-                    topologies[0].set(from + j, true);
-                from += columns;
+                const int b = k*64 + std::countr_zero(blocks);
+                const FLOAT *wb = &w[storedTileRank(stored, b) * 64];
+                const UQWORD tile = tiles[b];
+                const float32x4_t x0 = vld1q_f32(&x[b*8]);
+                const float32x4_t x1 = vld1q_f32(&x[b*8 + 4]);
+                for (int r=0; r<8; ++r)
+                {
+                    const UDWORD bits = static_cast<UDWORD>((tile >> (r*8)) & 0xff);
+                    if (bits == 0)
+                        continue;
+                    const uint32x4_t row = vdupq_n_u32(bits);
+                    const uint32x4_t w0 = vandq_u32(vreinterpretq_u32_f32(vld1q_f32(&wb[r*8])), vtstq_u32(row, bitsLo));
+                    const uint32x4_t w1 = vandq_u32(vreinterpretq_u32_f32(vld1q_f32(&wb[r*8 + 4])), vtstq_u32(row, bitsHi));
+                    acc[r] = vfmaq_f32(acc[r], vreinterpretq_f32_u32(w0), x0);
+                    acc[r] = vfmaq_f32(acc[r], vreinterpretq_f32_u32(w1), x1);
+                }
             }
-            from += InputSize;
-            for (int layer=1; layer<nLayers-1; ++layer)
+        for (int r=0; r<8; ++r)
+            y[r] = vaddvq_f32(acc[r]);
+    }
+
+    static void tileRowHalfArm64(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x,
+                                 const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        // Native binary16 loads, converted by the fpu:
+        const __fp16 *row = reinterpret_cast<const __fp16 *>(w);
+        for (int r=0; r<8; ++r)
+            y[r] = 0.0f;
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
             {
-                for (int i=0; i<hiddenSize; ++i)
+                const int b = k*64 + std::countr_zero(blocks);
+                const __fp16 *wb = &row[storedTileRank(stored, b) * 64];
+                for (UQWORD m = tiles[b]; m; m &= m - 1)
                 {
-                    for (int j=0; j<hiddenSize; ++j)
-                        topologies[layer].set(from + j, true);
-                    from += columns;
+                    const int bit = std::countr_zero(m);
+                    y[bit >> 3] += x[b*8 + (bit & 7)] * static_cast<FLOAT>(wb[bit]);
                 }
-                from += hiddenSize;
             }
-            const int current_src = from % columns; // Preserve previous layer's src offset
-            from = (columns - OutputSize) * columns + current_src; // Hard-align the dst
-            for (int i=0; i<OutputSize; ++i)
+    }
+#endif // __aarch64__
+
+
+/****************************************/
+/*                    Kernels, dispatch */
+/****************************************/
+    const NeuralKernels& neuralKernels()
+    {
+        static const NeuralKernels& best = []() -> const NeuralKernels&
+        {
+        #if defined(__x86_64__) || defined(__i386__)
+            static const NeuralKernels avx512vnni = { "avx512f+vnni", dotAvx512, maskedDotAvx512, axpyAvx512,
+                                                      tileRowAvx512, tileRowHalfAvx512, tileBackwardAvx512, dotU8S8Vnni,
+                                                      reluRowAvx512, tanhRowAvx512, sigmoidRowAvx512, expRowAvx512 };
+            static const NeuralKernels avx512 = { "avx512f", dotAvx512, maskedDotAvx512, axpyAvx512,
+                                                  tileRowAvx512, tileRowHalfAvx512, tileBackwardAvx512, dotU8S8Avx2,
+                                                  reluRowAvx512, tanhRowAvx512, sigmoidRowAvx512, expRowAvx512 };
+            static const NeuralKernels avx2 = { "avx2+fma", dotAvx2, maskedDotAvx2, axpyAvx2,
+                                                tileRowAvx2, tileRowHalfF16c, tileBackwardAvx2, dotU8S8Avx2,
+                                                reluRowAvx2, tanhRowAvx2, sigmoidRowAvx2, expRowAvx2 };
+            __builtin_cpu_init();
+            const bool f16c = __builtin_cpu_supports("f16c");
+            // The tile kernels take avx512vl/bw (masked 256 bit and 16 bit loads), all but the first avx-512 cpus have them:
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512bw") && f16c)
             {
-                for (int j=0; j<hiddenSize; ++j)
-                    topologies[nLayers-1].set(from + j, true);
-                from += columns;
+                if (__builtin_cpu_supports("avx512vnni"))
+                    return avx512vnni;
+                return avx512;
             }
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && f16c)
+                return avx2;
+        #elif defined(__aarch64__)
+            static const NeuralKernels arm64 = { "arm64 simd", dotArm64, maskedDotArm64, axpyArm64,
+                                                 tileRowArm64, tileRowHalfArm64, tileBackwardScalar, dotU8S8Arm64,
+                                                 reluRowArm64, tanhRowArm64, sigmoidRowArm64, expRowArm64 };
+            return arm64;
+        #endif
+            return scalarKernels();
+        }();
+        return best;
+    }
 
-            // Randomize connections a bit:
-            for (int layer=0; randomizeTopology && layer<nLayers; ++layer)
+    bool neuralKernelsSelfTest(const NeuralKernels& kernels)
+    {
+        const NeuralKernels& ref = scalarKernels();
+        constexpr int N = 75; // Not a multiple of any vector width
+        FLOAT a[N], b[N], mask[N];
+        UDWORD state = 12345u;
+        auto next = [&state]
+        {
+            state = state * 1664525u + 1013904223u;
+            return static_cast<FLOAT>(state >> 8) / 16777216.0f - 0.5f;
+        };
+        for (int i=0; i<N; ++i)
+        {
+            a[i] = next();
+            b[i] = next();
+            mask[i] = next() > 0.0f ? 1.0f : 0.0f;
+        }
+        auto close = [](const FLOAT x, const FLOAT y) { return std::fabs(x - y) <= 1e-4f * (1.0f + std::fabs(y)); };
+        bool ok = true;
+        for (int n=0; n<=N; n+=(n<20 ? 1 : 11))
+        {
+            ok = ok && close(kernels.dot(a, b, n), ref.dot(a, b, n));
+            ok = ok && close(kernels.maskedDot(a, b, mask, n), ref.maskedDot(a, b, mask, n));
+            FLOAT y0[N], y1[N];
+            for (int i=0; i<N; ++i) { y0[i] = b[i]; y1[i] = b[i]; }
+            kernels.axpy(y0, a, 0.25f, n);
+            ref.axpy(y1, a, 0.25f, n);
+            for (int i=0; i<N; ++i)
+                ok = ok && close(y0[i], y1[i]);
+        }
+        // One row of tiles over N columns: the last tile partial, some tiles
+        // empty, in the second round the last rows too. Every tile stored,
+        // so the empty ones are skipped over in the weights:
+        constexpr int Blocks = (N+7) / 8;
+        alignas(32) FLOAT x[Blocks*8] = {0}, err0[Blocks*8], err1[Blocks*8];
+        FLOAT w[64*Blocks], grad0[64*Blocks], grad1[64*Blocks], delta[8], y0[8], y1[8];
+        UWORD wHalf[64*Blocks];
+        UQWORD tiles[Blocks], occupied[1];
+        const UQWORD stored[1] = { (UQWORD(1) << Blocks) - 1 };
+        for (int i=0; i<N; ++i)
+            x[i] = a[i];
+        for (int i=0; i<64*Blocks; ++i)
+        {
+            w[i] = next();
+            wHalf[i] = halfFromFloat(w[i]);
+        }
+        for (int round=0; round<2; ++round)
+        {
+            occupied[0] = 0;
+            for (int t=0; t<Blocks; ++t)
             {
-                for (int i=0; i<columns*columns; ++i)
-                {
-                    if (rng() % 100 < 25) // 25% chance to flip
-                    {
-                        const bool current = topologies[layer][i];
-                        topologies[layer].set(i, !current);
-                    }
-                }
+                UQWORD tile = 0;
+                for (int bit=0; bit<64; ++bit)
+                    if (t*8 + bit%8 < N && (round == 0 || bit < 40) && next() > -0.2f)
+                        tile |= UQWORD(1) << bit;
+                tiles[t] = t % 4 == 1 ? 0 : tile;
+                occupied[0] |= tiles[t] ? UQWORD(1) << t : 0;
             }
+            for (int r=0; r<8; ++r)
+                delta[r] = r % 3 == round ? 0.0f : next();
+            kernels.tileRow(y0, w, stored, x, tiles, occupied, 1);
+            ref.tileRow(y1, w, stored, x, tiles, occupied, 1);
+            for (int r=0; r<8; ++r)
+                ok = ok && close(y0[r], y1[r]);
+            kernels.tileRowHalf(y0, wHalf, stored, x, tiles, occupied, 1);
+            ref.tileRowHalf(y1, wHalf, stored, x, tiles, occupied, 1);
+            for (int r=0; r<8; ++r)
+                ok = ok && close(y0[r], y1[r]);
+            for (int i=0; i<Blocks*8; ++i)
+                err0[i] = err1[i] = x[i];
+            for (int i=0; i<64*Blocks; ++i)
+                grad0[i] = grad1[i] = b[i % N];
+            kernels.tileBackward(err0, grad0, w, stored, x, delta, 0.5f, tiles, occupied, 1);
+            ref.tileBackward(err1, grad1, w, stored, x, delta, 0.5f, tiles, occupied, 1);
+            for (int i=0; i<Blocks*8; ++i)
+                ok = ok && close(err0[i], err1[i]);
+            kernels.tileBackward(nullptr, grad0, grad0, stored, x, delta, -0.75f, tiles, occupied, 1); // In place, as train() does
+            ref.tileBackward(nullptr, grad1, grad1, stored, x, delta, -0.75f, tiles, occupied, 1);
+            for (int i=0; i<64*Blocks; ++i)
+                ok = ok && close(grad0[i], grad1[i]);
         }
-
-        FLOAT *evaluate(const FLOAT *inputs)
+        // Integer dot products must match exactly, also at the extremes:
+        alignas(64) UBYTE xq[192];
+        alignas(64) SBYTE wq[192];
+        for (int i=0; i<192; ++i)
         {
-            forward<relu>(0, inputs, InputSize);
-            for (int i=1; i<nLayers-1; ++i)
-                forward<relu>(i, &activations[(i-1)*columns], columns);
-            // todo: tahn or softmax?
-            forward<tanh>(nLayers-1, &activations[(nLayers-2)*columns], columns);
-            return &activations[(nLayers-1)*columns];
+            xq[i] = static_cast<UBYTE>(i % 3 == 0 ? 127 : (state = state * 1664525u + 1013904223u) >> 25);
+            wq[i] = static_cast<SBYTE>(i % 5 == 0 ? -127 : static_cast<int>((state = state * 1664525u + 1013904223u) >> 24) - 128);
+            if (wq[i] == -128)
+                wq[i] = -127;
         }
-
-        FLOAT evaluateBatch()
+        for (int n=0; n<=192; n+=64)
+            ok = ok && kernels.dotU8S8(xq, wq, n) == ref.dotU8S8(xq, wq, n);
+        // Activations, over the full range including the clamps. The vector
+        // versions only differ from the scalar ones by fma rounding:
+        FLOAT row[4][N], rowRef[4][N];
+        for (int i=0; i<N; ++i)
+            for (int r=0; r<4; ++r)
+                row[r][i] = rowRef[r][i] = (r == 3 ? 200.0f : 24.0f) * a[i];
+        for (int n : {N, 8, 3})
         {
-            // Not implemented yet, but the idea is to process multiple inputs in parallel using SIMD.
-            // This would require reorganizing the data layout to be more cache-friendly and SIMD-friendly.
-            return 0.0f;
+            kernels.reluRow(row[0], n);       ref.reluRow(rowRef[0], n);
+            kernels.tanhRow(row[1], n);       ref.tanhRow(rowRef[1], n);
+            kernels.sigmoidRow(row[2], n);    ref.sigmoidRow(rowRef[2], n);
+            kernels.expRow(row[3], n);        ref.expRow(rowRef[3], n);
+            for (int i=0; i<N; ++i)
+                for (int r=0; r<4; ++r)
+                    ok = ok && close(row[r][i], rowRef[r][i]);
+            for (int i=0; i<N; ++i)
+                for (int r=0; r<4; ++r)
+                    row[r][i] = rowRef[r][i] = 0.02f * b[i] * (r == 3 ? 200.0f : 24.0f);
         }
+        return ok;
+    }
 
-        FLOAT train(const FLOAT *inputs, const FLOAT *targets, FLOAT learning_rate)
-        {
-            forward<relu>(0, inputs, InputSize);
-            for (int i=1; i<nLayers-1; ++i)
-                forward<relu>(i, &activations[(i-1)*columns], columns);
-            // last layer:
-            // todo: tahn or softmax?
-            forward<tanh>(nLayers-1, &activations[(nLayers-2)*columns], columns);
 
-            // Output to last hidden (sigmoid):
-            FLOAT squared_error_sum = 0.0f;
-            FLOAT output_delta[columns] = {0.0f};
-            const int lastLayerIdx = (nLayers-1) * columns;
-            for (int j=0; j<OutputSize; ++j)
-            {
-                const int output_neuron_idx = (columns - OutputSize) + j;
-                const FLOAT output_error = targets[j] - activations[lastLayerIdx + output_neuron_idx];
-                output_delta[output_neuron_idx] = output_error * tanh_derivative(activations[lastLayerIdx + output_neuron_idx]);
-                biases[lastLayerIdx + output_neuron_idx] += output_delta[output_neuron_idx] * learning_rate;
+/****************************************/
+/*                          Model files */
+/****************************************/
+    void neuralFileLayout(NeuralFileHeader& header)
+    {
+        auto align = [](const UQWORD at) { return (at + NeuralFileHeader::SectionAlign - 1) & ~(NeuralFileHeader::SectionAlign - 1); };
+        UQWORD at = align(sizeof(NeuralFileHeader));
+        for (UDWORD i=0; i<header.nSections; ++i)
+        {
+            header.offsets[i] = at;
+            at = align(at + header.sizes[i]);
+        }
+        header.fileSize = at;
+    }
 
-                // this line has nothing to do with anything, just for the return at the end:
-                squared_error_sum += output_error * output_error;
-            }
+    bool neuralFileWrite(const char *path, NeuralFileHeader header, const NeuralSection *sections)
+    {
+        static constexpr UBYTE zeros[NeuralFileHeader::SectionAlign] = {0};
+        auto padding = [&header](const UDWORD i) // After section i
+        {
+            const UQWORD end = header.offsets[i] + header.sizes[i];
+            return (i+1 < header.nSections ? header.offsets[i+1] : header.fileSize) - end;
+        };
+        header.checksum = fnv1a(zeros, header.offsets[0] - sizeof(NeuralFileHeader));
+        for (UDWORD i=0; i<header.nSections; ++i)
+        {
+            header.checksum = fnv1a(static_cast<const UBYTE *>(sections[i].data), sections[i].size, header.checksum);
+            header.checksum = fnv1a(zeros, padding(i), header.checksum);
+        }
 
+        FILE *file = std::fopen(path, "wb");
+        if (!file)
+            return false;
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = ok && std::fwrite(zeros, 1, header.offsets[0] - sizeof(header), file) == header.offsets[0] - sizeof(header);
+        for (UDWORD i=0; ok && i<header.nSections; ++i)
+        {
+            ok = std::fwrite(sections[i].data, 1, sections[i].size, file) == sections[i].size;
+            ok = ok && std::fwrite(zeros, 1, padding(i), file) == padding(i);
+        }
+        return (std::fclose(file) == 0) && ok;
+    }
 
-            // Hidden (relu):
-            FLOAT *next_layer_deltas = output_delta;
-            FLOAT delta_buffer[columns];
-            for (int l = nLayers-1; l > 1; --l)
-            {
-                backward<relu_derivative>(l, delta_buffer, next_layer_deltas, &activations[(l-1)*columns], learning_rate);
-                next_layer_deltas = delta_buffer;
-            }
+    // Everything but the checksum:
+    static bool neuralHeaderMatches(const NeuralFileHeader& h, const NeuralFileHeader& expected)
+    {
+        bool ok = h.magic == expected.magic && h.version == expected.version && h.byteOrder == expected.byteOrder;
+        ok = ok && h.inputSize == expected.inputSize && h.outputSize == expected.outputSize;
+        ok = ok && h.layers == expected.layers && h.hiddenWidth == expected.hiddenWidth;
+        ok = ok && h.columns == expected.columns && h.nSections == expected.nSections;
+        for (int i=0; i<NeuralFileHeader::MaxSections; ++i)
+            ok = ok && h.offsets[i] == expected.offsets[i] && h.sizes[i] == expected.sizes[i];
+        return ok && h.fileSize == expected.fileSize;
+    }
 
+    bool neuralFileValid(const UBYTE *bytes, const UQWORD size, const NeuralFileHeader& expected)
+    {
+        if (size != expected.fileSize || size < sizeof(NeuralFileHeader))
+            return false;
+        NeuralFileHeader header;
+        for (UQWORD i=0; i<sizeof(header); ++i) // May be misaligned
+            reinterpret_cast<UBYTE *>(&header)[i] = bytes[i];
+        return neuralHeaderMatches(header, expected)
+            && fnv1a(bytes + sizeof(header), size - sizeof(header)) == header.checksum;
+    }
 
-            // Hidden to input (sigmoid):
-            backward<relu_derivative>(1, delta_buffer, next_layer_deltas, activations, learning_rate);
+    bool neuralFileHeaderRead(const char *path, NeuralFileHeader& header)
+    {
+        FILE *file = std::fopen(path, "rb");
+        if (!file)
+            return false;
+        const bool ok = std::fread(&header, sizeof(header), 1, file) == 1;
+        std::fclose(file);
+        return ok;
+    }
 
+    bool neuralFileRead(const char *path, const NeuralFileHeader& expected, const NeuralSection *sections)
+    {
+        FILE *file = std::fopen(path, "rb");
+        if (!file)
+            return false;
+        NeuralFileHeader header;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && neuralHeaderMatches(header, expected);
+        // First pass, checksum:
+        UQWORD hash = fnv1a(nullptr, 0);
+        UQWORD left = expected.fileSize - sizeof(header);
+        while (ok && left > 0)
+        {
+            UBYTE chunk[4096];
+            const UQWORD n = left < sizeof(chunk) ? left : sizeof(chunk);
+            ok = std::fread(chunk, 1, n, file) == n;
+            hash = fnv1a(chunk, n, hash);
+            left -= n;
+        }
+        ok = ok && hash == header.checksum && std::fgetc(file) == EOF;
+        // Second pass, the sections:
+        for (UDWORD i=0; ok && i<expected.nSections; ++i)
+        {
+            ok = std::fseek(file, static_cast<long>(expected.offsets[i]), SEEK_SET) == 0;
+            ok = ok && std::fread(sections[i].data, 1, sections[i].size, file) == sections[i].size;
+        }
+        std::fclose(file);
+        return ok;
+    }
 
-            // Update weights (hidden to input):
-            for (int hidden_idx = 0; hidden_idx < columns; ++hidden_idx)
+    bool MappedFile::open(const char *path)
+    {
+        close();
+    #if defined(__unix__) || defined(__APPLE__)
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
             {
-                const FLOAT common = delta_buffer[hidden_idx] * learning_rate;
-                for (int input_idx = 0; input_idx < InputSize; ++input_idx)
-                {
-                    const int weight_idx = hidden_idx * columns + input_idx;
-                    const auto connected = topologies[0][weight_idx];
-                    weights[weight_idx] += inputs[input_idx] * common * connected;
-                }
+                data = static_cast<UBYTE *>(p);
+                size = static_cast<UQWORD>(st.st_size);
             }
-            return squared_error_sum / OutputSize; // mean squared error
         }
-    };
-
+        ::close(fd); // The mapping stays valid
+    #else
+        (void)path;
+    #endif
+        return data != nullptr;
+    }
 
-/****************************************/
-/*           feed forward 16 (IEEE 754) */
-/****************************************/
-template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
-using FeedForward16 = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
-// FLOAT masterCopy
+    void MappedFile::close()
+    {
+    #if defined(__unix__) || defined(__APPLE__)
+        if (data)
+            munmap(data, static_cast<size_t>(size));
+    #endif
+        data = nullptr;
+        size = 0;
+    }
 
 
 /****************************************/
-/*              "Neural Network" 🙄🙄🙄 */
+/*                      Frozen networks */
 /****************************************/
-#if defined(__AVX512FP16__) || defined(__ARM_NEON) || defined(__wasm_simd128__)
-  template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
-  using Neural = FeedForward16<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
-#else
-  // Of course not... 🙄
-  template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
-  using Neural = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
-#endif
-
-
-
-
-
+    bool neuralExportFrozen(const char *path, const char *name, const NeuralFileHeader& shape,
+                            const FLOAT *weights, const UQWORD *tiles, const FLOAT *biases)
+    {
+        const int inputs = static_cast<int>(shape.inputSize), outputs = static_cast<int>(shape.outputSize);
+        const int columns = static_cast<int>(shape.columns), layers = static_cast<int>(shape.layers);
+        const int blocks = (columns+7) / 8;
+        auto connected = [&](const int layer, const int dst, const int src) // Layer 0 only reads the inputs
+        {
+            return (layer > 0 || src < inputs)
+                && (tiles[(layer*blocks + dst/8)*blocks + src/8] >> ((dst%8)*8 + src%8)) & 1;
+        };
+        // Hex floats, the weights come back bit for bit:
+        auto writeFloat = [](FILE *file, const FLOAT x) { return std::fprintf(file, "%af", static_cast<double>(x)) > 0; };
+
+        for (int i=0; i<columns * columns; ++i)
+            if (!std::isfinite(weights[i]))
+                return false;
+        for (int i=0; i<columns * layers; ++i)
+            if (!std::isfinite(biases[i]))
+                return false;
+
+        int edges = 0;
+        for (int layer=0; layer<layers; ++layer)
+            for (int dst=0; dst<columns; ++dst)
+                for (int src=0; src<columns; ++src)
+                    edges += connected(layer, dst, src);
+
+        FILE *file = std::fopen(path, "w");
+        if (!file)
+            return false;
+        bool ok = std::fprintf(file, "// FeedForward32<%d, %d, %d, %d> frozen by exportFrozen(), %d edges\n",
+                               inputs, outputs, layers, static_cast<int>(shape.hiddenWidth), edges) > 0;
+        ok = ok && std::fprintf(file, "inline constexpr FrozenNetwork<%d, %d, %d, %d, %d> %s =\n{\n    {",
+                                inputs, outputs, layers, columns, edges, name) > 0;
+        int n = 0;
+        for (int layer=0; ok && layer<layers; ++layer)
+        {
+            ok = std::fprintf(file, "%d, ", n) > 0;
+            for (int dst=0; dst<columns; ++dst)
+                for (int src=0; src<columns; ++src)
+                    n += connected(layer, dst, src);
+        }
+        ok = ok && std::fprintf(file, "%d},\n    {", n) > 0;
 
+        n = 0;
+        for (int layer=0; ok && layer<layers; ++layer)
+            for (int dst=0; ok && dst<columns; ++dst)
+                for (int src=0; ok && src<columns; ++src)
+                {
+                    if (!connected(layer, dst, src))
+                        continue;
+                    ok = std::fprintf(file, "%s{%d, %d, ", n % 4 ? " " : "\n        ", dst, src) > 0;
+                    ok = ok && writeFloat(file, weights[dst*columns + src]) && std::fputs("},", file) >= 0;
+                    ++n;
+                }
+        if (edges == 0)
+            ok = ok && std::fputs("\n        {0, 0, 0.0f},", file) >= 0; // Never read
+        ok = ok && std::fputs("\n    },\n    {", file) >= 0;
 
-//extern "C" int is_prime(int n);
+        for (int i=0; ok && i<columns * layers; ++i)
+        {
+            ok = std::fputs(i % 8 ? " " : "\n        ", file) >= 0;
+            ok = ok && writeFloat(file, biases[i]) && std::fputc(',', file) != EOF;
+        }
+        ok = ok && std::fputs("\n    }\n};\n", file) >= 0;
+        return (std::fclose(file) == 0) && ok;
+    }
 
 
 /****************************************/
@@ -1255,6 +5847,82 @@ using FeedForward16 = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWid
 /****************************************/
 /*                                Tests */
 /****************************************/
+    static_assert([]
+                  {
+                      // FNV-1a 64 reference values:
+                      constexpr UBYTE a[1] = {'a'};
+                      constexpr UBYTE foobar[6] = {'f', 'o', 'o', 'b', 'a', 'r'};
+                      bool ok = fnv1a(a, 0) == 0xcbf29ce484222325ull;
+                      ok = ok && fnv1a(a, 1) == 0xaf63dc4c8601ec8cull;
+                      ok = ok && fnv1a(foobar, 6) == 0x85944171f73967e8ull;
+                      ok = ok && fnv1a(&foobar[3], 3, fnv1a(foobar, 3)) == fnv1a(foobar, 6); // Chunks chain
+                      return ok;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      // Spot values against the exact results (Activations box):
+                      auto near = [](const FLOAT x, const FLOAT y, const FLOAT tol) { return (x > y ? x - y : y - x) <= tol; };
+                      bool ok = fastTanh(0.0f) == 0.0f && fastSigmoid(0.0f) == 0.5f && fastExp(0.0f) == 1.0f;
+                      ok = ok && near(fastTanh(0.5f), 0.46211715726f, 4e-7f) && near(fastTanh(-2.0f), -0.96402758008f, 4e-7f);
+                      ok = ok && fastTanh(40.0f) == 1.0f && fastTanh(-40.0f) == -1.0f;
+                      ok = ok && near(fastSigmoid(3.0f), 0.95257412682f, 3e-7f) && near(fastSigmoid(-30.0f), 0.0f, 3e-7f);
+                      ok = ok && near(fastExp(1.0f), 2.71828182846f, 3e-7f) && near(fastExp(-10.0f), 4.53999297625e-5f, 1e-11f);
+                      ok = ok && near(fastExp(20.0f), 485165195.4f, 64.0f) && fastExp(-200.0f) > 0.0f;
+                      ok = ok && fastRelu(2.0f) == 2.0f && fastRelu(-2.0f) == -2.0f * ReluSlope;
+                      return ok;
+                  }()
+                 );
+
+    // Inputs 0, 1 -> hidden 2, 3 -> output 4, as exportFrozen() writes it:
+    static constexpr FrozenNetwork<2, 1, 2, 5, 5> frozenTestNet =
+    {
+        {0, 3, 5},
+        {
+            {2, 0, 0.5f}, {2, 1, -1.0f}, {3, 1, 2.0f},
+            {4, 2, 1.5f}, {4, 3, -0.25f},
+        },
+        {
+            0.0f, 0.0f, 0.1f, -0.2f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f, 0.55f,
+        }
+    };
+
+    static_assert([]
+                  {
+                      using Frozen = FrozenEvaluator<frozenTestNet>;
+                      auto near = [](const FLOAT x, const FLOAT y) { return (x > y ? x - y : y - x) <= 1e-6f; };
+                      FLOAT scratch[Frozen::activationSize] = {};
+                      const FLOAT a[2] = {1.0f, 0.5f};
+                      const FLOAT *out = Frozen::evaluate(a, scratch);
+                      bool ok = near(scratch[2], 0.1f) && near(scratch[3], 0.8f) && scratch[4] == 0.0f;
+                      ok = ok && near(out[4], 0.46211715726f) && out[2] == 0.0f; // Every column is activated
+                      const FLOAT b[2] = {-1.0f, 0.5f}; // Hidden 2 in the leaky part
+                      out = Frozen::evaluate(b, scratch);
+                      ok = ok && near(scratch[2], -0.9f * ReluSlope) && near(out[4], 0.33625581395f);
+                      return ok;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      bool ok = halfFromFloat(1.0f) == 0x3c00 && floatFromHalf(0x3c00) == 1.0f;
+                      ok = ok && halfFromFloat(-2.0f) == 0xc000 && floatFromHalf(0xc000) == -2.0f;
+                      ok = ok && halfFromFloat(65504.0f) == 0x7bff;  // Largest finite
+                      ok = ok && halfFromFloat(65520.0f) == 0x7c00;  // Rounds to inf
+                      ok = ok && halfFromFloat(1.0f + 1.0f/2048) == 0x3c00; // Tie, rounds to even
+                      ok = ok && halfFromFloat(1.0f + 3.0f/2048) == 0x3c02; // Tie, rounds to even (up)
+                      ok = ok && halfFromFloat(5.9604644775390625e-8f) == 0x0001; // Smallest subnormal
+                      ok = ok && floatFromHalf(0x0001) == 5.9604644775390625e-8f;
+                      ok = ok && halfFromFloat(1e-9f) == 0 && halfFromFloat(-0.0f) == 0x8000;
+                      // All finite halves survive the round trip:
+                      for (UDWORD h=0; h<0x7c00; h+=7)
+                          ok = ok && halfFromFloat(floatFromHalf(static_cast<UWORD>(h))) == h;
+                      return ok;
+                  }()
+                 );
+
     static_assert([]
                   {
                       constexpr int columns = 10;
@@ -1299,17 +5967,187 @@ using FeedForward16 = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWid
 
 
 
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    // A published network is ready for the players' incremental evaluators,
+    // they only get a const network and cannot prepare() it:
+    [[maybe_unused]] static const bool publishedIncrementalChecked = []
+    {
+        struct TestRng
+        {
+            UQWORD state = 1234;
+            UDWORD operator()()
+            {
+                UQWORD z = (state += 0x9e3779b97f4a7c15ull); // splitmix64
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                return static_cast<UDWORD>((z ^ (z >> 31)) >> 32);
+            }
+        } rng;
+        using Net = FeedForward32<16, 1, 3, 16, TestRng>;
+        auto trained = std::make_unique<Net>(rng);
+        trained->prepare();
+        auto exchange = std::make_unique<ModelExchange<Net>>(*trained, rng);
+        trained->setConnection(0, 3, 5, !trained->isConnected(0, 3, 5)); // Differs from the initial one
+        trained->prepare();
+        bool ok = exchange->publish(*trained);
+        const Net& played = exchange->acquire();
+        auto full = std::make_unique<Evaluator<Net>>(played);
+        auto incremental = std::make_unique<IncrementalEvaluator<Net>>(played);
+        FLOAT inputs[16] = {0.f};
+        for (int step=0; step<40; ++step)
+        {
+            inputs[rng() % 16] = static_cast<FLOAT>(static_cast<int>(rng() % 3) - 1);
+            const FLOAT a = full->evaluate(inputs)[Net::columns-1];
+            const FLOAT b = incremental->evaluate(inputs)[Net::columns-1];
+            ok = ok && std::fabs(a - b) < 1e-5f;
+        }
+        exchange->release(played);
+        assert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
+
+
+
+
+
+
+
+
+/****************************************/
+/*                             Research */
+/****************************************/
+/*
+    https://mohitmishra786.github.io/UnderTheHood/ <- lots of nn stuff!
+    https://www.jeremyong.com/cpp/machine-learning/2020/10/23/cpp-neural-network-in-a-weekend/
+    https://www.youtube.com/watch?v=AYuyN8vvkAM (not simd...)
+    https://www.youtube.com/watch?v=KphmOJnLAdI matrix math
+
+
+*/
+
+
+
+
+/****************************************/
+/*                          Worker pool */
+/****************************************/
+    WorkerPool::WorkerPool(const int workers)
+    {
+        int n = workers > 0 ? workers : static_cast<int>(std::thread::hardware_concurrency());
+        n = n < 1 ? 1 : (n > MaxWorkers ? MaxWorkers : n);
+        nWorkers = n;
+        for (int i=1; i<nWorkers; ++i)
+            threads[i] = std::thread([this, i] { loop(i); });
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (int i=1; i<nWorkers; ++i)
+            threads[i].join();
+    }
+
+    void WorkerPool::loop(const int workerIdx)
+    {
+        unsigned long long seen = 0;
+        while (true)
+        {
+            Job fn;
+            void *ctx;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen] { return quit || generation != seen; });
+                if (quit)
+                    return;
+                seen = generation;
+                fn  = job;
+                ctx = jobCtx;
+            }
+            fn(ctx, workerIdx);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending -= 1;
+            }
+            finished.notify_one();
+        }
+    }
+
+    void WorkerPool::dispatch(const Job fn, void *ctx)
+    {
+        if (nWorkers > 1)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job = fn;
+                jobCtx = ctx;
+                pending = nWorkers - 1;
+                generation += 1;
+            }
+            wake.notify_all();
+        }
+        fn(ctx, 0); // The caller pulls its weight too
+        if (nWorkers > 1)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [this] { return pending == 0; });
+        }
+    }
+
+
+
 /****************************************/
-/*                             Research */
+/*                                Tests */
+/* Threads can't run at compile time,   */
+/* these run at start-up in builds that */
+/* define INCLUDEAI__RUNTIME_TESTS      */
 /****************************************/
-/*
-    https://mohitmishra786.github.io/UnderTheHood/ <- lots of nn stuff!
-    https://www.jeremyong.com/cpp/machine-learning/2020/10/23/cpp-neural-network-in-a-weekend/
-    https://www.youtube.com/watch?v=AYuyN8vvkAM (not simd...)
-    https://www.youtube.com/watch?v=KphmOJnLAdI matrix math
-
-
-*/
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    [[maybe_unused]] static const bool workerPoolChecked = []
+    {
+        bool ok = true;
+        {
+            // Caller only, no threads are started:
+            WorkerPool pool(1);
+            const std::thread::id caller = std::this_thread::get_id();
+            int calls = 0;
+            auto job = [&](const int workerIdx)
+            {
+                ok = ok && workerIdx == 0 && std::this_thread::get_id() == caller;
+                calls += 1;
+            };
+            pool.run(job);
+            pool.run(job);
+            ok = ok && pool.size() == 1 && calls == 2;
+        }
+        {
+            // The same threads pick up job after job, every worker exactly once per job:
+            WorkerPool pool(4);
+            int runs[WorkerPool::MaxWorkers] = {0};
+            bool sameThread[WorkerPool::MaxWorkers] = {false};
+            std::thread::id ids[WorkerPool::MaxWorkers];
+            for (int generation=1; generation<=100; ++generation)
+            {
+                auto job = [&](const int workerIdx) // Every worker only touches its own slots
+                {
+                    sameThread[workerIdx] = generation == 1 || ids[workerIdx] == std::this_thread::get_id();
+                    ids[workerIdx] = std::this_thread::get_id();
+                    runs[workerIdx] += 1;
+                };
+                pool.run(job);
+                for (int w=0; w<WorkerPool::MaxWorkers; ++w)
+                    ok = ok && runs[w] == (w < pool.size() ? generation : 0) && sameThread[w] == (w < pool.size());
+            }
+            ok = ok && pool.size() == 4;
+        }
+        assert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
 
 
 
@@ -1385,10 +6223,210 @@ using FeedForward16 = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWid
             return result;
         }
 
-        constexpr UQWORD nextInt(UQWORD max)
+        // Uniform in [0,max) without the modulo bias of rng() % max. Lemire's
+        // multiply-shift (https://arxiv.org/abs/1805.10941), the rejection
+        // loop is only entered for a fraction max/2^32 of all draws:
+        constexpr UDWORD nextInt(const UDWORD max)
+        {
+            aiAssert(max > 0);
+            UQWORD m = (operator()() >> 32) * max;
+            if (static_cast<UDWORD>(m) < max)
+            {
+                const UDWORD threshold = static_cast<UDWORD>(-max) % max;
+                while (static_cast<UDWORD>(m) < threshold)
+                    m = (operator()() >> 32) * max;
+            }
+            return static_cast<UDWORD>(m >> 32);
+        }
+
+        // Advance by 2^64 / 2^96 calls. Streams that are one jump apart never
+        // overlap in practice (http://prng.di.unimi.it/):
+        constexpr void jump()
+        {
+            constexpr UQWORD Jump[2] = { 0xbeac0467eba5facbULL, 0xd86b048b86aa9922ULL };
+            polyJump(Jump);
+        }
+
+        constexpr void long_jump()
+        {
+            constexpr UQWORD LongJump[2] = { 0x18f7c399ccebda8dULL, 0xf2deac28bef3bb07ULL };
+            polyJump(LongJump);
+        }
+
+        // Stream 'idx' of 'seed'. Use one per thread/lane for independent,
+        // reproducible sequences:
+        static constexpr Xoroshiro128Plus stream(const UQWORD seed, const int idx)
+        {
+            Xoroshiro128Plus rng(seed);
+            for (int i=0; i<idx; ++i)
+                rng.jump();
+            return rng;
+        }
+
+    private:
+        constexpr void polyJump(const UQWORD (&poly)[2])
+        {
+            UQWORD s0 = 0;
+            UQWORD s1 = 0;
+            for (int i=0; i<2; ++i)
+            {
+                for (int b=0; b<64; ++b)
+                {
+                    if (poly[i] & (1ULL << b))
+                    {
+                        s0 ^= state[0];
+                        s1 ^= state[1];
+                    }
+                    operator()();
+                }
+            }
+            state[0] = s0;
+            state[1] = s1;
+        }
+    };
+
+
+/****************************************/
+/*                 Xoroshiro128+, lanes */
+/* 'Lanes' generators side by side, in  */
+/* struct-of-arrays layout so that the  */
+/* per-lane loops below compile to SIMD */
+/* (64 bit add/xor/shift). Lane i is    */
+/* stream i of the seed                 */
+/****************************************/
+    template <int Lanes>
+    struct Xoroshiro128PlusLanes
+    {
+        UQWORD state0[Lanes];
+        UQWORD state1[Lanes];
+
+        constexpr explicit Xoroshiro128PlusLanes(const UQWORD seed)
+          : state0{}, state1{}
+        {
+            Xoroshiro128Plus rng(seed);
+            for (int lane=0; lane<Lanes; ++lane)
+            {
+                state0[lane] = rng.state[0];
+                state1[lane] = rng.state[1];
+                rng.jump();
+            }
+        }
+
+        constexpr void operator()(UQWORD (&out)[Lanes])
+        {
+            for (int lane=0; lane<Lanes; ++lane)
+            {
+                const UQWORD s0 = state0[lane];
+                UQWORD s1 = state1[lane];
+                out[lane] = s0 + s1;
+                s1 ^= s0;
+                state0[lane] = ((s0 << 55) | (s0 >> (64 - 55))) ^ s1 ^ (s1 << 14);
+                state1[lane] = (s1 << 36) | (s1 >> (64 - 36));
+            }
+        }
+
+        // One bounded draw per lane, out[i] in [0,max[i]). Same method as
+        // Xoroshiro128Plus::nextInt, the (rare) rejected lanes are redrawn
+        // one by one afterwards:
+        constexpr void nextInts(UDWORD (&out)[Lanes], const UDWORD (&max)[Lanes])
+        {
+            UQWORD raw[Lanes];
+            operator()(raw);
+            UQWORD m[Lanes];
+            for (int lane=0; lane<Lanes; ++lane)
+                m[lane] = (raw[lane] >> 32) * max[lane];
+            for (int lane=0; lane<Lanes; ++lane)
+            {
+                if (static_cast<UDWORD>(m[lane]) < max[lane])
+                {
+                    const UDWORD threshold = static_cast<UDWORD>(-max[lane]) % max[lane];
+                    while (static_cast<UDWORD>(m[lane]) < threshold)
+                        m[lane] = (nextLane(lane) >> 32) * max[lane];
+                }
+                out[lane] = static_cast<UDWORD>(m[lane] >> 32);
+            }
+        }
+
+        // Fill 'n' indices in [0,max), 'Lanes' at a time:
+        constexpr void fillIndices(UDWORD *out, const int n, const UDWORD max)
+        {
+            UDWORD maxes[Lanes];
+            for (int lane=0; lane<Lanes; ++lane)
+                maxes[lane] = max;
+            UDWORD batch[Lanes];
+            for (int i=0; i<n; i+=Lanes)
+            {
+                nextInts(batch, maxes);
+                const int cnt = (n-i) < Lanes ? (n-i) : Lanes;
+                for (int lane=0; lane<cnt; ++lane)
+                    out[i+lane] = batch[lane];
+            }
+        }
+
+    private:
+        constexpr UQWORD nextLane(const int lane)
+        {
+            Xoroshiro128Plus rng(0);
+            rng.state[0] = state0[lane];
+            rng.state[1] = state1[lane];
+            const UQWORD result = rng();
+            state0[lane] = rng.state[0];
+            state1[lane] = rng.state[1];
+            return result;
+        }
+    };
+
+
+/****************************************/
+/*                              Zobrist */
+/* Position keys for transposition      */
+/* tables and evaluation caches: one    */
+/* random key per (cell, piece) and one */
+/* for the side to move, xor-ed         */
+/* together. Placing, removing or       */
+/* moving a piece toggles one or two    */
+/* keys. The table is made at compile   */
+/* time from Xoroshiro128+ and shared   */
+/* by every Zobrist of the same shape   */
+/****************************************/
+    template <int Cells, int Pieces>
+    struct ZobristTable
+    {
+        UQWORD keys[Cells][Pieces];
+        UQWORD turn;
+
+        constexpr explicit ZobristTable(const UQWORD seed)
+          : keys{}, turn{}
+        {
+            Xoroshiro128Plus rng(seed);
+            for (int cell=0; cell<Cells; ++cell)
+                for (int piece=0; piece<Pieces; ++piece)
+                    keys[cell][piece] = rng();
+            turn = rng();
+        }
+    };
+
+    template <int Cells, int Pieces, UQWORD Seed=0x5a0b1257ull>
+    class Zobrist
+    {
+    public:
+        static constexpr ZobristTable<Cells, Pieces> table{Seed};
+    private:
+        UQWORD m_hash = 0;
+    public:
+        constexpr void toggle(const int cell, const int piece)
         {
-            return operator()() % max; // Helper to replace rng() % max
+            aiAssert(cell >= 0 && cell < Cells && piece >= 0 && piece < Pieces);
+            m_hash ^= table.keys[cell][piece];
         }
+
+        constexpr void toggleTurn() { m_hash ^= table.turn; }
+
+        constexpr void clear() { m_hash = 0; }
+
+        constexpr UQWORD value() const { return m_hash; }
+
+        constexpr bool operator==(const Zobrist&) const = default;
     };
 
 
@@ -1438,6 +6476,191 @@ using FeedForward16 = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWid
         };
 
 
+/****************************************/
+/*                           Move masks */
+/* Optional: a board whose moves are    */
+/* cell numbers can hand out its legal  */
+/* moves as a Bitvec, bit i = Move(i).  */
+/* Rollouts, the desync check during    */
+/* selection and minimax then use the   */
+/* mask as it is (select for a random   */
+/* or the i-th move, a bit test for     */
+/* membership) instead of filling a     */
+/* StorageForMoves at every step.       */
+/* Expanding a node still lists moves   */
+/****************************************/
+    template <typename T>
+    concept BitmaskGameview =
+        Gameview<T> &&
+        std::convertible_to<int, typename T::Move> &&
+        std::convertible_to<typename T::Move, int> &&
+        requires (const T cobj, const typename T::MoveMask mask)
+        {
+            {cobj.generateMoveMask()} -> std::same_as<typename T::MoveMask>;
+            {mask.popcnt()} -> std::convertible_to<int>;
+            {mask.getNthSetBit(0)} -> std::convertible_to<int>;
+            {mask.check(0)} -> std::convertible_to<bool>;
+        };
+
+    // f(move) for moves[n-1] down to moves[0] (the likely ones last, see
+    // orderMovesByPolicy()) while it returns true:
+    template <typename Storage, typename F>
+    constexpr void forEachListedMove(const Storage& moves, const int n, F&& f)
+    {
+        for (int i=n-1; i>=0; --i)
+            if (!f(moves[i]))
+                return;
+    }
+
+    // The legal moves of a position, moves[0..n) in the order of
+    // generateMovesAndGetCnt() or, for a mask, ascending bits. forEach()
+    // walks all of them (while 'f' returns true), [] is for a random pick:
+    template <Gameview Board>
+    struct LegalMoves
+    {
+        typename Board::StorageForMoves moves;
+
+        constexpr int generate(const Board& board) { return board.generateMovesAndGetCnt(moves); }
+
+        constexpr typename Board::Move operator[](const int i) const { return moves[i]; }
+
+        template <typename F>
+        constexpr void forEach(const int n, F&& f) const { forEachListedMove(moves, n, f); }
+
+        constexpr bool contains(const typename Board::Move& move, const int n) const
+        {
+            for (int i=0; i<n; ++i)
+                if (move == moves[i])
+                    return true;
+            return false;
+        }
+    };
+
+    template <BitmaskGameview Board>
+    struct LegalMoves<Board>
+    {
+        typename Board::MoveMask mask;
+
+        constexpr int generate(const Board& board)
+        {
+            mask = board.generateMoveMask();
+            return static_cast<int>(mask.popcnt());
+        }
+
+        constexpr typename Board::Move operator[](const int i) const { return static_cast<typename Board::Move>(mask.getNthSetBit(i)); }
+
+        // One pass over the words instead of a select per move:
+        template <typename F>
+        constexpr void forEach(const int, F&& f) const
+        {
+            mask.forEachSetBit([&f](const int bit) -> bool { return f(static_cast<typename Board::Move>(bit)); });
+        }
+
+        constexpr bool contains(const typename Board::Move& move, const int) const { return mask.check(static_cast<int>(move)); }
+    };
+
+/****************************************/
+/*                      Policy ordering */
+/* Optional: a board whose network has  */
+/* a policy head tells which output     */
+/* belongs to a move,                   */
+/* nn.evaluate(inputs)[1 + policyIndex] */
+/* ([0] is the value). Then the search  */
+/* tries the likely moves first: mcts   */
+/* orders new children by it and the    */
+/* first ply of minimax() with an 'nn'. */
+/* Both reuse the evaluation that also  */
+/* gives the position its value         */
+/****************************************/
+    template <typename T>
+    concept PolicyGameview =
+        Gameview<T> &&
+        requires (const T cobj)
+        {
+            {cobj.policyIndex(typename T::Move{})} -> std::convertible_to<int>;
+        };
+
+    // Of the 'n' moves from 'board', the 'keep' most likely end up in
+    // moves[0..keep), the most likely last (the move loops run from the
+    // end, expansion puts moves[keep-1] into branches[0]). 'outputs' are
+    // the network outputs for 'board':
+    template <PolicyGameview Board>
+    constexpr void orderMovesByPolicy(const Board& board, const FLOAT *outputs, typename Board::StorageForMoves& moves, const int n, const int keep)
+    {
+        FLOAT policy[sizeof(moves) / sizeof(moves[0])];
+        for (int i=0; i<n; ++i)
+        {
+            const int index = board.policyIndex(moves[i]);
+            aiAssert(index >= 0);
+            policy[i] = outputs[1 + index];
+        }
+        // Insertion sort, most likely first (n is a branching factor):
+        for (int i=1; i<n; ++i)
+        {
+            const FLOAT p = policy[i];
+            const auto move = moves[i];
+            int j = i;
+            for (; j>0 && policy[j-1] < p; --j)
+            {
+                policy[j] = policy[j-1];
+                moves[j] = moves[j-1];
+            }
+            policy[j] = p;
+            moves[j] = move;
+        }
+        for (int lo=0, hi=keep-1; lo<hi; ++lo, --hi)
+        {
+            const auto move = moves[lo];
+            moves[lo] = moves[hi];
+            moves[hi] = move;
+        }
+    }
+
+
+/****************************************/
+/*                         Input deltas */
+/* Optional: a board that knows which   */
+/* network inputs changed since it was  */
+/* cloned (randomize() included). With  */
+/* a network that evaluates relative to */
+/* a base position, e.g. an Incremental */
+/* Evaluator, mcts makes the root the   */
+/* base once and evaluates every leaf   */
+/* from what changed since the root     */
+/****************************************/
+    template <typename T>
+    concept InputDeltaGameview =
+        Gameview<T> &&
+        requires (const T cobj, NetworkInputDelta *deltas)
+        {
+            {T::MaxInputDeltas} -> std::convertible_to<int>;
+            // The changes since clone(), -1 if more than MaxInputDeltas:
+            {cobj.networkInputDeltas(deltas)} -> std::convertible_to<int>;
+        };
+
+    template <typename NN>
+    concept BaseEvaluator =
+        requires (NN& nn, const FLOAT *inputs, const NetworkInputDelta *deltas)
+        {
+            {nn.setBase(inputs)};
+            {nn.evaluateFromBase(deltas, 0)} -> std::convertible_to<const FLOAT *>;
+        };
+
+    // The network outputs for 'board', a clone of the root moved down the tree:
+    template <Gameview Board, typename NN>
+    constexpr const FLOAT *evaluateLeaf(Board& board, NN& nn)
+    {
+        if constexpr (InputDeltaGameview<Board> && BaseEvaluator<NN>)
+        {
+            NetworkInputDelta deltas[Board::MaxInputDeltas > 0 ? Board::MaxInputDeltas : 1];
+            const int n = board.networkInputDeltas(deltas);
+            if (n >= 0)
+                return nn.evaluateFromBase(deltas, n);
+        }
+        return nn.evaluate(board.getNetworkInputs());
+    }
+
+
 /****************************************/
 /*       Node (should be converted from */
 /*        an 'array of structs' into a  */
@@ -1507,29 +6730,325 @@ int shallowestTerminalDepth = 9999;
     //static_assert(sizeof(Node<SQWORD>) <= 64); todo: del this line after a-o-s -> s-o-a conversion
 
 
+/****************************************/
+/*                Size-class free lists */
+/* Sibling blocks released by           */
+/* disconnectBranch() mostly come in a  */
+/* handful of sizes (the branching      */
+/* factor shrinks by one per ply). Each */
+/* list is keyed by block length and is */
+/* threaded through the dead head Node  */
+/* of every block, so no extra memory   */
+/* is needed:                           */
+/*   head->branches        = next block */
+/*   head->createdBranches = length     */
+/*   head->activeBranches  = removed    */
+/* MaxBlockLen==0 disables the lists.   */
+/****************************************/
+    template <int MaxBlockLen, GameMove MoveType>
+    struct NodeFreeLists
+    {
+        Node<MoveType> *heads[MaxBlockLen+1] = {nullptr};
+        UQWORD hits = 0, misses = 0;
+
+        constexpr bool push(Node<MoveType> *block, const int len)
+        {
+            if constexpr (MaxBlockLen == 0)
+                return false;
+            if (len > MaxBlockLen)
+                return false;
+            block->activeBranches  = Node<MoveType>::removed;
+            block->createdBranches = len;
+            block->branches        = heads[len];
+            heads[len] = block;
+            return true;
+        }
+
+        constexpr Node<MoveType> *pop(const int len)
+        {
+            if constexpr (MaxBlockLen == 0)
+                return nullptr;
+            if (len > MaxBlockLen)
+                return nullptr; // Never listed, not a miss
+            if (heads[len] == nullptr)
+            {
+                misses += 1;
+                return nullptr;
+            }
+            Node<MoveType> *block = heads[len];
+            heads[len] = block->branches;
+            hits += 1;
+            return block;
+        }
+
+        constexpr bool empty() const
+        {
+            for (int len=1; len<=MaxBlockLen; ++len)
+                if (heads[len]) return false;
+            return true;
+        }
+
+        // Hand every listed block to 'fn(block, len)' and forget about it:
+        template <typename Fn>
+        constexpr void drain(Fn&& fn)
+        {
+            for (int len=1; len<=MaxBlockLen; ++len)
+            {
+                while (heads[len])
+                {
+                    Node<MoveType> *block = heads[len];
+                    heads[len] = block->branches;
+                    fn(block, len);
+                }
+            }
+        }
+
+        constexpr void clear()
+        {
+            for (int len=0; len<=MaxBlockLen; ++len)
+                heads[len] = nullptr;
+        }
+
+        constexpr float hitRate() const
+        {
+            const UQWORD total = hits + misses;
+            return total ? (hits-0.f) / (total-0.f) : 0.f;
+        }
+    };
+
+
+/****************************************/
+/*                      Node pool shard */
+/* One arena of the node pool with its  */
+/* own BitAlloc. The owning thread is   */
+/* the only one allocating from it,     */
+/* except when another shard runs dry   */
+/* and steals (hence the 'busy' flag,   */
+/* which is practically uncontended).   */
+/* Blocks freed by a foreign thread are */
+/* pushed onto 'returned', a lock-free  */
+/* intrusive stack the owner reclaims   */
+/* in one exchange() (no ABA possible)  */
+/****************************************/
+    template <int ShardNodes, GameMove MoveType, BitfieldIntType BitfieldType, int FreeListMaxLen>
+    struct alignas(64) NodeShard
+    {
+        BitAlloc<ShardNodes, BitfieldType> bitalloc;
+        NodeFreeLists<FreeListMaxLen, MoveType> freeLists;
+        std::atomic<Node<MoveType> *> returned = nullptr;
+        std::atomic_flag busy;
+
+        void lock()    { while (busy.test_and_set(std::memory_order_acquire)) { while (busy.test(std::memory_order_relaxed)) {} } }
+        bool tryLock() { return !busy.test_and_set(std::memory_order_acquire); }
+        void unlock()  { busy.clear(std::memory_order_release); }
+    };
+
+
 /****************************************/
 /*                           Ai context */
+/* Shards>1 partitions the node pool    */
+/* into per-thread arenas, see above    */
 /****************************************/
-    template <int NumNodes, GameMove MoveType, BitfieldIntType BitfieldType>
+    template <int NumNodes, BitfieldIntType BitfieldType, int Shards>
+    inline constexpr bool shardedPoolFits =
+        Shards == 1 || (((NumNodes/Shards)*Shards) == NumNodes && ((NumNodes/Shards) % (sizeof(BitfieldType)*CHARBITS)) == 0);
+
+    template <int NumNodes, GameMove MoveType, BitfieldIntType BitfieldType, int FreeListMaxLen=0, int Shards=1>
     struct Ai_ctx
     {
+        static_assert(Shards >= 1);
         static constexpr int numNodes = NumNodes;
-        BitAlloc<NumNodes, BitfieldType> bitalloc;
+        static constexpr int numShards = Shards;
+        static constexpr int nodesPerShard = NumNodes / Shards;
+        static_assert(shardedPoolFits<NumNodes, BitfieldType, Shards>,
+                      "Every shard must span a whole number of bitfield words");
+        NodeShard<nodesPerShard, MoveType, BitfieldType, FreeListMaxLen> shards[Shards];
         Node<MoveType> nodePool[NumNodes];
 
-        Ai_ctx() {}
-        Ai_ctx(const Ai_ctx&) = delete;
-        Ai_ctx& operator=(const Ai_ctx&) = delete;
-    };
+        Ai_ctx() {}
+        Ai_ctx(const Ai_ctx&) = delete;
+        Ai_ctx& operator=(const Ai_ctx&) = delete;
+    };
+
+
+/****************************************/
+/*                   Branch allocation  */
+/* Exact-size free list first, then the */
+/* bitmap scan. If the bitmap can only  */
+/* offer a truncated chunk, the lists   */
+/* are flushed back and the scan is     */
+/* retried once before giving up.       */
+/* With several shards the home shard   */
+/* is tried first, then the others are  */
+/* raided (work stealing).              */
+/****************************************/
+    template <typename Ctx, typename Shard>
+    inline void reclaimReturned(Ctx& ctx, Shard& shard, const int base)
+    {
+        auto *block = shard.returned.exchange(nullptr, std::memory_order_acquire);
+        while (block)
+        {
+            auto *next = block->branches; // Read before push() overwrites the link
+            const int len = block->createdBranches;
+            if (!shard.freeLists.push(block, len))
+                shard.bitalloc.free(static_cast<int>(block - ctx.nodePool) - base, len);
+            block = next;
+        }
+    }
+
+    template <typename Ctx, typename Shard>
+    constexpr auto allocateFromShard(Ctx& ctx, Shard& shard, const int shardIdx, const int desiredSize)
+    {
+        using Chunk = decltype(shard.bitalloc.largestAvailChunk(0));
+        const int base = shardIdx * Ctx::nodesPerShard;
+        if constexpr (Ctx::numShards > 1)
+            reclaimReturned(ctx, shard, base);
+
+        if (auto *block = shard.freeLists.pop(desiredSize))
+            return Chunk{ .posOfAvailChunk = static_cast<int>(block - ctx.nodePool), .length = desiredSize };
+
+        Chunk chunk = shard.bitalloc.largestAvailChunk(desiredSize);
+        if (chunk.length < desiredSize && !shard.freeLists.empty())
+        {
+            if (chunk.length > 0)
+                shard.bitalloc.free(chunk.posOfAvailChunk, chunk.length);
+            shard.freeLists.drain([&ctx, &shard, base](const auto *block, const int len)
+                                  {
+                                      shard.bitalloc.free(static_cast<int>(block - ctx.nodePool) - base, len);
+                                  });
+            chunk = shard.bitalloc.largestAvailChunk(desiredSize);
+        }
+        if (chunk.posOfAvailChunk != -1)
+            chunk.posOfAvailChunk += base;
+        return chunk;
+    }
+
+    template <typename Ctx>
+    constexpr void releaseBranches(Ctx& ctx, const int pos, const int len, const int shardIdx=0)
+    {
+        const int owner = pos / Ctx::nodesPerShard;
+        auto& shard = ctx.shards[owner];
+        if constexpr (Ctx::numShards == 1)
+        {
+            if (!shard.freeLists.push(&ctx.nodePool[pos], len))
+                shard.bitalloc.free(pos, len);
+        }
+        else if (owner == shardIdx)
+        {
+            shard.lock();
+            if (!shard.freeLists.push(&ctx.nodePool[pos], len))
+                shard.bitalloc.free(pos - owner*Ctx::nodesPerShard, len);
+            shard.unlock();
+        }
+        else
+        {
+            // Foreign block, hand it back to its owner without taking any lock:
+            using NodeType = std::remove_reference_t<decltype(ctx.nodePool[0])>;
+            NodeType *block = &ctx.nodePool[pos];
+            block->activeBranches  = NodeType::removed;
+            block->createdBranches = len;
+            auto *head = shard.returned.load(std::memory_order_relaxed);
+            do { block->branches = head; }
+            while (!shard.returned.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+        }
+    }
+
+    template <typename Ctx>
+    constexpr auto allocateBranches(Ctx& ctx, const int desiredSize, const int shardIdx=0)
+    {
+        if constexpr (Ctx::numShards == 1)
+        {
+            return allocateFromShard(ctx, ctx.shards[0], 0, desiredSize);
+        }
+        else
+        {
+            auto& home = ctx.shards[shardIdx];
+            home.lock();
+            auto chunk = allocateFromShard(ctx, home, shardIdx, desiredSize);
+            home.unlock();
+
+            // Home ran dry (or only has a truncated chunk left). Steal from the others:
+            for (int i=1; i<Ctx::numShards && chunk.length<desiredSize; ++i)
+            {
+                const int victimIdx = (shardIdx + i) % Ctx::numShards;
+                auto& victim = ctx.shards[victimIdx];
+                if (!victim.tryLock())
+                    continue; // Its owner is busy, don't wait for it
+                auto stolen = allocateFromShard(ctx, victim, victimIdx, desiredSize);
+                victim.unlock();
+                if (stolen.length > chunk.length)
+                {
+                    const auto tmp = chunk;
+                    chunk = stolen;
+                    stolen = tmp;
+                }
+                if (stolen.length > 0) // Keep the larger one, return the other
+                    releaseBranches(ctx, stolen.posOfAvailChunk, stolen.length, shardIdx);
+            }
+            return chunk;
+        }
+    }
+
+    // Start of every search. With one shard mcts() calls this itself and node 0
+    // is reserved for the root. A sharded pool is reset by the caller, once,
+    // before its threads start searching (each takes its root from its shard):
+    template <typename Ctx>
+    inline void resetNodePool(Ctx& ctx)
+    {
+        for (auto& shard : ctx.shards)
+        {
+            shard.bitalloc.clearAll();
+            shard.freeLists.clear();
+            shard.returned.store(nullptr, std::memory_order_relaxed);
+        }
+        for (auto& node : ctx.nodePool)
+        {
+            node.activeBranches = node.never_expanded;
+            node.createdBranches = 0;
+        }
+        if constexpr (Ctx::numShards == 1)
+        {
+            [[maybe_unused]] const auto root = ctx.shards[0].bitalloc.largestAvailChunk(1);
+            aiAssert(root.posOfAvailChunk == 0);
+        }
+    }
+
+    // 1 - (largest free run / all free nodes). 0 means all free nodes are in one
+    // piece. Free-listed blocks are handed back to the bitmap first, so with one
+    // shard this must only be called in between searches (shards are locked):
+    template <typename Ctx>
+    inline float poolFragmentation(Ctx& ctx)
+    {
+        int avail = 0, largestRun = 0;
+        for (int shardIdx=0; shardIdx<Ctx::numShards; ++shardIdx)
+        {
+            auto& shard = ctx.shards[shardIdx];
+            const int base = shardIdx * Ctx::nodesPerShard;
+            if constexpr (Ctx::numShards > 1)
+                shard.lock();
+            reclaimReturned(ctx, shard, base);
+            shard.freeLists.drain([&ctx, &shard, base](const auto *block, const int len)
+                                  {
+                                      shard.bitalloc.free(static_cast<int>(block - ctx.nodePool) - base, len);
+                                  });
+            avail += shard.bitalloc.countAvail();
+            largestRun = aiMax(largestRun, shard.bitalloc.largestAvailRun());
+            if constexpr (Ctx::numShards > 1)
+                shard.unlock();
+        }
+        return avail ? 1.f - (largestRun-0.f) / (avail-0.f) : 0.f;
+    }
 
 
 /****************************************/
 /*    Search tree node helper functions */
 /****************************************/
-    template <int NumNodes, GameMove MoveType, BitfieldIntType BitfieldType>
-    inline void disconnectBranch(Ai_ctx<NumNodes, MoveType, BitfieldType>& ai_ctx,
+    // Returns the number of nodes handed back to the allocator:
+    template <int NumNodes, GameMove MoveType, BitfieldIntType BitfieldType, int FreeListMaxLen, int Shards>
+    inline int disconnectBranch(Ai_ctx<NumNodes, MoveType, BitfieldType, FreeListMaxLen, Shards>& ai_ctx,
                                  Node<MoveType> *parent,
-                                 const Node<MoveType> *removeMe)
+                                 const Node<MoveType> *removeMe,
+                                 const int shardIdx = 0)
     {
         aiAssert(parent);
         aiAssert(parent->activeBranches > 0);
@@ -1546,10 +7065,12 @@ int shallowestTerminalDepth = 9999;
 
         // 'parent->parent' is correct:
         const bool branchIsChildOfRoot = parent->parent == nullptr; // Keep full set of moves for root
+        int nodesFreed = 0;
         if (removeMe->createdBranches && !branchIsChildOfRoot)
         {
             //std::printf("rem: %d \n", removeMe->createdBranches);
-            ai_ctx.bitalloc.free(removeMe->branches - ai_ctx.nodePool, removeMe->createdBranches);
+            nodesFreed = removeMe->createdBranches;
+            releaseBranches(ai_ctx, removeMe->branches - ai_ctx.nodePool, removeMe->createdBranches, shardIdx);
         }
 
         const MoveType removedMoveHere = swapDst.moveHere;
@@ -1589,6 +7110,7 @@ int shallowestTerminalDepth = 9999;
 
         parent->activeBranches -= 1;
         aiAssert(swapDst.parent == parent);
+        return nodesFreed;
     }
 
 
@@ -1610,39 +7132,150 @@ int shallowestTerminalDepth = 9999;
 /* hidden identities after moves have   */
 /* been made without breaking causality */
 /****************************************/
+    // Single random playout. Returns +1 if the player to move in
+    // 'original' wins, -1 if they lose and 0 for a draw:
+    template <Gameview Board>
+    constexpr int rollout(const Board& original, Xoroshiro128Plus& rand)
+    {
+        Board boardSim = original.clone();
+        // Start single sim, run until end:
+        auto outcome = Outcome::running;
+        do
+        {
+            LegalMoves<Board> legalMoves;
+            const int nAvailMovesForThisTurn = legalMoves.generate(boardSim);
+            if (nAvailMovesForThisTurn == 0)
+                break;
+            const int idx = rand.nextInt(nAvailMovesForThisTurn);
+            outcome = boardSim.doMove( legalMoves[idx] );
+            boardSim.switchPlayer();
+        } while (outcome==Outcome::running);
+        // Count winner/loser:
+        if (outcome == Outcome::draw)
+            return 0;
+        return boardSim.getWinner() == original.getCurrentPlayer() ? 1 : -1;
+    }
+
     template <int MaxRandSims, Gameview Board>
     constexpr float simulate(const Board& original, Xoroshiro128Plus& rand)
     {
         int simWins = 0;
         // Run simulations:
         for (int i=0; i<MaxRandSims; ++i)
+            simWins += rollout(original, rand);
+        const float winRatio = (simWins-0.f) / (MaxRandSims-0.f);
+        return winRatio; // range from [-1,1]
+    }
+
+
+#ifndef INCLUDEAI__ROLLOUT_LANES
+  #define INCLUDEAI__ROLLOUT_LANES 1
+#endif
+    constexpr int RolloutLanes = INCLUDEAI__ROLLOUT_LANES;
+
+/****************************************/
+/*         Simulator, interleaved lanes */
+/* Plays 'Lanes' playouts side by side  */
+/* in one thread, one move per lane per */
+/* step. The lanes don't depend on each */
+/* other, so the cpu can overlap their  */
+/* (mostly branchy, latency bound)      */
+/* move generation. Every lane draws    */
+/* from its own random stream           */
+/****************************************/
+    template <int MaxRandSims, int Lanes, Gameview Board>
+    constexpr float simulateInterleaved(const Board& original, Xoroshiro128Plus& rand)
+    {
+        static_assert(Lanes > 0);
+        int simWins = 0;
+        for (int done=0; done<MaxRandSims; done+=Lanes)
         {
-            Board boardSim = original.clone();
-            // Start single sim, run until end:
-            auto outcome = Outcome::running;
-            do
-            {
-                typename Board::StorageForMoves storageForMoves;
-                const int nAvailMovesForThisTurn = boardSim.generateMovesAndGetCnt(storageForMoves);
-                if (nAvailMovesForThisTurn == 0)
-                    break;
-                const int idx = rand.nextInt(nAvailMovesForThisTurn);
-                outcome = boardSim.doMove( storageForMoves[idx] );
-                boardSim.switchPlayer();
-            } while (outcome==Outcome::running);
-            // Count winner/loser:
-            if (outcome != Outcome::draw)
+            const int lanesNow = (MaxRandSims-done) < Lanes ? (MaxRandSims-done) : Lanes;
+            simWins += [&]<int... Lane>(std::integer_sequence<int, Lane...>) -> int
             {
-                const bool weWon = boardSim.getWinner() == original.getCurrentPlayer();
-                simWins += weWon;
-                simWins -= !weWon;
-            }
+                Board boards[Lanes] = { ((void)Lane, original.clone())... };
+                Xoroshiro128PlusLanes<Lanes> streams(rand());
+                Outcome outcomes[Lanes] = { ((void)Lane, Outcome::running)... };
+                bool running[Lanes] = { (Lane < lanesNow)... };
+                int nRunning = lanesNow;
+                LegalMoves<Board> legalMoves[Lanes];
+                UDWORD nAvailMoves[Lanes];
+                UDWORD idx[Lanes];
+                while (nRunning > 0)
+                {
+                    for (int lane=0; lane<Lanes; ++lane)
+                    {
+                        nAvailMoves[lane] = 0;
+                        if (running[lane])
+                            nAvailMoves[lane] = legalMoves[lane].generate(boards[lane]);
+                    }
+                    streams.nextInts(idx, nAvailMoves); // One draw for every lane at once
+                    for (int lane=0; lane<Lanes; ++lane)
+                    {
+                        if (!running[lane])
+                            continue;
+                        if (nAvailMoves[lane] != 0)
+                        {
+                            outcomes[lane] = boards[lane].doMove( legalMoves[lane][idx[lane]] );
+                            boards[lane].switchPlayer();
+                        }
+                        if (nAvailMoves[lane] == 0 || outcomes[lane] != Outcome::running)
+                        {
+                            running[lane] = false;
+                            nRunning -= 1;
+                        }
+                    }
+                }
+                int wins = 0;
+                for (int lane=0; lane<lanesNow; ++lane)
+                    if (outcomes[lane] != Outcome::draw && outcomes[lane] != Outcome::running)
+                        wins += boards[lane].getWinner() == original.getCurrentPlayer() ? 1 : -1;
+                return wins;
+            }(std::make_integer_sequence<int, Lanes>{});
         }
         const float winRatio = (simWins-0.f) / (MaxRandSims-0.f);
         return winRatio; // range from [-1,1]
     }
 
 
+/****************************************/
+/*             Simulator, leaf-parallel */
+/* Spreads the playouts of one leaf     */
+/* over a WorkerPool. Each worker gets  */
+/* its own random stream and its own    */
+/* cache line for the win count, the    */
+/* counts are summed at the end. Worth  */
+/* it when a single playout is long     */
+/* (big boards, e.g. Yavalath)          */
+/****************************************/
+    template <int MaxRandSims, Gameview Board>
+    float simulate(const Board& original, Xoroshiro128Plus& rand, WorkerPool& pool)
+    {
+        struct alignas(64) WinCount { int wins; };
+        WinCount winCounts[WorkerPool::MaxWorkers];
+        const int nWorkers = pool.size() < MaxRandSims ? pool.size() : MaxRandSims;
+        const UQWORD seed = rand();
+        auto job = [&](const int workerIdx)
+        {
+            if (workerIdx >= nWorkers)
+                return;
+            Xoroshiro128Plus stream = Xoroshiro128Plus::stream(seed, workerIdx);
+            const int begin = (MaxRandSims * workerIdx) / nWorkers;
+            const int end   = (MaxRandSims * (workerIdx+1)) / nWorkers;
+            int wins = 0;
+            for (int i=begin; i<end; ++i)
+                wins += rollout(original, stream);
+            winCounts[workerIdx].wins = wins;
+        };
+        pool.run(job);
+        int simWins = 0;
+        for (int w=0; w<nWorkers; ++w)
+            simWins += winCounts[w].wins;
+        const float winRatio = (simWins-0.f) / (MaxRandSims-0.f);
+        return winRatio; // range from [-1,1]
+    }
+
+
 /****************************************/
 /*                              Minimax */
 /* A board.clone() arriving here is     */
@@ -1672,33 +7305,28 @@ int shallowestTerminalDepth = 9999;
                 return MinimaxWin;
         }
         if (depth<=0) { return MinimaxIndeterminable; }
-        typename Board::StorageForMoves storageForMoves;
-        int nMoves = clone.generateMovesAndGetCnt(storageForMoves);
-        nMoves -= 1;
+        LegalMoves<Board> legalMoves;
+        const int nMoves = legalMoves.generate(clone);
         if (clone.getCurrentPlayer() == current.getCurrentPlayer())
         {
             SWORD bestScore = MinimaxInit;
             bool encounteredIndeterminable = false;
-            while (nMoves >= 0)
+            legalMoves.forEach(nMoves, [&](const MoveType moveHere)
             {
-                const MoveType moveHere = storageForMoves[nMoves];
                 const SWORD returnedScore = minimax(clone, moveHere, alpha, beta, depth-1);
                 if (returnedScore == MinimaxIndeterminable)
                 {
                     encounteredIndeterminable = true;
                     // We cannot use this branch for scoring (yet),
                     // but we must continue searching in case we find a Win elsewhere.
-                    nMoves -= 1;
-                    continue;
+                    return true;
                 }
                 bestScore = aiMax(bestScore, returnedScore);
                 alpha     = aiMax(alpha, bestScore);
                 if (bestScore == MinimaxWin) // Can't do better than "win"
-                    break;
-                if (beta <= alpha)
-                    break;
-                nMoves -= 1;
-            }
+                    return false;
+                return beta > alpha;
+            });
             if (encounteredIndeterminable && bestScore != MinimaxWin) // rhs: Never let indeterminable paths overwrite a proven win.
                 // hit a depth limit on one of the branches:
                 return MinimaxIndeterminable;
@@ -1711,64 +7339,137 @@ int shallowestTerminalDepth = 9999;
             // Alpha/Beta from Opponent's perspective:
             SWORD oppAlpha = -beta;
             const SWORD oppBeta  = -alpha;
-            while (nMoves >= 0)
+            legalMoves.forEach(nMoves, [&](const MoveType moveHere)
             {
-                const MoveType moveHere = storageForMoves[nMoves];
                 const SWORD returnedScore = minimax(clone, moveHere, -beta, -alpha, depth-1);
                 if (returnedScore == MinimaxIndeterminable)
                 {
                     // See above for explanation ^
                     encounteredIndeterminable = true;
-                    nMoves -= 1;
-                    continue;
+                    return true;
                 }
                 bestOpponentScore = aiMax(bestOpponentScore, returnedScore);
                 oppAlpha = aiMax(oppAlpha, returnedScore);
                 if (bestOpponentScore == MinimaxWin)
-                    break;
-                if (oppBeta <= oppAlpha)
-                    break;
-                nMoves -= 1;
-            }
+                    return false;
+                return oppBeta > oppAlpha;
+            });
             if (encounteredIndeterminable && bestOpponentScore != MinimaxWin)
                 return MinimaxIndeterminable; // see above^ for explanation
             return bestOpponentScore == MinimaxInit ? MinimaxDraw : -bestOpponentScore;
         }
     }
 
-    template <Gameview Board, GameMove MoveType>
-    inline constexpr SWORD minimax(const Board& current, const int MaxDepth)
+    // The first ply of 'clone', forEachMove(f) calls f(move) while it
+    // returns true, see LegalMoves::forEach():
+    template <Gameview Board, GameMove MoveType, typename ForEachMove>
+    inline constexpr SWORD minimaxMoves(const Board& clone, ForEachMove&& forEachMove, const int MaxDepth)
     {
-        Board clone = current.clone();
-        typename Board::StorageForMoves storageForMoves;
-        int nMoves = clone.generateMovesAndGetCnt(storageForMoves);
-        nMoves -= 1;
         SWORD best = MinimaxInit;
         bool encounteredIndeterminable = false;
-        while (nMoves >= 0)
+        forEachMove([&](const MoveType moveHere)
         {
-            const MoveType moveHere = storageForMoves[nMoves];
             const SWORD mnx = minimax(clone, moveHere, MinimaxLose, MinimaxWin, MaxDepth);
             if (mnx == MinimaxIndeterminable)
             {
                 encounteredIndeterminable = true;
-                nMoves -= 1;
-                continue;
+                return true;
             }
             if (mnx > best)
                 best = mnx;
-            if (best == MinimaxWin)
-                break;
-            nMoves -= 1;
-        }
+            return best != MinimaxWin;
+        });
         if (encounteredIndeterminable && best != MinimaxWin)
             return MinimaxIndeterminable;
         return best==MinimaxInit ? MinimaxDraw : best;
     }
 
+    template <Gameview Board, GameMove MoveType>
+    inline constexpr SWORD minimax(const Board& current, const int MaxDepth)
+    {
+        Board clone = current.clone();
+        LegalMoves<Board> legalMoves;
+        const int nMoves = legalMoves.generate(clone);
+        return minimaxMoves<Board, MoveType>(clone, [&](auto f) { legalMoves.forEach(nMoves, f); }, MaxDepth);
+    }
+
+    // Same, the first ply in the order of the policy head (a win found
+    // early ends the search). 'outputs' are the network outputs for
+    // 'current', e.g. those that gave it its value:
+    template <PolicyGameview Board, GameMove MoveType>
+    inline constexpr SWORD minimaxByPolicy(const Board& current, const int MaxDepth, const FLOAT *outputs)
+    {
+        Board clone = current.clone();
+        typename Board::StorageForMoves storageForMoves;
+        const int nMoves = clone.generateMovesAndGetCnt(storageForMoves);
+        orderMovesByPolicy(clone, outputs, storageForMoves, nMoves, nMoves);
+        return minimaxMoves<Board, MoveType>(clone, [&](auto f) { forEachListedMove(storageForMoves, nMoves, f); }, MaxDepth);
+    }
+
+    template <PolicyGameview Board, GameMove MoveType, typename NN>
+    inline constexpr SWORD minimax(const Board& current, const int MaxDepth, NN& nn)
+    {
+        Board clone = current.clone();
+        return minimaxByPolicy<Board, MoveType>(current, MaxDepth, nn.evaluate(clone.getNetworkInputs()));
+    }
+
+
+/****************************************/
+/*              Tree memory statistics  */
+/* Plain counters bumped once per       */
+/* expansion/disconnect. Define         */
+/* INCLUDEAI__NO_MEMORY_STATS to        */
+/* compile them out entirely.           */
+/****************************************/
+    struct TreeMemoryStats
+    {
+        #ifndef INCLUDEAI__NO_MEMORY_STATS
+          int inUse = 1; // root
+          int peakInUse = 1, highWaterMark = 1, truncatedExpansions = 0, nodesFreed = 0;
+
+          constexpr void expanded(const int pos, const int len, const int desired)
+          {
+              truncatedExpansions += len < desired;
+              if (pos == -1)
+                  return;
+              inUse += len;
+              peakInUse = aiMax(peakInUse, inUse);
+              highWaterMark = aiMax(highWaterMark, pos + len);
+          }
+
+          constexpr void released(const int len)
+          {
+              inUse -= len;
+              nodesFreed += len;
+          }
+
+          template <typename Result, typename Ctx>
+          void store(Result& result, Ctx& ctx) const
+          {
+              result.statistics[Result::peakNodesInUse]      = peakInUse;
+              result.statistics[Result::highWaterMark]       = highWaterMark;
+              result.statistics[Result::truncatedExpansions] = truncatedExpansions;
+              result.statistics[Result::nodesFreed]          = nodesFreed;
+              result.statistics[Result::fragmentation]       = poolFragmentation(ctx);
+          }
+        #else
+          constexpr void expanded(int, int, int) {}
+          constexpr void released(int) {}
+          template <typename Result, typename Ctx>
+          void store(Result&, Ctx&) const {}
+        #endif
+    };
+
 
 /****************************************/
 /*                               result */
+/* The memory statistics are how        */
+/* 'NumNodes' should be sized for a     */
+/* game: peak live nodes, the highest   */
+/* node position ever handed out, the   */
+/* expansions that got fewer nodes than */
+/* moves, nodes freed by pruning and    */
+/* how fragmented the pool ended up.    */
 /****************************************/
     template <GameMove MoveType>
     struct MCTS_result
@@ -1776,6 +7477,7 @@ int shallowestTerminalDepth = 9999;
         enum { simulations, minimaxes, thresholdLevel, networkEvaluated, terminalReached,
                desyncs,
                score, visits,
+               peakNodesInUse, highWaterMark, truncatedExpansions, nodesFreed, fragmentation,
                end
              };
         float statistics[end] = {0};
@@ -1810,7 +7512,7 @@ int shallowestTerminalDepth = 9999;
               typename AiCtx,
               typename NN
              >
-    constexpr MCTS_result<MoveType> mcts(const Board& boardOriginal, AiCtx& ai_ctx, NN& nn, UQWORD seed=69420) noexcept
+    constexpr MCTS_result<MoveType> mcts(const Board& boardOriginal, AiCtx& ai_ctx, NN& nn, UQWORD seed=69420, const int shardIdx=0) noexcept
     {
         [[maybe_unused]] auto UCBselectBranch =
             [](const Node<MoveType>& node) -> Node<MoveType> *
@@ -1857,9 +7559,11 @@ int shallowestTerminalDepth = 9999;
                       }
                     #endif
                 }
-                int pos = node.activeBranches - 1;
-                float best = node.branches[pos].UCBscore;
-                for (int i=pos-1; i>=0; --i)
+                // Ties go to the lower index: branches[0] is the most likely move
+                // with a policy head (disconnectBranch() moves the last into a gap)
+                int pos = 0;
+                float best = node.branches[0].UCBscore;
+                for (int i=1; i<node.activeBranches; ++i)
                 {
                     if (node.branches[i].UCBscore > best)
                     {
@@ -1895,29 +7599,42 @@ int shallowestTerminalDepth = 9999;
             };
 
 
-        Node<MoveType> *placeholder = nullptr; // Prevent gcc from deducting the wrong type... 🙄
-        Node<MoveType> *root = &insertNodeIntoPool(ai_ctx, 0, placeholder, MoveType{});
-        ai_ctx.bitalloc.clearAll();
-        [[maybe_unused]] const auto throwaway = ai_ctx.bitalloc.largestAvailChunk(1);
-        for (int i=0; i<AiCtx::numNodes; ++i)
-        {
-            ai_ctx.nodePool[i].activeBranches = -1;
-            ai_ctx.nodePool[i].createdBranches = 0;
-        }
-
         int cutoffDepth = 9999;
+        TreeMemoryStats memoryStats;
         FLOAT threshold = 1.1f; // 'threshold' above which the result of .evaluate() is used, not minimax or randroll
         SWORD rootMovesRemaining;
         MCTS_result<MoveType> mcts_result;
+
+        // Several threads can search with one sharded Ai_ctx, each passing its
+        // own shardIdx. Then the caller resets the pool before they start:
+        int rootPos = 0;
+        if constexpr (AiCtx::numShards == 1)
+            resetNodePool(ai_ctx);
+        else
+            rootPos = allocateBranches(ai_ctx, 1, shardIdx).posOfAvailChunk;
+        if (rootPos == -1) [[unlikely]]
+        {
+            mcts_result.errorOutOfMem = true;
+            return mcts_result;
+        }
+        Node<MoveType> *placeholder = nullptr; // Prevent gcc from deducting the wrong type... 🙄
+        Node<MoveType> *root = &insertNodeIntoPool(ai_ctx, rootPos, placeholder, MoveType{});
         Xoroshiro128Plus rand(seed);
+        if constexpr (InputDeltaGameview<Board> && BaseEvaluator<NN>)
+        {
+            Board rootView = boardOriginal.clone();
+            nn.setBase(rootView.getNetworkInputs()); // See evaluateLeaf()
+        }
         for (int iterations=0; root->activeBranches!=0 && iterations<MaxIterations; ++iterations)
         {
             Node<MoveType> *selectedNode = root;
             Board boardClone = boardOriginal.clone();
             boardClone.randomize(rand()); // Hidden information is simulated by creating a "plausibe" random game state
             typename Board::StorageForMoves storageForMoves;
+            LegalMoves<Board> legalMoves;
             Outcome outcome = Outcome::running;
             int depth = 1;
+            const FLOAT *leafOutputs = nullptr; // The network outputs for boardClone, if already evaluated
 
 
 
@@ -1933,17 +7650,9 @@ int shallowestTerminalDepth = 9999;
                 //aiAssert(selectedNode->branchScore == 0);
                 aiAssert(selectedNode->parent == parentOfSelected);
                 const MoveType moveHere = selectedNode->moveHere;
-                const int nMoves = boardClone.generateMovesAndGetCnt(storageForMoves);
+                const int nMoves = legalMoves.generate(boardClone);
                 // desyncs can happen due to the call to randomize()
-                bool moveIsValid = false;
-                for (int i=0; i<nMoves; ++i)
-                {
-                    if (moveHere == storageForMoves[i])
-                    {
-                        moveIsValid = true;
-                        break;
-                    }
-                }
+                const bool moveIsValid = legalMoves.contains(moveHere, nMoves);
                 if (!moveIsValid)
                 {
                     is_desynchronized = true;
@@ -1983,7 +7692,9 @@ int shallowestTerminalDepth = 9999;
             {
                 // typename Board::StorageForMoves storageForMoves; // todo: test and remove if working
                 int nValidMoves = boardClone.generateMovesAndGetCnt(storageForMoves);
-                const auto availNodes = ai_ctx.bitalloc.largestAvailChunk(nValidMoves);
+                const auto availNodes = allocateBranches(ai_ctx, nValidMoves, shardIdx);
+                memoryStats.expanded(availNodes.posOfAvailChunk, availNodes.length, nValidMoves);
+                const int nGenerated = nValidMoves;
                 nValidMoves = availNodes.length; // This line is critical!
                 int nodePos = availNodes.posOfAvailChunk;
                 if (nodePos == -1) [[unlikely]]
@@ -1992,6 +7703,13 @@ int shallowestTerminalDepth = 9999;
                     // todo: record this in the result!
                     break;
                 }
+                // branches[0] becomes the most likely, also if not all moves got a node.
+                // The same evaluation scores this node in step 4:
+                if constexpr (PolicyGameview<Board>)
+                {
+                    leafOutputs = evaluateLeaf(boardClone, nn);
+                    orderMovesByPolicy(boardClone, leafOutputs, storageForMoves, nGenerated, nValidMoves);
+                }
                 if (selectedNode == root)
                     rootMovesRemaining = nValidMoves;
 
@@ -2050,12 +7768,14 @@ int shallowestTerminalDepth = 9999;
             {
                 rootMovesRemaining -= 1;
                 selectedNode = &root->branches[rootMovesRemaining];
+                leafOutputs = nullptr; // Those were the root's
                 outcome = boardClone.doMove( selectedNode->moveHere );
                 boardClone.switchPlayer();
                 depth += 1;
             }
-            // 3b. Pick (select) a node for analysis:
-            else if (selectedNode->activeBranches > 0)
+            // 3b. Pick (select) a node for analysis. A node that was just
+            // evaluated for its policy is analysed itself:
+            else if (selectedNode->activeBranches > 0 && !leafOutputs)
             {
                 aiAssert(selectedNode->branches);
                 if constexpr (Board::MaxNetworkInputs > 0)
@@ -2115,17 +7835,26 @@ int shallowestTerminalDepth = 9999;
                   const SWORD polarity = boardClone.getWinner()!=boardOriginal.getCurrentPlayer() ? -1 : 1;
                 #endif
 
-                const FLOAT *pValues = nn.evaluate(boardClone.getNetworkInputs());
+                const FLOAT *pValues = leafOutputs ? leafOutputs : evaluateLeaf(boardClone, nn);
                 //const FLOAT *pValues = selectedNode->nnEvaluationResult;
                 const FLOAT confidence = pValues[0];
                 aiAssert(confidence<1.1f && confidence>-1.1f);
                 if (aiAbs(confidence) < threshold)
                 {
-                    const SWORD branchscore = minimax<Board, MoveType>(boardClone, MinimaxDepth);
+                    SWORD branchscore;
+                    if constexpr (PolicyGameview<Board>)
+                        branchscore = minimaxByPolicy<Board, MoveType>(boardClone, MinimaxDepth, pValues);
+                    else
+                        branchscore = minimax<Board, MoveType>(boardClone, MinimaxDepth);
                     if (branchscore == MinimaxIndeterminable) // Fallback if minimax fails
                     {
                         // Simulate to get an estimation of the quality of this position:
-                        score = simulate<SimDepth>(boardClone, rand);
+                        if constexpr (requires { ai_ctx.rolloutPool; })
+                            score = simulate<SimDepth>(boardClone, rand, ai_ctx.rolloutPool);
+                        else if constexpr (RolloutLanes > 1)
+                            score = simulateInterleaved<SimDepth, RolloutLanes>(boardClone, rand);
+                        else
+                            score = simulate<SimDepth>(boardClone, rand);
                         score *= polarity-0.f;
                         mcts_result.statistics[MCTS_result<MoveType>::simulations] += 1;
                         // worst case: no clear result. Adjust threshold:
@@ -2281,7 +8010,7 @@ int shallowestTerminalDepth = 9999;
                   //  std::printf("%d \n", parent->activeBranches);
 
 
-                    disconnectBranch(ai_ctx, parent, child);
+                    memoryStats.released(disconnectBranch(ai_ctx, parent, child, shardIdx));
                     if (parent->activeBranches != 0)
                     {
                         break; // Stop
@@ -2402,6 +8131,7 @@ int shallowestTerminalDepth = 9999;
 
             mcts_result.statistics[MCTS_result<MoveType>::score]  = bestScore;
             mcts_result.statistics[MCTS_result<MoveType>::visits] = bestVisits;
+            memoryStats.store(mcts_result, ai_ctx);
             mcts_result.best = [root, posVisits, posScore, bestScore]
                                {
                                    if (bestScore > 0.f)
@@ -2412,6 +8142,68 @@ int shallowestTerminalDepth = 9999;
 
     }
 
+
+/****************************************/
+/*                            Self-play */
+/* The producer side: plays one game of */
+/* mcts against itself and pushes every */
+/* position, labelled +1 if the player  */
+/* to move won, -1 if it lost, 0 for a  */
+/* draw, to a ReplayBuffer. Run it in   */
+/* as many threads as there are cores,  */
+/* each with its own ai_ctx and nn      */
+/* (e.g. an Evaluator on the network    */
+/* acquired from a ModelExchange). Only */
+/* the last MaxPlies positions of a     */
+/* longer game are kept                 */
+/****************************************/
+    template <int MaxIterations,
+              int SimDepth,
+              int MinimaxDepth,
+              GameMove MoveType,
+              BitfieldIntType BitfieldType,
+              int MaxPlies,
+              Gameview Board,
+              typename AiCtx,
+              typename NN,
+              typename Buffer
+             >
+    Outcome selfPlayGame(const Board& start, AiCtx& ai_ctx, NN& nn, Buffer& buffer, UQWORD seed=69420) noexcept
+    {
+        static_assert(Buffer::inputSize == Board::MaxNetworkInputs && Buffer::outputSize == 1, "a value network");
+        using Player = decltype(start.getCurrentPlayer());
+        FLOAT positions[MaxPlies][Board::MaxNetworkInputs];
+        Player toMove[MaxPlies];
+        int plies = 0;
+        Board board = start.clone();
+        Outcome outcome = Outcome::running;
+        while (outcome == Outcome::running)
+        {
+            const int slot = plies % MaxPlies;
+            const FLOAT *inputs = board.getNetworkInputs();
+            for (int i=0; i<Board::MaxNetworkInputs; ++i)
+                positions[slot][i] = inputs[i];
+            toMove[slot] = board.getCurrentPlayer();
+            plies += 1;
+
+            const MCTS_result<MoveType> res =
+                mcts<MaxIterations, SimDepth, MinimaxDepth, MoveType, BitfieldType>(board, ai_ctx, nn, seed + plies);
+            outcome = board.doMove(res.best);
+            board.switchPlayer();
+        }
+
+        const int first = plies > MaxPlies ? plies - MaxPlies : 0;
+        for (int ply=first; ply<plies; ++ply)
+        {
+            const int slot = ply % MaxPlies;
+            FLOAT target = 0.0f;
+            if (outcome == Outcome::fin)
+                target = toMove[slot] == board.getWinner() ? 1.0f : -1.0f;
+            buffer.push(positions[slot], &target);
+        }
+        return outcome;
+    }
+
     template <int MaxIterations,
               int SimDepth,
               int MinimaxDepth,
@@ -2525,6 +8317,67 @@ int shallowestTerminalDepth = 9999;
         constexpr void randomize(unsigned) {}
     };
 
+    static_assert([]
+                  {
+                      // Known answers for 2^64 and 2^96 steps ahead:
+                      Xoroshiro128Plus a(1234);
+                      a.jump();
+                      bool ok = a() == 0xd78eff46553bc9deULL;
+                      Xoroshiro128Plus b(1234);
+                      b.long_jump();
+                      ok = ok && b() == 0x96f96766f3effd28ULL;
+                      // Streams:
+                      Xoroshiro128Plus c = Xoroshiro128Plus::stream(1234, 1);
+                      ok = ok && c() == 0xd78eff46553bc9deULL;
+                      // Lanes are the streams of the seed:
+                      Xoroshiro128PlusLanes<4> lanes(1234);
+                      Xoroshiro128Plus lane0 = Xoroshiro128Plus::stream(1234, 0);
+                      Xoroshiro128Plus lane3 = Xoroshiro128Plus::stream(1234, 3);
+                      UQWORD raw[4];
+                      lanes(raw);
+                      ok = ok && raw[0] == lane0() && raw[3] == lane3();
+                      // Bounded draws:
+                      int hist[7] = {0};
+                      for (int i=0; i<700; ++i)
+                          hist[lane0.nextInt(7)] += 1;
+                      for (int i=0; i<7; ++i)
+                          ok = ok && hist[i] > 60 && hist[i] < 140;
+                      UDWORD idx[4];
+                      const UDWORD max[4] = {1, 2, 0, 1000};
+                      for (int i=0; i<100; ++i)
+                      {
+                          lanes.nextInts(idx, max);
+                          ok = ok && idx[0] == 0 && idx[1] < 2 && idx[2] == 0 && idx[3] < 1000;
+                      }
+                      UDWORD filled[10] = {0};
+                      lanes.fillIndices(filled, 9, 3);
+                      for (int i=0; i<9; ++i)
+                          ok = ok && filled[i] < 3;
+                      return ok && filled[9] == 0;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Zobrist<9, 2> a, b;
+                      bool ok = a.value() == 0 && a == b;
+                      a.toggle(4, 0);
+                      a.toggle(7, 1);
+                      a.toggleTurn();
+                      b.toggleTurn();
+                      b.toggle(7, 1);
+                      b.toggle(4, 0); // Order does not matter
+                      ok = ok && a == b && a.value() != 0;
+                      a.toggle(4, 0); // Take it back
+                      b.toggle(4, 1); // Other piece, same cell
+                      ok = ok && a != b && a.value() == (Zobrist<9, 2>::table.keys[7][1] ^ Zobrist<9, 2>::table.turn);
+                      Xoroshiro128Plus rng(0x5a0b1257ull);
+                      ok = ok && Zobrist<9, 2>::table.keys[0][0] == rng() && Zobrist<9, 2>::table.keys[0][1] == rng();
+                      b.clear();
+                      return ok && b.value() == 0;
+                  }()
+                 );
+
     static_assert([]
                   {
                       Xoroshiro128Plus rand(0x9E3779B97f4A7C15ull);
@@ -2545,6 +8398,59 @@ int shallowestTerminalDepth = 9999;
                   }()
                  );
 
+    static_assert([]
+                  {
+                      Xoroshiro128Plus rand(0x9E3779B97f4A7C15ull);
+                      TicTacTest t1;
+                      t1.pos[0]=2; t1.pos[1]=1; t1.pos[2]=2;
+                      t1.pos[3]=1; t1.pos[4]=1; t1.pos[5]=2;
+                      t1.pos[6]=0; t1.pos[7]=2; t1.pos[8]=1;
+                      t1.currentPlayer = 1;
+                      // 5 playouts over 4 lanes, the second batch is partial:
+                      float res = simulateInterleaved<5, 4>(t1, rand);
+                      bool ok = res == 0.f; // draw
+                      TicTacTest t2;
+                      t2.pos[0]=1; t2.pos[1]=1; t2.pos[2]=0;
+                      t2.pos[3]=2; t2.pos[4]=2; t2.pos[5]=1;
+                      t2.pos[6]=2; t2.pos[7]=1; t2.pos[8]=2;
+                      t2.currentPlayer = 1;
+                      res = simulateInterleaved<5, 4>(t2, rand);
+                      ok = ok && (res == 1.f); // Player 1 wins
+                      res = simulateInterleaved<3, 1>(t2, rand);
+                      return ok && (res == 1.f);
+                  }()
+                 );
+
+    // Leaf-parallel playouts on the same positions, checked at start-up (threads):
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    [[maybe_unused]] static const bool leafParallelChecked = []
+    {
+        TicTacTest t1;
+        t1.pos[0]=2; t1.pos[1]=1; t1.pos[2]=2;
+        t1.pos[3]=1; t1.pos[4]=1; t1.pos[5]=2;
+        t1.pos[6]=0; t1.pos[7]=2; t1.pos[8]=1;
+        t1.currentPlayer = 1;
+        TicTacTest t2;
+        t2.pos[0]=1; t2.pos[1]=1; t2.pos[2]=0;
+        t2.pos[3]=2; t2.pos[4]=2; t2.pos[5]=1;
+        t2.pos[6]=2; t2.pos[7]=1; t2.pos[8]=2;
+        t2.currentPlayer = 1;
+        bool ok = true;
+        for (const int workers : {2, 3, 4})
+        {
+            WorkerPool pool(workers);
+            Xoroshiro128Plus rand(0x9E3779B97f4A7C15ull), single(0x9E3779B97f4A7C15ull);
+            ok = ok && pool.size() == workers;
+            ok = ok && simulate<5>(t1, rand, pool) == simulate<5>(t1, single);   // draw
+            ok = ok && simulate<5>(t2, rand, pool) == simulate<5>(t2, single);   // Player 1 wins
+            ok = ok && simulate<2>(t2, rand, pool) == simulate<2>(t2, single);   // Fewer playouts than workers
+            ok = ok && simulate<5>(t2, rand, pool) == 1.f;
+        }
+        aiAssert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
+
     static_assert([]
                   {
                       TicTacTest t;
@@ -2612,6 +8518,340 @@ int shallowestTerminalDepth = 9999;
                   }()
                  );
 
+    // TicTacTest with a policy head: output 1 + cell
+    struct TicTacPolicyTest : TicTacTest
+    {
+        constexpr TicTacPolicyTest clone() const
+        {
+            TicTacPolicyTest dst;
+            for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; }
+            dst.currentPlayer = currentPlayer;
+            return dst;
+        }
+
+        constexpr int policyIndex(const Move mv) const { return mv; }
+    };
+
+    static_assert([]
+                  {
+                      struct PolicyNet
+                      {
+                          float outputs[1+9] = {0.f, 0.1f, 0.3f, 0.f, 0.2f, 0.9f, 0.f, 0.f, 0.4f, 0.5f};
+                          constexpr const float *evaluate(const float *) const { return outputs; }
+                      } nn;
+                      bool ok = PolicyGameview<TicTacPolicyTest> && !PolicyGameview<TicTacTest>;
+                      TicTacPolicyTest t;
+                      t.pos[2] = 1; t.pos[5] = 2; t.pos[6] = 1;
+                      TicTacTest::StorageForMoves moves;
+                      const int n = t.generateMovesAndGetCnt(moves); // 0 1 3 4 7 8
+                      orderMovesByPolicy(t, nn.outputs, moves, n, n);
+                      ok = ok && n == 6 && moves[0] == 0 && moves[1] == 3 && moves[2] == 1;
+                      ok = ok && moves[3] == 7 && moves[4] == 8 && moves[5] == 4; // Most likely last
+                      t.generateMovesAndGetCnt(moves);
+                      orderMovesByPolicy(t, nn.outputs, moves, n, 2); // Only 2 nodes left: the best two
+                      ok = ok && moves[0] == 8 && moves[1] == 4;
+
+                      // Same results in another order:
+                      TicTacPolicyTest w;
+                      w.pos[0]=0; w.pos[1]=0; w.pos[2]=1;
+                      w.pos[3]=2; w.pos[4]=0; w.pos[5]=0;
+                      w.pos[6]=2; w.pos[7]=0; w.pos[8]=1;
+                      w.currentPlayer = 1;
+                      ok = ok && minimax<TicTacPolicyTest, TicTacTest::Move>(w, 9, nn) == MinimaxWin;
+                      ok = ok && minimax<TicTacPolicyTest, TicTacTest::Move>(t, 9, nn) == minimax<TicTacPolicyTest, TicTacTest::Move>(t, 9);
+                      return ok;
+                  }()
+                 );
+
+    // TicTacTest handing out its moves as a mask:
+    struct TicTacMaskTest : TicTacTest
+    {
+        using MoveMask = Bitvec<UWORD, 9>;
+
+        constexpr TicTacMaskTest clone() const
+        {
+            TicTacMaskTest dst;
+            for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; }
+            dst.currentPlayer = currentPlayer;
+            return dst;
+        }
+
+        constexpr MoveMask generateMoveMask() const
+        {
+            MoveMask mask;
+            for (int i=0; i<9; ++i)
+                mask.set(i, pos[i]==0);
+            return mask;
+        }
+    };
+
+    static_assert([]
+                  {
+                      bool ok = BitmaskGameview<TicTacMaskTest> && !BitmaskGameview<TicTacTest>;
+                      TicTacMaskTest t;
+                      t.pos[0]=1; t.pos[1]=0; t.pos[2]=2;
+                      t.pos[3]=0; t.pos[4]=1; t.pos[5]=0;
+                      t.pos[6]=0; t.pos[7]=0; t.pos[8]=0;
+                      LegalMoves<TicTacMaskTest> masked;
+                      LegalMoves<TicTacTest> listed;
+                      const int n = masked.generate(t);
+                      ok = ok && n == 6 && listed.generate(t) == n;
+                      for (int i=0; i<n; ++i)
+                          ok = ok && masked[i] == listed[i];
+                      ok = ok && masked.contains(5, n) && !masked.contains(4, n) && listed.contains(8, n) && !listed.contains(0, n);
+                      // Same move order, so the same searches and playouts:
+                      t.currentPlayer = 2;
+                      ok = ok && minimax<TicTacMaskTest, TicTacTest::Move>(t, 10) == MinimaxDraw;
+                      t.pos[5] = 2;
+                      t.currentPlayer = 1;
+                      ok = ok && minimax<TicTacMaskTest, TicTacTest::Move>(t, 9) == MinimaxWin;
+                      t.pos[5] = 0; t.pos[4] = 0;
+                      ok = ok && minimax<TicTacMaskTest, TicTacTest::Move>(t, 9) == minimax<TicTacTest, TicTacTest::Move>(t, 9);
+                      Xoroshiro128Plus randA(77), randB(77);
+                      ok = ok && simulate<9>(t, randA) == simulate<9>(static_cast<const TicTacTest&>(t), randB);
+                      ok = ok && simulateInterleaved<9, 4>(t, randA) == simulateInterleaved<9, 4>(static_cast<const TicTacTest&>(t), randB);
+                      return ok;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Node<int> pool[16];
+                      NodeFreeLists<4, int> lists;
+                      bool ok = lists.empty();
+                      ok = ok && lists.push(&pool[2], 3);
+                      ok = ok && lists.push(&pool[8], 3);
+                      ok = ok && !lists.push(&pool[11], 5); // Too large, must go back to the bitmap
+                      ok = ok && pool[8].activeBranches == Node<int>::removed;
+                      ok = ok && lists.pop(3) == &pool[8]; // LIFO, most recently freed first
+                      ok = ok && lists.pop(3) == &pool[2];
+                      ok = ok && lists.pop(3) == nullptr;
+                      ok = ok && lists.pop(2) == nullptr;
+                      ok = ok && lists.hits == 2 && lists.misses == 2;
+                      ok = ok && lists.pop(5) == nullptr && lists.misses == 2; // Too large to be listed, no miss
+                      lists.push(&pool[4], 1);
+                      lists.push(&pool[12], 4);
+                      int drained = 0;
+                      lists.drain([&drained](const Node<int> *, const int len) { drained += len; });
+                      ok = ok && drained == 5 && lists.empty();
+
+                      NodeFreeLists<0, int> disabled;
+                      ok = ok && !disabled.push(&pool[0], 1);
+                      ok = ok && disabled.pop(1) == nullptr && disabled.misses == 0;
+                      return ok;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      bool ok = shardedPoolFits<100, UQWORD, 1> && shardedPoolFits<128, UQWORD, 2> && shardedPoolFits<64, UBYTE, 8>;
+                      ok = ok && !shardedPoolFits<128, UQWORD, 4>; // 32 nodes, half a bitfield word
+                      ok = ok && !shardedPoolFits<130, UBYTE, 2>;  // 65 nodes
+                      return ok && !shardedPoolFits<96, UQWORD, 3>;
+                  }()
+                 );
+
+    // TicTacTest without a network (mcts needs to know):
+    struct TicTacSearchTest : TicTacTest
+    {
+        static constexpr int MaxNetworkInputs = 0;
+
+        constexpr TicTacSearchTest clone() const
+        {
+            TicTacSearchTest dst;
+            for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; }
+            dst.currentPlayer = currentPlayer;
+            return dst;
+        }
+    };
+
+    // The shards synchronise with atomics, which can't run at compile time.
+    // Checked once at start-up instead, in builds that define
+    // INCLUDEAI__RUNTIME_TESTS (it starts threads):
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    [[maybe_unused]] static const bool shardedPoolChecked = []
+    {
+        static Ai_ctx<128, int, UQWORD, 4, 2> ctx; // 64 nodes per shard
+        resetNodePool(ctx);
+        const auto a = allocateBranches(ctx, 3, 1); // From its home shard
+        bool ok = a.posOfAvailChunk >= 64 && a.length == 3;
+        // Freed by the other thread: queued for the owner, not listed yet
+        releaseBranches(ctx, a.posOfAvailChunk, 3, 0);
+        ok = ok && ctx.shards[1].returned.load() == &ctx.nodePool[a.posOfAvailChunk];
+        ok = ok && ctx.shards[1].freeLists.empty();
+        reclaimReturned(ctx, ctx.shards[1], 64);
+        ok = ok && ctx.shards[1].returned.load() == nullptr;
+        ok = ok && ctx.shards[1].freeLists.pop(3) == &ctx.nodePool[a.posOfAvailChunk];
+        // allocateBranches() reclaims by itself:
+        releaseBranches(ctx, a.posOfAvailChunk, 3, 0);
+        ok = ok && allocateBranches(ctx, 3, 1).posOfAvailChunk == a.posOfAvailChunk;
+
+        // Shard 0 runs dry and steals from shard 1, unless that one is busy:
+        resetNodePool(ctx);
+        const auto all = allocateBranches(ctx, 64, 0);
+        ok = ok && all.posOfAvailChunk == 0 && all.length == 64;
+        ctx.shards[1].lock();
+        ok = ok && allocateBranches(ctx, 5, 0).length == 0;
+        ctx.shards[1].unlock();
+        const auto stolen = allocateBranches(ctx, 5, 0);
+        ok = ok && stolen.posOfAvailChunk >= 64 && stolen.length == 5;
+        releaseBranches(ctx, stolen.posOfAvailChunk, 5, 0); // Goes back to shard 1
+        ok = ok && ctx.shards[1].returned.load() == &ctx.nodePool[stolen.posOfAvailChunk];
+        ok = ok && allocateBranches(ctx, 5, 1).posOfAvailChunk == stolen.posOfAvailChunk;
+
+        // Two threads searching at once, one shard each, get the same trees as
+        // searches on their own:
+        struct NoNetwork
+        {
+            float outputs[1] = {0.f};
+            const float *evaluate(const float *) const { return outputs; }
+        } nn;
+        TicTacSearchTest t;
+        t.pos[0]=0; t.pos[1]=0; t.pos[2]=1;
+        t.pos[3]=2; t.pos[4]=0; t.pos[5]=0;
+        t.pos[6]=0; t.pos[7]=0; t.pos[8]=0;
+        static Ai_ctx<4096, int, UQWORD, 8, 2> searchCtx;
+        static Ai_ctx<4096, int, UQWORD, 8> aloneCtx;
+        resetNodePool(searchCtx);
+        MCTS_result<int> results[2];
+        std::thread searches[2];
+        for (int i=0; i<2; ++i)
+            searches[i] = std::thread([&, i] { results[i] = mcts<300, 9, 2, int, UQWORD>(t, searchCtx, nn, 1234 + i, i); });
+        for (auto& search : searches)
+            search.join();
+        for (int i=0; i<2; ++i)
+        {
+            const auto alone = mcts<300, 9, 2, int, UQWORD>(t, aloneCtx, nn, 1234 + i);
+            ok = ok && results[i].best == alone.best && !results[i].errorOutOfMem;
+            ok = ok && results[i].statistics[MCTS_result<int>::peakNodesInUse] == alone.statistics[MCTS_result<int>::peakNodesInUse];
+            ok = ok && results[i].statistics[MCTS_result<int>::simulations] == alone.statistics[MCTS_result<int>::simulations];
+        }
+        aiAssert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
+
+    // TicTacSearchTest with inputs (+1/-1 per stone placed) that reports
+    // what changed since clone():
+    struct TicTacDeltaTest : TicTacSearchTest
+    {
+        static constexpr int MaxInputDeltas = 9;
+        NetworkInputDelta changes[9];
+        int nChanges = 0;
+
+        constexpr TicTacDeltaTest clone() const
+        {
+            TicTacDeltaTest dst;
+            for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; dst.neuralInputs[i] = neuralInputs[i]; }
+            dst.currentPlayer = currentPlayer;
+            return dst;
+        }
+
+        constexpr include_ai::Outcome doMove(const Move mv)
+        {
+            const float stone = currentPlayer == 1 ? 1.f : -1.f;
+            neuralInputs[mv] = stone;
+            changes[nChanges++] = { mv, stone };
+            return TicTacTest::doMove(mv);
+        }
+
+        constexpr int networkInputDeltas(NetworkInputDelta *deltas) const
+        {
+            for (int i=0; i<nChanges; ++i)
+                deltas[i] = changes[i];
+            return nChanges;
+        }
+    };
+
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    // The leaves evaluated from the root plus their changes get the same
+    // values as from their inputs, so the same search:
+    [[maybe_unused]] static const bool leafDeltasChecked = []
+    {
+        struct SumNetwork
+        {
+            float outputs[1] = {0.f};
+            static float value(const float *x)
+            {
+                float sum = 0.f;
+                for (int i=0; i<9; ++i)
+                    sum += (0.05f*i - 0.2f) * x[i];
+                return sum;
+            }
+            const float *evaluate(const float *inputs) { outputs[0] = value(inputs); return outputs; }
+        };
+        struct SumBaseNetwork : SumNetwork
+        {
+            float base[9] = {0.f};
+            int fromBase = 0;
+            void setBase(const float *inputs) { for (int i=0; i<9; ++i) base[i] = inputs[i]; }
+            const float *evaluateFromBase(const NetworkInputDelta *deltas, const int n)
+            {
+                float x[9];
+                for (int i=0; i<9; ++i)
+                    x[i] = base[i];
+                for (int d=0; d<n; ++d)
+                    x[deltas[d].input] += deltas[d].change;
+                fromBase += 1;
+                outputs[0] = value(x);
+                return outputs;
+            }
+        };
+        bool ok = InputDeltaGameview<TicTacDeltaTest> && !InputDeltaGameview<TicTacSearchTest>;
+        ok = ok && BaseEvaluator<SumBaseNetwork> && !BaseEvaluator<SumNetwork>;
+        TicTacDeltaTest t;
+        t.pos[0]=0; t.pos[1]=0; t.pos[2]=1;
+        t.pos[3]=2; t.pos[4]=0; t.pos[5]=0;
+        t.pos[6]=0; t.pos[7]=0; t.pos[8]=0;
+        t.neuralInputs[2] = 1.f; t.neuralInputs[3] = -1.f;
+        static Ai_ctx<4096, int, UQWORD, 8> ctx;
+        SumNetwork plain;
+        SumBaseNetwork incremental;
+        const auto a = mcts<300, 9, 2, int, UQWORD>(t, ctx, plain, 1234);
+        const auto b = mcts<300, 9, 2, int, UQWORD>(t, ctx, incremental, 1234);
+        ok = ok && a.best == b.best && incremental.fromBase > 0;
+        ok = ok && a.statistics[MCTS_result<int>::networkEvaluated] == b.statistics[MCTS_result<int>::networkEvaluated];
+        ok = ok && a.statistics[MCTS_result<int>::simulations] == b.statistics[MCTS_result<int>::simulations];
+        aiAssert(ok);
+        return ok;
+    }();
+
+    // With a policy head the network is still evaluated once per leaf (and
+    // once for the root's children): expansion and minimax reuse the value's
+    // evaluation
+    [[maybe_unused]] static const bool policyEvaluationsChecked = []
+    {
+        struct PolicySearchTest : TicTacSearchTest
+        {
+            constexpr PolicySearchTest clone() const
+            {
+                PolicySearchTest dst;
+                for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; }
+                dst.currentPlayer = currentPlayer;
+                return dst;
+            }
+
+            constexpr int policyIndex(const Move mv) const { return mv; }
+        };
+        struct CountingNetwork
+        {
+            float outputs[1+9] = {0.f, 0.1f, 0.3f, 0.f, 0.2f, 0.9f, 0.f, 0.f, 0.4f, 0.5f};
+            int evaluations = 0;
+            const float *evaluate(const float *) { evaluations += 1; return outputs; }
+        };
+        PolicySearchTest t;
+        t.pos[2] = 1; t.pos[3] = 2;
+        static Ai_ctx<4096, int, UQWORD, 8> ctx;
+        CountingNetwork nn;
+        const auto r = mcts<300, 9, 2, int, UQWORD>(t, ctx, nn, 1234);
+        const int leaves = r.statistics[MCTS_result<int>::minimaxes] + r.statistics[MCTS_result<int>::simulations]
+                         + r.statistics[MCTS_result<int>::networkEvaluated];
+        const bool ok = PolicyGameview<PolicySearchTest> && !r.errorOutOfMem && leaves > 0 && nn.evaluations == leaves + 1;
+        aiAssert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
+
 
 
 
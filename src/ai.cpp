@@ -79,6 +79,69 @@
         constexpr void randomize(unsigned) {}
     };
 
+    static_assert([]
+                  {
+                      using namespace include_ai;
+                      // Known answers for 2^64 and 2^96 steps ahead:
+                      Xoroshiro128Plus a(1234);
+                      a.jump();
+                      bool ok = a() == 0xd78eff46553bc9deULL;
+                      Xoroshiro128Plus b(1234);
+                      b.long_jump();
+                      ok = ok && b() == 0x96f96766f3effd28ULL;
+                      // Streams:
+                      Xoroshiro128Plus c = Xoroshiro128Plus::stream(1234, 1);
+                      ok = ok && c() == 0xd78eff46553bc9deULL;
+                      // Lanes are the streams of the seed:
+                      Xoroshiro128PlusLanes<4> lanes(1234);
+                      Xoroshiro128Plus lane0 = Xoroshiro128Plus::stream(1234, 0);
+                      Xoroshiro128Plus lane3 = Xoroshiro128Plus::stream(1234, 3);
+                      UQWORD raw[4];
+                      lanes(raw);
+                      ok = ok && raw[0] == lane0() && raw[3] == lane3();
+                      // Bounded draws:
+                      int hist[7] = {0};
+                      for (int i=0; i<700; ++i)
+                          hist[lane0.nextInt(7)] += 1;
+                      for (int i=0; i<7; ++i)
+                          ok = ok && hist[i] > 60 && hist[i] < 140;
+                      UDWORD idx[4];
+                      const UDWORD max[4] = {1, 2, 0, 1000};
+                      for (int i=0; i<100; ++i)
+                      {
+                          lanes.nextInts(idx, max);
+                          ok = ok && idx[0] == 0 && idx[1] < 2 && idx[2] == 0 && idx[3] < 1000;
+                      }
+                      UDWORD filled[10] = {0};
+                      lanes.fillIndices(filled, 9, 3);
+                      for (int i=0; i<9; ++i)
+                          ok = ok && filled[i] < 3;
+                      return ok && filled[9] == 0;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      using namespace include_ai;
+                      Zobrist<9, 2> a, b;
+                      bool ok = a.value() == 0 && a == b;
+                      a.toggle(4, 0);
+                      a.toggle(7, 1);
+                      a.toggleTurn();
+                      b.toggleTurn();
+                      b.toggle(7, 1);
+                      b.toggle(4, 0); // Order does not matter
+                      ok = ok && a == b && a.value() != 0;
+                      a.toggle(4, 0); // Take it back
+                      b.toggle(4, 1); // Other piece, same cell
+                      ok = ok && a != b && a.value() == (Zobrist<9, 2>::table.keys[7][1] ^ Zobrist<9, 2>::table.turn);
+                      Xoroshiro128Plus rng(0x5a0b1257ull);
+                      ok = ok && Zobrist<9, 2>::table.keys[0][0] == rng() && Zobrist<9, 2>::table.keys[0][1] == rng();
+                      b.clear();
+                      return ok && b.value() == 0;
+                  }()
+                 );
+
     static_assert([]
                   {
                       using namespace include_ai;
@@ -100,6 +163,61 @@
                   }()
                  );
 
+    static_assert([]
+                  {
+                      using namespace include_ai;
+                      Xoroshiro128Plus rand(0x9E3779B97f4A7C15ull);
+                      TicTacTest t1;
+                      t1.pos[0]=2; t1.pos[1]=1; t1.pos[2]=2;
+                      t1.pos[3]=1; t1.pos[4]=1; t1.pos[5]=2;
+                      t1.pos[6]=0; t1.pos[7]=2; t1.pos[8]=1;
+                      t1.currentPlayer = 1;
+                      // 5 playouts over 4 lanes, the second batch is partial:
+                      float res = simulateInterleaved<5, 4>(t1, rand);
+                      bool ok = res == 0.f; // draw
+                      TicTacTest t2;
+                      t2.pos[0]=1; t2.pos[1]=1; t2.pos[2]=0;
+                      t2.pos[3]=2; t2.pos[4]=2; t2.pos[5]=1;
+                      t2.pos[6]=2; t2.pos[7]=1; t2.pos[8]=2;
+                      t2.currentPlayer = 1;
+                      res = simulateInterleaved<5, 4>(t2, rand);
+                      ok = ok && (res == 1.f); // Player 1 wins
+                      res = simulateInterleaved<3, 1>(t2, rand);
+                      return ok && (res == 1.f);
+                  }()
+                 );
+
+    // Leaf-parallel playouts on the same positions, checked at start-up (threads):
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    [[maybe_unused]] static const bool leafParallelChecked = []
+    {
+        using namespace include_ai;
+        TicTacTest t1;
+        t1.pos[0]=2; t1.pos[1]=1; t1.pos[2]=2;
+        t1.pos[3]=1; t1.pos[4]=1; t1.pos[5]=2;
+        t1.pos[6]=0; t1.pos[7]=2; t1.pos[8]=1;
+        t1.currentPlayer = 1;
+        TicTacTest t2;
+        t2.pos[0]=1; t2.pos[1]=1; t2.pos[2]=0;
+        t2.pos[3]=2; t2.pos[4]=2; t2.pos[5]=1;
+        t2.pos[6]=2; t2.pos[7]=1; t2.pos[8]=2;
+        t2.currentPlayer = 1;
+        bool ok = true;
+        for (const int workers : {2, 3, 4})
+        {
+            WorkerPool pool(workers);
+            Xoroshiro128Plus rand(0x9E3779B97f4A7C15ull), single(0x9E3779B97f4A7C15ull);
+            ok = ok && pool.size() == workers;
+            ok = ok && simulate<5>(t1, rand, pool) == simulate<5>(t1, single);   // draw
+            ok = ok && simulate<5>(t2, rand, pool) == simulate<5>(t2, single);   // Player 1 wins
+            ok = ok && simulate<2>(t2, rand, pool) == simulate<2>(t2, single);   // Fewer playouts than workers
+            ok = ok && simulate<5>(t2, rand, pool) == 1.f;
+        }
+        aiAssert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
+
     static_assert([]
                   {
                       using namespace include_ai;
@@ -172,6 +290,347 @@
                   }()
                  );
 
+    // TicTacTest with a policy head: output 1 + cell
+    struct TicTacPolicyTest : TicTacTest
+    {
+        constexpr TicTacPolicyTest clone() const
+        {
+            TicTacPolicyTest dst;
+            for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; }
+            dst.currentPlayer = currentPlayer;
+            return dst;
+        }
+
+        constexpr int policyIndex(const Move mv) const { return mv; }
+    };
+
+    static_assert([]
+                  {
+                      using namespace include_ai;
+                      struct PolicyNet
+                      {
+                          float outputs[1+9] = {0.f, 0.1f, 0.3f, 0.f, 0.2f, 0.9f, 0.f, 0.f, 0.4f, 0.5f};
+                          constexpr const float *evaluate(const float *) const { return outputs; }
+                      } nn;
+                      bool ok = PolicyGameview<TicTacPolicyTest> && !PolicyGameview<TicTacTest>;
+                      TicTacPolicyTest t;
+                      t.pos[2] = 1; t.pos[5] = 2; t.pos[6] = 1;
+                      TicTacTest::StorageForMoves moves;
+                      const int n = t.generateMovesAndGetCnt(moves); // 0 1 3 4 7 8
+                      orderMovesByPolicy(t, nn.outputs, moves, n, n);
+                      ok = ok && n == 6 && moves[0] == 0 && moves[1] == 3 && moves[2] == 1;
+                      ok = ok && moves[3] == 7 && moves[4] == 8 && moves[5] == 4; // Most likely last
+                      t.generateMovesAndGetCnt(moves);
+                      orderMovesByPolicy(t, nn.outputs, moves, n, 2); // Only 2 nodes left: the best two
+                      ok = ok && moves[0] == 8 && moves[1] == 4;
+
+                      // Same results in another order:
+                      TicTacPolicyTest w;
+                      w.pos[0]=0; w.pos[1]=0; w.pos[2]=1;
+                      w.pos[3]=2; w.pos[4]=0; w.pos[5]=0;
+                      w.pos[6]=2; w.pos[7]=0; w.pos[8]=1;
+                      w.currentPlayer = 1;
+                      ok = ok && minimax<TicTacPolicyTest, TicTacTest::Move>(w, 9, nn) == MinimaxWin;
+                      ok = ok && minimax<TicTacPolicyTest, TicTacTest::Move>(t, 9, nn) == minimax<TicTacPolicyTest, TicTacTest::Move>(t, 9);
+                      return ok;
+                  }()
+                 );
+
+    // TicTacTest handing out its moves as a mask:
+    struct TicTacMaskTest : TicTacTest
+    {
+        using MoveMask = Bitvec<UWORD, 9>;
+
+        constexpr TicTacMaskTest clone() const
+        {
+            TicTacMaskTest dst;
+            for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; }
+            dst.currentPlayer = currentPlayer;
+            return dst;
+        }
+
+        constexpr MoveMask generateMoveMask() const
+        {
+            MoveMask mask;
+            for (int i=0; i<9; ++i)
+                mask.set(i, pos[i]==0);
+            return mask;
+        }
+    };
+
+    static_assert([]
+                  {
+                      using namespace include_ai;
+                      bool ok = BitmaskGameview<TicTacMaskTest> && !BitmaskGameview<TicTacTest>;
+                      TicTacMaskTest t;
+                      t.pos[0]=1; t.pos[1]=0; t.pos[2]=2;
+                      t.pos[3]=0; t.pos[4]=1; t.pos[5]=0;
+                      t.pos[6]=0; t.pos[7]=0; t.pos[8]=0;
+                      LegalMoves<TicTacMaskTest> masked;
+                      LegalMoves<TicTacTest> listed;
+                      const int n = masked.generate(t);
+                      ok = ok && n == 6 && listed.generate(t) == n;
+                      for (int i=0; i<n; ++i)
+                          ok = ok && masked[i] == listed[i];
+                      ok = ok && masked.contains(5, n) && !masked.contains(4, n) && listed.contains(8, n) && !listed.contains(0, n);
+                      // Same move order, so the same searches and playouts:
+                      t.currentPlayer = 2;
+                      ok = ok && minimax<TicTacMaskTest, TicTacTest::Move>(t, 10) == MinimaxDraw;
+                      t.pos[5] = 2;
+                      t.currentPlayer = 1;
+                      ok = ok && minimax<TicTacMaskTest, TicTacTest::Move>(t, 9) == MinimaxWin;
+                      t.pos[5] = 0; t.pos[4] = 0;
+                      ok = ok && minimax<TicTacMaskTest, TicTacTest::Move>(t, 9) == minimax<TicTacTest, TicTacTest::Move>(t, 9);
+                      Xoroshiro128Plus randA(77), randB(77);
+                      ok = ok && simulate<9>(t, randA) == simulate<9>(static_cast<const TicTacTest&>(t), randB);
+                      ok = ok && simulateInterleaved<9, 4>(t, randA) == simulateInterleaved<9, 4>(static_cast<const TicTacTest&>(t), randB);
+                      return ok;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      using namespace include_ai;
+                      Node<int> pool[16];
+                      NodeFreeLists<4, int> lists;
+                      bool ok = lists.empty();
+                      ok = ok && lists.push(&pool[2], 3);
+                      ok = ok && lists.push(&pool[8], 3);
+                      ok = ok && !lists.push(&pool[11], 5); // Too large, must go back to the bitmap
+                      ok = ok && pool[8].activeBranches == Node<int>::removed;
+                      ok = ok && lists.pop(3) == &pool[8]; // LIFO, most recently freed first
+                      ok = ok && lists.pop(3) == &pool[2];
+                      ok = ok && lists.pop(3) == nullptr;
+                      ok = ok && lists.pop(2) == nullptr;
+                      ok = ok && lists.hits == 2 && lists.misses == 2;
+                      ok = ok && lists.pop(5) == nullptr && lists.misses == 2; // Too large to be listed, no miss
+                      lists.push(&pool[4], 1);
+                      lists.push(&pool[12], 4);
+                      int drained = 0;
+                      lists.drain([&drained](const Node<int> *, const int len) { drained += len; });
+                      ok = ok && drained == 5 && lists.empty();
+
+                      NodeFreeLists<0, int> disabled;
+                      ok = ok && !disabled.push(&pool[0], 1);
+                      ok = ok && disabled.pop(1) == nullptr && disabled.misses == 0;
+                      return ok;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      using namespace include_ai;
+                      bool ok = shardedPoolFits<100, UQWORD, 1> && shardedPoolFits<128, UQWORD, 2> && shardedPoolFits<64, UBYTE, 8>;
+                      ok = ok && !shardedPoolFits<128, UQWORD, 4>; // 32 nodes, half a bitfield word
+                      ok = ok && !shardedPoolFits<130, UBYTE, 2>;  // 65 nodes
+                      return ok && !shardedPoolFits<96, UQWORD, 3>;
+                  }()
+                 );
+
+    // TicTacTest without a network (mcts needs to know):
+    struct TicTacSearchTest : TicTacTest
+    {
+        static constexpr int MaxNetworkInputs = 0;
+
+        constexpr TicTacSearchTest clone() const
+        {
+            TicTacSearchTest dst;
+            for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; }
+            dst.currentPlayer = currentPlayer;
+            return dst;
+        }
+    };
+
+    // The shards synchronise with atomics, which can't run at compile time.
+    // Checked once at start-up instead, in builds that define
+    // INCLUDEAI__RUNTIME_TESTS (it starts threads):
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    [[maybe_unused]] static const bool shardedPoolChecked = []
+    {
+        using namespace include_ai;
+        static Ai_ctx<128, int, UQWORD, 4, 2> ctx; // 64 nodes per shard
+        resetNodePool(ctx);
+        const auto a = allocateBranches(ctx, 3, 1); // From its home shard
+        bool ok = a.posOfAvailChunk >= 64 && a.length == 3;
+        // Freed by the other thread: queued for the owner, not listed yet
+        releaseBranches(ctx, a.posOfAvailChunk, 3, 0);
+        ok = ok && ctx.shards[1].returned.load() == &ctx.nodePool[a.posOfAvailChunk];
+        ok = ok && ctx.shards[1].freeLists.empty();
+        reclaimReturned(ctx, ctx.shards[1], 64);
+        ok = ok && ctx.shards[1].returned.load() == nullptr;
+        ok = ok && ctx.shards[1].freeLists.pop(3) == &ctx.nodePool[a.posOfAvailChunk];
+        // allocateBranches() reclaims by itself:
+        releaseBranches(ctx, a.posOfAvailChunk, 3, 0);
+        ok = ok && allocateBranches(ctx, 3, 1).posOfAvailChunk == a.posOfAvailChunk;
+
+        // Shard 0 runs dry and steals from shard 1, unless that one is busy:
+        resetNodePool(ctx);
+        const auto all = allocateBranches(ctx, 64, 0);
+        ok = ok && all.posOfAvailChunk == 0 && all.length == 64;
+        ctx.shards[1].lock();
+        ok = ok && allocateBranches(ctx, 5, 0).length == 0;
+        ctx.shards[1].unlock();
+        const auto stolen = allocateBranches(ctx, 5, 0);
+        ok = ok && stolen.posOfAvailChunk >= 64 && stolen.length == 5;
+        releaseBranches(ctx, stolen.posOfAvailChunk, 5, 0); // Goes back to shard 1
+        ok = ok && ctx.shards[1].returned.load() == &ctx.nodePool[stolen.posOfAvailChunk];
+        ok = ok && allocateBranches(ctx, 5, 1).posOfAvailChunk == stolen.posOfAvailChunk;
+
+        // Two threads searching at once, one shard each, get the same trees as
+        // searches on their own:
+        struct NoNetwork
+        {
+            float outputs[1] = {0.f};
+            const float *evaluate(const float *) const { return outputs; }
+        } nn;
+        TicTacSearchTest t;
+        t.pos[0]=0; t.pos[1]=0; t.pos[2]=1;
+        t.pos[3]=2; t.pos[4]=0; t.pos[5]=0;
+        t.pos[6]=0; t.pos[7]=0; t.pos[8]=0;
+        static Ai_ctx<4096, int, UQWORD, 8, 2> searchCtx;
+        static Ai_ctx<4096, int, UQWORD, 8> aloneCtx;
+        resetNodePool(searchCtx);
+        MCTS_result<int> results[2];
+        std::thread searches[2];
+        for (int i=0; i<2; ++i)
+            searches[i] = std::thread([&, i] { results[i] = mcts<300, 9, 2, int, UQWORD>(t, searchCtx, nn, 1234 + i, i); });
+        for (auto& search : searches)
+            search.join();
+        for (int i=0; i<2; ++i)
+        {
+            const auto alone = mcts<300, 9, 2, int, UQWORD>(t, aloneCtx, nn, 1234 + i);
+            ok = ok && results[i].best == alone.best && !results[i].errorOutOfMem;
+            ok = ok && results[i].statistics[MCTS_result<int>::peakNodesInUse] == alone.statistics[MCTS_result<int>::peakNodesInUse];
+            ok = ok && results[i].statistics[MCTS_result<int>::simulations] == alone.statistics[MCTS_result<int>::simulations];
+        }
+        aiAssert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
+
+    // TicTacSearchTest with inputs (+1/-1 per stone placed) that reports
+    // what changed since clone():
+    struct TicTacDeltaTest : TicTacSearchTest
+    {
+        static constexpr int MaxInputDeltas = 9;
+        NetworkInputDelta changes[9];
+        int nChanges = 0;
+
+        constexpr TicTacDeltaTest clone() const
+        {
+            TicTacDeltaTest dst;
+            for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; dst.neuralInputs[i] = neuralInputs[i]; }
+            dst.currentPlayer = currentPlayer;
+            return dst;
+        }
+
+        constexpr include_ai::Outcome doMove(const Move mv)
+        {
+            const float stone = currentPlayer == 1 ? 1.f : -1.f;
+            neuralInputs[mv] = stone;
+            changes[nChanges++] = { mv, stone };
+            return TicTacTest::doMove(mv);
+        }
+
+        constexpr int networkInputDeltas(NetworkInputDelta *deltas) const
+        {
+            for (int i=0; i<nChanges; ++i)
+                deltas[i] = changes[i];
+            return nChanges;
+        }
+    };
+
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    // The leaves evaluated from the root plus their changes get the same
+    // values as from their inputs, so the same search:
+    [[maybe_unused]] static const bool leafDeltasChecked = []
+    {
+        using namespace include_ai;
+        struct SumNetwork
+        {
+            float outputs[1] = {0.f};
+            static float value(const float *x)
+            {
+                float sum = 0.f;
+                for (int i=0; i<9; ++i)
+                    sum += (0.05f*i - 0.2f) * x[i];
+                return sum;
+            }
+            const float *evaluate(const float *inputs) { outputs[0] = value(inputs); return outputs; }
+        };
+        struct SumBaseNetwork : SumNetwork
+        {
+            float base[9] = {0.f};
+            int fromBase = 0;
+            void setBase(const float *inputs) { for (int i=0; i<9; ++i) base[i] = inputs[i]; }
+            const float *evaluateFromBase(const NetworkInputDelta *deltas, const int n)
+            {
+                float x[9];
+                for (int i=0; i<9; ++i)
+                    x[i] = base[i];
+                for (int d=0; d<n; ++d)
+                    x[deltas[d].input] += deltas[d].change;
+                fromBase += 1;
+                outputs[0] = value(x);
+                return outputs;
+            }
+        };
+        bool ok = InputDeltaGameview<TicTacDeltaTest> && !InputDeltaGameview<TicTacSearchTest>;
+        ok = ok && BaseEvaluator<SumBaseNetwork> && !BaseEvaluator<SumNetwork>;
+        TicTacDeltaTest t;
+        t.pos[0]=0; t.pos[1]=0; t.pos[2]=1;
+        t.pos[3]=2; t.pos[4]=0; t.pos[5]=0;
+        t.pos[6]=0; t.pos[7]=0; t.pos[8]=0;
+        t.neuralInputs[2] = 1.f; t.neuralInputs[3] = -1.f;
+        static Ai_ctx<4096, int, UQWORD, 8> ctx;
+        SumNetwork plain;
+        SumBaseNetwork incremental;
+        const auto a = mcts<300, 9, 2, int, UQWORD>(t, ctx, plain, 1234);
+        const auto b = mcts<300, 9, 2, int, UQWORD>(t, ctx, incremental, 1234);
+        ok = ok && a.best == b.best && incremental.fromBase > 0;
+        ok = ok && a.statistics[MCTS_result<int>::networkEvaluated] == b.statistics[MCTS_result<int>::networkEvaluated];
+        ok = ok && a.statistics[MCTS_result<int>::simulations] == b.statistics[MCTS_result<int>::simulations];
+        aiAssert(ok);
+        return ok;
+    }();
+
+    // With a policy head the network is still evaluated once per leaf (and
+    // once for the root's children): expansion and minimax reuse the value's
+    // evaluation
+    [[maybe_unused]] static const bool policyEvaluationsChecked = []
+    {
+        using namespace include_ai;
+        struct PolicySearchTest : TicTacSearchTest
+        {
+            constexpr PolicySearchTest clone() const
+            {
+                PolicySearchTest dst;
+                for (int i=0; i<9; ++i) { dst.pos[i] = pos[i]; }
+                dst.currentPlayer = currentPlayer;
+                return dst;
+            }
+
+            constexpr int policyIndex(const Move mv) const { return mv; }
+        };
+        struct CountingNetwork
+        {
+            float outputs[1+9] = {0.f, 0.1f, 0.3f, 0.f, 0.2f, 0.9f, 0.f, 0.f, 0.4f, 0.5f};
+            int evaluations = 0;
+            const float *evaluate(const float *) { evaluations += 1; return outputs; }
+        };
+        PolicySearchTest t;
+        t.pos[2] = 1; t.pos[3] = 2;
+        static Ai_ctx<4096, int, UQWORD, 8> ctx;
+        CountingNetwork nn;
+        const auto r = mcts<300, 9, 2, int, UQWORD>(t, ctx, nn, 1234);
+        const int leaves = r.statistics[MCTS_result<int>::minimaxes] + r.statistics[MCTS_result<int>::simulations]
+                         + r.statistics[MCTS_result<int>::networkEvaluated];
+        const bool ok = PolicyGameview<PolicySearchTest> && !r.errorOutOfMem && leaves > 0 && nn.evaluations == leaves + 1;
+        aiAssert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
+
 
 
 
@@ -3,10 +3,13 @@
 
 #include "asmtypes.hpp"
 #include "bitalloc.hpp"
+#include "bitvec.hpp"
 #include "neural.hpp"
+#include <atomic>
 #include <concepts>
 #include <cmath>
 #include <cstdio>
+#include <utility>
 //#if defined(AI_DEBUG)
   #include <assert.h>
 //#endif
@@ -81,13 +84,213 @@ namespace include_ai {
             return result;
         }
 
-        constexpr UQWORD nextInt(UQWORD max)
+        // Uniform in [0,max) without the modulo bias of rng() % max. Lemire's
+        // multiply-shift (https://arxiv.org/abs/1805.10941), the rejection
+        // loop is only entered for a fraction max/2^32 of all draws:
+        constexpr UDWORD nextInt(const UDWORD max)
         {
-            return operator()() % max; // Helper to replace rng() % max
+            aiAssert(max > 0);
+            UQWORD m = (operator()() >> 32) * max;
+            if (static_cast<UDWORD>(m) < max)
+            {
+                const UDWORD threshold = static_cast<UDWORD>(-max) % max;
+                while (static_cast<UDWORD>(m) < threshold)
+                    m = (operator()() >> 32) * max;
+            }
+            return static_cast<UDWORD>(m >> 32);
+        }
+
+        // Advance by 2^64 / 2^96 calls. Streams that are one jump apart never
+        // overlap in practice (http://prng.di.unimi.it/):
+        constexpr void jump()
+        {
+            constexpr UQWORD Jump[2] = { 0xbeac0467eba5facbULL, 0xd86b048b86aa9922ULL };
+            polyJump(Jump);
+        }
+
+        constexpr void long_jump()
+        {
+            constexpr UQWORD LongJump[2] = { 0x18f7c399ccebda8dULL, 0xf2deac28bef3bb07ULL };
+            polyJump(LongJump);
+        }
+
+        // Stream 'idx' of 'seed'. Use one per thread/lane for independent,
+        // reproducible sequences:
+        static constexpr Xoroshiro128Plus stream(const UQWORD seed, const int idx)
+        {
+            Xoroshiro128Plus rng(seed);
+            for (int i=0; i<idx; ++i)
+                rng.jump();
+            return rng;
+        }
+
+    private:
+        constexpr void polyJump(const UQWORD (&poly)[2])
+        {
+            UQWORD s0 = 0;
+            UQWORD s1 = 0;
+            for (int i=0; i<2; ++i)
+            {
+                for (int b=0; b<64; ++b)
+                {
+                    if (poly[i] & (1ULL << b))
+                    {
+                        s0 ^= state[0];
+                        s1 ^= state[1];
+                    }
+                    operator()();
+                }
+            }
+            state[0] = s0;
+            state[1] = s1;
         }
     };
 
 
+/****************************************/
+/*                 Xoroshiro128+, lanes */
+/* 'Lanes' generators side by side, in  */
+/* struct-of-arrays layout so that the  */
+/* per-lane loops below compile to SIMD */
+/* (64 bit add/xor/shift). Lane i is    */
+/* stream i of the seed                 */
+/****************************************/
+    template <int Lanes>
+    struct Xoroshiro128PlusLanes
+    {
+        UQWORD state0[Lanes];
+        UQWORD state1[Lanes];
+
+        constexpr explicit Xoroshiro128PlusLanes(const UQWORD seed)
+          : state0{}, state1{}
+        {
+            Xoroshiro128Plus rng(seed);
+            for (int lane=0; lane<Lanes; ++lane)
+            {
+                state0[lane] = rng.state[0];
+                state1[lane] = rng.state[1];
+                rng.jump();
+            }
+        }
+
+        constexpr void operator()(UQWORD (&out)[Lanes])
+        {
+            for (int lane=0; lane<Lanes; ++lane)
+            {
+                const UQWORD s0 = state0[lane];
+                UQWORD s1 = state1[lane];
+                out[lane] = s0 + s1;
+                s1 ^= s0;
+                state0[lane] = ((s0 << 55) | (s0 >> (64 - 55))) ^ s1 ^ (s1 << 14);
+                state1[lane] = (s1 << 36) | (s1 >> (64 - 36));
+            }
+        }
+
+        // One bounded draw per lane, out[i] in [0,max[i]). Same method as
+        // Xoroshiro128Plus::nextInt, the (rare) rejected lanes are redrawn
+        // one by one afterwards:
+        constexpr void nextInts(UDWORD (&out)[Lanes], const UDWORD (&max)[Lanes])
+        {
+            UQWORD raw[Lanes];
+            operator()(raw);
+            UQWORD m[Lanes];
+            for (int lane=0; lane<Lanes; ++lane)
+                m[lane] = (raw[lane] >> 32) * max[lane];
+            for (int lane=0; lane<Lanes; ++lane)
+            {
+                if (static_cast<UDWORD>(m[lane]) < max[lane])
+                {
+                    const UDWORD threshold = static_cast<UDWORD>(-max[lane]) % max[lane];
+                    while (static_cast<UDWORD>(m[lane]) < threshold)
+                        m[lane] = (nextLane(lane) >> 32) * max[lane];
+                }
+                out[lane] = static_cast<UDWORD>(m[lane] >> 32);
+            }
+        }
+
+        // Fill 'n' indices in [0,max), 'Lanes' at a time:
+        constexpr void fillIndices(UDWORD *out, const int n, const UDWORD max)
+        {
+            UDWORD maxes[Lanes];
+            for (int lane=0; lane<Lanes; ++lane)
+                maxes[lane] = max;
+            UDWORD batch[Lanes];
+            for (int i=0; i<n; i+=Lanes)
+            {
+                nextInts(batch, maxes);
+                const int cnt = (n-i) < Lanes ? (n-i) : Lanes;
+                for (int lane=0; lane<cnt; ++lane)
+                    out[i+lane] = batch[lane];
+            }
+        }
+
+    private:
+        constexpr UQWORD nextLane(const int lane)
+        {
+            Xoroshiro128Plus rng(0);
+            rng.state[0] = state0[lane];
+            rng.state[1] = state1[lane];
+            const UQWORD result = rng();
+            state0[lane] = rng.state[0];
+            state1[lane] = rng.state[1];
+            return result;
+        }
+    };
+
+
+/****************************************/
+/*                              Zobrist */
+/* Position keys for transposition      */
+/* tables and evaluation caches: one    */
+/* random key per (cell, piece) and one */
+/* for the side to move, xor-ed         */
+/* together. Placing, removing or       */
+/* moving a piece toggles one or two    */
+/* keys. The table is made at compile   */
+/* time from Xoroshiro128+ and shared   */
+/* by every Zobrist of the same shape   */
+/****************************************/
+    template <int Cells, int Pieces>
+    struct ZobristTable
+    {
+        UQWORD keys[Cells][Pieces];
+        UQWORD turn;
+
+        constexpr explicit ZobristTable(const UQWORD seed)
+          : keys{}, turn{}
+        {
+            Xoroshiro128Plus rng(seed);
+            for (int cell=0; cell<Cells; ++cell)
+                for (int piece=0; piece<Pieces; ++piece)
+                    keys[cell][piece] = rng();
+            turn = rng();
+        }
+    };
+
+    template <int Cells, int Pieces, UQWORD Seed=0x5a0b1257ull>
+    class Zobrist
+    {
+    public:
+        static constexpr ZobristTable<Cells, Pieces> table{Seed};
+    private:
+        UQWORD m_hash = 0;
+    public:
+        constexpr void toggle(const int cell, const int piece)
+        {
+            aiAssert(cell >= 0 && cell < Cells && piece >= 0 && piece < Pieces);
+            m_hash ^= table.keys[cell][piece];
+        }
+
+        constexpr void toggleTurn() { m_hash ^= table.turn; }
+
+        constexpr void clear() { m_hash = 0; }
+
+        constexpr UQWORD value() const { return m_hash; }
+
+        constexpr bool operator==(const Zobrist&) const = default;
+    };
+
+
 
 /****************************************/
 /*   A 'move'/'action' by a user/player */
@@ -134,6 +337,191 @@ namespace include_ai {
         };
 
 
+/****************************************/
+/*                           Move masks */
+/* Optional: a board whose moves are    */
+/* cell numbers can hand out its legal  */
+/* moves as a Bitvec, bit i = Move(i).  */
+/* Rollouts, the desync check during    */
+/* selection and minimax then use the   */
+/* mask as it is (select for a random   */
+/* or the i-th move, a bit test for     */
+/* membership) instead of filling a     */
+/* StorageForMoves at every step.       */
+/* Expanding a node still lists moves   */
+/****************************************/
+    template <typename T>
+    concept BitmaskGameview =
+        Gameview<T> &&
+        std::convertible_to<int, typename T::Move> &&
+        std::convertible_to<typename T::Move, int> &&
+        requires (const T cobj, const typename T::MoveMask mask)
+        {
+            {cobj.generateMoveMask()} -> std::same_as<typename T::MoveMask>;
+            {mask.popcnt()} -> std::convertible_to<int>;
+            {mask.getNthSetBit(0)} -> std::convertible_to<int>;
+            {mask.check(0)} -> std::convertible_to<bool>;
+        };
+
+    // f(move) for moves[n-1] down to moves[0] (the likely ones last, see
+    // orderMovesByPolicy()) while it returns true:
+    template <typename Storage, typename F>
+    constexpr void forEachListedMove(const Storage& moves, const int n, F&& f)
+    {
+        for (int i=n-1; i>=0; --i)
+            if (!f(moves[i]))
+                return;
+    }
+
+    // The legal moves of a position, moves[0..n) in the order of
+    // generateMovesAndGetCnt() or, for a mask, ascending bits. forEach()
+    // walks all of them (while 'f' returns true), [] is for a random pick:
+    template <Gameview Board>
+    struct LegalMoves
+    {
+        typename Board::StorageForMoves moves;
+
+        constexpr int generate(const Board& board) { return board.generateMovesAndGetCnt(moves); }
+
+        constexpr typename Board::Move operator[](const int i) const { return moves[i]; }
+
+        template <typename F>
+        constexpr void forEach(const int n, F&& f) const { forEachListedMove(moves, n, f); }
+
+        constexpr bool contains(const typename Board::Move& move, const int n) const
+        {
+            for (int i=0; i<n; ++i)
+                if (move == moves[i])
+                    return true;
+            return false;
+        }
+    };
+
+    template <BitmaskGameview Board>
+    struct LegalMoves<Board>
+    {
+        typename Board::MoveMask mask;
+
+        constexpr int generate(const Board& board)
+        {
+            mask = board.generateMoveMask();
+            return static_cast<int>(mask.popcnt());
+        }
+
+        constexpr typename Board::Move operator[](const int i) const { return static_cast<typename Board::Move>(mask.getNthSetBit(i)); }
+
+        // One pass over the words instead of a select per move:
+        template <typename F>
+        constexpr void forEach(const int, F&& f) const
+        {
+            mask.forEachSetBit([&f](const int bit) -> bool { return f(static_cast<typename Board::Move>(bit)); });
+        }
+
+        constexpr bool contains(const typename Board::Move& move, const int) const { return mask.check(static_cast<int>(move)); }
+    };
+
+/****************************************/
+/*                      Policy ordering */
+/* Optional: a board whose network has  */
+/* a policy head tells which output     */
+/* belongs to a move,                   */
+/* nn.evaluate(inputs)[1 + policyIndex] */
+/* ([0] is the value). Then the search  */
+/* tries the likely moves first: mcts   */
+/* orders new children by it and the    */
+/* first ply of minimax() with an 'nn'. */
+/* Both reuse the evaluation that also  */
+/* gives the position its value         */
+/****************************************/
+    template <typename T>
+    concept PolicyGameview =
+        Gameview<T> &&
+        requires (const T cobj)
+        {
+            {cobj.policyIndex(typename T::Move{})} -> std::convertible_to<int>;
+        };
+
+    // Of the 'n' moves from 'board', the 'keep' most likely end up in
+    // moves[0..keep), the most likely last (the move loops run from the
+    // end, expansion puts moves[keep-1] into branches[0]). 'outputs' are
+    // the network outputs for 'board':
+    template <PolicyGameview Board>
+    constexpr void orderMovesByPolicy(const Board& board, const FLOAT *outputs, typename Board::StorageForMoves& moves, const int n, const int keep)
+    {
+        FLOAT policy[sizeof(moves) / sizeof(moves[0])];
+        for (int i=0; i<n; ++i)
+        {
+            const int index = board.policyIndex(moves[i]);
+            aiAssert(index >= 0);
+            policy[i] = outputs[1 + index];
+        }
+        // Insertion sort, most likely first (n is a branching factor):
+        for (int i=1; i<n; ++i)
+        {
+            const FLOAT p = policy[i];
+            const auto move = moves[i];
+            int j = i;
+            for (; j>0 && policy[j-1] < p; --j)
+            {
+                policy[j] = policy[j-1];
+                moves[j] = moves[j-1];
+            }
+            policy[j] = p;
+            moves[j] = move;
+        }
+        for (int lo=0, hi=keep-1; lo<hi; ++lo, --hi)
+        {
+            const auto move = moves[lo];
+            moves[lo] = moves[hi];
+            moves[hi] = move;
+        }
+    }
+
+
+/****************************************/
+/*                         Input deltas */
+/* Optional: a board that knows which   */
+/* network inputs changed since it was  */
+/* cloned (randomize() included). With  */
+/* a network that evaluates relative to */
+/* a base position, e.g. an Incremental */
+/* Evaluator, mcts makes the root the   */
+/* base once and evaluates every leaf   */
+/* from what changed since the root     */
+/****************************************/
+    template <typename T>
+    concept InputDeltaGameview =
+        Gameview<T> &&
+        requires (const T cobj, NetworkInputDelta *deltas)
+        {
+            {T::MaxInputDeltas} -> std::convertible_to<int>;
+            // The changes since clone(), -1 if more than MaxInputDeltas:
+            {cobj.networkInputDeltas(deltas)} -> std::convertible_to<int>;
+        };
+
+    template <typename NN>
+    concept BaseEvaluator =
+        requires (NN& nn, const FLOAT *inputs, const NetworkInputDelta *deltas)
+        {
+            {nn.setBase(inputs)};
+            {nn.evaluateFromBase(deltas, 0)} -> std::convertible_to<const FLOAT *>;
+        };
+
+    // The network outputs for 'board', a clone of the root moved down the tree:
+    template <Gameview Board, typename NN>
+    constexpr const FLOAT *evaluateLeaf(Board& board, NN& nn)
+    {
+        if constexpr (InputDeltaGameview<Board> && BaseEvaluator<NN>)
+        {
+            NetworkInputDelta deltas[Board::MaxInputDeltas > 0 ? Board::MaxInputDeltas : 1];
+            const int n = board.networkInputDeltas(deltas);
+            if (n >= 0)
+                return nn.evaluateFromBase(deltas, n);
+        }
+        return nn.evaluate(board.getNetworkInputs());
+    }
+
+
 /****************************************/
 /*       Node (should be converted from */
 /*        an 'array of structs' into a  */
@@ -203,14 +591,139 @@ int shallowestTerminalDepth = 9999;
     //static_assert(sizeof(Node<SQWORD>) <= 64); todo: del this line after a-o-s -> s-o-a conversion
 
 
+/****************************************/
+/*                Size-class free lists */
+/* Sibling blocks released by           */
+/* disconnectBranch() mostly come in a  */
+/* handful of sizes (the branching      */
+/* factor shrinks by one per ply). Each */
+/* list is keyed by block length and is */
+/* threaded through the dead head Node  */
+/* of every block, so no extra memory   */
+/* is needed:                           */
+/*   head->branches        = next block */
+/*   head->createdBranches = length     */
+/*   head->activeBranches  = removed    */
+/* MaxBlockLen==0 disables the lists.   */
+/****************************************/
+    template <int MaxBlockLen, GameMove MoveType>
+    struct NodeFreeLists
+    {
+        Node<MoveType> *heads[MaxBlockLen+1] = {nullptr};
+        UQWORD hits = 0, misses = 0;
+
+        constexpr bool push(Node<MoveType> *block, const int len)
+        {
+            if constexpr (MaxBlockLen == 0)
+                return false;
+            if (len > MaxBlockLen)
+                return false;
+            block->activeBranches  = Node<MoveType>::removed;
+            block->createdBranches = len;
+            block->branches        = heads[len];
+            heads[len] = block;
+            return true;
+        }
+
+        constexpr Node<MoveType> *pop(const int len)
+        {
+            if constexpr (MaxBlockLen == 0)
+                return nullptr;
+            if (len > MaxBlockLen)
+                return nullptr; // Never listed, not a miss
+            if (heads[len] == nullptr)
+            {
+                misses += 1;
+                return nullptr;
+            }
+            Node<MoveType> *block = heads[len];
+            heads[len] = block->branches;
+            hits += 1;
+            return block;
+        }
+
+        constexpr bool empty() const
+        {
+            for (int len=1; len<=MaxBlockLen; ++len)
+                if (heads[len]) return false;
+            return true;
+        }
+
+        // Hand every listed block to 'fn(block, len)' and forget about it:
+        template <typename Fn>
+        constexpr void drain(Fn&& fn)
+        {
+            for (int len=1; len<=MaxBlockLen; ++len)
+            {
+                while (heads[len])
+                {
+                    Node<MoveType> *block = heads[len];
+                    heads[len] = block->branches;
+                    fn(block, len);
+                }
+            }
+        }
+
+        constexpr void clear()
+        {
+            for (int len=0; len<=MaxBlockLen; ++len)
+                heads[len] = nullptr;
+        }
+
+        constexpr float hitRate() const
+        {
+            const UQWORD total = hits + misses;
+            return total ? (hits-0.f) / (total-0.f) : 0.f;
+        }
+    };
+
+
+/****************************************/
+/*                      Node pool shard */
+/* One arena of the node pool with its  */
+/* own BitAlloc. The owning thread is   */
+/* the only one allocating from it,     */
+/* except when another shard runs dry   */
+/* and steals (hence the 'busy' flag,   */
+/* which is practically uncontended).   */
+/* Blocks freed by a foreign thread are */
+/* pushed onto 'returned', a lock-free  */
+/* intrusive stack the owner reclaims   */
+/* in one exchange() (no ABA possible)  */
+/****************************************/
+    template <int ShardNodes, GameMove MoveType, BitfieldIntType BitfieldType, int FreeListMaxLen>
+    struct alignas(64) NodeShard
+    {
+        BitAlloc<ShardNodes, BitfieldType> bitalloc;
+        NodeFreeLists<FreeListMaxLen, MoveType> freeLists;
+        std::atomic<Node<MoveType> *> returned = nullptr;
+        std::atomic_flag busy;
+
+        void lock()    { while (busy.test_and_set(std::memory_order_acquire)) { while (busy.test(std::memory_order_relaxed)) {} } }
+        bool tryLock() { return !busy.test_and_set(std::memory_order_acquire); }
+        void unlock()  { busy.clear(std::memory_order_release); }
+    };
+
+
 /****************************************/
 /*                           Ai context */
+/* Shards>1 partitions the node pool    */
+/* into per-thread arenas, see above    */
 /****************************************/
-    template <int NumNodes, GameMove MoveType, BitfieldIntType BitfieldType>
+    template <int NumNodes, BitfieldIntType BitfieldType, int Shards>
+    inline constexpr bool shardedPoolFits =
+        Shards == 1 || (((NumNodes/Shards)*Shards) == NumNodes && ((NumNodes/Shards) % (sizeof(BitfieldType)*CHARBITS)) == 0);
+
+    template <int NumNodes, GameMove MoveType, BitfieldIntType BitfieldType, int FreeListMaxLen=0, int Shards=1>
     struct Ai_ctx
     {
+        static_assert(Shards >= 1);
         static constexpr int numNodes = NumNodes;
-        BitAlloc<NumNodes, BitfieldType> bitalloc;
+        static constexpr int numShards = Shards;
+        static constexpr int nodesPerShard = NumNodes / Shards;
+        static_assert(shardedPoolFits<NumNodes, BitfieldType, Shards>,
+                      "Every shard must span a whole number of bitfield words");
+        NodeShard<nodesPerShard, MoveType, BitfieldType, FreeListMaxLen> shards[Shards];
         Node<MoveType> nodePool[NumNodes];
 
         Ai_ctx() {}
@@ -219,13 +732,184 @@ int shallowestTerminalDepth = 9999;
     };
 
 
+/****************************************/
+/*                   Branch allocation  */
+/* Exact-size free list first, then the */
+/* bitmap scan. If the bitmap can only  */
+/* offer a truncated chunk, the lists   */
+/* are flushed back and the scan is     */
+/* retried once before giving up.       */
+/* With several shards the home shard   */
+/* is tried first, then the others are  */
+/* raided (work stealing).              */
+/****************************************/
+    template <typename Ctx, typename Shard>
+    inline void reclaimReturned(Ctx& ctx, Shard& shard, const int base)
+    {
+        auto *block = shard.returned.exchange(nullptr, std::memory_order_acquire);
+        while (block)
+        {
+            auto *next = block->branches; // Read before push() overwrites the link
+            const int len = block->createdBranches;
+            if (!shard.freeLists.push(block, len))
+                shard.bitalloc.free(static_cast<int>(block - ctx.nodePool) - base, len);
+            block = next;
+        }
+    }
+
+    template <typename Ctx, typename Shard>
+    constexpr auto allocateFromShard(Ctx& ctx, Shard& shard, const int shardIdx, const int desiredSize)
+    {
+        using Chunk = decltype(shard.bitalloc.largestAvailChunk(0));
+        const int base = shardIdx * Ctx::nodesPerShard;
+        if constexpr (Ctx::numShards > 1)
+            reclaimReturned(ctx, shard, base);
+
+        if (auto *block = shard.freeLists.pop(desiredSize))
+            return Chunk{ .posOfAvailChunk = static_cast<int>(block - ctx.nodePool), .length = desiredSize };
+
+        Chunk chunk = shard.bitalloc.largestAvailChunk(desiredSize);
+        if (chunk.length < desiredSize && !shard.freeLists.empty())
+        {
+            if (chunk.length > 0)
+                shard.bitalloc.free(chunk.posOfAvailChunk, chunk.length);
+            shard.freeLists.drain([&ctx, &shard, base](const auto *block, const int len)
+                                  {
+                                      shard.bitalloc.free(static_cast<int>(block - ctx.nodePool) - base, len);
+                                  });
+            chunk = shard.bitalloc.largestAvailChunk(desiredSize);
+        }
+        if (chunk.posOfAvailChunk != -1)
+            chunk.posOfAvailChunk += base;
+        return chunk;
+    }
+
+    template <typename Ctx>
+    constexpr void releaseBranches(Ctx& ctx, const int pos, const int len, const int shardIdx=0)
+    {
+        const int owner = pos / Ctx::nodesPerShard;
+        auto& shard = ctx.shards[owner];
+        if constexpr (Ctx::numShards == 1)
+        {
+            if (!shard.freeLists.push(&ctx.nodePool[pos], len))
+                shard.bitalloc.free(pos, len);
+        }
+        else if (owner == shardIdx)
+        {
+            shard.lock();
+            if (!shard.freeLists.push(&ctx.nodePool[pos], len))
+                shard.bitalloc.free(pos - owner*Ctx::nodesPerShard, len);
+            shard.unlock();
+        }
+        else
+        {
+            // Foreign block, hand it back to its owner without taking any lock:
+            using NodeType = std::remove_reference_t<decltype(ctx.nodePool[0])>;
+            NodeType *block = &ctx.nodePool[pos];
+            block->activeBranches  = NodeType::removed;
+            block->createdBranches = len;
+            auto *head = shard.returned.load(std::memory_order_relaxed);
+            do { block->branches = head; }
+            while (!shard.returned.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+        }
+    }
+
+    template <typename Ctx>
+    constexpr auto allocateBranches(Ctx& ctx, const int desiredSize, const int shardIdx=0)
+    {
+        if constexpr (Ctx::numShards == 1)
+        {
+            return allocateFromShard(ctx, ctx.shards[0], 0, desiredSize);
+        }
+        else
+        {
+            auto& home = ctx.shards[shardIdx];
+            home.lock();
+            auto chunk = allocateFromShard(ctx, home, shardIdx, desiredSize);
+            home.unlock();
+
+            // Home ran dry (or only has a truncated chunk left). Steal from the others:
+            for (int i=1; i<Ctx::numShards && chunk.length<desiredSize; ++i)
+            {
+                const int victimIdx = (shardIdx + i) % Ctx::numShards;
+                auto& victim = ctx.shards[victimIdx];
+                if (!victim.tryLock())
+                    continue; // Its owner is busy, don't wait for it
+                auto stolen = allocateFromShard(ctx, victim, victimIdx, desiredSize);
+                victim.unlock();
+                if (stolen.length > chunk.length)
+                {
+                    const auto tmp = chunk;
+                    chunk = stolen;
+                    stolen = tmp;
+                }
+                if (stolen.length > 0) // Keep the larger one, return the other
+                    releaseBranches(ctx, stolen.posOfAvailChunk, stolen.length, shardIdx);
+            }
+            return chunk;
+        }
+    }
+
+    // Start of every search. With one shard mcts() calls this itself and node 0
+    // is reserved for the root. A sharded pool is reset by the caller, once,
+    // before its threads start searching (each takes its root from its shard):
+    template <typename Ctx>
+    inline void resetNodePool(Ctx& ctx)
+    {
+        for (auto& shard : ctx.shards)
+        {
+            shard.bitalloc.clearAll();
+            shard.freeLists.clear();
+            shard.returned.store(nullptr, std::memory_order_relaxed);
+        }
+        for (auto& node : ctx.nodePool)
+        {
+            node.activeBranches = node.never_expanded;
+            node.createdBranches = 0;
+        }
+        if constexpr (Ctx::numShards == 1)
+        {
+            [[maybe_unused]] const auto root = ctx.shards[0].bitalloc.largestAvailChunk(1);
+            aiAssert(root.posOfAvailChunk == 0);
+        }
+    }
+
+    // 1 - (largest free run / all free nodes). 0 means all free nodes are in one
+    // piece. Free-listed blocks are handed back to the bitmap first, so with one
+    // shard this must only be called in between searches (shards are locked):
+    template <typename Ctx>
+    inline float poolFragmentation(Ctx& ctx)
+    {
+        int avail = 0, largestRun = 0;
+        for (int shardIdx=0; shardIdx<Ctx::numShards; ++shardIdx)
+        {
+            auto& shard = ctx.shards[shardIdx];
+            const int base = shardIdx * Ctx::nodesPerShard;
+            if constexpr (Ctx::numShards > 1)
+                shard.lock();
+            reclaimReturned(ctx, shard, base);
+            shard.freeLists.drain([&ctx, &shard, base](const auto *block, const int len)
+                                  {
+                                      shard.bitalloc.free(static_cast<int>(block - ctx.nodePool) - base, len);
+                                  });
+            avail += shard.bitalloc.countAvail();
+            largestRun = aiMax(largestRun, shard.bitalloc.largestAvailRun());
+            if constexpr (Ctx::numShards > 1)
+                shard.unlock();
+        }
+        return avail ? 1.f - (largestRun-0.f) / (avail-0.f) : 0.f;
+    }
+
+
 /****************************************/
 /*    Search tree node helper functions */
 /****************************************/
-    template <int NumNodes, GameMove MoveType, BitfieldIntType BitfieldType>
-    inline void disconnectBranch(Ai_ctx<NumNodes, MoveType, BitfieldType>& ai_ctx,
+    // Returns the number of nodes handed back to the allocator:
+    template <int NumNodes, GameMove MoveType, BitfieldIntType BitfieldType, int FreeListMaxLen, int Shards>
+    inline int disconnectBranch(Ai_ctx<NumNodes, MoveType, BitfieldType, FreeListMaxLen, Shards>& ai_ctx,
                                  Node<MoveType> *parent,
-                                 const Node<MoveType> *removeMe)
+                                 const Node<MoveType> *removeMe,
+                                 const int shardIdx = 0)
     {
         aiAssert(parent);
         aiAssert(parent->activeBranches > 0);
@@ -242,10 +926,12 @@ int shallowestTerminalDepth = 9999;
 
         // 'parent->parent' is correct:
         const bool branchIsChildOfRoot = parent->parent == nullptr; // Keep full set of moves for root
+        int nodesFreed = 0;
         if (removeMe->createdBranches && !branchIsChildOfRoot)
         {
             //std::printf("rem: %d \n", removeMe->createdBranches);
-            ai_ctx.bitalloc.free(removeMe->branches - ai_ctx.nodePool, removeMe->createdBranches);
+            nodesFreed = removeMe->createdBranches;
+            releaseBranches(ai_ctx, removeMe->branches - ai_ctx.nodePool, removeMe->createdBranches, shardIdx);
         }
 
         const MoveType removedMoveHere = swapDst.moveHere;
@@ -285,6 +971,7 @@ int shallowestTerminalDepth = 9999;
 
         parent->activeBranches -= 1;
         aiAssert(swapDst.parent == parent);
+        return nodesFreed;
     }
 
 
@@ -306,39 +993,150 @@ int shallowestTerminalDepth = 9999;
 /* hidden identities after moves have   */
 /* been made without breaking causality */
 /****************************************/
+    // Single random playout. Returns +1 if the player to move in
+    // 'original' wins, -1 if they lose and 0 for a draw:
+    template <Gameview Board>
+    constexpr int rollout(const Board& original, Xoroshiro128Plus& rand)
+    {
+        Board boardSim = original.clone();
+        // Start single sim, run until end:
+        auto outcome = Outcome::running;
+        do
+        {
+            LegalMoves<Board> legalMoves;
+            const int nAvailMovesForThisTurn = legalMoves.generate(boardSim);
+            if (nAvailMovesForThisTurn == 0)
+                break;
+            const int idx = rand.nextInt(nAvailMovesForThisTurn);
+            outcome = boardSim.doMove( legalMoves[idx] );
+            boardSim.switchPlayer();
+        } while (outcome==Outcome::running);
+        // Count winner/loser:
+        if (outcome == Outcome::draw)
+            return 0;
+        return boardSim.getWinner() == original.getCurrentPlayer() ? 1 : -1;
+    }
+
     template <int MaxRandSims, Gameview Board>
     constexpr float simulate(const Board& original, Xoroshiro128Plus& rand)
     {
         int simWins = 0;
         // Run simulations:
         for (int i=0; i<MaxRandSims; ++i)
+            simWins += rollout(original, rand);
+        const float winRatio = (simWins-0.f) / (MaxRandSims-0.f);
+        return winRatio; // range from [-1,1]
+    }
+
+
+#ifndef INCLUDEAI__ROLLOUT_LANES
+  #define INCLUDEAI__ROLLOUT_LANES 1
+#endif
+    constexpr int RolloutLanes = INCLUDEAI__ROLLOUT_LANES;
+
+/****************************************/
+/*         Simulator, interleaved lanes */
+/* Plays 'Lanes' playouts side by side  */
+/* in one thread, one move per lane per */
+/* step. The lanes don't depend on each */
+/* other, so the cpu can overlap their  */
+/* (mostly branchy, latency bound)      */
+/* move generation. Every lane draws    */
+/* from its own random stream           */
+/****************************************/
+    template <int MaxRandSims, int Lanes, Gameview Board>
+    constexpr float simulateInterleaved(const Board& original, Xoroshiro128Plus& rand)
+    {
+        static_assert(Lanes > 0);
+        int simWins = 0;
+        for (int done=0; done<MaxRandSims; done+=Lanes)
         {
-            Board boardSim = original.clone();
-            // Start single sim, run until end:
-            auto outcome = Outcome::running;
-            do
-            {
-                typename Board::StorageForMoves storageForMoves;
-                const int nAvailMovesForThisTurn = boardSim.generateMovesAndGetCnt(storageForMoves);
-                if (nAvailMovesForThisTurn == 0)
-                    break;
-                const int idx = rand.nextInt(nAvailMovesForThisTurn);
-                outcome = boardSim.doMove( storageForMoves[idx] );
-                boardSim.switchPlayer();
-            } while (outcome==Outcome::running);
-            // Count winner/loser:
-            if (outcome != Outcome::draw)
+            const int lanesNow = (MaxRandSims-done) < Lanes ? (MaxRandSims-done) : Lanes;
+            simWins += [&]<int... Lane>(std::integer_sequence<int, Lane...>) -> int
             {
-                const bool weWon = boardSim.getWinner() == original.getCurrentPlayer();
-                simWins += weWon;
-                simWins -= !weWon;
-            }
+                Board boards[Lanes] = { ((void)Lane, original.clone())... };
+                Xoroshiro128PlusLanes<Lanes> streams(rand());
+                Outcome outcomes[Lanes] = { ((void)Lane, Outcome::running)... };
+                bool running[Lanes] = { (Lane < lanesNow)... };
+                int nRunning = lanesNow;
+                LegalMoves<Board> legalMoves[Lanes];
+                UDWORD nAvailMoves[Lanes];
+                UDWORD idx[Lanes];
+                while (nRunning > 0)
+                {
+                    for (int lane=0; lane<Lanes; ++lane)
+                    {
+                        nAvailMoves[lane] = 0;
+                        if (running[lane])
+                            nAvailMoves[lane] = legalMoves[lane].generate(boards[lane]);
+                    }
+                    streams.nextInts(idx, nAvailMoves); // One draw for every lane at once
+                    for (int lane=0; lane<Lanes; ++lane)
+                    {
+                        if (!running[lane])
+                            continue;
+                        if (nAvailMoves[lane] != 0)
+                        {
+                            outcomes[lane] = boards[lane].doMove( legalMoves[lane][idx[lane]] );
+                            boards[lane].switchPlayer();
+                        }
+                        if (nAvailMoves[lane] == 0 || outcomes[lane] != Outcome::running)
+                        {
+                            running[lane] = false;
+                            nRunning -= 1;
+                        }
+                    }
+                }
+                int wins = 0;
+                for (int lane=0; lane<lanesNow; ++lane)
+                    if (outcomes[lane] != Outcome::draw && outcomes[lane] != Outcome::running)
+                        wins += boards[lane].getWinner() == original.getCurrentPlayer() ? 1 : -1;
+                return wins;
+            }(std::make_integer_sequence<int, Lanes>{});
         }
         const float winRatio = (simWins-0.f) / (MaxRandSims-0.f);
         return winRatio; // range from [-1,1]
     }
 
 
+/****************************************/
+/*             Simulator, leaf-parallel */
+/* Spreads the playouts of one leaf     */
+/* over a WorkerPool. Each worker gets  */
+/* its own random stream and its own    */
+/* cache line for the win count, the    */
+/* counts are summed at the end. Worth  */
+/* it when a single playout is long     */
+/* (big boards, e.g. Yavalath)          */
+/****************************************/
+    template <int MaxRandSims, Gameview Board>
+    float simulate(const Board& original, Xoroshiro128Plus& rand, WorkerPool& pool)
+    {
+        struct alignas(64) WinCount { int wins; };
+        WinCount winCounts[WorkerPool::MaxWorkers];
+        const int nWorkers = pool.size() < MaxRandSims ? pool.size() : MaxRandSims;
+        const UQWORD seed = rand();
+        auto job = [&](const int workerIdx)
+        {
+            if (workerIdx >= nWorkers)
+                return;
+            Xoroshiro128Plus stream = Xoroshiro128Plus::stream(seed, workerIdx);
+            const int begin = (MaxRandSims * workerIdx) / nWorkers;
+            const int end   = (MaxRandSims * (workerIdx+1)) / nWorkers;
+            int wins = 0;
+            for (int i=begin; i<end; ++i)
+                wins += rollout(original, stream);
+            winCounts[workerIdx].wins = wins;
+        };
+        pool.run(job);
+        int simWins = 0;
+        for (int w=0; w<nWorkers; ++w)
+            simWins += winCounts[w].wins;
+        const float winRatio = (simWins-0.f) / (MaxRandSims-0.f);
+        return winRatio; // range from [-1,1]
+    }
+
+
 /****************************************/
 /*                              Minimax */
 /* A board.clone() arriving here is     */
@@ -368,33 +1166,28 @@ int shallowestTerminalDepth = 9999;
                 return MinimaxWin;
         }
         if (depth<=0) { return MinimaxIndeterminable; }
-        typename Board::StorageForMoves storageForMoves;
-        int nMoves = clone.generateMovesAndGetCnt(storageForMoves);
-        nMoves -= 1;
+        LegalMoves<Board> legalMoves;
+        const int nMoves = legalMoves.generate(clone);
         if (clone.getCurrentPlayer() == current.getCurrentPlayer())
         {
             SWORD bestScore = MinimaxInit;
             bool encounteredIndeterminable = false;
-            while (nMoves >= 0)
+            legalMoves.forEach(nMoves, [&](const MoveType moveHere)
             {
-                const MoveType moveHere = storageForMoves[nMoves];
                 const SWORD returnedScore = minimax(clone, moveHere, alpha, beta, depth-1);
                 if (returnedScore == MinimaxIndeterminable)
                 {
                     encounteredIndeterminable = true;
                     // We cannot use this branch for scoring (yet),
                     // but we must continue searching in case we find a Win elsewhere.
-                    nMoves -= 1;
-                    continue;
+                    return true;
                 }
                 bestScore = aiMax(bestScore, returnedScore);
                 alpha     = aiMax(alpha, bestScore);
                 if (bestScore == MinimaxWin) // Can't do better than "win"
-                    break;
-                if (beta <= alpha)
-                    break;
-                nMoves -= 1;
-            }
+                    return false;
+                return beta > alpha;
+            });
             if (encounteredIndeterminable && bestScore != MinimaxWin) // rhs: Never let indeterminable paths overwrite a proven win.
                 // hit a depth limit on one of the branches:
                 return MinimaxIndeterminable;
@@ -407,64 +1200,137 @@ int shallowestTerminalDepth = 9999;
             // Alpha/Beta from Opponent's perspective:
             SWORD oppAlpha = -beta;
             const SWORD oppBeta  = -alpha;
-            while (nMoves >= 0)
+            legalMoves.forEach(nMoves, [&](const MoveType moveHere)
             {
-                const MoveType moveHere = storageForMoves[nMoves];
                 const SWORD returnedScore = minimax(clone, moveHere, -beta, -alpha, depth-1);
                 if (returnedScore == MinimaxIndeterminable)
                 {
                     // See above for explanation ^
                     encounteredIndeterminable = true;
-                    nMoves -= 1;
-                    continue;
+                    return true;
                 }
                 bestOpponentScore = aiMax(bestOpponentScore, returnedScore);
                 oppAlpha = aiMax(oppAlpha, returnedScore);
                 if (bestOpponentScore == MinimaxWin)
-                    break;
-                if (oppBeta <= oppAlpha)
-                    break;
-                nMoves -= 1;
-            }
+                    return false;
+                return oppBeta > oppAlpha;
+            });
             if (encounteredIndeterminable && bestOpponentScore != MinimaxWin)
                 return MinimaxIndeterminable; // see above^ for explanation
             return bestOpponentScore == MinimaxInit ? MinimaxDraw : -bestOpponentScore;
         }
     }
 
-    template <Gameview Board, GameMove MoveType>
-    inline constexpr SWORD minimax(const Board& current, const int MaxDepth)
+    // The first ply of 'clone', forEachMove(f) calls f(move) while it
+    // returns true, see LegalMoves::forEach():
+    template <Gameview Board, GameMove MoveType, typename ForEachMove>
+    inline constexpr SWORD minimaxMoves(const Board& clone, ForEachMove&& forEachMove, const int MaxDepth)
     {
-        Board clone = current.clone();
-        typename Board::StorageForMoves storageForMoves;
-        int nMoves = clone.generateMovesAndGetCnt(storageForMoves);
-        nMoves -= 1;
         SWORD best = MinimaxInit;
         bool encounteredIndeterminable = false;
-        while (nMoves >= 0)
+        forEachMove([&](const MoveType moveHere)
         {
-            const MoveType moveHere = storageForMoves[nMoves];
             const SWORD mnx = minimax(clone, moveHere, MinimaxLose, MinimaxWin, MaxDepth);
             if (mnx == MinimaxIndeterminable)
             {
                 encounteredIndeterminable = true;
-                nMoves -= 1;
-                continue;
+                return true;
             }
             if (mnx > best)
                 best = mnx;
-            if (best == MinimaxWin)
-                break;
-            nMoves -= 1;
-        }
+            return best != MinimaxWin;
+        });
         if (encounteredIndeterminable && best != MinimaxWin)
             return MinimaxIndeterminable;
         return best==MinimaxInit ? MinimaxDraw : best;
     }
 
+    template <Gameview Board, GameMove MoveType>
+    inline constexpr SWORD minimax(const Board& current, const int MaxDepth)
+    {
+        Board clone = current.clone();
+        LegalMoves<Board> legalMoves;
+        const int nMoves = legalMoves.generate(clone);
+        return minimaxMoves<Board, MoveType>(clone, [&](auto f) { legalMoves.forEach(nMoves, f); }, MaxDepth);
+    }
+
+    // Same, the first ply in the order of the policy head (a win found
+    // early ends the search). 'outputs' are the network outputs for
+    // 'current', e.g. those that gave it its value:
+    template <PolicyGameview Board, GameMove MoveType>
+    inline constexpr SWORD minimaxByPolicy(const Board& current, const int MaxDepth, const FLOAT *outputs)
+    {
+        Board clone = current.clone();
+        typename Board::StorageForMoves storageForMoves;
+        const int nMoves = clone.generateMovesAndGetCnt(storageForMoves);
+        orderMovesByPolicy(clone, outputs, storageForMoves, nMoves, nMoves);
+        return minimaxMoves<Board, MoveType>(clone, [&](auto f) { forEachListedMove(storageForMoves, nMoves, f); }, MaxDepth);
+    }
+
+    template <PolicyGameview Board, GameMove MoveType, typename NN>
+    inline constexpr SWORD minimax(const Board& current, const int MaxDepth, NN& nn)
+    {
+        Board clone = current.clone();
+        return minimaxByPolicy<Board, MoveType>(current, MaxDepth, nn.evaluate(clone.getNetworkInputs()));
+    }
+
+
+/****************************************/
+/*              Tree memory statistics  */
+/* Plain counters bumped once per       */
+/* expansion/disconnect. Define         */
+/* INCLUDEAI__NO_MEMORY_STATS to        */
+/* compile them out entirely.           */
+/****************************************/
+    struct TreeMemoryStats
+    {
+        #ifndef INCLUDEAI__NO_MEMORY_STATS
+          int inUse = 1; // root
+          int peakInUse = 1, highWaterMark = 1, truncatedExpansions = 0, nodesFreed = 0;
+
+          constexpr void expanded(const int pos, const int len, const int desired)
+          {
+              truncatedExpansions += len < desired;
+              if (pos == -1)
+                  return;
+              inUse += len;
+              peakInUse = aiMax(peakInUse, inUse);
+              highWaterMark = aiMax(highWaterMark, pos + len);
+          }
+
+          constexpr void released(const int len)
+          {
+              inUse -= len;
+              nodesFreed += len;
+          }
+
+          template <typename Result, typename Ctx>
+          void store(Result& result, Ctx& ctx) const
+          {
+              result.statistics[Result::peakNodesInUse]      = peakInUse;
+              result.statistics[Result::highWaterMark]       = highWaterMark;
+              result.statistics[Result::truncatedExpansions] = truncatedExpansions;
+              result.statistics[Result::nodesFreed]          = nodesFreed;
+              result.statistics[Result::fragmentation]       = poolFragmentation(ctx);
+          }
+        #else
+          constexpr void expanded(int, int, int) {}
+          constexpr void released(int) {}
+          template <typename Result, typename Ctx>
+          void store(Result&, Ctx&) const {}
+        #endif
+    };
+
 
 /****************************************/
 /*                               result */
+/* The memory statistics are how        */
+/* 'NumNodes' should be sized for a     */
+/* game: peak live nodes, the highest   */
+/* node position ever handed out, the   */
+/* expansions that got fewer nodes than */
+/* moves, nodes freed by pruning and    */
+/* how fragmented the pool ended up.    */
 /****************************************/
     template <GameMove MoveType>
     struct MCTS_result
@@ -472,6 +1338,7 @@ int shallowestTerminalDepth = 9999;
         enum { simulations, minimaxes, thresholdLevel, networkEvaluated, terminalReached,
                desyncs,
                score, visits,
+               peakNodesInUse, highWaterMark, truncatedExpansions, nodesFreed, fragmentation,
                end
              };
         float statistics[end] = {0};
@@ -506,7 +1373,7 @@ int shallowestTerminalDepth = 9999;
               typename AiCtx,
               typename NN
              >
-    constexpr MCTS_result<MoveType> mcts(const Board& boardOriginal, AiCtx& ai_ctx, NN& nn, UQWORD seed=69420) noexcept
+    constexpr MCTS_result<MoveType> mcts(const Board& boardOriginal, AiCtx& ai_ctx, NN& nn, UQWORD seed=69420, const int shardIdx=0) noexcept
     {
         [[maybe_unused]] auto UCBselectBranch =
             [](const Node<MoveType>& node) -> Node<MoveType> *
@@ -553,9 +1420,11 @@ int shallowestTerminalDepth = 9999;
                       }
                     #endif
                 }
-                int pos = node.activeBranches - 1;
-                float best = node.branches[pos].UCBscore;
-                for (int i=pos-1; i>=0; --i)
+                // Ties go to the lower index: branches[0] is the most likely move
+                // with a policy head (disconnectBranch() moves the last into a gap)
+                int pos = 0;
+                float best = node.branches[0].UCBscore;
+                for (int i=1; i<node.activeBranches; ++i)
                 {
                     if (node.branches[i].UCBscore > best)
                     {
@@ -591,29 +1460,42 @@ int shallowestTerminalDepth = 9999;
             };
 
 
-        Node<MoveType> *placeholder = nullptr; // Prevent gcc from deducting the wrong type... 🙄
-        Node<MoveType> *root = &insertNodeIntoPool(ai_ctx, 0, placeholder, MoveType{});
-        ai_ctx.bitalloc.clearAll();
-        [[maybe_unused]] const auto throwaway = ai_ctx.bitalloc.largestAvailChunk(1);
-        for (int i=0; i<AiCtx::numNodes; ++i)
-        {
-            ai_ctx.nodePool[i].activeBranches = -1;
-            ai_ctx.nodePool[i].createdBranches = 0;
-        }
-
         int cutoffDepth = 9999;
+        TreeMemoryStats memoryStats;
         FLOAT threshold = 1.1f; // 'threshold' above which the result of .evaluate() is used, not minimax or randroll
         SWORD rootMovesRemaining;
         MCTS_result<MoveType> mcts_result;
+
+        // Several threads can search with one sharded Ai_ctx, each passing its
+        // own shardIdx. Then the caller resets the pool before they start:
+        int rootPos = 0;
+        if constexpr (AiCtx::numShards == 1)
+            resetNodePool(ai_ctx);
+        else
+            rootPos = allocateBranches(ai_ctx, 1, shardIdx).posOfAvailChunk;
+        if (rootPos == -1) [[unlikely]]
+        {
+            mcts_result.errorOutOfMem = true;
+            return mcts_result;
+        }
+        Node<MoveType> *placeholder = nullptr; // Prevent gcc from deducting the wrong type... 🙄
+        Node<MoveType> *root = &insertNodeIntoPool(ai_ctx, rootPos, placeholder, MoveType{});
         Xoroshiro128Plus rand(seed);
+        if constexpr (InputDeltaGameview<Board> && BaseEvaluator<NN>)
+        {
+            Board rootView = boardOriginal.clone();
+            nn.setBase(rootView.getNetworkInputs()); // See evaluateLeaf()
+        }
         for (int iterations=0; root->activeBranches!=0 && iterations<MaxIterations; ++iterations)
         {
             Node<MoveType> *selectedNode = root;
             Board boardClone = boardOriginal.clone();
             boardClone.randomize(rand()); // Hidden information is simulated by creating a "plausibe" random game state
             typename Board::StorageForMoves storageForMoves;
+            LegalMoves<Board> legalMoves;
             Outcome outcome = Outcome::running;
             int depth = 1;
+            const FLOAT *leafOutputs = nullptr; // The network outputs for boardClone, if already evaluated
 
 
 
@@ -629,17 +1511,9 @@ int shallowestTerminalDepth = 9999;
                 //aiAssert(selectedNode->branchScore == 0);
                 aiAssert(selectedNode->parent == parentOfSelected);
                 const MoveType moveHere = selectedNode->moveHere;
-                const int nMoves = boardClone.generateMovesAndGetCnt(storageForMoves);
+                const int nMoves = legalMoves.generate(boardClone);
                 // desyncs can happen due to the call to randomize()
-                bool moveIsValid = false;
-                for (int i=0; i<nMoves; ++i)
-                {
-                    if (moveHere == storageForMoves[i])
-                    {
-                        moveIsValid = true;
-                        break;
-                    }
-                }
+                const bool moveIsValid = legalMoves.contains(moveHere, nMoves);
                 if (!moveIsValid)
                 {
                     is_desynchronized = true;
@@ -679,7 +1553,9 @@ int shallowestTerminalDepth = 9999;
             {
                 // typename Board::StorageForMoves storageForMoves; // todo: test and remove if working
                 int nValidMoves = boardClone.generateMovesAndGetCnt(storageForMoves);
-                const auto availNodes = ai_ctx.bitalloc.largestAvailChunk(nValidMoves);
+                const auto availNodes = allocateBranches(ai_ctx, nValidMoves, shardIdx);
+                memoryStats.expanded(availNodes.posOfAvailChunk, availNodes.length, nValidMoves);
+                const int nGenerated = nValidMoves;
                 nValidMoves = availNodes.length; // This line is critical!
                 int nodePos = availNodes.posOfAvailChunk;
                 if (nodePos == -1) [[unlikely]]
@@ -688,6 +1564,13 @@ int shallowestTerminalDepth = 9999;
                     // todo: record this in the result!
                     break;
                 }
+                // branches[0] becomes the most likely, also if not all moves got a node.
+                // The same evaluation scores this node in step 4:
+                if constexpr (PolicyGameview<Board>)
+                {
+                    leafOutputs = evaluateLeaf(boardClone, nn);
+                    orderMovesByPolicy(boardClone, leafOutputs, storageForMoves, nGenerated, nValidMoves);
+                }
                 if (selectedNode == root)
                     rootMovesRemaining = nValidMoves;
 
@@ -746,12 +1629,14 @@ int shallowestTerminalDepth = 9999;
             {
                 rootMovesRemaining -= 1;
                 selectedNode = &root->branches[rootMovesRemaining];
+                leafOutputs = nullptr; // Those were the root's
                 outcome = boardClone.doMove( selectedNode->moveHere );
                 boardClone.switchPlayer();
                 depth += 1;
             }
-            // 3b. Pick (select) a node for analysis:
-            else if (selectedNode->activeBranches > 0)
+            // 3b. Pick (select) a node for analysis. A node that was just
+            // evaluated for its policy is analysed itself:
+            else if (selectedNode->activeBranches > 0 && !leafOutputs)
             {
                 aiAssert(selectedNode->branches);
                 if constexpr (Board::MaxNetworkInputs > 0)
@@ -811,17 +1696,26 @@ int shallowestTerminalDepth = 9999;
                   const SWORD polarity = boardClone.getWinner()!=boardOriginal.getCurrentPlayer() ? -1 : 1;
                 #endif
 
-                const FLOAT *pValues = nn.evaluate(boardClone.getNetworkInputs());
+                const FLOAT *pValues = leafOutputs ? leafOutputs : evaluateLeaf(boardClone, nn);
                 //const FLOAT *pValues = selectedNode->nnEvaluationResult;
                 const FLOAT confidence = pValues[0];
                 aiAssert(confidence<1.1f && confidence>-1.1f);
                 if (aiAbs(confidence) < threshold)
                 {
-                    const SWORD branchscore = minimax<Board, MoveType>(boardClone, MinimaxDepth);
+                    SWORD branchscore;
+                    if constexpr (PolicyGameview<Board>)
+                        branchscore = minimaxByPolicy<Board, MoveType>(boardClone, MinimaxDepth, pValues);
+                    else
+                        branchscore = minimax<Board, MoveType>(boardClone, MinimaxDepth);
                     if (branchscore == MinimaxIndeterminable) // Fallback if minimax fails
                     {
                         // Simulate to get an estimation of the quality of this position:
-                        score = simulate<SimDepth>(boardClone, rand);
+                        if constexpr (requires { ai_ctx.rolloutPool; })
+                            score = simulate<SimDepth>(boardClone, rand, ai_ctx.rolloutPool);
+                        else if constexpr (RolloutLanes > 1)
+                            score = simulateInterleaved<SimDepth, RolloutLanes>(boardClone, rand);
+                        else
+                            score = simulate<SimDepth>(boardClone, rand);
                         score *= polarity-0.f;
                         mcts_result.statistics[MCTS_result<MoveType>::simulations] += 1;
                         // worst case: no clear result. Adjust threshold:
@@ -977,7 +1871,7 @@ int shallowestTerminalDepth = 9999;
                   //  std::printf("%d \n", parent->activeBranches);
 
 
-                    disconnectBranch(ai_ctx, parent, child);
+                    memoryStats.released(disconnectBranch(ai_ctx, parent, child, shardIdx));
                     if (parent->activeBranches != 0)
                     {
                         break; // Stop
@@ -1098,6 +1992,7 @@ int shallowestTerminalDepth = 9999;
 
             mcts_result.statistics[MCTS_result<MoveType>::score]  = bestScore;
             mcts_result.statistics[MCTS_result<MoveType>::visits] = bestVisits;
+            memoryStats.store(mcts_result, ai_ctx);
             mcts_result.best = [root, posVisits, posScore, bestScore]
                                {
                                    if (bestScore > 0.f)
@@ -1108,6 +2003,68 @@ int shallowestTerminalDepth = 9999;
 
     }
 
+
+/****************************************/
+/*                            Self-play */
+/* The producer side: plays one game of */
+/* mcts against itself and pushes every */
+/* position, labelled +1 if the player  */
+/* to move won, -1 if it lost, 0 for a  */
+/* draw, to a ReplayBuffer. Run it in   */
+/* as many threads as there are cores,  */
+/* each with its own ai_ctx and nn      */
+/* (e.g. an Evaluator on the network    */
+/* acquired from a ModelExchange). Only */
+/* the last MaxPlies positions of a     */
+/* longer game are kept                 */
+/****************************************/
+    template <int MaxIterations,
+              int SimDepth,
+              int MinimaxDepth,
+              GameMove MoveType,
+              BitfieldIntType BitfieldType,
+              int MaxPlies,
+              Gameview Board,
+              typename AiCtx,
+              typename NN,
+              typename Buffer
+             >
+    Outcome selfPlayGame(const Board& start, AiCtx& ai_ctx, NN& nn, Buffer& buffer, UQWORD seed=69420) noexcept
+    {
+        static_assert(Buffer::inputSize == Board::MaxNetworkInputs && Buffer::outputSize == 1, "a value network");
+        using Player = decltype(start.getCurrentPlayer());
+        FLOAT positions[MaxPlies][Board::MaxNetworkInputs];
+        Player toMove[MaxPlies];
+        int plies = 0;
+        Board board = start.clone();
+        Outcome outcome = Outcome::running;
+        while (outcome == Outcome::running)
+        {
+            const int slot = plies % MaxPlies;
+            const FLOAT *inputs = board.getNetworkInputs();
+            for (int i=0; i<Board::MaxNetworkInputs; ++i)
+                positions[slot][i] = inputs[i];
+            toMove[slot] = board.getCurrentPlayer();
+            plies += 1;
+
+            const MCTS_result<MoveType> res =
+                mcts<MaxIterations, SimDepth, MinimaxDepth, MoveType, BitfieldType>(board, ai_ctx, nn, seed + plies);
+            outcome = board.doMove(res.best);
+            board.switchPlayer();
+        }
+
+        const int first = plies > MaxPlies ? plies - MaxPlies : 0;
+        for (int ply=first; ply<plies; ++ply)
+        {
+            const int slot = ply % MaxPlies;
+            FLOAT target = 0.0f;
+            if (outcome == Outcome::fin)
+                target = toMove[slot] == board.getWinner() ? 1.0f : -1.0f;
+            buffer.push(positions[slot], &target);
+        }
+        return outcome;
+    }
+
     template <int MaxIterations,
               int SimDepth,
               int MinimaxDepth,
@@ -194,3 +194,21 @@
                       return ok;
                   }()
                  );
+
+    static_assert([]
+                  {
+                      constexpr bool comptime = true;
+                      BitAlloc<20, UBYTE, BitAlloc_Mode::FAST, comptime> testAlloc; // 3 buckets, 4 padding bits
+                      bool ok = testAlloc.countAvail() == 20 && testAlloc.largestAvailRun() == 20;
+                      testAlloc.largestAvailChunk(6);  // 0..5
+                      testAlloc.largestAvailChunk(10); // 8..17
+                      ok = ok && testAlloc.countAvail() == 4;
+                      ok = ok && testAlloc.largestAvailRun() == 2;
+                      testAlloc.free(10, 4);
+                      ok = ok && testAlloc.countAvail() == 8;
+                      ok = ok && testAlloc.largestAvailRun() == 4;
+                      testAlloc.free(0, 6);
+                      ok = ok && testAlloc.largestAvailRun() == 8; // 0..7
+                      return ok;
+                  }()
+                 );
@@ -240,6 +240,41 @@
             for (int i=0; i<NumberOfBuckets; ++i)
                 bucketPool[i] = 0;
         }
+
+        // Statistics (not meant for the hot path). Bit 'Intbits-1' of a bucket is
+        // position 0, padding bits past 'Size' are never counted:
+        constexpr int countAvail() const
+        {
+            int avail = 0;
+            for (int pos=0; pos<Size; ++pos)
+                avail += isAvail(pos);
+            return avail;
+        }
+
+        constexpr int largestAvailRun() const
+        {
+            int best = 0, run = 0;
+            for (int pos=0; pos<Size; ++pos)
+            {
+                if (pos % Intbits == 0 && bucketPool[pos/Intbits] == 0 && pos+Intbits <= Size)
+                {
+                    run += Intbits; // Fast path for empty buckets
+                    pos += Intbits - 1;
+                }
+                else
+                {
+                    run = isAvail(pos) ? run+1 : 0;
+                }
+                best = bitAllocatorMax(best, run);
+            }
+            return best;
+        }
+
+    private:
+        constexpr bool isAvail(const int pos) const
+        {
+            return ((bucketPool[pos/Intbits] >> (Intbits - 1 - (pos%Intbits))) & 1) == 0;
+        }
     };
 
 
@@ -1,4 +1,5 @@
 #include "bitvec.hpp"
+#include <assert.h>
 
 /****************************************/
 /*                                Tests */
@@ -89,3 +90,311 @@
                       return a.getNthSetBit(0)==1 && a.getNthSetBit(1)==7;
                   }()
                  );
+
+    static_assert([]
+                  {
+                      // 19x19 board, at compile time the word loops stand in for the wide paths:
+                      Bitvec<UQWORD, 361> a, b;
+                      a.setRange(0, 200);
+                      b.setRange(150, 360);
+                      bool ok = (a | b).popcnt() == 361 && (a & b).popcnt() == 51 && (a ^ b).popcnt() == 310;
+                      ok = ok && (~a).popcnt() == 160 && (~a | a) == ~Bitvec<UQWORD, 361>() && !(~(a | b));
+                      ok = ok && static_cast<bool>(b) && !Bitvec<UQWORD, 361>() && a != b;
+                      Bitvec<UDWORD, 4100> big;
+                      big.setRange(3, 4098);
+                      return ok && big.popcnt() == 4096 && (~big).popcnt() == 4;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UQWORD, 200> a;
+                      a.set(3);
+                      a.set(130);
+                      bool ok = (a << 0) == a && (a >> 0) == a;
+                      ok = ok && (a << 70).popcnt() == 1 && (a << 70).check(73);
+                      ok = ok && (a >> 4).popcnt() == 1 && (a >> 4).check(126);
+                      ok = ok && (a << 64).check(67) && (a << 64).check(194) && !(a << 200) && !(a >> 131);
+                      Bitvec<UBYTE, 20> b;
+                      b.setRange(0, 19);
+                      ok = ok && (b << 5).popcnt() == 15 && (b << 5).check(5) && !(b << 5).check(4);
+                      return ok && (b >> 13).popcnt() == 7 && ((b << 13) >> 13).popcnt() == 7;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      using Board = Bitvec<UQWORD, 169>;
+                      using Grid = BitGrid<Board, 13, 13>;
+                      constexpr Grid grid;
+                      Board stones;
+                      // Three at the end of row 2 and three at the start of row 3 lie
+                      // next to each other in memory, but are not six in a row:
+                      stones.setRange(2*13+10, 3*13+2);
+                      bool ok = !grid.anyInARow<6>(stones) && grid.anyInARow<3>(stones);
+                      ok = ok && !grid.shift(stones, Grid::east).check(3*13);
+                      ok = ok && grid.shift(stones, Grid::west, 2).popcnt() == 4;
+                      for (int i = 0; i < 6; ++i)
+                          stones.set((5+i)*13 + i);
+                      const Board ends = grid.kInARow<6>(stones, Grid::southEast);
+                      ok = ok && ends.popcnt() == 1 && ends.check(10*13 + 5);
+                      ok = ok && grid.kInARow<6>(stones, Grid::northWest).check(5*13);
+                      return ok && grid.anyInARow<6>(stones) && !grid.anyInARow<7>(stones);
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      // Hexagon with 5 cells a side in an 11x11 layout (rows shifted by one each):
+                      using Board = Bitvec<UQWORD, 121>;
+                      using Hex = BitGrid<Board, 11, 11, GridShape::hex>;
+                      Board cells;
+                      for (int y = 1; y < 10; ++y)
+                          cells.setRange(y*11 + (y < 5 ? 6-y : 1), y*11 + (y < 5 ? 9 : 14-y));
+                      const Hex hex(cells);
+                      bool ok = cells.popcnt() == 61 && hex.shift(cells, Hex::east).popcnt() == 61-9;
+                      Board stones;
+                      for (int i = 0; i < 4; ++i)
+                          stones.set((5-i)*11 + 1+i); // Towards north-east from the west corner
+                      ok = ok && hex.anyInARow<4>(stones) && hex.kInARow<4>(stones, Hex::northEast).check(2*11 + 4);
+                      stones.clear(2*11 + 4);
+                      stones.set(1*11 + 5);
+                      return ok && !hex.anyInARow<4>(stones) && hex.kInARow<3>(stones, Hex::southWest).check(5*11 + 1);
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      bool ok = bitvecSelect64(1, 0) == 0 && bitvecSelect64(~0ull, 63) == 63;
+                      ok = ok && bitvecSelect64(0x8000000100010000ull, 1) == 32 && bitvecSelect64(0x8000000100010000ull, 2) == 63;
+                      Bitvec<UQWORD, 200> a;
+                      a.set(5); a.set(64); a.set(100); a.set(199);
+                      ok = ok && a.getNthSetBit(2) == 100 && a.getNthSetBit(3) == 199 && a.getNthSetBit(4) == -1;
+                      const auto ranks = a.rankIndex();
+                      ok = ok && ranks.popcnt() == 4 && ranks.select(0) == 5 && ranks.select(1) == 64 && ranks.select(3) == 199;
+                      ok = ok && ranks.select(4) == -1 && ranks.rank(64) == 1 && ranks.rank(65) == 2 && ranks.rank(200) == 4;
+                      Bitvec<UBYTE, 12> b;
+                      b.setRange(3, 10);
+                      const auto byteRanks = b.rankIndex();
+                      return ok && byteRanks.select(5) == 8 && byteRanks.rank(9) == 6 && b.getNthSetBit(7) == 10;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UQWORD, 200> a;
+                      a.set(5); a.set(64); a.set(100); a.set(199);
+                      int sum = 0, visited = 0;
+                      a.forEachSetBit([&](int bit) { sum += bit; });
+                      a.forEachSetBit([&](int bit) { visited += 1; return bit < 64; }); // Stops after 64
+                      return sum == 5 + 64 + 100 + 199 && visited == 2;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      Bitvec<UQWORD, 361> a, b;
+                      a.setRange(10, 300);
+                      b = ~(~a); // Same bits, built differently
+                      bool ok = a.hashValue() == b.hashValue() && a.hashValue() != Bitvec<UQWORD, 361>().hashValue();
+                      b.clear(299);
+                      ok = ok && a.hashValue() != b.hashValue();
+                      Bitvec<UBYTE, 12> c, d;
+                      c.set(3);
+                      d = c;
+                      d.set(14); // Padding, ignored like by ==
+                      return ok && c == d && c.hashValue() == d.hashValue() && (c << 1).hashValue() != c.hashValue();
+                  }()
+                 );
+
+
+
+/****************************************/
+/*                        Runtime tests */
+/* Constant evaluation takes the word   */
+/* loops, these compare the vector      */
+/* paths against them at start-up in    */
+/* builds that define                   */
+/* INCLUDEAI__RUNTIME_TESTS             */
+/****************************************/
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    inline UQWORD bitvecTestRandom(UQWORD& state) // splitmix64
+    {
+        UQWORD z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Ops, ==, bool and popcnt() of random vectors (padding bits too, they
+    // must not leak into the results) against the same words one by one.
+    // The words go in and out through set() and check(), bit by bit:
+    template <class Int, int Size>
+    bool bitvecWideMatchesWords(UQWORD& state)
+    {
+        using Vec = Bitvec<Int, Size>;
+        using UInt = std::make_unsigned_t<Int>;
+        constexpr int w = int(sizeof(Int)*CHARBITS);
+        constexpr int nInts = (Size + w - 1) / w;
+        constexpr int lastBits = Size - (nInts-1) * w;
+        constexpr UInt lastMask = lastBits == w ? UInt(~UInt(0)) : UInt((UInt(1) << lastBits) - 1);
+        auto load = [](Vec& vec, const UInt *words)
+        {
+            for (int pos=0; pos<nInts*w; ++pos)
+                vec.set(pos, (words[pos / w] >> (pos % w)) & 1);
+        };
+        auto word = [](const Vec& vec, const int i)
+        {
+            UInt result = 0;
+            for (int bit=0; bit<w; ++bit)
+                result |= static_cast<UInt>(vec.check(i*w + bit) ? UInt(1) << bit : 0);
+            return result;
+        };
+        bool ok = true;
+        for (int round=0; round<32; ++round)
+        {
+            UInt wa[nInts], wb[nInts];
+            for (int i=0; i<nInts; ++i)
+            {
+                wa[i] = static_cast<UInt>(bitvecTestRandom(state));
+                wb[i] = static_cast<UInt>(bitvecTestRandom(state));
+                if (round % 4 == 1) // Sparse
+                    wa[i] &= static_cast<UInt>(bitvecTestRandom(state) & bitvecTestRandom(state));
+                if (round % 4 == 2) // Empty but for the padding
+                    wa[i] = i == nInts-1 ? static_cast<UInt>(~lastMask) : 0;
+            }
+            if (round % 8 == 2) // One bit
+            {
+                const int pos = static_cast<int>(bitvecTestRandom(state) % Size);
+                wa[pos / w] |= static_cast<UInt>(UInt(1) << (pos % w));
+            }
+            Vec a, b;
+            load(a, wa);
+            load(b, wb);
+
+            const Vec orV = a | b, andV = a & b, xorV = a ^ b, notV = ~a;
+            UQWORD cnt = 0;
+            bool any = false;
+            for (int i=0; i<nInts; ++i)
+            {
+                const UInt masked = i == nInts-1 ? static_cast<UInt>(wa[i] & lastMask) : wa[i];
+                ok = ok && word(orV, i) == static_cast<UInt>(wa[i] | wb[i]);
+                ok = ok && word(andV, i) == static_cast<UInt>(wa[i] & wb[i]);
+                ok = ok && word(xorV, i) == static_cast<UInt>(wa[i] ^ wb[i]);
+                ok = ok && word(notV, i) == static_cast<UInt>(i == nInts-1 ? ~wa[i] & lastMask : ~wa[i]);
+                cnt += static_cast<UQWORD>(std::popcount(masked));
+                any = any || masked != 0;
+            }
+            ok = ok && a.popcnt() == static_cast<Int>(cnt) && static_cast<bool>(a) == any;
+
+            Vec c = a;
+            ok = ok && c == a;
+            if constexpr (lastBits != w)
+            {
+                c.set(Size, !a.check(Size)); // Padding only
+                ok = ok && c == a;
+            }
+            const int pos = static_cast<int>(bitvecTestRandom(state) % Size);
+            c.set(pos, !a.check(pos));
+            ok = ok && !(c == a) && (a ^ c).popcnt() == 1;
+        }
+        return ok;
+    }
+
+    [[maybe_unused]] static const bool bitvecWideChecked = []
+    {
+        UQWORD state = 2024;
+        bool ok = true;
+    #if INCLUDEAI_SIMD_BITVEC == 256
+        {
+            // Lanes of bitvecPopcount256(), then Harley-Seal below, at and past
+            // 16 vectors, with every remainder:
+            alignas(32) UQWORD words[48 * 4];
+            for (UQWORD& word : words)
+                word = bitvecTestRandom(state) & (bitvecTestRandom(state) % 3 == 0 ? ~0ull : bitvecTestRandom(state));
+            for (int v=0; v<48; ++v)
+            {
+                alignas(32) UQWORD lanes[4];
+                _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), bitvecPopcount256(_mm256_load_si256(reinterpret_cast<const __m256i *>(words) + v)));
+                for (int lane=0; lane<4; ++lane)
+                    ok = ok && lanes[lane] == static_cast<UQWORD>(std::popcount(words[v*4 + lane]));
+            }
+            UQWORD expected = 0;
+            for (int n=0; n<=48; ++n)
+            {
+                ok = ok && bitvecPopcountBytes(reinterpret_cast<const UBYTE *>(words), n) == expected;
+                if (n < 48)
+                    for (int lane=0; lane<4; ++lane)
+                        expected += static_cast<UQWORD>(std::popcount(words[n*4 + lane]));
+            }
+        }
+    #endif
+        // Whole vectors (512, 1024), tails of every kind (257, 361, 777, 1000)
+        // and enough for Harley-Seal in popcnt() (4500):
+        ok = ok && bitvecWideMatchesWords<UQWORD, 361>(state) && bitvecWideMatchesWords<UQWORD, 512>(state);
+        ok = ok && bitvecWideMatchesWords<UQWORD, 1024>(state) && bitvecWideMatchesWords<UQWORD, 257>(state);
+        ok = ok && bitvecWideMatchesWords<UQWORD, 1000>(state) && bitvecWideMatchesWords<UQWORD, 4500>(state);
+        ok = ok && bitvecWideMatchesWords<UDWORD, 361>(state) && bitvecWideMatchesWords<UDWORD, 777>(state);
+        ok = ok && bitvecWideMatchesWords<UDWORD, 1024>(state) && bitvecWideMatchesWords<UWORD, 361>(state);
+        ok = ok && bitvecWideMatchesWords<UWORD, 1000>(state) && bitvecWideMatchesWords<UBYTE, 361>(state);
+        ok = ok && bitvecWideMatchesWords<UBYTE, 512>(state) && bitvecWideMatchesWords<UBYTE, 1000>(state);
+        ok = ok && bitvecWideMatchesWords<UBYTE, 4500>(state);
+        assert(ok);
+        return ok;
+    }();
+
+    // getNthSetBit() and RankIndex::select() against the set bits listed
+    // by check(), on random vectors with padding bits set:
+    template <class Int, int Size>
+    bool bitvecSelectMatchesNaive(UQWORD& state)
+    {
+        constexpr int w = int(sizeof(Int)*CHARBITS);
+        constexpr int nBits = (Size + w - 1) / w * w;
+        bool ok = true;
+        for (int round=0; round<16; ++round)
+        {
+            Bitvec<Int, Size> vec;
+            for (int pos=0; pos<nBits; ++pos)
+                vec.set(pos, bitvecTestRandom(state) % 8 < static_cast<UQWORD>(round % 8)); // Empty to dense
+            int setBits[Size];
+            int nSet = 0;
+            for (int pos=0; pos<Size; ++pos)
+                if (vec.check(pos))
+                    setBits[nSet++] = pos;
+            const auto ranks = vec.rankIndex();
+            ok = ok && ranks.popcnt() == nSet;
+            for (int n=0; n<=nSet; ++n)
+            {
+                const int expected = n < nSet ? setBits[n] : -1;
+                ok = ok && vec.getNthSetBit(n) == expected && ranks.select(n) == expected;
+                ok = ok && (n == nSet || ranks.rank(expected) == n);
+            }
+        }
+        return ok;
+    }
+
+    [[maybe_unused]] static const bool bitvecSelectChecked = []
+    {
+        UQWORD state = 4711;
+        bool ok = true;
+        // bitvecSelect64() (pdep in -mbmi2 builds) against the n-th set bit
+        // found bit by bit, every n of words from sparse to full:
+        for (int round=0; round<4096; ++round)
+        {
+            UQWORD word = bitvecTestRandom(state);
+            for (int thin=0; thin<round%4; ++thin)
+                word &= bitvecTestRandom(state);
+            if (round % 64 == 0)
+                word = ~0ull;
+            int n = 0;
+            for (int pos=0; pos<64; ++pos)
+                if ((word >> pos) & 1)
+                    ok = ok && bitvecSelect64(word, n++) == pos;
+        }
+        ok = ok && bitvecSelectMatchesNaive<UQWORD, 1000>(state) && bitvecSelectMatchesNaive<UQWORD, 361>(state);
+        ok = ok && bitvecSelectMatchesNaive<UDWORD, 361>(state) && bitvecSelectMatchesNaive<UWORD, 200>(state);
+        ok = ok && bitvecSelectMatchesNaive<UBYTE, 361>(state) && bitvecSelectMatchesNaive<UBYTE, 12>(state);
+        assert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
@@ -2,9 +2,163 @@
 #define BITVEC_HPP
 
 #include "asmtypes.hpp"
+#include <bit>
 #include <compare>
+#include <type_traits>
 
 
+/****************************************/
+/*                      Wide bulk paths */
+/* Bitvecs of 256 bits and more do |=,  */
+/* &=, ^=, ~, ==, bool and popcnt() a   */
+/* vector at a time when the build      */
+/* targets it (-mavx2, 64 bytes at a    */
+/* time with avx-512f, vpopcntq, arm64) */
+/* Picked at compile time: these run    */
+/* inside rollouts, a dispatch per call */
+/* would cost more than the work.       */
+/* Constant evaluation always takes the */
+/* word loops. Define                   */
+/* INCLUDEAI_SIMD_OFF for word loops    */
+/* everywhere                           */
+/****************************************/
+#if !defined(INCLUDEAI_SIMD_OFF) && defined(__AVX2__)
+  #define INCLUDEAI_SIMD_BITVEC 256
+  #include <immintrin.h>
+#elif !defined(INCLUDEAI_SIMD_OFF) && defined(__ARM_NEON) && defined(__aarch64__)
+  #define INCLUDEAI_SIMD_BITVEC 128
+  #include <arm_neon.h>
+#else
+  #define INCLUDEAI_SIMD_BITVEC 0
+#endif
+#if INCLUDEAI_SIMD_BITVEC == 256 && defined(__AVX512F__)
+  #define INCLUDEAI_SIMD_BITVEC512 1
+#else
+  #define INCLUDEAI_SIMD_BITVEC512 0
+#endif
+#if INCLUDEAI_SIMD_BITVEC512 && defined(__AVX512VPOPCNTDQ__) && defined(__AVX512BW__)
+  #define INCLUDEAI_SIMD_POPCNT512 1
+#else
+  #define INCLUDEAI_SIMD_POPCNT512 0
+#endif
+
+#if INCLUDEAI_SIMD_BITVEC == 256
+    // Set bits of each 64 bit lane (Mula: nibble lookup, then psadbw):
+    inline __m256i bitvecPopcount256(const __m256i v)
+    {
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        const __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, nibble));
+        const __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+    }
+
+    // Carry-save adder: a + b + c = 2*high + low, bitwise
+    inline void bitvecCsa(__m256i& high, __m256i& low, const __m256i a, const __m256i b, const __m256i c)
+    {
+        const __m256i u = _mm256_xor_si256(a, b);
+        high = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+        low = _mm256_xor_si256(u, c);
+    }
+
+    inline UQWORD bitvecSum256(const __m256i v)
+    {
+        const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        return static_cast<UQWORD>(_mm_cvtsi128_si64(s)) + static_cast<UQWORD>(_mm_extract_epi64(s, 1));
+    }
+
+    // Set bits in 'n' vectors at 'p'. Harley-Seal: 16 vectors go through
+    // a tree of carry-save adders, only the carries out of it are counted;
+    // the rest (and short vectors) are counted one vector at a time
+    inline UQWORD bitvecPopcountBytes(const UBYTE *p, const int n)
+    {
+        auto load = [p](const int v) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p) + v); };
+        __m256i total = _mm256_setzero_si256();
+        int v = 0;
+        if (n >= 16)
+        {
+            __m256i ones = total, twos = total, fours = total, eights = total, sixteens;
+            __m256i twosA, twosB, foursA, foursB, eightsA, eightsB;
+            for (; v + 16 <= n; v += 16)
+            {
+                bitvecCsa(twosA, ones, ones, load(v), load(v+1));
+                bitvecCsa(twosB, ones, ones, load(v+2), load(v+3));
+                bitvecCsa(foursA, twos, twos, twosA, twosB);
+                bitvecCsa(twosA, ones, ones, load(v+4), load(v+5));
+                bitvecCsa(twosB, ones, ones, load(v+6), load(v+7));
+                bitvecCsa(foursB, twos, twos, twosA, twosB);
+                bitvecCsa(eightsA, fours, fours, foursA, foursB);
+                bitvecCsa(twosA, ones, ones, load(v+8), load(v+9));
+                bitvecCsa(twosB, ones, ones, load(v+10), load(v+11));
+                bitvecCsa(foursA, twos, twos, twosA, twosB);
+                bitvecCsa(twosA, ones, ones, load(v+12), load(v+13));
+                bitvecCsa(twosB, ones, ones, load(v+14), load(v+15));
+                bitvecCsa(foursB, twos, twos, twosA, twosB);
+                bitvecCsa(eightsB, fours, fours, foursA, foursB);
+                bitvecCsa(sixteens, eights, eights, eightsA, eightsB);
+                total = _mm256_add_epi64(total, bitvecPopcount256(sixteens));
+            }
+            total = _mm256_slli_epi64(total, 4);
+            total = _mm256_add_epi64(total, _mm256_slli_epi64(bitvecPopcount256(eights), 3));
+            total = _mm256_add_epi64(total, _mm256_slli_epi64(bitvecPopcount256(fours), 2));
+            total = _mm256_add_epi64(total, _mm256_slli_epi64(bitvecPopcount256(twos), 1));
+            total = _mm256_add_epi64(total, bitvecPopcount256(ones));
+        }
+        for (; v < n; ++v)
+            total = _mm256_add_epi64(total, bitvecPopcount256(load(v)));
+        return bitvecSum256(total);
+    }
+#endif
+
+
+/****************************************/
+/*                     Select in a word */
+/* Position of the n-th (from 0) set    */
+/* bit of a word in constant time: one  */
+/* pdep with BMI2. Otherwise a bytewise */
+/* compare against the running byte     */
+/* counts finds the byte, the nibble,   */
+/* pair and bit counts the rest. pdep   */
+/* is slow on Zen 1/2, build without    */
+/* -mbmi2 or with INCLUDEAI_SIMD_OFF    */
+/****************************************/
+#if !defined(INCLUDEAI_SIMD_OFF) && defined(__BMI2__)
+  #define INCLUDEAI_BMI2_SELECT 1
+  #include <immintrin.h>
+#else
+  #define INCLUDEAI_BMI2_SELECT 0
+#endif
+    // 'n' must be below the popcount of 'word':
+    constexpr int bitvecSelect64(const UQWORD word, int n)
+    {
+    #if INCLUDEAI_BMI2_SELECT
+        if (!std::is_constant_evaluated())
+            return std::countr_zero(_pdep_u64(UQWORD(1) << n, word));
+    #endif
+        constexpr UQWORD ones = 0x0101010101010101ull, highs = 0x8080808080808080ull;
+        const UQWORD c1 = word - ((word >> 1) & 0x5555555555555555ull);
+        const UQWORD c2 = (c1 & 0x3333333333333333ull) + ((c1 >> 2) & 0x3333333333333333ull);
+        const UQWORD c4 = (c2 + (c2 >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        // Byte i of 'upTo' counts the set bits in bytes 0..i, the target
+        // byte is the number of bytes whose count does not exceed n:
+        const UQWORD upTo = c4 * ones;
+        const UQWORD notAbove = ((static_cast<UQWORD>(n) * ones | highs) - upTo) & highs;
+        int pos = static_cast<int>(((notAbove >> 7) * ones) >> 56) * 8;
+        n -= static_cast<int>(((upTo << 8) >> pos) & 0xFF);
+        auto descend = [&](const UQWORD counts, const UQWORD fieldMask, const int half)
+        {
+            const int below = static_cast<int>((counts >> pos) & fieldMask);
+            const bool upper = n >= below;
+            pos += upper * half;
+            n -= upper * below;
+        };
+        descend(c2, 0xF, 4);
+        descend(c1, 0x3, 2);
+        descend(word, 0x1, 1);
+        return pos;
+    }
+
 /****************************************/
 /*                           Bit vector */
 /****************************************/
@@ -16,6 +170,178 @@
         static constexpr Int shift = []{ Int p=0, b=sizeof(Int)*Charbits; while (b>>=1) p++; return p; }();
         static constexpr int N_INTS = (Size + w - 1) / w;
         Int mem[N_INTS] = {};
+    private:
+        // See "Wide bulk paths". Vectors cover mem[0 .. VecInts*nVecs),
+        // nFullVecs of them lie before the last (partly used) word:
+        static constexpr bool Wide = INCLUDEAI_SIMD_BITVEC > 0 && Size >= 256;
+        static constexpr int VecBytes = INCLUDEAI_SIMD_BITVEC > 0 ? INCLUDEAI_SIMD_BITVEC / 8 : 16;
+        static constexpr int VecInts = VecBytes / static_cast<int>(sizeof(Int));
+        static constexpr int nVecs = N_INTS / VecInts;
+        static constexpr int nFullVecs = (N_INTS-1) / VecInts;
+        enum class WideOp { orOp, andOp, xorOp, notOp };
+
+        UBYTE *bytes() { return reinterpret_cast<UBYTE *>(mem); }
+        const UBYTE *bytes() const { return reinterpret_cast<const UBYTE *>(mem); }
+
+        static constexpr Int lastMask()
+        {
+            if constexpr (Size % w != 0)
+                return (Int(1) << (Size % w)) - 1;
+            else
+                return static_cast<Int>(~Int(0));
+        }
+
+        // Word 'i' without the padding bits:
+        constexpr std::make_unsigned_t<Int> maskedWord(const int i) const
+        {
+            return static_cast<std::make_unsigned_t<Int>>(i == N_INTS-1 ? mem[i] & lastMask() : mem[i]);
+        }
+
+        // dst = this op rhs (rhs unused for notOp), all words:
+        template <WideOp Op>
+        void wide(Bitvec& dst, const Bitvec& rhs) const
+        {
+            int i = 0;
+        #if INCLUDEAI_SIMD_BITVEC512
+            // Pairs of vectors, the rest below. No masked tail: the next
+            // operation on the board would wait for a masked store
+            for (int v = 0; v + 2 <= nVecs; v += 2)
+            {
+                const __m512i a = _mm512_loadu_si512(bytes() + v*VecBytes);
+                __m512i r;
+                if constexpr (Op == WideOp::orOp)
+                    r = _mm512_or_si512(a, _mm512_loadu_si512(rhs.bytes() + v*VecBytes));
+                else if constexpr (Op == WideOp::andOp)
+                    r = _mm512_and_si512(a, _mm512_loadu_si512(rhs.bytes() + v*VecBytes));
+                else if constexpr (Op == WideOp::xorOp)
+                    r = _mm512_xor_si512(a, _mm512_loadu_si512(rhs.bytes() + v*VecBytes));
+                else
+                    r = _mm512_ternarylogic_epi64(a, a, a, 0x55); // ~a
+                _mm512_storeu_si512(dst.bytes() + v*VecBytes, r);
+            }
+            i = (nVecs & ~1) * VecInts;
+        #endif
+        #if INCLUDEAI_SIMD_BITVEC == 256
+            for (int v = i / VecInts; v < nVecs; ++v)
+            {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes()) + v);
+                const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs.bytes()) + v);
+                __m256i r;
+                if constexpr (Op == WideOp::orOp)
+                    r = _mm256_or_si256(a, b);
+                else if constexpr (Op == WideOp::andOp)
+                    r = _mm256_and_si256(a, b);
+                else if constexpr (Op == WideOp::xorOp)
+                    r = _mm256_xor_si256(a, b);
+                else
+                    r = _mm256_xor_si256(a, _mm256_set1_epi32(-1));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst.bytes()) + v, r);
+            }
+            i = nVecs * VecInts;
+        #elif INCLUDEAI_SIMD_BITVEC == 128
+            for (int v = 0; v < nVecs; ++v)
+            {
+                const uint8x16_t a = vld1q_u8(bytes() + v*16);
+                const uint8x16_t b = vld1q_u8(rhs.bytes() + v*16);
+                uint8x16_t r;
+                if constexpr (Op == WideOp::orOp)
+                    r = vorrq_u8(a, b);
+                else if constexpr (Op == WideOp::andOp)
+                    r = vandq_u8(a, b);
+                else if constexpr (Op == WideOp::xorOp)
+                    r = veorq_u8(a, b);
+                else
+                    r = vmvnq_u8(a);
+                vst1q_u8(dst.bytes() + v*16, r);
+            }
+            i = nVecs * VecInts;
+        #endif
+            for (; i < N_INTS; ++i)
+            {
+                if constexpr (Op == WideOp::orOp)
+                    dst.mem[i] = mem[i] | rhs.mem[i];
+                else if constexpr (Op == WideOp::andOp)
+                    dst.mem[i] = mem[i] & rhs.mem[i];
+                else if constexpr (Op == WideOp::xorOp)
+                    dst.mem[i] = mem[i] ^ rhs.mem[i];
+                else
+                    dst.mem[i] = ~mem[i];
+            }
+        }
+
+        // Any bit set in this (xor rhs, if Xor) in the words before the last:
+        template <bool Xor>
+        bool wideAny(const Bitvec& rhs) const
+        {
+            int i = 0;
+            bool any = false;
+        #if INCLUDEAI_SIMD_BITVEC512
+            __m512i acc512 = _mm512_setzero_si512();
+            for (int v = 0; v + 2 <= nFullVecs; v += 2)
+            {
+                __m512i a = _mm512_loadu_si512(bytes() + v*VecBytes);
+                if constexpr (Xor)
+                    a = _mm512_xor_si512(a, _mm512_loadu_si512(rhs.bytes() + v*VecBytes));
+                acc512 = _mm512_or_si512(acc512, a);
+            }
+            any = _mm512_test_epi64_mask(acc512, acc512) != 0;
+            i = (nFullVecs & ~1) * VecInts;
+        #endif
+        #if INCLUDEAI_SIMD_BITVEC == 256
+            __m256i acc = _mm256_setzero_si256();
+            for (int v = i / VecInts; v < nFullVecs; ++v)
+            {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes()) + v);
+                if constexpr (Xor)
+                    a = _mm256_xor_si256(a, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs.bytes()) + v));
+                acc = _mm256_or_si256(acc, a);
+            }
+            any = any || !_mm256_testz_si256(acc, acc);
+            i = nFullVecs * VecInts;
+        #elif INCLUDEAI_SIMD_BITVEC == 128
+            uint8x16_t acc = vdupq_n_u8(0);
+            for (int v = 0; v < nFullVecs; ++v)
+            {
+                uint8x16_t a = vld1q_u8(bytes() + v*16);
+                if constexpr (Xor)
+                    a = veorq_u8(a, vld1q_u8(rhs.bytes() + v*16));
+                acc = vorrq_u8(acc, a);
+            }
+            any = vmaxvq_u8(acc) != 0;
+            i = nFullVecs * VecInts;
+        #endif
+            for (; i < N_INTS-1; ++i)
+                any = any || (Xor ? mem[i] != rhs.mem[i] : mem[i] != 0);
+            return any;
+        }
+
+        // Set bits in the words before the last:
+        UQWORD widePopcnt() const
+        {
+            UQWORD cnt = 0;
+            int i = 0;
+        #if INCLUDEAI_SIMD_POPCNT512
+            // Whole 64 bytes only, the rest by word (a masked tail waits for
+            // the store of the last operation, see wide()):
+            __m512i acc = _mm512_setzero_si512();
+            for (int v = 0; v + 2 <= nFullVecs; v += 2)
+                acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512(bytes() + v*VecBytes)));
+            // The halves through bitvecSum256. Full-mask maskz: the plain cast and
+            // extract trip -Wuninitialized in gcc 12's headers, same instruction
+            cnt = bitvecSum256(_mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(0xf, acc, 0), _mm512_maskz_extracti64x4_epi64(0xf, acc, 1)));
+            i = (nFullVecs & ~1) * VecInts;
+        #elif INCLUDEAI_SIMD_BITVEC == 256
+            cnt = bitvecPopcountBytes(bytes(), nFullVecs);
+            i = nFullVecs * VecInts;
+        #elif INCLUDEAI_SIMD_BITVEC == 128
+            for (int v = 0; v < nFullVecs; ++v)
+                cnt += vaddvq_u8(vcntq_u8(vld1q_u8(bytes() + v*16))); // At most 128 per vector
+            i = nFullVecs * VecInts;
+        #endif
+            for (; i < N_INTS-1; ++i)
+                cnt += static_cast<UQWORD>(std::popcount(static_cast<std::make_unsigned_t<Int>>(mem[i])));
+            return cnt;
+        }
     public:
         // Helper for operator[]:
         class BitProxy
@@ -67,6 +393,11 @@
 
         constexpr explicit operator bool() const
         {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                    return wideAny<false>(*this) || (mem[N_INTS-1] & lastMask()) != 0;
+            }
             for (int i = 0; i < N_INTS - 1; ++i)
                 if (mem[i] != 0) return true;
 
@@ -82,6 +413,11 @@
 
         constexpr bool operator==(const Bitvec& rhs) const
         {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                    return !wideAny<true>(rhs) && ((mem[N_INTS-1] ^ rhs.mem[N_INTS-1]) & lastMask()) == 0;
+            }
             int same = 0;
             for (int i=0; i<(N_INTS-1); ++i)
                 same += mem[i] == rhs.mem[i];
@@ -128,6 +464,14 @@
 
         constexpr Bitvec& operator|=(const Bitvec& rhs)
         {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                {
+                    wide<WideOp::orOp>(*this, rhs);
+                    return *this;
+                }
+            }
             for (int i=0; i<N_INTS; ++i)
                 mem[i] |= rhs.mem[i];
             return *this;
@@ -142,6 +486,14 @@
 
         constexpr Bitvec& operator&=(const Bitvec& rhs)
         {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                {
+                    wide<WideOp::andOp>(*this, rhs);
+                    return *this;
+                }
+            }
             for (int i=0; i<N_INTS; ++i)
                 mem[i] &= rhs.mem[i];
             return *this;
@@ -156,6 +508,14 @@
 
         constexpr Bitvec& operator^=(const Bitvec& rhs)
         {
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                {
+                    wide<WideOp::xorOp>(*this, rhs);
+                    return *this;
+                }
+            }
             for (int i=0; i<N_INTS; ++i)
                 mem[i] ^= rhs.mem[i];
             return *this;
@@ -171,8 +531,19 @@
         constexpr Bitvec operator~() const
         {
             Bitvec result;
-            for (int i = 0; i < N_INTS; ++i)
-                result.mem[i] = ~mem[i];
+            if constexpr (Wide)
+            {
+                if (!std::is_constant_evaluated())
+                    wide<WideOp::notOp>(result, *this);
+                else
+                    for (int i = 0; i < N_INTS; ++i)
+                        result.mem[i] = ~mem[i];
+            }
+            else
+            {
+                for (int i = 0; i < N_INTS; ++i)
+                    result.mem[i] = ~mem[i];
+            }
 
             // Safely mask off the trailing unused bits in the final word.
             // This prevents issues with popcnt() or == accidentally counting
@@ -241,6 +612,63 @@
             return result;
         }
 
+        // Shifts across word boundaries, bits moved past Size are dropped:
+        constexpr Bitvec& operator<<=(const int n)
+        {
+            if (n >= Size)
+            {
+                clearAll();
+                return *this;
+            }
+            const int words = n >> shift, bits = n & (w-1);
+            for (int i = N_INTS-1; i >= words; --i)
+            {
+                Int v = static_cast<Int>(mem[i-words] << bits);
+                if (bits && i > words)
+                    v |= static_cast<Int>(mem[i-words-1] >> (w-bits));
+                mem[i] = v;
+            }
+            for (int i = 0; i < words; ++i)
+                mem[i] = 0;
+            mem[N_INTS-1] &= lastMask();
+            return *this;
+        }
+
+        constexpr Bitvec operator<<(const int n) const
+        {
+            Bitvec result = *this;
+            result <<= n;
+            return result;
+        }
+
+        constexpr Bitvec& operator>>=(const int n)
+        {
+            if (n >= Size)
+            {
+                clearAll();
+                return *this;
+            }
+            const int words = n >> shift, bits = n & (w-1);
+            mem[N_INTS-1] &= lastMask();
+            for (int i = 0; i < N_INTS-words; ++i)
+            {
+                Int v = static_cast<Int>(mem[i+words] >> bits);
+                if (bits && i+words+1 < N_INTS)
+                    v |= static_cast<Int>(mem[i+words+1] << (w-bits));
+                mem[i] = v;
+            }
+            for (int i = N_INTS-words; i < N_INTS; ++i)
+                mem[i] = 0;
+            return *this;
+        }
+
+        constexpr Bitvec operator>>(const int n) const
+        {
+            Bitvec result = *this;
+            result >>= n;
+            return result;
+        }
+
         constexpr void set(const int pos, const bool val)
         {
             const Int mask = Int(1) << (pos&(w-1));
@@ -358,6 +786,11 @@
         template <bool Comptime=false>
         constexpr Int popcnt() const
         {
+            if constexpr (Wide && !Comptime)
+            {
+                if (!std::is_constant_evaluated())
+                    return static_cast<Int>(widePopcnt() + static_cast<UQWORD>(std::popcount(static_cast<std::make_unsigned_t<Int>>(mem[N_INTS-1] & lastMask()))));
+            }
             Int cnt = 0;
             for (int i=0; i<(N_INTS-1); ++i)
             {
@@ -406,8 +839,9 @@
             return cnt;
         }
 
+        // An int index: an Int one cannot reach past bit 255 of a UBYTE vector:
         template <bool Comptime=false>
-        constexpr int getNthSetBit(Int idx) const
+        constexpr int getNthSetBit(int idx) const
         {
             if constexpr (Comptime)
             {
@@ -444,27 +878,65 @@
                         bits_in_word = __builtin_popcount(word);
 
                     if (idx < bits_in_word)
-                    {
-                        // The bit is in this word. Find it.
-                        // Clear the LSB 'n' times:
-                        for (Int j = 0; j < idx; ++j)
-                            word &= word - 1; // Brian Kernighan's bit-clearing trick
-                        // The LSB of the remaining 'word' is the target bit.
-                        // Find its position using Count Trailing Zeros:
-                        int pos_in_word;
-                        if constexpr (sizeof(Int) == sizeof(UQWORD))
-                            pos_in_word = __builtin_ctzll(word);
-                        else
-                            pos_in_word = __builtin_ctz(word);
-
-                        return (i * w) + pos_in_word;
-                    }
+                        return (i * w) + bitvecSelect64(static_cast<std::make_unsigned_t<Int>>(word), idx);
                     idx -= bits_in_word;
                 }
                 return -1; // Not found
             }
         }
 
+        // Cumulative popcounts per word of a Bitvec, so that repeated
+        // select and rank queries skip the word walk. Refers to the Bitvec
+        // and is stale once it changes, like BitProxy:
+        class RankIndex
+        {
+            friend class Bitvec;
+        private:
+            const Bitvec& m_vec;
+            int m_before[N_INTS+1] = {}; // Set bits in the words before i
+            constexpr explicit RankIndex(const Bitvec& vec) : m_vec(vec)
+            {
+                for (int i = 0; i < N_INTS; ++i)
+                    m_before[i+1] = m_before[i] + std::popcount(m_vec.maskedWord(i));
+            }
+        public:
+            constexpr int popcnt() const { return m_before[N_INTS]; }
+
+            // Set bits below 'pos':
+            constexpr int rank(const int pos) const
+            {
+                if (pos >= Size)
+                    return popcnt();
+                const auto below = (std::make_unsigned_t<Int>(1) << (pos & (w-1))) - 1;
+                return m_before[pos >> shift] + std::popcount(static_cast<std::make_unsigned_t<Int>>(m_vec.mem[pos >> shift] & below));
+            }
+
+            // Same as getNthSetBit(), e.g. select(rand % popcnt()) picks a
+            // uniformly random set bit:
+            constexpr int select(const int idx) const
+            {
+                if (idx < 0 || idx >= popcnt())
+                    return -1;
+                int lo = 0, hi = N_INTS - 1; // Last word with m_before <= idx
+                while (lo < hi)
+                {
+                    const int mid = (lo + hi + 1) / 2;
+                    if (m_before[mid] <= idx)
+                        lo = mid;
+                    else
+                        hi = mid - 1;
+                }
+                return lo * w + bitvecSelect64(m_vec.maskedWord(lo), idx - m_before[lo]);
+            }
+        };
+
+        constexpr RankIndex rankIndex() const
+        {
+            return RankIndex(*this);
+        }
+
+        // f(i) for every set bit, ascending. An 'f' that returns bool stops
+        // the walk by returning false:
         template <typename F>
         constexpr void forEachSetBit(F&& f) const
         {
@@ -483,18 +955,137 @@
                 {
                     int bit = (sizeof(Int) == sizeof(UQWORD)) ? __builtin_ctzll(word)
                                                               : __builtin_ctz(word);
-                    f(i * w + bit);
+                    if constexpr (std::is_same_v<decltype(f(0)), bool>)
+                    {
+                        if (!f(i * w + bit))
+                            return;
+                    }
+                    else
+                        f(i * w + bit);
                     word &= word - 1;
                 }
             }
         }
 
-        constexpr std::size_t hashValue() const
+        // 64 bit hash of the used bits (padding ignored, like ==), e.g. for
+        // transposition tables. Multiply-xorshift over the words in two
+        // independent lanes, so that the multiplies overlap, then the
+        // splitmix64 finalizer. Same value at compile time and at runtime:
+        constexpr UQWORD hashValue() const
         {
-            std::size_t h = 1469598103934665603ull; // FNV-1a offset basis
-            for (int i = 0; i < N_INTS; ++i)
-                h = (h ^ static_cast<std::size_t>(mem[i])) * 1099511628211ull;
-            return h;
+            auto mix = [](const UQWORD h, const UQWORD word)
+            {
+                return std::rotl(h ^ (word * 0xbf58476d1ce4e5b9ull), 29) * 0x94d049bb133111ebull;
+            };
+            UQWORD a = 0x9e3779b97f4a7c15ull ^ static_cast<UQWORD>(Size);
+            UQWORD b = 0x6a09e667f3bcc909ull;
+            int i = 0;
+            for (; i + 1 < N_INTS; i += 2)
+            {
+                a = mix(a, maskedWord(i));
+                b = mix(b, maskedWord(i+1));
+            }
+            if (i < N_INTS)
+                a = mix(a, maskedWord(i));
+            UQWORD h = a ^ std::rotl(b, 32);
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+            return h ^ (h >> 31);
+        }
+    };
+
+
+/****************************************/
+/*                    Bitboard geometry */
+/* A Width x Height board stored row by */
+/* row in a Bitvec, cell = y*Width + x. */
+/* shift() moves all stones some steps  */
+/* in one direction with one multi-word */
+/* shift, then masks out whatever left  */
+/* the board: wrapped around a row end  */
+/* or landed outside 'cells'. Hex       */
+/* boards use axial coordinates in the  */
+/* same layout (neighbours +-1, +-Width */
+/* and +-(Width-1)), a hexagonal board  */
+/* is that rhombus with the corners     */
+/* left out of 'cells'                  */
+/****************************************/
+    enum class GridShape { square, hex };
+
+    template <class Bv, int Width, int Height, GridShape Shape=GridShape::square, int MaxSteps=4>
+    class BitGrid
+    {
+        static_assert(Bv::NumBits >= Width * Height, "Bitvec too small for the board");
+    public:
+        // y grows downwards. Opposite directions are neighbours, so lines
+        // run along 2*i and 2*i+1. Hex boards use the first six:
+        enum Direction : int { east, west, south, north, northEast, southWest, southEast, northWest };
+        static constexpr int nDirections = Shape == GridShape::square ? 8 : 6;
+        static constexpr int dx[8] = {1, -1, 0,  0,  1, -1, 1, -1};
+        static constexpr int dy[8] = {0,  0, 1, -1, -1,  1, 1, -1};
+    private:
+        Bv board;
+        // Cells whose source 'steps' cells back is on the board:
+        Bv masks[nDirections][MaxSteps];
+
+        static constexpr Bv wholeGrid()
+        {
+            Bv all;
+            all.setRange(0, Width * Height - 1);
+            return all;
+        }
+    public:
+        constexpr BitGrid() : BitGrid(wholeGrid()) {}
+
+        constexpr explicit BitGrid(const Bv& cells) : board(cells)
+        {
+            for (int d = 0; d < nDirections; ++d)
+                for (int steps = 1; steps <= MaxSteps; ++steps)
+                    for (int y = 0; y < Height; ++y)
+                        for (int x = 0; x < Width; ++x)
+                        {
+                            const int fromX = x - steps * dx[d], fromY = y - steps * dy[d];
+                            if (fromX < 0 || fromX >= Width || fromY < 0 || fromY >= Height)
+                                continue;
+                            if (board.check(y * Width + x) && board.check(fromY * Width + fromX))
+                                masks[d][steps-1].set(y * Width + x);
+                        }
+        }
+
+        constexpr const Bv& cells() const { return board; }
+
+        // Every stone moved 'steps' cells towards 'dir', those leaving the board dropped:
+        constexpr Bv shift(const Bv& b, const int dir, const int steps=1) const
+        {
+            const int offset = steps * (dy[dir] * Width + dx[dir]);
+            return (offset >= 0 ? b << offset : b >> -offset) & masks[dir][steps-1];
+        }
+
+        // Cells that end a run of K stones pointing towards 'dir', i.e. the
+        // cell and the K-1 behind it are all set. Doubling: while 'r' holds
+        // the ends of runs of n, r & shift(r, s) holds those of n+s (s <= n)
+        template <int K>
+        constexpr Bv kInARow(const Bv& b, const int dir) const
+        {
+            static_assert(K >= 1 && K / 2 <= MaxSteps, "kInARow<K> shifts by up to K/2 steps, raise MaxSteps");
+            Bv r = b & board;
+            for (int n = 1; n < K;)
+            {
+                const int s = n < K - n ? n : K - n;
+                r &= shift(r, dir, s);
+                n += s;
+            }
+            return r;
+        }
+
+        // Any run of K stones on any line of the board:
+        template <int K>
+        constexpr bool anyInARow(const Bv& b) const
+        {
+            for (int d = 0; d < nDirections; d += 2)
+                if (kInARow<K>(b, d))
+                    return true;
+            return false;
         }
     };
 
@@ -28,8 +28,8 @@
 
     UDWORD pcg32rand(const UQWORD seed)
     {
-        static bool initialized = false;
-        static pcg32 generator;
+        thread_local bool initialized = false;
+        thread_local pcg32 generator;
         if (seed != 0 || !initialized) {
             generator = pcg32(seed);
             initialized = true;
@@ -62,8 +62,8 @@
 
     UWORD pcg16rand(const UDWORD seed)
     {
-        static bool initialized = false;
-        static pcg16 generator;
+        thread_local bool initialized = false;
+        thread_local pcg16 generator;
         if (seed != 0 || !initialized) {
             generator = pcg16(seed);
             initialized = true;
@@ -45,6 +45,8 @@
         constexpr UWORD operator()();
     };
 
+    // Convenience generators with hidden state. The state is per thread,
+    // so threads don't race but also don't share a sequence:
     UDWORD pcg32rand(const UQWORD seed=0);
     UWORD  pcg16rand(const UDWORD seed=0);
 
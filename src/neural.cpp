@@ -1,18 +1,1132 @@
 #include "neural.hpp"
-#if defined(__AVX__) || defined(__AVX2__) || defined(__AVX512F__) || defined(__SSSE3__)
+#if defined(__x86_64__) || defined(__i386__) // AVX, AVX-512 via target attributes
   #include <immintrin.h>
 #elif defined(__ARM_NEON)
   #include <arm_neon.h>
 #elif defined(__wasm_simd128__)
   #include <wasm_simd128.h>
-#else // not "__AVX__" etc.
-  #error "unknown arch! (if compiling for wasm use '-msimd128' to fix)"
-#endif // unknown
+#endif // unknown arch: scalar kernels only
+#if defined(__unix__) || defined(__APPLE__) // mmap, on unknown systems model files are read with fread
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif // unknown: no mmap
 
 
 //extern "C" int is_prime(int n);
 
 
+/****************************************/
+/*                      Kernels, scalar */
+/* Reference for all the others         */
+/****************************************/
+    static FLOAT dotScalar(const FLOAT *a, const FLOAT *b, const int n)
+    {
+        FLOAT sum = 0.0f;
+        for (int i=0; i<n; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    static FLOAT maskedDotScalar(const FLOAT *a, const FLOAT *b, const FLOAT *mask, const int n)
+    {
+        FLOAT sum = 0.0f;
+        for (int i=0; i<n; ++i)
+            sum += a[i] * b[i] * mask[i];
+        return sum;
+    }
+
+    static void axpyScalar(FLOAT *y, const FLOAT *x, const FLOAT alpha, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            y[i] += alpha * x[i];
+    }
+
+    template <typename Weight, FLOAT (*Convert)(Weight)>
+    static void tileRowGeneric(FLOAT *y, const Weight *w, const UQWORD *stored, const FLOAT *x,
+                               const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        FLOAT acc[8] = {0.0f};
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const Weight *wb = &w[storedTileRank(stored, b) * 64];
+                for (UQWORD m = tiles[b]; m; m &= m - 1)
+                {
+                    const int bit = std::countr_zero(m);
+                    acc[bit >> 3] += x[b*8 + (bit & 7)] * Convert(wb[bit]);
+                }
+            }
+        for (int r=0; r<8; ++r)
+            y[r] = acc[r];
+    }
+
+    static FLOAT asFloat(const FLOAT w) { return w; }
+
+    static void tileRowScalar(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                              const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        tileRowGeneric<FLOAT, asFloat>(y, w, stored, x, tiles, occupied, nWords);
+    }
+
+    static void tileRowHalfScalar(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x,
+                                  const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        tileRowGeneric<UWORD, floatFromHalf>(y, w, stored, x, tiles, occupied, nWords);
+    }
+
+    static void tileBackwardScalar(FLOAT *err, FLOAT *grad, const FLOAT *w, const UQWORD *stored, const FLOAT *x, const FLOAT *delta,
+                                   const FLOAT scale, const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        UQWORD live = 0; // The rows with a delta
+        for (int r=0; r<8; ++r)
+            live |= delta[r] != 0.0f ? UQWORD(0xff) << (r*8) : 0;
+        for (int k=0; live && k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const int at = storedTileRank(stored, b) * 64;
+                for (UQWORD m = tiles[b] & live; m; m &= m - 1)
+                {
+                    const int bit = std::countr_zero(m);
+                    const int r = bit >> 3;
+                    const int i = b*8 + (bit & 7);
+                    if (err)
+                        err[i] += delta[r] * w[at + bit];
+                    grad[at + bit] += delta[r] * scale * x[i];
+                }
+            }
+    }
+
+    static SDWORD dotU8S8Scalar(const UBYTE *x, const SBYTE *w, const int n)
+    {
+        SDWORD sum = 0;
+        for (int i=0; i<n; ++i)
+            sum += static_cast<SDWORD>(x[i]) * w[i];
+        return sum;
+    }
+
+    static void reluRowScalar(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            x[i] = fastRelu(x[i]);
+    }
+
+    static void tanhRowScalar(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            x[i] = fastTanh(x[i]);
+    }
+
+    static void sigmoidRowScalar(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            x[i] = fastSigmoid(x[i]);
+    }
+
+    static void expRowScalar(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; ++i)
+            x[i] = fastExp(x[i]);
+    }
+
+    const NeuralKernels& scalarKernels()
+    {
+        static const NeuralKernels kernels = { "scalar", dotScalar, maskedDotScalar, axpyScalar,
+                                               tileRowScalar, tileRowHalfScalar, tileBackwardScalar, dotU8S8Scalar,
+                                               reluRowScalar, tanhRowScalar, sigmoidRowScalar, expRowScalar };
+        return kernels;
+    }
+
+
+#if defined(__x86_64__) || defined(__i386__)
+/****************************************/
+/*                    Kernels, x86 avx2 */
+/* Compiled for avx2+fma regardless of  */
+/* the -m flags, only ever called after */
+/* the cpuid check below                */
+/****************************************/
+    __attribute__((target("avx2,fma"))) static FLOAT hsum256(const __m256 v)
+    {
+        __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+        lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+        return _mm_cvtss_f32(lo);
+    }
+
+    __attribute__((target("avx2,fma"))) static FLOAT dotAvx2(const FLOAT *a, const FLOAT *b, const int n)
+    {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i+16<=n; i+=16)
+        {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i]),   _mm256_loadu_ps(&b[i]),   sum0);
+            sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i+8]), _mm256_loadu_ps(&b[i+8]), sum1);
+        }
+        for (; i+8<=n; i+=8)
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]), sum0);
+        FLOAT sum = hsum256(_mm256_add_ps(sum0, sum1));
+        for (; i<n; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    __attribute__((target("avx2,fma"))) static FLOAT maskedDotAvx2(const FLOAT *a, const FLOAT *b, const FLOAT *mask, const int n)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        int i = 0;
+        for (; i+8<=n; i+=8)
+        {
+            const __m256 ab = _mm256_mul_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]));
+            sum = _mm256_fmadd_ps(ab, _mm256_loadu_ps(&mask[i]), sum);
+        }
+        FLOAT result = hsum256(sum);
+        for (; i<n; ++i)
+            result += a[i] * b[i] * mask[i];
+        return result;
+    }
+
+    __attribute__((target("avx2,fma"))) static void axpyAvx2(FLOAT *y, const FLOAT *x, const FLOAT alpha, const int n)
+    {
+        const __m256 va = _mm256_set1_ps(alpha);
+        int i = 0;
+        for (; i+8<=n; i+=8)
+            _mm256_storeu_ps(&y[i], _mm256_fmadd_ps(va, _mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&y[i])));
+        for (; i<n; ++i)
+            y[i] += alpha * x[i];
+    }
+
+    // Lane c all ones if bit r*8+c of the tile is set, for the masked loads.
+    // A stored tile has all 64 weights, the mask picks the edges of the
+    // layer (the others belong to other layers or are unused):
+    __attribute__((target("avx2,fma"))) static __m256i tileRowMask(const UQWORD tile, const int r)
+    {
+        const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        const __m256i row = _mm256_set1_epi32(static_cast<int>((tile >> (r*8)) & 0xff));
+        return _mm256_cmpeq_epi32(_mm256_and_si256(row, bits), bits);
+    }
+
+    // Lane r = the sum of acc[r]:
+    __attribute__((target("avx2,fma"))) static __m256 hsum256x8(const __m256 *acc)
+    {
+        const __m256 s01 = _mm256_hadd_ps(acc[0], acc[1]);
+        const __m256 s23 = _mm256_hadd_ps(acc[2], acc[3]);
+        const __m256 s45 = _mm256_hadd_ps(acc[4], acc[5]);
+        const __m256 s67 = _mm256_hadd_ps(acc[6], acc[7]);
+        const __m256 s0123 = _mm256_hadd_ps(s01, s23); // Low half rows 0-3 of lanes 0-3, high half of lanes 4-7
+        const __m256 s4567 = _mm256_hadd_ps(s45, s67);
+        return _mm256_add_ps(_mm256_permute2f128_ps(s0123, s4567, 0x20), _mm256_permute2f128_ps(s0123, s4567, 0x31));
+    }
+
+    __attribute__((target("avx2,fma"))) static void tileRowAvx2(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                                                                const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        __m256 acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = _mm256_setzero_ps();
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const FLOAT *wb = &w[storedTileRank(stored, b) * 64];
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                for (int r=0; r<8; ++r)
+                    acc[r] = _mm256_fmadd_ps(_mm256_maskload_ps(&wb[r*8], tileRowMask(tiles[b], r)), vx, acc[r]);
+            }
+        _mm256_storeu_ps(y, hsum256x8(acc));
+    }
+
+    // Every cpu with avx2 also has f16c (checked anyway). No masked 16 bit
+    // loads: the empty rows are skipped, the others loaded whole and masked
+    __attribute__((target("avx2,fma,f16c"))) static void tileRowHalfF16c(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x,
+                                                                         const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        __m256 acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = _mm256_setzero_ps();
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const UWORD *wb = &w[storedTileRank(stored, b) * 64];
+                const UQWORD tile = tiles[b];
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                for (int r=0; r<8; ++r)
+                {
+                    if (((tile >> (r*8)) & 0xff) == 0)
+                        continue;
+                    const __m256 vw = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&wb[r*8])));
+                    acc[r] = _mm256_fmadd_ps(_mm256_and_ps(vw, _mm256_castsi256_ps(tileRowMask(tile, r))), vx, acc[r]);
+                }
+            }
+        _mm256_storeu_ps(y, hsum256x8(acc));
+    }
+
+    __attribute__((target("avx2,fma"))) static void tileBackwardAvx2(FLOAT *err, FLOAT *grad, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                                                                     const FLOAT *delta, const FLOAT scale,
+                                                                     const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        UQWORD live = 0; // The rows with a delta
+        for (int r=0; r<8; ++r)
+            live |= delta[r] != 0.0f ? UQWORD(0xff) << (r*8) : 0;
+        for (int k=0; live && k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const int at = storedTileRank(stored, b) * 64;
+                const UQWORD tile = tiles[b] & live;
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                __m256 verr = _mm256_setzero_ps();
+                for (int r=0; r<8; ++r)
+                {
+                    if (((tile >> (r*8)) & 0xff) == 0)
+                        continue;
+                    const __m256i mask = tileRowMask(tile, r);
+                    verr = _mm256_fmadd_ps(_mm256_maskload_ps(&w[at + r*8], mask), _mm256_set1_ps(delta[r]), verr);
+                    const __m256 g = _mm256_maskload_ps(&grad[at + r*8], mask);
+                    _mm256_maskstore_ps(&grad[at + r*8], mask, _mm256_fmadd_ps(_mm256_set1_ps(delta[r] * scale), vx, g));
+                }
+                if (err)
+                    _mm256_store_ps(&err[b*8], _mm256_add_ps(_mm256_load_ps(&err[b*8]), verr));
+            }
+    }
+
+    __attribute__((target("avx2"))) static SDWORD dotU8S8Avx2(const UBYTE *x, const SBYTE *w, const int n)
+    {
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i sum = _mm256_setzero_si256();
+        for (int i=0; i<n; i+=32)
+        {
+            const __m256i vx = _mm256_load_si256(reinterpret_cast<const __m256i *>(&x[i]));
+            const __m256i vw = _mm256_load_si256(reinterpret_cast<const __m256i *>(&w[i]));
+            const __m256i pairs = _mm256_maddubs_epi16(vx, vw);            // u8*s8, pairwise -> s16
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pairs, ones)); // s16 pairs -> s32
+        }
+        __m128i r = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        r = _mm_add_epi32(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(1, 0, 3, 2)));
+        r = _mm_add_epi32(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(r);
+    }
+
+    // Same polynomials as fastTanh/fastExp, eight lanes at a time:
+    __attribute__((target("avx2,fma"))) static __m256 tanh256(__m256 x)
+    {
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-TanhClamp)), _mm256_set1_ps(TanhClamp));
+        const __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 p = _mm256_set1_ps(TanhP[0]);
+        for (int k=1; k<7; ++k)
+            p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(TanhP[k]));
+        __m256 q = _mm256_set1_ps(TanhQ[0]);
+        for (int k=1; k<4; ++k)
+            q = _mm256_fmadd_ps(q, x2, _mm256_set1_ps(TanhQ[k]));
+        return _mm256_div_ps(_mm256_mul_ps(x, p), q);
+    }
+
+    __attribute__((target("avx2,fma"))) static __m256 exp256(__m256 x)
+    {
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(ExpMin)), _mm256_set1_ps(ExpMax));
+        const __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(Log2e), _mm256_set1_ps(0.5f)));
+        x = _mm256_fnmadd_ps(n, _mm256_set1_ps(Ln2Hi), x);
+        x = _mm256_fnmadd_ps(n, _mm256_set1_ps(Ln2Lo), x);
+        __m256 y = _mm256_set1_ps(ExpP[0]);
+        for (int k=1; k<6; ++k)
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(ExpP[k]));
+        y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, _mm256_set1_ps(1.0f)));
+        const __m256i scale = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(y, _mm256_castsi256_ps(scale));
+    }
+
+    __attribute__((target("avx2,fma"))) static void reluRowAvx2(FLOAT *x, const int n)
+    {
+        const __m256 slope = _mm256_set1_ps(ReluSlope);
+        int i = 0;
+        for (; i+8<=n; i+=8)
+        {
+            const __m256 v = _mm256_loadu_ps(&x[i]);
+            _mm256_storeu_ps(&x[i], _mm256_max_ps(v, _mm256_mul_ps(v, slope)));
+        }
+        reluRowScalar(&x[i], n-i);
+    }
+
+    __attribute__((target("avx2,fma"))) static void tanhRowAvx2(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+8<=n; i+=8)
+            _mm256_storeu_ps(&x[i], tanh256(_mm256_loadu_ps(&x[i])));
+        tanhRowScalar(&x[i], n-i);
+    }
+
+    __attribute__((target("avx2,fma"))) static void sigmoidRowAvx2(FLOAT *x, const int n)
+    {
+        const __m256 half = _mm256_set1_ps(0.5f);
+        int i = 0;
+        for (; i+8<=n; i+=8)
+            _mm256_storeu_ps(&x[i], _mm256_fmadd_ps(half, tanh256(_mm256_mul_ps(half, _mm256_loadu_ps(&x[i]))), half));
+        sigmoidRowScalar(&x[i], n-i);
+    }
+
+    __attribute__((target("avx2,fma"))) static void expRowAvx2(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+8<=n; i+=8)
+            _mm256_storeu_ps(&x[i], exp256(_mm256_loadu_ps(&x[i])));
+        expRowScalar(&x[i], n-i);
+    }
+
+
+/****************************************/
+/*                 Kernels, x86 avx-512 */
+/****************************************/
+    // gcc 12's own gather/reduce intrinsics trip -Wuninitialized:
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wuninitialized"
+    #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    __attribute__((target("avx512f"))) static FLOAT dotAvx512(const FLOAT *a, const FLOAT *b, const int n)
+    {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        int i = 0;
+        for (; i+32<=n; i+=32)
+        {
+            sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(&a[i]),    _mm512_loadu_ps(&b[i]),    sum0);
+            sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(&a[i+16]), _mm512_loadu_ps(&b[i+16]), sum1);
+        }
+        sum0 = _mm512_add_ps(sum0, sum1);
+        if (i+16 <= n)
+        {
+            sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(&a[i]), _mm512_loadu_ps(&b[i]), sum0);
+            i += 16;
+        }
+        const __mmask16 tail = static_cast<__mmask16>((1u << (n-i)) - 1);
+        sum0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, &a[i]), _mm512_maskz_loadu_ps(tail, &b[i]), sum0);
+        return _mm512_reduce_add_ps(sum0);
+    }
+
+    __attribute__((target("avx512f"))) static FLOAT maskedDotAvx512(const FLOAT *a, const FLOAT *b, const FLOAT *mask, const int n)
+    {
+        __m512 sum = _mm512_setzero_ps();
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            const __m512 ab = _mm512_mul_ps(_mm512_maskz_loadu_ps(m, &a[i]), _mm512_maskz_loadu_ps(m, &b[i]));
+            sum = _mm512_fmadd_ps(ab, _mm512_maskz_loadu_ps(m, &mask[i]), sum);
+        }
+        return _mm512_reduce_add_ps(sum);
+    }
+
+    __attribute__((target("avx512f"))) static void axpyAvx512(FLOAT *y, const FLOAT *x, const FLOAT alpha, const int n)
+    {
+        const __m512 va = _mm512_set1_ps(alpha);
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            const __m512 r = _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, &x[i]), _mm512_maskz_loadu_ps(m, &y[i]));
+            _mm512_mask_storeu_ps(&y[i], m, r);
+        }
+    }
+
+    // With avx512vl the mask of a tile row is just its byte of the tile:
+    __attribute__((target("avx512f,avx512vl,fma"))) static void tileRowAvx512(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                                                                              const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        __m256 acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = _mm256_setzero_ps();
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const FLOAT *wb = &w[storedTileRank(stored, b) * 64];
+                const UQWORD tile = tiles[b];
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                for (int r=0; r<8; ++r)
+                    acc[r] = _mm256_fmadd_ps(_mm256_maskz_loadu_ps(static_cast<__mmask8>(tile >> (r*8)), &wb[r*8]), vx, acc[r]);
+            }
+        _mm256_storeu_ps(y, hsum256x8(acc));
+    }
+
+    __attribute__((target("avx512f,avx512vl,avx512bw,fma,f16c"))) static void tileRowHalfAvx512(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x,
+                                                                                                const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        __m256 acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = _mm256_setzero_ps();
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const UWORD *wb = &w[storedTileRank(stored, b) * 64];
+                const UQWORD tile = tiles[b];
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                for (int r=0; r<8; ++r)
+                {
+                    const __m128i half = _mm_maskz_loadu_epi16(static_cast<__mmask8>(tile >> (r*8)), &wb[r*8]);
+                    acc[r] = _mm256_fmadd_ps(_mm256_cvtph_ps(half), vx, acc[r]);
+                }
+            }
+        _mm256_storeu_ps(y, hsum256x8(acc));
+    }
+
+    __attribute__((target("avx512f,avx512vl,fma"))) static void tileBackwardAvx512(FLOAT *err, FLOAT *grad, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                                                                                   const FLOAT *delta, const FLOAT scale,
+                                                                                   const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        UQWORD live = 0; // The rows with a delta
+        for (int r=0; r<8; ++r)
+            live |= delta[r] != 0.0f ? UQWORD(0xff) << (r*8) : 0;
+        for (int k=0; live && k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const int at = storedTileRank(stored, b) * 64;
+                const UQWORD tile = tiles[b] & live;
+                const __m256 vx = _mm256_load_ps(&x[b*8]);
+                __m256 verr = _mm256_setzero_ps();
+                for (int r=0; r<8; ++r)
+                {
+                    const __mmask8 mask = static_cast<__mmask8>(tile >> (r*8));
+                    if (mask == 0)
+                        continue;
+                    verr = _mm256_fmadd_ps(_mm256_maskz_loadu_ps(mask, &w[at + r*8]), _mm256_set1_ps(delta[r]), verr);
+                    const __m256 g = _mm256_maskz_loadu_ps(mask, &grad[at + r*8]);
+                    _mm256_mask_storeu_ps(&grad[at + r*8], mask, _mm256_fmadd_ps(_mm256_set1_ps(delta[r] * scale), vx, g));
+                }
+                if (err)
+                    _mm256_store_ps(&err[b*8], _mm256_add_ps(_mm256_load_ps(&err[b*8]), verr));
+            }
+    }
+
+    // vpdpbusd: u8*s8, four products at a time straight into s32
+    __attribute__((target("avx512f,avx512bw,avx512vnni"))) static SDWORD dotU8S8Vnni(const UBYTE *x, const SBYTE *w, const int n)
+    {
+        __m512i sum = _mm512_setzero_si512();
+        for (int i=0; i<n; i+=64)
+        {
+            const __m512i vx = _mm512_load_si512(&x[i]);
+            const __m512i vw = _mm512_load_si512(&w[i]);
+            sum = _mm512_dpbusd_epi32(sum, vx, vw);
+        }
+        return _mm512_reduce_add_epi32(sum);
+    }
+
+    __attribute__((target("avx512f"))) static __m512 tanh512(__m512 x)
+    {
+        x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-TanhClamp)), _mm512_set1_ps(TanhClamp));
+        const __m512 x2 = _mm512_mul_ps(x, x);
+        __m512 p = _mm512_set1_ps(TanhP[0]);
+        for (int k=1; k<7; ++k)
+            p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(TanhP[k]));
+        __m512 q = _mm512_set1_ps(TanhQ[0]);
+        for (int k=1; k<4; ++k)
+            q = _mm512_fmadd_ps(q, x2, _mm512_set1_ps(TanhQ[k]));
+        return _mm512_div_ps(_mm512_mul_ps(x, p), q);
+    }
+
+    __attribute__((target("avx512f"))) static __m512 exp512(__m512 x)
+    {
+        x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(ExpMin)), _mm512_set1_ps(ExpMax));
+        const __m512 n = _mm512_roundscale_ps(_mm512_fmadd_ps(x, _mm512_set1_ps(Log2e), _mm512_set1_ps(0.5f)),
+                                              _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        x = _mm512_fnmadd_ps(n, _mm512_set1_ps(Ln2Hi), x);
+        x = _mm512_fnmadd_ps(n, _mm512_set1_ps(Ln2Lo), x);
+        __m512 y = _mm512_set1_ps(ExpP[0]);
+        for (int k=1; k<6; ++k)
+            y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(ExpP[k]));
+        y = _mm512_fmadd_ps(y, _mm512_mul_ps(x, x), _mm512_add_ps(x, _mm512_set1_ps(1.0f)));
+        return _mm512_scalef_ps(y, n); // y * 2^n
+    }
+
+    // The tails run masked instead of falling back to scalar:
+    __attribute__((target("avx512f"))) static void reluRowAvx512(FLOAT *x, const int n)
+    {
+        const __m512 slope = _mm512_set1_ps(ReluSlope);
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            const __m512 v = _mm512_maskz_loadu_ps(m, &x[i]);
+            _mm512_mask_storeu_ps(&x[i], m, _mm512_max_ps(v, _mm512_mul_ps(v, slope)));
+        }
+    }
+
+    __attribute__((target("avx512f"))) static void tanhRowAvx512(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            _mm512_mask_storeu_ps(&x[i], m, tanh512(_mm512_maskz_loadu_ps(m, &x[i])));
+        }
+    }
+
+    __attribute__((target("avx512f"))) static void sigmoidRowAvx512(FLOAT *x, const int n)
+    {
+        const __m512 half = _mm512_set1_ps(0.5f);
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            const __m512 v = _mm512_maskz_loadu_ps(m, &x[i]);
+            _mm512_mask_storeu_ps(&x[i], m, _mm512_fmadd_ps(half, tanh512(_mm512_mul_ps(half, v)), half));
+        }
+    }
+
+    __attribute__((target("avx512f"))) static void expRowAvx512(FLOAT *x, const int n)
+    {
+        for (int i=0; i<n; i+=16)
+        {
+            const __mmask16 m = n-i >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (n-i)) - 1);
+            _mm512_mask_storeu_ps(&x[i], m, exp512(_mm512_maskz_loadu_ps(m, &x[i])));
+        }
+    }
+    #pragma GCC diagnostic pop
+#endif // __x86_64__ || __i386__
+
+
+#if defined(__aarch64__)
+/****************************************/
+/*                  Kernels, arm64 simd */
+/* Always present on arm64, no check    */
+/* needed. No masked loads, the tile    */
+/* rows are loaded whole and masked     */
+/****************************************/
+    static FLOAT dotArm64(const FLOAT *a, const FLOAT *b, const int n)
+    {
+        float32x4_t sum0 = vdupq_n_f32(0.0f);
+        float32x4_t sum1 = vdupq_n_f32(0.0f);
+        int i = 0;
+        for (; i+8<=n; i+=8)
+        {
+            sum0 = vfmaq_f32(sum0, vld1q_f32(&a[i]),   vld1q_f32(&b[i]));
+            sum1 = vfmaq_f32(sum1, vld1q_f32(&a[i+4]), vld1q_f32(&b[i+4]));
+        }
+        FLOAT sum = vaddvq_f32(vaddq_f32(sum0, sum1));
+        for (; i<n; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    static FLOAT maskedDotArm64(const FLOAT *a, const FLOAT *b, const FLOAT *mask, const int n)
+    {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            sum = vfmaq_f32(sum, vmulq_f32(vld1q_f32(&a[i]), vld1q_f32(&b[i])), vld1q_f32(&mask[i]));
+        FLOAT result = vaddvq_f32(sum);
+        for (; i<n; ++i)
+            result += a[i] * b[i] * mask[i];
+        return result;
+    }
+
+    static void axpyArm64(FLOAT *y, const FLOAT *x, const FLOAT alpha, const int n)
+    {
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            vst1q_f32(&y[i], vfmaq_n_f32(vld1q_f32(&y[i]), vld1q_f32(&x[i]), alpha));
+        for (; i<n; ++i)
+            y[i] += alpha * x[i];
+    }
+
+    static SDWORD dotU8S8Arm64(const UBYTE *x, const SBYTE *w, const int n)
+    {
+        int32x4_t sum = vdupq_n_s32(0);
+        for (int i=0; i<n; i+=16)
+        {
+            const int16x8_t vx0 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(&x[i])));
+            const int16x8_t vx1 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(&x[i+8])));
+            const int16x8_t vw0 = vmovl_s8(vld1_s8(&w[i]));
+            const int16x8_t vw1 = vmovl_s8(vld1_s8(&w[i+8]));
+            sum = vmlal_s16(sum, vget_low_s16(vx0), vget_low_s16(vw0));
+            sum = vmlal_high_s16(sum, vx0, vw0);
+            sum = vmlal_s16(sum, vget_low_s16(vx1), vget_low_s16(vw1));
+            sum = vmlal_high_s16(sum, vx1, vw1);
+        }
+        return vaddvq_s32(sum);
+    }
+
+    static float32x4_t tanhArm64(float32x4_t x)
+    {
+        x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-TanhClamp)), vdupq_n_f32(TanhClamp));
+        const float32x4_t x2 = vmulq_f32(x, x);
+        float32x4_t p = vdupq_n_f32(TanhP[0]);
+        for (int k=1; k<7; ++k)
+            p = vfmaq_f32(vdupq_n_f32(TanhP[k]), p, x2);
+        float32x4_t q = vdupq_n_f32(TanhQ[0]);
+        for (int k=1; k<4; ++k)
+            q = vfmaq_f32(vdupq_n_f32(TanhQ[k]), q, x2);
+        return vdivq_f32(vmulq_f32(x, p), q);
+    }
+
+    static float32x4_t expArm64(float32x4_t x)
+    {
+        x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(ExpMin)), vdupq_n_f32(ExpMax));
+        const float32x4_t n = vrndmq_f32(vfmaq_n_f32(vdupq_n_f32(0.5f), x, Log2e));
+        x = vfmsq_n_f32(x, n, Ln2Hi);
+        x = vfmsq_n_f32(x, n, Ln2Lo);
+        float32x4_t y = vdupq_n_f32(ExpP[0]);
+        for (int k=1; k<6; ++k)
+            y = vfmaq_f32(vdupq_n_f32(ExpP[k]), y, x);
+        y = vfmaq_f32(vaddq_f32(x, vdupq_n_f32(1.0f)), y, vmulq_f32(x, x));
+        const int32x4_t scale = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+        return vmulq_f32(y, vreinterpretq_f32_s32(scale));
+    }
+
+    static void reluRowArm64(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+4<=n; i+=4)
+        {
+            const float32x4_t v = vld1q_f32(&x[i]);
+            vst1q_f32(&x[i], vmaxq_f32(v, vmulq_n_f32(v, ReluSlope)));
+        }
+        reluRowScalar(&x[i], n-i);
+    }
+
+    static void tanhRowArm64(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            vst1q_f32(&x[i], tanhArm64(vld1q_f32(&x[i])));
+        tanhRowScalar(&x[i], n-i);
+    }
+
+    static void sigmoidRowArm64(FLOAT *x, const int n)
+    {
+        const float32x4_t half = vdupq_n_f32(0.5f);
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            vst1q_f32(&x[i], vfmaq_f32(half, half, tanhArm64(vmulq_f32(half, vld1q_f32(&x[i])))));
+        sigmoidRowScalar(&x[i], n-i);
+    }
+
+    static void expRowArm64(FLOAT *x, const int n)
+    {
+        int i = 0;
+        for (; i+4<=n; i+=4)
+            vst1q_f32(&x[i], expArm64(vld1q_f32(&x[i])));
+        expRowScalar(&x[i], n-i);
+    }
+    static void tileRowArm64(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x,
+                             const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        const uint32x4_t bitsLo = {1u, 2u, 4u, 8u};
+        const uint32x4_t bitsHi = {16u, 32u, 64u, 128u};
+        float32x4_t acc[8];
+        for (int r=0; r<8; ++r)
+            acc[r] = vdupq_n_f32(0.0f);
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const FLOAT *wb = &w[storedTileRank(stored, b) * 64];
+                const UQWORD tile = tiles[b];
+                const float32x4_t x0 = vld1q_f32(&x[b*8]);
+                const float32x4_t x1 = vld1q_f32(&x[b*8 + 4]);
+                for (int r=0; r<8; ++r)
+                {
+                    const UDWORD bits = static_cast<UDWORD>((tile >> (r*8)) & 0xff);
+                    if (bits == 0)
+                        continue;
+                    const uint32x4_t row = vdupq_n_u32(bits);
+                    const uint32x4_t w0 = vandq_u32(vreinterpretq_u32_f32(vld1q_f32(&wb[r*8])), vtstq_u32(row, bitsLo));
+                    const uint32x4_t w1 = vandq_u32(vreinterpretq_u32_f32(vld1q_f32(&wb[r*8 + 4])), vtstq_u32(row, bitsHi));
+                    acc[r] = vfmaq_f32(acc[r], vreinterpretq_f32_u32(w0), x0);
+                    acc[r] = vfmaq_f32(acc[r], vreinterpretq_f32_u32(w1), x1);
+                }
+            }
+        for (int r=0; r<8; ++r)
+            y[r] = vaddvq_f32(acc[r]);
+    }
+
+    static void tileRowHalfArm64(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x,
+                                 const UQWORD *tiles, const UQWORD *occupied, const int nWords)
+    {
+        // Native binary16 loads, converted by the fpu:
+        const __fp16 *row = reinterpret_cast<const __fp16 *>(w);
+        for (int r=0; r<8; ++r)
+            y[r] = 0.0f;
+        for (int k=0; k<nWords; ++k)
+            for (UQWORD blocks = occupied[k]; blocks; blocks &= blocks - 1)
+            {
+                const int b = k*64 + std::countr_zero(blocks);
+                const __fp16 *wb = &row[storedTileRank(stored, b) * 64];
+                for (UQWORD m = tiles[b]; m; m &= m - 1)
+                {
+                    const int bit = std::countr_zero(m);
+                    y[bit >> 3] += x[b*8 + (bit & 7)] * static_cast<FLOAT>(wb[bit]);
+                }
+            }
+    }
+#endif // __aarch64__
+
+
+/****************************************/
+/*                    Kernels, dispatch */
+/****************************************/
+    const NeuralKernels& neuralKernels()
+    {
+        static const NeuralKernels& best = []() -> const NeuralKernels&
+        {
+        #if defined(__x86_64__) || defined(__i386__)
+            static const NeuralKernels avx512vnni = { "avx512f+vnni", dotAvx512, maskedDotAvx512, axpyAvx512,
+                                                      tileRowAvx512, tileRowHalfAvx512, tileBackwardAvx512, dotU8S8Vnni,
+                                                      reluRowAvx512, tanhRowAvx512, sigmoidRowAvx512, expRowAvx512 };
+            static const NeuralKernels avx512 = { "avx512f", dotAvx512, maskedDotAvx512, axpyAvx512,
+                                                  tileRowAvx512, tileRowHalfAvx512, tileBackwardAvx512, dotU8S8Avx2,
+                                                  reluRowAvx512, tanhRowAvx512, sigmoidRowAvx512, expRowAvx512 };
+            static const NeuralKernels avx2 = { "avx2+fma", dotAvx2, maskedDotAvx2, axpyAvx2,
+                                                tileRowAvx2, tileRowHalfF16c, tileBackwardAvx2, dotU8S8Avx2,
+                                                reluRowAvx2, tanhRowAvx2, sigmoidRowAvx2, expRowAvx2 };
+            __builtin_cpu_init();
+            const bool f16c = __builtin_cpu_supports("f16c");
+            // The tile kernels take avx512vl/bw (masked 256 bit and 16 bit loads), all but the first avx-512 cpus have them:
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512bw") && f16c)
+            {
+                if (__builtin_cpu_supports("avx512vnni"))
+                    return avx512vnni;
+                return avx512;
+            }
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && f16c)
+                return avx2;
+        #elif defined(__aarch64__)
+            static const NeuralKernels arm64 = { "arm64 simd", dotArm64, maskedDotArm64, axpyArm64,
+                                                 tileRowArm64, tileRowHalfArm64, tileBackwardScalar, dotU8S8Arm64,
+                                                 reluRowArm64, tanhRowArm64, sigmoidRowArm64, expRowArm64 };
+            return arm64;
+        #endif
+            return scalarKernels();
+        }();
+        return best;
+    }
+
+    bool neuralKernelsSelfTest(const NeuralKernels& kernels)
+    {
+        const NeuralKernels& ref = scalarKernels();
+        constexpr int N = 75; // Not a multiple of any vector width
+        FLOAT a[N], b[N], mask[N];
+        UDWORD state = 12345u;
+        auto next = [&state]
+        {
+            state = state * 1664525u + 1013904223u;
+            return static_cast<FLOAT>(state >> 8) / 16777216.0f - 0.5f;
+        };
+        for (int i=0; i<N; ++i)
+        {
+            a[i] = next();
+            b[i] = next();
+            mask[i] = next() > 0.0f ? 1.0f : 0.0f;
+        }
+        auto close = [](const FLOAT x, const FLOAT y) { return std::fabs(x - y) <= 1e-4f * (1.0f + std::fabs(y)); };
+        bool ok = true;
+        for (int n=0; n<=N; n+=(n<20 ? 1 : 11))
+        {
+            ok = ok && close(kernels.dot(a, b, n), ref.dot(a, b, n));
+            ok = ok && close(kernels.maskedDot(a, b, mask, n), ref.maskedDot(a, b, mask, n));
+            FLOAT y0[N], y1[N];
+            for (int i=0; i<N; ++i) { y0[i] = b[i]; y1[i] = b[i]; }
+            kernels.axpy(y0, a, 0.25f, n);
+            ref.axpy(y1, a, 0.25f, n);
+            for (int i=0; i<N; ++i)
+                ok = ok && close(y0[i], y1[i]);
+        }
+        // One row of tiles over N columns: the last tile partial, some tiles
+        // empty, in the second round the last rows too. Every tile stored,
+        // so the empty ones are skipped over in the weights:
+        constexpr int Blocks = (N+7) / 8;
+        alignas(32) FLOAT x[Blocks*8] = {0}, err0[Blocks*8], err1[Blocks*8];
+        FLOAT w[64*Blocks], grad0[64*Blocks], grad1[64*Blocks], delta[8], y0[8], y1[8];
+        UWORD wHalf[64*Blocks];
+        UQWORD tiles[Blocks], occupied[1];
+        const UQWORD stored[1] = { (UQWORD(1) << Blocks) - 1 };
+        for (int i=0; i<N; ++i)
+            x[i] = a[i];
+        for (int i=0; i<64*Blocks; ++i)
+        {
+            w[i] = next();
+            wHalf[i] = halfFromFloat(w[i]);
+        }
+        for (int round=0; round<2; ++round)
+        {
+            occupied[0] = 0;
+            for (int t=0; t<Blocks; ++t)
+            {
+                UQWORD tile = 0;
+                for (int bit=0; bit<64; ++bit)
+                    if (t*8 + bit%8 < N && (round == 0 || bit < 40) && next() > -0.2f)
+                        tile |= UQWORD(1) << bit;
+                tiles[t] = t % 4 == 1 ? 0 : tile;
+                occupied[0] |= tiles[t] ? UQWORD(1) << t : 0;
+            }
+            for (int r=0; r<8; ++r)
+                delta[r] = r % 3 == round ? 0.0f : next();
+            kernels.tileRow(y0, w, stored, x, tiles, occupied, 1);
+            ref.tileRow(y1, w, stored, x, tiles, occupied, 1);
+            for (int r=0; r<8; ++r)
+                ok = ok && close(y0[r], y1[r]);
+            kernels.tileRowHalf(y0, wHalf, stored, x, tiles, occupied, 1);
+            ref.tileRowHalf(y1, wHalf, stored, x, tiles, occupied, 1);
+            for (int r=0; r<8; ++r)
+                ok = ok && close(y0[r], y1[r]);
+            for (int i=0; i<Blocks*8; ++i)
+                err0[i] = err1[i] = x[i];
+            for (int i=0; i<64*Blocks; ++i)
+                grad0[i] = grad1[i] = b[i % N];
+            kernels.tileBackward(err0, grad0, w, stored, x, delta, 0.5f, tiles, occupied, 1);
+            ref.tileBackward(err1, grad1, w, stored, x, delta, 0.5f, tiles, occupied, 1);
+            for (int i=0; i<Blocks*8; ++i)
+                ok = ok && close(err0[i], err1[i]);
+            kernels.tileBackward(nullptr, grad0, grad0, stored, x, delta, -0.75f, tiles, occupied, 1); // In place, as train() does
+            ref.tileBackward(nullptr, grad1, grad1, stored, x, delta, -0.75f, tiles, occupied, 1);
+            for (int i=0; i<64*Blocks; ++i)
+                ok = ok && close(grad0[i], grad1[i]);
+        }
+        // Integer dot products must match exactly, also at the extremes:
+        alignas(64) UBYTE xq[192];
+        alignas(64) SBYTE wq[192];
+        for (int i=0; i<192; ++i)
+        {
+            xq[i] = static_cast<UBYTE>(i % 3 == 0 ? 127 : (state = state * 1664525u + 1013904223u) >> 25);
+            wq[i] = static_cast<SBYTE>(i % 5 == 0 ? -127 : static_cast<int>((state = state * 1664525u + 1013904223u) >> 24) - 128);
+            if (wq[i] == -128)
+                wq[i] = -127;
+        }
+        for (int n=0; n<=192; n+=64)
+            ok = ok && kernels.dotU8S8(xq, wq, n) == ref.dotU8S8(xq, wq, n);
+        // Activations, over the full range including the clamps. The vector
+        // versions only differ from the scalar ones by fma rounding:
+        FLOAT row[4][N], rowRef[4][N];
+        for (int i=0; i<N; ++i)
+            for (int r=0; r<4; ++r)
+                row[r][i] = rowRef[r][i] = (r == 3 ? 200.0f : 24.0f) * a[i];
+        for (int n : {N, 8, 3})
+        {
+            kernels.reluRow(row[0], n);       ref.reluRow(rowRef[0], n);
+            kernels.tanhRow(row[1], n);       ref.tanhRow(rowRef[1], n);
+            kernels.sigmoidRow(row[2], n);    ref.sigmoidRow(rowRef[2], n);
+            kernels.expRow(row[3], n);        ref.expRow(rowRef[3], n);
+            for (int i=0; i<N; ++i)
+                for (int r=0; r<4; ++r)
+                    ok = ok && close(row[r][i], rowRef[r][i]);
+            for (int i=0; i<N; ++i)
+                for (int r=0; r<4; ++r)
+                    row[r][i] = rowRef[r][i] = 0.02f * b[i] * (r == 3 ? 200.0f : 24.0f);
+        }
+        return ok;
+    }
+
+
+/****************************************/
+/*                          Model files */
+/****************************************/
+    void neuralFileLayout(NeuralFileHeader& header)
+    {
+        auto align = [](const UQWORD at) { return (at + NeuralFileHeader::SectionAlign - 1) & ~(NeuralFileHeader::SectionAlign - 1); };
+        UQWORD at = align(sizeof(NeuralFileHeader));
+        for (UDWORD i=0; i<header.nSections; ++i)
+        {
+            header.offsets[i] = at;
+            at = align(at + header.sizes[i]);
+        }
+        header.fileSize = at;
+    }
+
+    bool neuralFileWrite(const char *path, NeuralFileHeader header, const NeuralSection *sections)
+    {
+        static constexpr UBYTE zeros[NeuralFileHeader::SectionAlign] = {0};
+        auto padding = [&header](const UDWORD i) // After section i
+        {
+            const UQWORD end = header.offsets[i] + header.sizes[i];
+            return (i+1 < header.nSections ? header.offsets[i+1] : header.fileSize) - end;
+        };
+        header.checksum = fnv1a(zeros, header.offsets[0] - sizeof(NeuralFileHeader));
+        for (UDWORD i=0; i<header.nSections; ++i)
+        {
+            header.checksum = fnv1a(static_cast<const UBYTE *>(sections[i].data), sections[i].size, header.checksum);
+            header.checksum = fnv1a(zeros, padding(i), header.checksum);
+        }
+
+        FILE *file = std::fopen(path, "wb");
+        if (!file)
+            return false;
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = ok && std::fwrite(zeros, 1, header.offsets[0] - sizeof(header), file) == header.offsets[0] - sizeof(header);
+        for (UDWORD i=0; ok && i<header.nSections; ++i)
+        {
+            ok = std::fwrite(sections[i].data, 1, sections[i].size, file) == sections[i].size;
+            ok = ok && std::fwrite(zeros, 1, padding(i), file) == padding(i);
+        }
+        return (std::fclose(file) == 0) && ok;
+    }
+
+    // Everything but the checksum:
+    static bool neuralHeaderMatches(const NeuralFileHeader& h, const NeuralFileHeader& expected)
+    {
+        bool ok = h.magic == expected.magic && h.version == expected.version && h.byteOrder == expected.byteOrder;
+        ok = ok && h.inputSize == expected.inputSize && h.outputSize == expected.outputSize;
+        ok = ok && h.layers == expected.layers && h.hiddenWidth == expected.hiddenWidth;
+        ok = ok && h.columns == expected.columns && h.nSections == expected.nSections;
+        for (int i=0; i<NeuralFileHeader::MaxSections; ++i)
+            ok = ok && h.offsets[i] == expected.offsets[i] && h.sizes[i] == expected.sizes[i];
+        return ok && h.fileSize == expected.fileSize;
+    }
+
+    bool neuralFileValid(const UBYTE *bytes, const UQWORD size, const NeuralFileHeader& expected)
+    {
+        if (size != expected.fileSize || size < sizeof(NeuralFileHeader))
+            return false;
+        NeuralFileHeader header;
+        for (UQWORD i=0; i<sizeof(header); ++i) // May be misaligned
+            reinterpret_cast<UBYTE *>(&header)[i] = bytes[i];
+        return neuralHeaderMatches(header, expected)
+            && fnv1a(bytes + sizeof(header), size - sizeof(header)) == header.checksum;
+    }
+
+    bool neuralFileHeaderRead(const char *path, NeuralFileHeader& header)
+    {
+        FILE *file = std::fopen(path, "rb");
+        if (!file)
+            return false;
+        const bool ok = std::fread(&header, sizeof(header), 1, file) == 1;
+        std::fclose(file);
+        return ok;
+    }
+
+    bool neuralFileRead(const char *path, const NeuralFileHeader& expected, const NeuralSection *sections)
+    {
+        FILE *file = std::fopen(path, "rb");
+        if (!file)
+            return false;
+        NeuralFileHeader header;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && neuralHeaderMatches(header, expected);
+        // First pass, checksum:
+        UQWORD hash = fnv1a(nullptr, 0);
+        UQWORD left = expected.fileSize - sizeof(header);
+        while (ok && left > 0)
+        {
+            UBYTE chunk[4096];
+            const UQWORD n = left < sizeof(chunk) ? left : sizeof(chunk);
+            ok = std::fread(chunk, 1, n, file) == n;
+            hash = fnv1a(chunk, n, hash);
+            left -= n;
+        }
+        ok = ok && hash == header.checksum && std::fgetc(file) == EOF;
+        // Second pass, the sections:
+        for (UDWORD i=0; ok && i<expected.nSections; ++i)
+        {
+            ok = std::fseek(file, static_cast<long>(expected.offsets[i]), SEEK_SET) == 0;
+            ok = ok && std::fread(sections[i].data, 1, sections[i].size, file) == sections[i].size;
+        }
+        std::fclose(file);
+        return ok;
+    }
+
+    bool MappedFile::open(const char *path)
+    {
+        close();
+    #if defined(__unix__) || defined(__APPLE__)
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data = static_cast<UBYTE *>(p);
+                size = static_cast<UQWORD>(st.st_size);
+            }
+        }
+        ::close(fd); // The mapping stays valid
+    #else
+        (void)path;
+    #endif
+        return data != nullptr;
+    }
+
+    void MappedFile::close()
+    {
+    #if defined(__unix__) || defined(__APPLE__)
+        if (data)
+            munmap(data, static_cast<size_t>(size));
+    #endif
+        data = nullptr;
+        size = 0;
+    }
+
+
+/****************************************/
+/*                      Frozen networks */
+/****************************************/
+    bool neuralExportFrozen(const char *path, const char *name, const NeuralFileHeader& shape,
+                            const FLOAT *weights, const UQWORD *tiles, const FLOAT *biases)
+    {
+        const int inputs = static_cast<int>(shape.inputSize), outputs = static_cast<int>(shape.outputSize);
+        const int columns = static_cast<int>(shape.columns), layers = static_cast<int>(shape.layers);
+        const int blocks = (columns+7) / 8;
+        auto connected = [&](const int layer, const int dst, const int src) // Layer 0 only reads the inputs
+        {
+            return (layer > 0 || src < inputs)
+                && (tiles[(layer*blocks + dst/8)*blocks + src/8] >> ((dst%8)*8 + src%8)) & 1;
+        };
+        // Hex floats, the weights come back bit for bit:
+        auto writeFloat = [](FILE *file, const FLOAT x) { return std::fprintf(file, "%af", static_cast<double>(x)) > 0; };
+
+        for (int i=0; i<columns * columns; ++i)
+            if (!std::isfinite(weights[i]))
+                return false;
+        for (int i=0; i<columns * layers; ++i)
+            if (!std::isfinite(biases[i]))
+                return false;
+
+        int edges = 0;
+        for (int layer=0; layer<layers; ++layer)
+            for (int dst=0; dst<columns; ++dst)
+                for (int src=0; src<columns; ++src)
+                    edges += connected(layer, dst, src);
+
+        FILE *file = std::fopen(path, "w");
+        if (!file)
+            return false;
+        bool ok = std::fprintf(file, "// FeedForward32<%d, %d, %d, %d> frozen by exportFrozen(), %d edges\n",
+                               inputs, outputs, layers, static_cast<int>(shape.hiddenWidth), edges) > 0;
+        ok = ok && std::fprintf(file, "inline constexpr FrozenNetwork<%d, %d, %d, %d, %d> %s =\n{\n    {",
+                                inputs, outputs, layers, columns, edges, name) > 0;
+        int n = 0;
+        for (int layer=0; ok && layer<layers; ++layer)
+        {
+            ok = std::fprintf(file, "%d, ", n) > 0;
+            for (int dst=0; dst<columns; ++dst)
+                for (int src=0; src<columns; ++src)
+                    n += connected(layer, dst, src);
+        }
+        ok = ok && std::fprintf(file, "%d},\n    {", n) > 0;
+
+        n = 0;
+        for (int layer=0; ok && layer<layers; ++layer)
+            for (int dst=0; ok && dst<columns; ++dst)
+                for (int src=0; ok && src<columns; ++src)
+                {
+                    if (!connected(layer, dst, src))
+                        continue;
+                    ok = std::fprintf(file, "%s{%d, %d, ", n % 4 ? " " : "\n        ", dst, src) > 0;
+                    ok = ok && writeFloat(file, weights[dst*columns + src]) && std::fputs("},", file) >= 0;
+                    ++n;
+                }
+        if (edges == 0)
+            ok = ok && std::fputs("\n        {0, 0, 0.0f},", file) >= 0; // Never read
+        ok = ok && std::fputs("\n    },\n    {", file) >= 0;
+
+        for (int i=0; ok && i<columns * layers; ++i)
+        {
+            ok = std::fputs(i % 8 ? " " : "\n        ", file) >= 0;
+            ok = ok && writeFloat(file, biases[i]) && std::fputc(',', file) != EOF;
+        }
+        ok = ok && std::fputs("\n    }\n};\n", file) >= 0;
+        return (std::fclose(file) == 0) && ok;
+    }
+
+
 /****************************************/
 /*                      feed forward 32 */
 /****************************************/
@@ -24,6 +1138,82 @@
 /****************************************/
 /*                                Tests */
 /****************************************/
+    static_assert([]
+                  {
+                      // FNV-1a 64 reference values:
+                      constexpr UBYTE a[1] = {'a'};
+                      constexpr UBYTE foobar[6] = {'f', 'o', 'o', 'b', 'a', 'r'};
+                      bool ok = fnv1a(a, 0) == 0xcbf29ce484222325ull;
+                      ok = ok && fnv1a(a, 1) == 0xaf63dc4c8601ec8cull;
+                      ok = ok && fnv1a(foobar, 6) == 0x85944171f73967e8ull;
+                      ok = ok && fnv1a(&foobar[3], 3, fnv1a(foobar, 3)) == fnv1a(foobar, 6); // Chunks chain
+                      return ok;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      // Spot values against the exact results (Activations box):
+                      auto near = [](const FLOAT x, const FLOAT y, const FLOAT tol) { return (x > y ? x - y : y - x) <= tol; };
+                      bool ok = fastTanh(0.0f) == 0.0f && fastSigmoid(0.0f) == 0.5f && fastExp(0.0f) == 1.0f;
+                      ok = ok && near(fastTanh(0.5f), 0.46211715726f, 4e-7f) && near(fastTanh(-2.0f), -0.96402758008f, 4e-7f);
+                      ok = ok && fastTanh(40.0f) == 1.0f && fastTanh(-40.0f) == -1.0f;
+                      ok = ok && near(fastSigmoid(3.0f), 0.95257412682f, 3e-7f) && near(fastSigmoid(-30.0f), 0.0f, 3e-7f);
+                      ok = ok && near(fastExp(1.0f), 2.71828182846f, 3e-7f) && near(fastExp(-10.0f), 4.53999297625e-5f, 1e-11f);
+                      ok = ok && near(fastExp(20.0f), 485165195.4f, 64.0f) && fastExp(-200.0f) > 0.0f;
+                      ok = ok && fastRelu(2.0f) == 2.0f && fastRelu(-2.0f) == -2.0f * ReluSlope;
+                      return ok;
+                  }()
+                 );
+
+    // Inputs 0, 1 -> hidden 2, 3 -> output 4, as exportFrozen() writes it:
+    static constexpr FrozenNetwork<2, 1, 2, 5, 5> frozenTestNet =
+    {
+        {0, 3, 5},
+        {
+            {2, 0, 0.5f}, {2, 1, -1.0f}, {3, 1, 2.0f},
+            {4, 2, 1.5f}, {4, 3, -0.25f},
+        },
+        {
+            0.0f, 0.0f, 0.1f, -0.2f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f, 0.55f,
+        }
+    };
+
+    static_assert([]
+                  {
+                      using Frozen = FrozenEvaluator<frozenTestNet>;
+                      auto near = [](const FLOAT x, const FLOAT y) { return (x > y ? x - y : y - x) <= 1e-6f; };
+                      FLOAT scratch[Frozen::activationSize] = {};
+                      const FLOAT a[2] = {1.0f, 0.5f};
+                      const FLOAT *out = Frozen::evaluate(a, scratch);
+                      bool ok = near(scratch[2], 0.1f) && near(scratch[3], 0.8f) && scratch[4] == 0.0f;
+                      ok = ok && near(out[4], 0.46211715726f) && out[2] == 0.0f; // Every column is activated
+                      const FLOAT b[2] = {-1.0f, 0.5f}; // Hidden 2 in the leaky part
+                      out = Frozen::evaluate(b, scratch);
+                      ok = ok && near(scratch[2], -0.9f * ReluSlope) && near(out[4], 0.33625581395f);
+                      return ok;
+                  }()
+                 );
+
+    static_assert([]
+                  {
+                      bool ok = halfFromFloat(1.0f) == 0x3c00 && floatFromHalf(0x3c00) == 1.0f;
+                      ok = ok && halfFromFloat(-2.0f) == 0xc000 && floatFromHalf(0xc000) == -2.0f;
+                      ok = ok && halfFromFloat(65504.0f) == 0x7bff;  // Largest finite
+                      ok = ok && halfFromFloat(65520.0f) == 0x7c00;  // Rounds to inf
+                      ok = ok && halfFromFloat(1.0f + 1.0f/2048) == 0x3c00; // Tie, rounds to even
+                      ok = ok && halfFromFloat(1.0f + 3.0f/2048) == 0x3c02; // Tie, rounds to even (up)
+                      ok = ok && halfFromFloat(5.9604644775390625e-8f) == 0x0001; // Smallest subnormal
+                      ok = ok && floatFromHalf(0x0001) == 5.9604644775390625e-8f;
+                      ok = ok && halfFromFloat(1e-9f) == 0 && halfFromFloat(-0.0f) == 0x8000;
+                      // All finite halves survive the round trip:
+                      for (UDWORD h=0; h<0x7c00; h+=7)
+                          ok = ok && halfFromFloat(floatFromHalf(static_cast<UWORD>(h))) == h;
+                      return ok;
+                  }()
+                 );
+
     static_assert([]
                   {
                       constexpr int columns = 10;
@@ -45,15 +1235,15 @@
                       {
                           return weights[i];
                       };
-                      auto correct0 = Neural<2,2,3,decltype(rng)>::BitArray<columns*columns>{
+                      auto correct0 = Neural<2,2,3,16,decltype(rng)>::BitArray<columns*columns>{
                                           0b0000000000000000000011000000001100000000110000000000000000000000,
                                           0b0000000000000000000000000000000000000000000000000000000000000000
                                       };
-                      auto correct1 = Neural<2,2,3,decltype(rng)>::BitArray<columns*columns>{
+                      auto correct1 = Neural<2,2,3,16,decltype(rng)>::BitArray<columns*columns>{
                                           0b0000000000000000000000000000000000000000000000000000111000000011,
                                           0b1000000011100000000000000000000000000000000000000000000000000000
                                       };
-                      auto correct2 = Neural<2,2,3,decltype(rng)>::BitArray<columns*columns>{
+                      auto correct2 = Neural<2,2,3,16,decltype(rng)>::BitArray<columns*columns>{
                                           0b0000000000000000000000000000000000000000000000000000000000000000,
                                           0b0000000000000000000001110000000111000000000000000000000000000000
                                       };
@@ -68,6 +1258,53 @@
 
 
 
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    // A published network is ready for the players' incremental evaluators,
+    // they only get a const network and cannot prepare() it:
+    [[maybe_unused]] static const bool publishedIncrementalChecked = []
+    {
+        struct TestRng
+        {
+            UQWORD state = 1234;
+            UDWORD operator()()
+            {
+                UQWORD z = (state += 0x9e3779b97f4a7c15ull); // splitmix64
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                return static_cast<UDWORD>((z ^ (z >> 31)) >> 32);
+            }
+        } rng;
+        using Net = FeedForward32<16, 1, 3, 16, TestRng>;
+        auto trained = std::make_unique<Net>(rng);
+        trained->prepare();
+        auto exchange = std::make_unique<ModelExchange<Net>>(*trained, rng);
+        trained->setConnection(0, 3, 5, !trained->isConnected(0, 3, 5)); // Differs from the initial one
+        trained->prepare();
+        bool ok = exchange->publish(*trained);
+        const Net& played = exchange->acquire();
+        auto full = std::make_unique<Evaluator<Net>>(played);
+        auto incremental = std::make_unique<IncrementalEvaluator<Net>>(played);
+        FLOAT inputs[16] = {0.f};
+        for (int step=0; step<40; ++step)
+        {
+            inputs[rng() % 16] = static_cast<FLOAT>(static_cast<int>(rng() % 3) - 1);
+            const FLOAT a = full->evaluate(inputs)[Net::columns-1];
+            const FLOAT b = incremental->evaluate(inputs)[Net::columns-1];
+            ok = ok && std::fabs(a - b) < 1e-5f;
+        }
+        exchange->release(played);
+        assert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
+
+
+
+
+
+
+
+
 /****************************************/
 /*                             Research */
 /****************************************/
@@ -2,11 +2,17 @@
 #define NEURAL_HPP
 
 #include "asmtypes.hpp"
+#include "workers.hpp"
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
 #include <cmath>
 #include <assert.h>
 #include <iostream>
-//#include <arm_neon.h>
-//#include <immintrin.h>
+#include <memory>
+#include <type_traits>
+#include <utility>
 
 
 inline float sigmoid(float x) { return 1.0f / (1.0f + std::exp(-x)); }
@@ -18,12 +24,442 @@ using std::tanh;
 inline float tanh_derivative(float y) { return 1.0f - y * y; }
 
 
+/****************************************/
+/*   Half precision (IEEE 754 binary16) */
+/* Software conversion, round to        */
+/* nearest even. Used to fill the half  */
+/* weights and where there is no f16c   */
+/****************************************/
+    constexpr UWORD halfFromFloat(const FLOAT f)
+    {
+        UDWORD x = std::bit_cast<UDWORD>(f);
+        const UWORD sign = static_cast<UWORD>((x >> 16) & 0x8000u);
+        x &= 0x7fffffffu;
+        if (x >= 0x7f800000u) // inf, nan (stays a quiet nan)
+            return sign | 0x7c00u | (x > 0x7f800000u ? 0x200u : 0u);
+        if (x >= 0x477ff000u) // Rounds to >= 65536
+            return sign | 0x7c00u;
+        if (x < 0x38800000u) // Below 2^-14: subnormal or zero
+        {
+            if (x < 0x33000000u)
+                return sign;
+            const UDWORD e = x >> 23;
+            const UDWORD m = (x & 0x7fffffu) | 0x800000u;
+            const UDWORD shift = 126u - e;
+            UDWORD h = m >> shift;
+            const UDWORD rem  = m & ((1u << shift) - 1u);
+            const UDWORD half = 1u << (shift - 1u);
+            h += (rem > half) || (rem == half && (h & 1u));
+            return sign | static_cast<UWORD>(h);
+        }
+        UDWORD h = (x - 0x38000000u) >> 13;
+        const UDWORD rem = x & 0x1fffu;
+        h += (rem > 0x1000u) || (rem == 0x1000u && (h & 1u));
+        return sign | static_cast<UWORD>(h);
+    }
+
+    constexpr FLOAT floatFromHalf(const UWORD h)
+    {
+        const UDWORD sign = static_cast<UDWORD>(h & 0x8000u) << 16;
+        const UDWORD e = (h >> 10) & 0x1fu;
+        const UDWORD m = h & 0x3ffu;
+        if (e == 0)
+        {
+            const FLOAT sub = (m-0.f) * 5.9604644775390625e-8f; // m * 2^-24
+            return sign ? -sub : sub;
+        }
+        if (e == 31)
+            return std::bit_cast<FLOAT>(sign | 0x7f800000u | (m << 13));
+        return std::bit_cast<FLOAT>(sign | ((e + 112u) << 23) | (m << 13));
+    }
+
+
+/****************************************/
+/*                          Activations */
+/* Approximations that the kernels also */
+/* compute vectorized, one pass over a  */
+/* whole row. Max error against the     */
+/* exact double results:                */
+/* - fastTanh: 4.0e-7 absolute          */
+/*   (std::tanh in float: 1.0e-7)       */
+/* - fastSigmoid: 2.3e-7 absolute       */
+/* - fastExp: 8.0e-8 relative in        */
+/*   [-87.3, 88.3], clamped outside     */
+/****************************************/
+    enum class Activation { relu, tanh, sigmoid };
+
+    inline constexpr FLOAT ReluSlope = 0.0001f; // Leaky, for x <= 0
+    // tanh(x) = x * P(x^2) / Q(x^2), exact to float precision beyond the clamp:
+    inline constexpr FLOAT TanhClamp = 7.90531110763549805f;
+    inline constexpr FLOAT TanhP[7] = { -2.76076847742355e-16f, 2.00018790482477e-13f, -8.60467152213735e-11f,
+                                        5.12229709037114e-08f, 1.48572235717979e-05f, 6.37261928875436e-04f,
+                                        4.89352455891786e-03f };
+    inline constexpr FLOAT TanhQ[4] = { 1.19825839466702e-06f, 1.18534705686654e-04f, 2.26843463243900e-03f,
+                                        4.89352518554385e-03f };
+    // exp(x) = 2^n * exp(r), r = x - n*ln2 (in two parts), exp(r) as a polynomial:
+    inline constexpr FLOAT ExpMin = -87.3f, ExpMax = 88.3f;
+    inline constexpr FLOAT Log2e = 1.44269504088896341f;
+    inline constexpr FLOAT Ln2Hi = 0.693359375f, Ln2Lo = -2.12194440e-4f;
+    inline constexpr FLOAT ExpP[6] = { 1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f,
+                                       4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f };
+
+    constexpr FLOAT fastRelu(const FLOAT x) { return x > 0.0f ? x : ReluSlope * x; }
+
+    constexpr FLOAT fastTanh(FLOAT x)
+    {
+        x = x < -TanhClamp ? -TanhClamp : (x > TanhClamp ? TanhClamp : x);
+        const FLOAT x2 = x * x;
+        FLOAT p = TanhP[0];
+        for (int k=1; k<7; ++k)
+            p = p * x2 + TanhP[k];
+        FLOAT q = TanhQ[0];
+        for (int k=1; k<4; ++k)
+            q = q * x2 + TanhQ[k];
+        return x * p / q;
+    }
+
+    constexpr FLOAT fastSigmoid(const FLOAT x) { return 0.5f + 0.5f * fastTanh(0.5f * x); }
+
+    constexpr FLOAT fastExp(FLOAT x)
+    {
+        x = x < ExpMin ? ExpMin : (x > ExpMax ? ExpMax : x);
+        const FLOAT t = x * Log2e + 0.5f;
+        SDWORD n = static_cast<SDWORD>(t);
+        n -= t < (n-0.f); // floor
+        x = x - (n-0.f) * Ln2Hi;
+        x = x - (n-0.f) * Ln2Lo;
+        FLOAT y = ExpP[0];
+        for (int k=1; k<6; ++k)
+            y = y * x + ExpP[k];
+        y = y * (x * x) + x + 1.0f;
+        return y * std::bit_cast<FLOAT>(static_cast<UDWORD>(n + 127) << 23);
+    }
+
+
+/****************************************/
+/*                              Kernels */
+/* The inner loops of the networks. One */
+/* table per instruction set, the best  */
+/* one for the cpu we are running on is */
+/* picked once at startup (cpuid), so a */
+/* binary built without -march=... uses */
+/* the wide units where there are any.  */
+/* The tile kernels take one row of 8x8 */
+/* tiles, see "Topology, 8x8 tiles"     */
+/****************************************/
+    struct NeuralKernels
+    {
+        const char *name;
+        // sum(a[i] * b[i])
+        FLOAT (*dot)(const FLOAT *a, const FLOAT *b, int n);
+        // sum(a[i] * b[i] * mask[i])
+        FLOAT (*maskedDot)(const FLOAT *a, const FLOAT *b, const FLOAT *mask, int n);
+        // y[i] += alpha * x[i]
+        void (*axpy)(FLOAT *y, const FLOAT *x, FLOAT alpha, int n);
+        // One row of tiles: tiles[b] for the bits b set in occupied[0..nWords).
+        // 'w' holds 64 weights per tile set in 'stored' (a superset of
+        // 'occupied'), those of tile b start at wb = w + 64*storedTileRank(
+        // stored, b). 'x' and 'err' are padded to whole tiles and 32 byte
+        // aligned. Over the edges (bit r*8+c of tiles[b] set, i = b*8+c):
+        // y[r] = sum(x[i] * wb[r*8 + c])
+        void (*tileRow)(FLOAT *y, const FLOAT *w, const UQWORD *stored, const FLOAT *x, const UQWORD *tiles, const UQWORD *occupied, int nWords);
+        // tileRow with the weights stored as binary16
+        void (*tileRowHalf)(FLOAT *y, const UWORD *w, const UQWORD *stored, const FLOAT *x, const UQWORD *tiles, const UQWORD *occupied, int nWords);
+        // err[i] += delta[r] * wb[r*8 + c] (unless 'err' is null), then
+        // gb[r*8 + c] += delta[r] * scale * x[i], 'grad' laid out like 'w'
+        // (it may be 'w')
+        void (*tileBackward)(FLOAT *err, FLOAT *grad, const FLOAT *w, const UQWORD *stored, const FLOAT *x, const FLOAT *delta, FLOAT scale,
+                             const UQWORD *tiles, const UQWORD *occupied, int nWords);
+        // sum(x[i] * w[i]), n a multiple of 64. x in [0,127] so that no
+        // pair of products can saturate a 16 bit lane (pmaddubsw)
+        SDWORD (*dotU8S8)(const UBYTE *x, const SBYTE *w, int n);
+        // x[i] = fastRelu(x[i]), fastTanh(x[i]), ... in place
+        void (*reluRow)(FLOAT *x, int n);
+        void (*tanhRow)(FLOAT *x, int n);
+        void (*sigmoidRow)(FLOAT *x, int n);
+        void (*expRow)(FLOAT *x, int n);
+
+        void activate(const Activation a, FLOAT *x, const int n) const
+        {
+            if (a == Activation::relu)
+                reluRow(x, n);
+            else if (a == Activation::tanh)
+                tanhRow(x, n);
+            else
+                sigmoidRow(x, n);
+        }
+    };
+
+    const NeuralKernels& scalarKernels();
+    const NeuralKernels& neuralKernels(); // Best for this cpu
+
+    // Runs 'kernels' against the scalar reference on random data, true if
+    // all results agree (within rounding, the wide kernels sum in another order):
+    bool neuralKernelsSelfTest(const NeuralKernels& kernels);
+
+
+/****************************************/
+/*                          Model files */
+/* A header, then the sections (weights */
+/* biases, topology tiles) each on      */
+/* a 64 byte boundary, in the byte      */
+/* order of the machine that wrote it.  */
+/* The checksum (FNV-1a) covers all the */
+/* bytes after the header. Loading maps */
+/* the file (copy on write) where there */
+/* is mmap and uses the weights in      */
+/* place, else it is read with fread.   */
+/* The weights section has 64 floats    */
+/* per stored tile, its size gives the  */
+/* number of stored tiles               */
+/****************************************/
+    constexpr UQWORD fnv1a(const UBYTE *bytes, const UQWORD n, UQWORD hash = 0xcbf29ce484222325ull)
+    {
+        for (UQWORD i=0; i<n; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    struct NeuralFileHeader
+    {
+        static constexpr UQWORD Magic = 0x4e4e2d4941434e49ull; // "INCAI-NN"
+        static constexpr UDWORD Version = 3; // 2: topologies as 8x8 tiles, 3: weights per stored tile
+        static constexpr UDWORD ByteOrder = 0x01020304u;
+        static constexpr int MaxSections = 4;
+        static constexpr UQWORD SectionAlign = 64;
+
+        UQWORD magic = Magic;
+        UDWORD version = Version;
+        UDWORD byteOrder = ByteOrder;
+        UDWORD inputSize = 0, outputSize = 0, layers = 0, hiddenWidth = 0;
+        UDWORD columns = 0, nSections = 0;
+        UQWORD offsets[MaxSections] = {0};
+        UQWORD sizes[MaxSections] = {0};
+        UQWORD fileSize = 0;
+        UQWORD checksum = 0;
+    };
+
+    struct NeuralSection
+    {
+        void *data;
+        UQWORD size;
+    };
+
+    // Fills in the offsets and the file size from the section sizes:
+    void neuralFileLayout(NeuralFileHeader& header);
+    // Writes header and sections, filling in the checksum. 'header' as
+    // returned by neuralFileLayout():
+    bool neuralFileWrite(const char *path, NeuralFileHeader header, const NeuralSection *sections);
+    // True if the file image matches 'expected' (everything but the
+    // checksum) and its checksum is right:
+    bool neuralFileValid(const UBYTE *bytes, UQWORD size, const NeuralFileHeader& expected);
+    // Just the header, unchecked. For the section sizes that depend on the
+    // network (the expected header is built from them):
+    bool neuralFileHeaderRead(const char *path, NeuralFileHeader& header);
+    // The fread path: checks the whole file first, then reads the sections.
+    // Leaves 'sections' alone if the file does not match:
+    bool neuralFileRead(const char *path, const NeuralFileHeader& expected, const NeuralSection *sections);
+
+    // A whole file mapped private (writes stay in this process). open() is
+    // false where there is no mmap, or the file cannot be mapped:
+    class MappedFile
+    {
+    private:
+        UBYTE *data = nullptr;
+        UQWORD size = 0;
+    public:
+        MappedFile() = default;
+        ~MappedFile() { close(); }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const char *path);
+        void close();
+        void swap(MappedFile& other)
+        {
+            UBYTE *d = data; data = other.data; other.data = d;
+            const UQWORD s = size; size = other.size; other.size = s;
+        }
+
+        UBYTE *bytes() const { return data; }
+        UQWORD length() const { return size; }
+    };
+
+
+/****************************************/
+/*                      Frozen networks */
+/* A trained FeedForward32 written out  */
+/* as C++ (exportFrozen), its edges as  */
+/* a constexpr table. FrozenEvaluator   */
+/* unrolls that table at compile time:  */
+/* one multiply-add per edge with the   */
+/* weight and both columns as constants */
+/* and no topology, loops or branches   */
+/* left. Compile time grows with the    */
+/* edges, meant for small shipped nets  */
+/****************************************/
+    struct FrozenEdge
+    {
+        UWORD dst, src;
+        FLOAT weight;
+    };
+
+    // Edges sorted by layer, dst, src; those of layer l are
+    // edges[layerStart[l]] .. edges[layerStart[l+1]-1]:
+    template <int InputSize, int OutputSize, int Layers, int Columns, int Edges>
+    struct FrozenNetwork
+    {
+        static constexpr int inputSize = InputSize;
+        static constexpr int outputSize = OutputSize;
+        static constexpr int layers = Layers;
+        static constexpr int columns = Columns;
+        static constexpr int nEdges = Edges;
+
+        int layerStart[Layers + 1];
+        FrozenEdge edges[Edges > 0 ? Edges : 1];
+        FLOAT biases[Columns * Layers];
+    };
+
+    // Writes 'inline constexpr FrozenNetwork<...> name = {...};' to 'path',
+    // the network given as in its model file (see FeedForward32::exportFrozen):
+    bool neuralExportFrozen(const char *path, const char *name, const NeuralFileHeader& shape,
+                            const FLOAT *weights, const UQWORD *tiles, const FLOAT *biases);
+
+    // Same results as FeedForward32::evaluate (up to rounding, the sums
+    // are in another order) for the network it was exported from:
+    template <const auto& Net>
+    class FrozenEvaluator
+    {
+        using Shape = std::remove_cvref_t<decltype(Net)>;
+        static_assert(Shape::layers >= 2, "an input and an output layer");
+    public:
+        static constexpr int inputSize = Shape::inputSize;
+        static constexpr int outputSize = Shape::outputSize;
+        static constexpr int columns = Shape::columns;
+        static constexpr int activationSize = columns * Shape::layers;
+    private:
+        static constexpr int Chunk = 256; // Edges per fold expression
+
+        FLOAT activations[activationSize];
+
+        template <int First, int... E>
+        static constexpr void addEdges(const FLOAT *in, FLOAT *out, std::integer_sequence<int, E...>)
+        {
+            ((out[Net.edges[First+E].dst] += Net.edges[First+E].weight * in[Net.edges[First+E].src]), ...);
+        }
+
+        // Halves [First, Last) down to chunks, the instantiations stay shallow:
+        template <int First, int Last>
+        static constexpr void sumEdges(const FLOAT *in, FLOAT *out)
+        {
+            if constexpr (Last - First <= Chunk)
+                addEdges<First>(in, out, std::make_integer_sequence<int, Last - First>());
+            else
+            {
+                constexpr int Mid = First + (Last - First) / 2;
+                sumEdges<First, Mid>(in, out);
+                sumEdges<Mid, Last>(in, out);
+            }
+        }
+
+        template <int Layer>
+        static constexpr void forward(const FLOAT *in, FLOAT *scratch)
+        {
+            FLOAT *out = &scratch[Layer*columns];
+            FLOAT sums[columns]; // Not aliased by 'in', stays out of memory where it can
+            for (int c = 0; c < columns; ++c)
+                sums[c] = Net.biases[Layer*columns + c];
+            sumEdges<Net.layerStart[Layer], Net.layerStart[Layer+1]>(in, sums);
+            if constexpr (Layer+1 < Shape::layers)
+            {
+                for (int c = 0; c < columns; ++c)
+                    out[c] = fastRelu(sums[c]);
+                forward<Layer+1>(out, scratch);
+            }
+            else
+            {
+                for (int c = 0; c < columns; ++c)
+                    out[c] = fastTanh(sums[c]);
+            }
+        }
+    public:
+        // The outputs are the last outputSize columns of the returned
+        // row, as with FeedForward32. Also usable in constant expressions:
+        static constexpr FLOAT *evaluate(const FLOAT *inputs, FLOAT *scratch)
+        {
+            forward<0>(inputs, scratch);
+            return &scratch[(Shape::layers-1)*columns];
+        }
+
+        FLOAT *evaluate(const FLOAT *inputs) { return evaluate(inputs, activations); }
+    };
+
+
+/****************************************/
+/*                    First layer, NNUE */
+/* Between two positions only a few     */
+/* inputs change. An Accumulator holds  */
+/* the first layer before activation;   */
+/* a changed input adds change * (its   */
+/* weight column), the deeper layers    */
+/* are recomputed from there. Turns the */
+/* O(inputs x hidden) first layer into  */
+/* O(changed x hidden)                  */
+/****************************************/
+    struct NetworkInputDelta
+    {
+        int input;
+        FLOAT change; // New value - old value
+    };
+
+
+/****************************************/
+/*                  Topology, 8x8 tiles */
+/* The connections of a layer form a    */
+/* columns x columns bit matrix that is */
+/* mostly empty, a layer only connects  */
+/* a band of the columns. It is kept as */
+/* 8x8 tiles (one UQWORD each) plus, by */
+/* row of tiles, a bitmap of the tiles  */
+/* that have any edge. The kernels skip */
+/* the empty tiles and take a full one  */
+/* a row of 8 weights at a time         */
+/* Only the tiles with an edge (in any  */
+/* layer) have weights: 64 floats each, */
+/* row by row, found by counting the    */
+/* stored tiles before them in a bitmap */
+/****************************************/
+    // Where the weights of tile b are among those of its row of tiles:
+    inline int storedTileRank(const UQWORD *stored, const int b)
+    {
+        int rank = std::popcount(stored[b/64] & ((UQWORD(1) << (b%64)) - 1));
+        for (int k=0; k<b/64; ++k)
+            rank += std::popcount(stored[k]);
+        return rank;
+    }
+
+
 /****************************************/
 /*  feed forward 32 (this one is worse) */
 /****************************************/
+    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
+    class FeedForward16;
+
+    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
+    class FeedForward8;
+
+    template <typename Net, int MaxThreads>
+    class Trainer;
+
     template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng, int batchSize = 1>
     class FeedForward32
     {
+        template <int, int, int, int, typename> friend class FeedForward16;
+        template <int, int, int, int, typename> friend class FeedForward8;
+        template <typename, int> friend class Trainer;
     public:
         static constexpr int columns = InputSize+((Max_layers-1)*HiddenWidth)+OutputSize;
         template <int Size>
@@ -57,10 +493,45 @@ inline float tanh_derivative(float y) { return 1.0f - y * y; }
         };
     private:
         static constexpr int nLayers = Max_layers;
-        FLOAT weights[columns * columns];
+        static constexpr int blocks = (columns+7) / 8; // Tiles per row/column
+        static constexpr int occupiedWords = (blocks+63) / 64;
+        static constexpr int BatchTile = 8; // Samples per pass of evaluateBatch()
+        static constexpr int TileWeights = 64;
+        // Layer 0 by input, see update(). The column of input i holds its
+        // weights into the rows first[i/8] .. first[i/8]+length[i/8] (0
+        // where there is no edge), those rows of tiles that have any edge
+        // from the inputs of its tile:
+        static constexpr int inputBlocks = (InputSize+7) / 8;
+        struct InputColumns
+        {
+            std::unique_ptr<FLOAT[]> weights;
+            int size = 0;
+            int start[InputSize];
+            int first[inputBlocks];
+            int length[inputBlocks];
+        };
+        std::unique_ptr<FLOAT[]> ownWeights; // TileWeights per stored tile, see "Topology, 8x8 tiles"
+        FLOAT *weights = nullptr; // ownWeights, or the weights in the mapped model file, see load()
+        MappedFile mapped;
+        UQWORD weightSeed; // See initialWeight()
         FLOAT biases[columns * Max_layers];
-        BitArray<columns*columns> topologies[ Max_layers ];
-        FLOAT activations[columns * Max_layers];
+        // Bit r*8+c of tiles[layer][rb*blocks + cb] is the edge from column
+        // cb*8+c to column rb*8+r. All layers share the weights, one per
+        // dst and src (and training updates them)
+        UQWORD tiles[Max_layers][blocks * blocks];
+        // Compiled from the tiles: bit cb of occupied[layer][rb] is set if
+        // tile (rb, cb) has any edge
+        UQWORD occupied[Max_layers][blocks][occupiedWords];
+        // The tiles that have weights, those occupied in any layer. Row rb
+        // starts at weights[rowStart[rb] * TileWeights]
+        UQWORD stored[blocks][occupiedWords] = {};
+        int rowStart[blocks+1] = {0};
+        InputColumns firstLayer;
+        int nEdges = 0;
+        FLOAT activations[columns * Max_layers]; // Scratch of evaluate(inputs)/train() only
+        bool topologyDirty = true;
+        bool columnsDirty = true; // 'firstLayer' is behind the weights, see prepare()
+        const NeuralKernels *kernels = &neuralKernels();
     private:
         static FLOAT u64_to_float(const UQWORD i)
         {
@@ -70,226 +541,249 @@ inline float tanh_derivative(float y) { return 1.0f - y * y; }
             u.i = (0x3FFULL << 52) | (i >> 12);
             return static_cast<FLOAT>(u.d - 1.0);
         }
+
+        static NeuralFileHeader fileHeader(const int nStoredTiles)
+        {
+            NeuralFileHeader header;
+            header.inputSize = InputSize;
+            header.outputSize = OutputSize;
+            header.layers = Max_layers;
+            header.hiddenWidth = HiddenWidth;
+            header.columns = columns;
+            header.nSections = 3;
+            header.sizes[0] = UQWORD(nStoredTiles) * TileWeights * sizeof(FLOAT);
+            header.sizes[1] = sizeof(biases);
+            header.sizes[2] = sizeof(tiles);
+            neuralFileLayout(header);
+            return header;
+        }
     private:
+        // Reference path, multiplies by every topology bit:
         template <FLOAT (*Act)(FLOAT)>
-        void forward567(const int layer, const FLOAT *input, int inputSize)
+        void forwardDense(const int layer, const FLOAT *input, int inputSize, FLOAT *acts) const
         {
-            #if 0
-            FLOAT tops[columns*columns];
             for (int dst = 0; dst < columns; ++dst)
             {
+                FLOAT tops[columns], row[columns];
                 for (int src = 0; src < inputSize; ++src)
                 {
-                    const int i = dst * columns + src;
-                    tops[dst * columns + src] = topologies[layer][i];
+                    tops[src] = isConnected(layer, dst, src);
+                    row[src] = weightAt(dst, src);
                 }
+
+                const FLOAT sum = kernels->maskedDot(input, row, tops, inputSize);
+                acts[(layer*columns) + dst] = Act(sum + biases[(layer*columns) + dst]);
             }
+        }
 
-            for (int dst = 0; dst < columns; ++dst)
-                {
-                    // AVX accumulator for the dot product (8 floats initialized to 0.0)
-                    __m256 v_sum = _mm256_setzero_ps();
-                    int src = 0;
-                    const int weight_row_start = dst * columns;
-
-
-                    //__m256 v_connected[inputSize/8];
-                    //int pos = 0;
-                    //for (int src2=src; src2 <= inputSize - 8; src2 += 8)
-                    //{
-                    //    const float connected_mask[8] = {
-                    //        (float)topologies[layer][weight_row_start + src2 + 0],
-                    //        (float)topologies[layer][weight_row_start + src2 + 1],
-                    //        (float)topologies[layer][weight_row_start + src2 + 2],
-                    //        (float)topologies[layer][weight_row_start + src2 + 3],
-                    //        (float)topologies[layer][weight_row_start + src2 + 4],
-                    //        (float)topologies[layer][weight_row_start + src2 + 5],
-                    //        (float)topologies[layer][weight_row_start + src2 + 6],
-                    //        (float)topologies[layer][weight_row_start + src2 + 7]
-                    //    };
-                    //    v_connected[pos++] = _mm256_loadu_ps(connected_mask);
-                    //}
-                    //pos = 0;
-
-                    for (; src <= inputSize - 8; src += 8)
-                    {
-                        // Build the connection mask for 8 elements
-                        //const float connected_mask[8] = {
-                        //    (float)topologies[layer][weight_row_start + src + 0],
-                        //    (float)topologies[layer][weight_row_start + src + 1],
-                        //    (float)topologies[layer][weight_row_start + src + 2],
-                        //    (float)topologies[layer][weight_row_start + src + 3],
-                        //    (float)topologies[layer][weight_row_start + src + 4],
-                        //    (float)topologies[layer][weight_row_start + src + 5],
-                        //    (float)topologies[layer][weight_row_start + src + 6],
-                        //    (float)topologies[layer][weight_row_start + src + 7]
-                        //};
-
-                        const __m256 v_connected = _mm256_loadu_ps(&tops[weight_row_start+src]);
-                        //const __m256 v_connected = _mm256_loadu_ps(connected_mask);
-
-                        // Load 8 contiguous inputs and weights (use 'loadu' for unaligned access)
-                        const __m256 v_input = _mm256_loadu_ps(&input[src]);
-                        const __m256 v_weight = _mm256_loadu_ps(&weights[weight_row_start + src]);
-
-                        __m256 v_prod = _mm256_mul_ps(v_connected, v_weight);
-                        v_sum = _mm256_fmadd_ps(v_prod, v_input, v_sum);
-                    }
+        // The tile kernels read whole tiles of their vectors:
+        static void padToTiles(FLOAT *padded, const FLOAT *x, const int n)
+        {
+            for (int i=0; i<n; ++i)
+                padded[i] = x[i];
+            for (int i=n; i<blocks*8; ++i)
+                padded[i] = 0.0f;
+        }
 
-                    // Horizontal sum of the 8 floats in the v_sum vector
-                    // This is a standard, efficient pattern for AVX
-                    __m128 v_low = _mm256_castps256_ps128(v_sum);
-                    __m128 v_high = _mm256_extractf128_ps(v_sum, 1);
-                    v_low = _mm_add_ps(v_low, v_high);
-                    __m128 h_sum = _mm_hadd_ps(v_low, v_low);
-                    h_sum = _mm_hadd_ps(h_sum, h_sum);
-                    float sum = _mm_cvtss_f32(h_sum);
-
-                    // Handle any remaining elements (if inputSize is not a multiple of 8)
-                    for (; src < inputSize; ++src)
-                    {
-                        const int i = weight_row_start + src;
-                        if (topologies[layer][i])
-                        {
-                            sum += input[src] * weights[i];
-                        }
-                    }
+        // The weights of row of tiles rb, TileWeights per stored tile:
+        FLOAT *rowWeights(const int rb) const { return &weights[rowStart[rb] * TileWeights]; }
 
-                    // Apply bias and activation function
-                    activations[(layer * columns) + dst] = Act(sum + biases[(layer * columns) + dst]);
-                }
-            #endif
+        // The 64 weights of a stored tile, weight r*8+c for edge bit r*8+c:
+        FLOAT *tileWeights(const int rb, const int cb) const
+        {
+            return &rowWeights(rb)[storedTileRank(stored[rb], cb) * TileWeights];
         }
 
+        // The same for every network of this seed, so an edge that gets a
+        // new tile starts like the edges of the constructor did:
+        FLOAT initialWeight(const int dst, const int src) const
+        {
+            UQWORD z = weightSeed + UQWORD(dst*columns + src + 1) * 0x9e3779b97f4a7c15ull; // splitmix64
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            // He/Xavier Initialization: scale weights down so massive summations
+            // don't blow out the Tanh Output derivative into 0.0!
+            return (2.0f * u64_to_float(z ^ (z >> 31)) - 1.0f) * std::sqrt(2.0f / columns);
+        }
 
-        template <FLOAT (*Act)(FLOAT)>
-        void forward3455(const int layer, const FLOAT *input, int inputSize)
+        // Tiles with an edge in any layer, by row:
+        static int markStored(const UQWORD (*tileBits)[blocks * blocks], UQWORD (&bits)[blocks][occupiedWords], int (&start)[blocks+1])
         {
-            int cntW = 0;
-            float sparseWeights[columns+columns];
-            float sparseSrc[columns+columns];
-            float sparseDst[columns+columns];
-            for (int dst = 0; dst < columns; ++dst)
+            start[0] = 0;
+            for (int rb=0; rb<blocks; ++rb)
             {
-                for (int src = 0; src < inputSize; ++src)
+                for (int k=0; k<occupiedWords; ++k)
+                    bits[rb][k] = 0;
+                for (int layer=0; layer<Max_layers; ++layer)
+                    for (int cb=0; cb<blocks; ++cb)
+                        if (tileBits[layer][rb*blocks + cb])
+                            bits[rb][cb/64] |= UQWORD(1) << (cb%64);
+                start[rb+1] = start[rb];
+                for (int k=0; k<occupiedWords; ++k)
+                    start[rb+1] += std::popcount(bits[rb][k]);
+            }
+            return start[blocks];
+        }
+
+        // After the topology changed: a tile that lost its last edge gives
+        // its weights back, one that got its first edge gets initial weights
+        void restoreWeights()
+        {
+            UQWORD bits[blocks][occupiedWords];
+            int start[blocks+1];
+            const int n = markStored(tiles, bits, start);
+            bool same = weights != nullptr;
+            for (int rb=0; same && rb<blocks; ++rb)
+                for (int k=0; k<occupiedWords; ++k)
+                    same = same && bits[rb][k] == stored[rb][k];
+            if (same)
+                return;
+            auto fresh = std::make_unique_for_overwrite<FLOAT[]>(n > 0 ? n * TileWeights : 1);
+            for (int rb=0; rb<blocks; ++rb)
+            {
+                for (int cb=0; cb<blocks; ++cb)
                 {
-                    const int i = dst * columns + src;
-                    if (topologies[layer][i] != 0)
-                    {
-                        sparseWeights[cntW] = weights[i];
-                      //  sparseSrc[cntSrc++] = src;
-                    }
+                    if (!((bits[rb][cb/64] >> (cb%64)) & 1))
+                        continue;
+                    FLOAT *dst = &fresh[(start[rb] + storedTileRank(bits[rb], cb)) * TileWeights];
+                    const bool kept = weights && ((stored[rb][cb/64] >> (cb%64)) & 1);
+                    const FLOAT *src = kept ? tileWeights(rb, cb) : nullptr;
+                    for (int i=0; i<TileWeights; ++i)
+                        dst[i] = kept ? src[i] : initialWeight(rb*8 + i/8, cb*8 + i%8);
                 }
+                for (int k=0; k<occupiedWords; ++k)
+                    stored[rb][k] = bits[rb][k];
             }
+            for (int rb=0; rb<=blocks; ++rb)
+                rowStart[rb] = start[rb];
+            ownWeights = std::move(fresh);
+            weights = ownWeights.get();
+            mapped.close();
+        }
 
-
-
-
-
-            for (int dst = 0; dst < columns; ++dst)
+        // 'weightOf(rb, cb, bit)' reads the stored tile (rb, cb):
+        template <typename WeightOf>
+        void transposeFirstLayer(InputColumns& out, WeightOf weightOf) const
+        {
+            int size = 0;
+            for (int cb = 0; cb < inputBlocks; ++cb)
             {
-                float sum = 0.0f;
-                for (int src = 0; src < inputSize; ++src)
+                int firstRow = blocks, lastRow = -1;
+                for (int rb = 0; rb < blocks; ++rb)
+                    if (tiles[0][rb*blocks + cb])
+                    {
+                        firstRow = firstRow < rb ? firstRow : rb;
+                        lastRow = rb;
+                    }
+                const int end = (lastRow+1)*8 < columns ? (lastRow+1)*8 : columns;
+                out.first[cb] = lastRow < 0 ? 0 : firstRow*8;
+                out.length[cb] = lastRow < 0 ? 0 : end - firstRow*8;
+                for (int c = 0; c < 8 && cb*8 + c < InputSize; ++c)
+                {
+                    out.start[cb*8 + c] = size;
+                    size += out.length[cb];
+                }
+            }
+            if (!out.weights || out.size != size)
+                out.weights = std::make_unique_for_overwrite<FLOAT[]>(size > 0 ? size : 1);
+            out.size = size;
+            for (int cb = 0; cb < inputBlocks; ++cb)
+                for (int dst = out.first[cb]; dst < out.first[cb] + out.length[cb]; ++dst)
                 {
-                    const int i = dst * columns + src;
-                    const float connected = topologies[layer][i];
-                    sum += input[src] * weights[i] * connected;
+                    const UQWORD tile = tiles[0][(dst/8)*blocks + cb];
+                    for (int c = 0; c < 8 && cb*8 + c < InputSize; ++c)
+                    {
+                        const int bit = (dst%8)*8 + c;
+                        out.weights[out.start[cb*8 + c] + dst - out.first[cb]] = (tile >> bit) & 1 ? weightOf(dst/8, cb, bit) : 0.0f;
+                    }
                 }
-                activations[(layer*columns) + dst] = Act(sum + biases[(layer*columns) + dst]);
+        }
+
+        // Accumulator updates are one axpy per changed input:
+        static void applyDeltas(const NeuralKernels& k, const InputColumns& in, FLOAT *sums, const NetworkInputDelta *deltas, const int n)
+        {
+            for (int d = 0; d < n; ++d)
+            {
+                const int src = deltas[d].input;
+                k.axpy(&sums[in.first[src/8]], &in.weights[in.start[src]], deltas[d].change, in.length[src/8]);
             }
         }
 
+        // out[dst] = the edges of 'layer' into dst + its bias, 'x' padded:
+        void sumEdges(const int layer, const FLOAT *x, FLOAT *out) const
+        {
+            for (int rb = 0; rb < blocks; ++rb)
+            {
+                FLOAT y[8];
+                kernels->tileRow(y, rowWeights(rb), stored[rb], x, &tiles[layer][rb*blocks], occupied[layer][rb], occupiedWords);
+                for (int r = 0; r < 8 && rb*8 + r < columns; ++r)
+                    out[rb*8 + r] = y[r] + biases[(layer*columns) + rb*8 + r];
+            }
+        }
 
+        // Same result as forwardDense (the absent edges only ever added
+        // zeros), but only reads the tiles that have edges. Layer 0 only
+        // has edges from the inputs. The activation is a second pass over
+        // the whole row
+        template <Activation Act>
+        void forward(const int layer, const FLOAT *input, FLOAT *acts) const
+        {
+            alignas(32) FLOAT x[blocks*8];
+            padToTiles(x, input, layer == 0 ? InputSize : columns);
+            FLOAT *row = &acts[layer*columns];
+            sumEdges(layer, x, row);
+            kernels->activate(Act, row, columns);
+        }
 
-        template <FLOAT (*Act)(FLOAT)>
-        void forward(const int layer, const FLOAT *input, int inputSize)
+        // forward() for n <= BatchTile samples, layer 0 reads 'inputs' and
+        // the others the previous layer in their 'scratch':
+        template <Activation Act>
+        void forwardBatch(const int layer, const FLOAT *const *inputs, FLOAT *const *scratch, const int n) const
         {
-            for (int dst = 0; dst < columns; ++dst)
+            alignas(32) FLOAT x[BatchTile][blocks*8];
+            for (int s = 0; s < n; ++s)
             {
-                FLOAT tops[columns];
-                for (int src = 0; src < inputSize; ++src)
+                if (layer == 0)
+                    padToTiles(x[s], inputs[s], InputSize);
+                else
+                    padToTiles(x[s], &scratch[s][(layer-1)*columns], columns);
+            }
+            for (int rb = 0; rb < blocks; ++rb)
+            {
+                for (int s = 0; s < n; ++s)
                 {
-                    const int i = dst * columns + src;
-                    tops[src] = topologies[layer][i];
+                    FLOAT y[8];
+                    kernels->tileRow(y, rowWeights(rb), stored[rb], x[s], &tiles[layer][rb*blocks], occupied[layer][rb], occupiedWords);
+                    for (int r = 0; r < 8 && rb*8 + r < columns; ++r)
+                        scratch[s][(layer*columns) + rb*8 + r] = y[r] + biases[(layer*columns) + rb*8 + r];
                 }
+            }
+            for (int s = 0; s < n; ++s)
+                kernels->activate(Act, &scratch[s][layer*columns], columns);
+        }
+
+        // Layers 1.. on top of the layer 0 activations in 'scratch':
+        FLOAT *forwardHidden(FLOAT *scratch) const
+        {
+            for (int i=1; i<nLayers-1; ++i)
+                forward<Activation::relu>(i, &scratch[(i-1)*columns], scratch);
+            // todo: tahn or softmax?
+            forward<Activation::tanh>(nLayers-1, &scratch[(nLayers-2)*columns], scratch);
+            return &scratch[(nLayers-1)*columns];
+        }
 
-                FLOAT sum = 0.0f;
-                for (int src = 0; src < inputSize; ++src)
-                {
-                    const int i = dst * columns + src;
-                    sum += input[src] * weights[i] * tops[src];
-                }
-                activations[(layer*columns) + dst] = Act(sum + biases[(layer*columns) + dst]);
-            }
-        }
-
-
-
-            //for (int dst = 0; dst < columns; ++dst)
-            //    {
-            //        // Vector accumulator for the dot product.
-            //        float32x4_t v_sum = vdupq_n_f32(0.0f);
-            //        int src = 0;
-            //        const int weight_row_start = dst * columns;
-            //
-            //        // Process the inner loop in chunks of 4 using NEON.
-            //        for (; src <= inputSize - 4; src += 4)
-            //        {
-            //            // 1. Load 4 contiguous inputs. (FAST)
-            //            const float32x4_t v_input = vld1q_f32(&input[src]);
-            //
-            //            // 2. Load 4 contiguous weights. (FAST)
-            //            const float32x4_t v_weight = vld1q_f32(&weights[weight_row_start + src]);
-            //
-            //            // 3. Handle the 'connected' bits. This remains a bottleneck.
-            //            //    We still need to build the mask on the fly.
-            //            const float connected_mask[4] = {
-            //                (float)topologies[layer][weight_row_start + src + 0],
-            //                (float)topologies[layer][weight_row_start + src + 1],
-            //                (float)topologies[layer][weight_row_start + src + 2],
-            //                (float)topologies[layer][weight_row_start + src + 3]
-            //            };
-            //            const float32x4_t v_connected = vld1q_f32(connected_mask);
-            //
-            //            // 4. Multiply weights and inputs.
-            //            float32x4_t v_prod = vmulq_f32(v_input, v_weight);
-            //            v_sum = vmlaq_f32(v_sum, v_prod, v_connected);
-            //        }
-            //
-            //        // 7. Horizontally add the 4 lanes of the sum vector to get a single float.
-            //        float sum = vgetq_lane_f32(v_sum, 0) + vgetq_lane_f32(v_sum, 1) +
-            //                    vgetq_lane_f32(v_sum, 2) + vgetq_lane_f32(v_sum, 3);
-            //
-            //        // 8. Handle any remaining elements (if inputSize is not a multiple of 4).
-            //        for (; src < inputSize; ++src)
-            //        {
-            //            const int i = weight_row_start + src;
-            //            if (topologies[layer][i])
-            //            {
-            //                sum += input[src] * weights[i];
-            //            }
-            //        }
-            //
-            //        // 9. Apply bias and activation function.
-            //        activations[(layer * columns) + dst] = Act(sum + biases[(layer * columns) + dst]);
-            //    }
 
 
+        // 'inputs' (the deltas of 'topologyIdx') padded to whole tiles:
         template <FLOAT (*Deriv)(FLOAT)>
         void backward(const int topologyIdx, FLOAT *deltas, const FLOAT *inputs, const FLOAT *activations, FLOAT learning_rate)
         {
-            FLOAT hidden_error[columns] = {0.0f};
-            for (int input_idx = 0; input_idx < columns; ++input_idx)
-            {
-                const FLOAT common = inputs[input_idx] * learning_rate;
-                for (int hidden_idx = 0; hidden_idx < columns; ++hidden_idx)
-                {
-                    const int weight_idx = input_idx * columns + hidden_idx;
-                    const auto connected = topologies[topologyIdx][weight_idx];
-                    hidden_error[hidden_idx] += inputs[input_idx] * weights[weight_idx] * connected;
-                    weights[weight_idx] += activations[hidden_idx] * common * connected;
-                }
-            }
+            alignas(32) FLOAT hidden_error[blocks*8] = {0.0f};
+            alignas(32) FLOAT x[blocks*8];
+            padToTiles(x, activations, columns);
+            for (int rb = 0; rb < blocks; ++rb)
+                kernels->tileBackward(hidden_error, rowWeights(rb), rowWeights(rb), stored[rb], x, &inputs[rb*8], learning_rate,
+                                      &tiles[topologyIdx][rb*blocks], occupied[topologyIdx][rb], occupiedWords);
             for (int h = 0; h < columns; ++h)
             {
                 deltas[h] = hidden_error[h] * Deriv(activations[h]);
@@ -314,17 +808,10 @@ inline float tanh_derivative(float y) { return 1.0f - y * y; }
 
 
 
-            // 1. Calculate hidden width to determine weight scaling
-                  const int hiddenSizex = (columns-(InputSize+OutputSize)) / (nLayers-1);
+            // 1. Weights, only for the tiles that end up with edges (see initialWeight()):
+                  weightSeed = (UQWORD(rng()) << 32) ^ UQWORD(rng());
 
-                  // 2. He/Xavier Initialization: scale weights down so massive summations
-                  // don't blow out the Tanh Output derivative into 0.0!
-                  const FLOAT weight_scale = std::sqrt(2.0f / (FLOAT)(columns));
-
-                  for (int i = 0; i < columns * columns; ++i)
-                      weights[i] = (2.0f * u64_to_float(rng()) - 1.0f) * weight_scale;
-
-                  // 3. Initialize biases slightly positive to ensure ReLUs aren't born "dead"
+                  // 2. Initialize biases slightly positive to ensure ReLUs aren't born "dead"
                   for (int i = 0; i < columns * Max_layers; ++i)
                       biases[i] = 0.01f;
 
@@ -343,7 +830,7 @@ inline float tanh_derivative(float y) { return 1.0f - y * y; }
             for (int i=0; i<hiddenSize; ++i)
             {
                 for (int j=0; j<InputSize; ++j)
-                    topologies[0].set(from + j, true);
+                    setConnection(0, (from + j) / columns, (from + j) % columns, true);
                 from += columns;
             }
             from += InputSize;
@@ -352,7 +839,7 @@ inline float tanh_derivative(float y) { return 1.0f - y * y; }
                 for (int i=0; i<hiddenSize; ++i)
                 {
                     for (int j=0; j<hiddenSize; ++j)
-                        topologies[layer].set(from + j, true);
+                        setConnection(layer, (from + j) / columns, (from + j) % columns, true);
                     from += columns;
                 }
                 from += hiddenSize;
@@ -362,7 +849,7 @@ inline float tanh_derivative(float y) { return 1.0f - y * y; }
             for (int i=0; i<OutputSize; ++i)
             {
                 for (int j=0; j<hiddenSize; ++j)
-                    topologies[nLayers-1].set(from + j, true);
+                    setConnection(nLayers-1, (from + j) / columns, (from + j) % columns, true);
                 from += columns;
             }
 
@@ -371,44 +858,297 @@ inline float tanh_derivative(float y) { return 1.0f - y * y; }
             {
                 for (int i=0; i<columns*columns; ++i)
                 {
-                    if (rng() % 100 < 25) // 25% chance to flip
+                    const int dst = i / columns, src = i % columns;
+                    if (rng() % 100 < 25 && (layer > 0 || src < InputSize)) // 25% chance to flip
+                        setConnection(layer, dst, src, !isConnected(layer, dst, src));
+                }
+            }
+            compileTopology();
+        }
+
+        FeedForward32(const FeedForward32&) = delete; // 'weights' may point into this one
+        FeedForward32& operator=(const FeedForward32&) = delete;
+
+        // Weights (of the stored tiles), biases and topology tiles, see "Model files":
+        bool save(const char *path) const
+        {
+            const NeuralSection sections[3] = { { weights, fileHeader(rowStart[blocks]).sizes[0] },
+                                                { const_cast<FLOAT *>(biases), sizeof(biases) },
+                                                { const_cast<UQWORD *>(&tiles[0][0]), sizeof(tiles) } };
+            return neuralFileWrite(path, fileHeader(rowStart[blocks]), sections);
+        }
+
+        // Replace the network by the one in 'path'. False (and the network
+        // unchanged) if the file is missing, damaged, or of another shape.
+        // Where possible the weights are used straight from the mapped
+        // file: no copy, and processes loading the same file share its
+        // pages until one of them trains (copy on write)
+        bool load(const char *path)
+        {
+            // The size of the weights section gives the number of stored
+            // tiles, the topology in the file must need exactly these:
+            constexpr UQWORD TileBytes = TileWeights * sizeof(FLOAT);
+            NeuralFileHeader found;
+            if (!neuralFileHeaderRead(path, found) || found.sizes[0] % TileBytes != 0 || found.sizes[0] > TileBytes * blocks * blocks)
+                return false;
+            const int nStored = static_cast<int>(found.sizes[0] / TileBytes);
+            const NeuralFileHeader expected = fileHeader(nStored);
+            auto fileTiles = std::make_unique_for_overwrite<UQWORD[][blocks * blocks]>(Max_layers);
+            auto fileBiases = std::make_unique_for_overwrite<FLOAT[]>(columns * Max_layers);
+            std::unique_ptr<FLOAT[]> fileWeights;
+            MappedFile file;
+            if (file.open(path))
+            {
+                if (!neuralFileValid(file.bytes(), file.length(), expected))
+                    return false;
+                const UBYTE *biasBytes = file.bytes() + expected.offsets[1];
+                const UBYTE *tileBytes = file.bytes() + expected.offsets[2];
+                for (UQWORD i=0; i<sizeof(biases); ++i)
+                    reinterpret_cast<UBYTE *>(fileBiases.get())[i] = biasBytes[i];
+                for (UQWORD i=0; i<sizeof(tiles); ++i)
+                    reinterpret_cast<UBYTE *>(fileTiles.get())[i] = tileBytes[i];
+            }
+            else
+            {
+                fileWeights = std::make_unique_for_overwrite<FLOAT[]>(nStored > 0 ? nStored * TileWeights : 1);
+                const NeuralSection sections[3] = { { fileWeights.get(), expected.sizes[0] },
+                                                    { fileBiases.get(), sizeof(biases) },
+                                                    { fileTiles.get(), sizeof(tiles) } };
+                if (!neuralFileRead(path, expected, sections))
+                    return false;
+            }
+            UQWORD bits[blocks][occupiedWords];
+            int start[blocks+1];
+            if (markStored(fileTiles.get(), bits, start) != nStored)
+                return false;
+
+            for (int i=0; i<columns * Max_layers; ++i)
+                biases[i] = fileBiases[i];
+            for (int layer=0; layer<Max_layers; ++layer)
+                for (int t=0; t<blocks*blocks; ++t)
+                    tiles[layer][t] = fileTiles[layer][t];
+            for (int rb=0; rb<blocks; ++rb)
+                for (int k=0; k<occupiedWords; ++k)
+                    stored[rb][k] = bits[rb][k];
+            for (int rb=0; rb<=blocks; ++rb)
+                rowStart[rb] = start[rb];
+            if (fileWeights)
+            {
+                ownWeights = std::move(fileWeights);
+                weights = ownWeights.get();
+                mapped.close();
+            }
+            else
+            {
+                weights = reinterpret_cast<FLOAT *>(file.bytes() + expected.offsets[0]);
+                mapped.swap(file); // The old mapping (if any) goes with 'file'
+                ownWeights.reset();
+            }
+            compileTopology(); // Same stored tiles, so the weights stay where they are
+            return true;
+        }
+
+        // The network as a C++ header for FrozenEvaluator, see "Frozen
+        // networks". 'name' becomes the name of the constexpr table:
+        bool exportFrozen(const char *path, const char *name) const
+        {
+            auto dense = std::make_unique<FLOAT[]>(columns * columns);
+            for (int dst=0; dst<columns; ++dst)
+                for (int src=0; src<columns; ++src)
+                    dense[dst*columns + src] = weightAt(dst, src);
+            return neuralExportFrozen(path, name, fileHeader(rowStart[blocks]), dense.get(), &tiles[0][0], biases);
+        }
+
+        // Take over weights, biases and topology of 'other' (same shape).
+        // Prepared afterwards: readers of a copy, e.g. the players of a
+        // ModelExchange, only have a const network and cannot prepare():
+        void copyFrom(const FeedForward32& other)
+        {
+            const int n = other.rowStart[blocks] * TileWeights;
+            if (weights != ownWeights.get() || rowStart[blocks] != other.rowStart[blocks])
+                ownWeights = std::make_unique_for_overwrite<FLOAT[]>(n > 0 ? n : 1);
+            for (int i=0; i<n; ++i)
+                ownWeights[i] = other.weights[i];
+            weights = ownWeights.get();
+            mapped.close();
+            weightSeed = other.weightSeed;
+            for (int i=0; i<columns * Max_layers; ++i)
+                biases[i] = other.biases[i];
+            for (int layer=0; layer<nLayers; ++layer)
+                for (int t=0; t<blocks*blocks; ++t)
+                    tiles[layer][t] = other.tiles[layer][t];
+            for (int rb=0; rb<blocks; ++rb)
+                for (int k=0; k<occupiedWords; ++k)
+                    stored[rb][k] = other.stored[rb][k];
+            for (int rb=0; rb<=blocks; ++rb)
+                rowStart[rb] = other.rowStart[rb];
+            compileTopology();
+            prepare();
+        }
+
+        // Add/remove the edge src->dst in 'layer' (layer 0: src an input).
+        // The occupancy bitmap (and which tiles have weights) is rebuilt on the
+        // next evaluate()/train()/prepare():
+        void setConnection(const int layer, const int dst, const int src, const bool connected)
+        {
+            assert((layer > 0 || src < InputSize) && "layer 0 connects the inputs only");
+            UQWORD& tile = tiles[layer][(dst/8)*blocks + src/8];
+            const UQWORD bit = UQWORD(1) << ((dst%8)*8 + src%8);
+            tile = connected ? (tile | bit) : (tile & ~bit);
+            topologyDirty = true;
+        }
+
+        void compileTopology()
+        {
+            nEdges = 0;
+            for (int layer=0; layer<nLayers; ++layer)
+            {
+                for (int rb=0; rb<blocks; ++rb)
+                {
+                    for (int k=0; k<occupiedWords; ++k)
+                        occupied[layer][rb][k] = 0;
+                    for (int cb=0; cb<blocks; ++cb)
                     {
-                        const bool current = topologies[layer][i];
-                        topologies[layer].set(i, !current);
+                        const UQWORD tile = tiles[layer][rb*blocks + cb];
+                        if (tile)
+                            occupied[layer][rb][cb/64] |= UQWORD(1) << (cb%64);
+                        nEdges += std::popcount(tile);
                     }
                 }
             }
+            restoreWeights();
+            topologyDirty = false;
+            columnsDirty = true;
+        }
+
+        // Bring everything derived (compiled topology, the first layer by
+        // input) up to date. Needed after setConnection()/train() before the
+        // network is shared with Evaluators, which only read it:
+        void prepare()
+        {
+            if (topologyDirty)
+                compileTopology();
+            if (columnsDirty)
+            {
+                transposeFirstLayer(firstLayer, [this](const int rb, const int cb, const int bit) { return tileWeights(rb, cb)[bit]; });
+                columnsDirty = false;
+            }
+        }
+
+        bool isConnected(const int layer, const int dst, const int src) const
+        {
+            return (tiles[layer][(dst/8)*blocks + src/8] >> ((dst%8)*8 + src%8)) & 1;
+        }
+
+        // The weight of src->dst, 0 where no layer has its tile:
+        FLOAT weightAt(const int dst, const int src) const
+        {
+            const int rb = dst/8, cb = src/8;
+            if (!((stored[rb][cb/64] >> (cb%64)) & 1))
+                return 0.0f;
+            return tileWeights(rb, cb)[(dst%8)*8 + src%8];
+        }
+
+        // Bytes of weights held, TileWeights floats per stored tile:
+        UQWORD weightBytes() const { return UQWORD(rowStart[blocks]) * TileWeights * sizeof(FLOAT); }
+
+        // Pin the kernels, e.g. scalarKernels() for a reference run:
+        void setKernels(const NeuralKernels& k) { kernels = &k; }
+
+        int countEdges() const { return nEdges; }
+
+        static constexpr int activationSize = columns * Max_layers;
+        static constexpr int inputSize = InputSize;
+        static constexpr int outputSize = OutputSize;
+
+        // Read-only evaluation into the caller's 'scratch' (activationSize
+        // floats). Any number of threads may do this at the same time:
+        FLOAT *evaluate(const FLOAT *inputs, FLOAT *scratch) const
+        {
+            assert(!topologyDirty && "call prepare() first");
+            forward<Activation::relu>(0, inputs, scratch);
+            return forwardHidden(scratch);
+        }
+
+        // Layer 0 before the activation, see "First layer, NNUE":
+        struct Accumulator
+        {
+            FLOAT sums[columns];
+        };
+
+        void refresh(Accumulator& acc, const FLOAT *inputs) const
+        {
+            assert(!topologyDirty && "call prepare() first");
+            alignas(32) FLOAT x[blocks*8];
+            padToTiles(x, inputs, InputSize);
+            sumEdges(0, x, acc.sums);
+        }
+
+        // A changed input adds change * (its column of layer 0), contiguous
+        // in 'firstLayer':
+        void update(Accumulator& acc, const NetworkInputDelta *deltas, const int n) const
+        {
+            assert(!topologyDirty && !columnsDirty && "call prepare() first");
+            applyDeltas(*kernels, firstLayer, acc.sums, deltas, n);
+        }
+
+        FLOAT *evaluate(const Accumulator& acc, FLOAT *scratch) const
+        {
+            for (int dst = 0; dst < columns; ++dst)
+                scratch[dst] = acc.sums[dst];
+            kernels->reluRow(scratch, columns);
+            return forwardHidden(scratch);
         }
 
         FLOAT *evaluate(const FLOAT *inputs)
         {
-            forward<relu>(0, inputs, InputSize);
+            prepare();
+            return evaluate(inputs, activations);
+        }
+
+        // Same as evaluate() using the dense reference path. For testing and
+        // benchmarking only:
+        FLOAT *evaluateDense(const FLOAT *inputs)
+        {
+            forwardDense<relu>(0, inputs, InputSize, activations);
             for (int i=1; i<nLayers-1; ++i)
-                forward<relu>(i, &activations[(i-1)*columns], columns);
-            // todo: tahn or softmax?
-            forward<tanh>(nLayers-1, &activations[(nLayers-2)*columns], columns);
+                forwardDense<relu>(i, &activations[(i-1)*columns], columns, activations);
+            forwardDense<tanh>(nLayers-1, &activations[(nLayers-2)*columns], columns, activations);
             return &activations[(nLayers-1)*columns];
         }
 
-        FLOAT evaluateBatch()
+        // evaluate(inputs[s], scratch[s]) for 'n' samples, same results.
+        // BatchTile samples go through a layer together, so each row of
+        // tiles is read from memory once for all of them instead of once
+        // per sample. Read-only like evaluate(inputs, scratch)
+        void evaluateBatch(const FLOAT *const *inputs, FLOAT *const *scratch, const int n) const
         {
-            // Not implemented yet, but the idea is to process multiple inputs in parallel using SIMD.
-            // This would require reorganizing the data layout to be more cache-friendly and SIMD-friendly.
-            return 0.0f;
+            assert(!topologyDirty && "call prepare() first");
+            for (int first = 0; first < n; first += BatchTile)
+            {
+                const int m = n - first < BatchTile ? n - first : BatchTile;
+                forwardBatch<Activation::relu>(0, &inputs[first], &scratch[first], m);
+                for (int i=1; i<nLayers-1; ++i)
+                    forwardBatch<Activation::relu>(i, nullptr, &scratch[first], m);
+                forwardBatch<Activation::tanh>(nLayers-1, nullptr, &scratch[first], m);
+            }
         }
 
         FLOAT train(const FLOAT *inputs, const FLOAT *targets, FLOAT learning_rate)
         {
-            forward<relu>(0, inputs, InputSize);
+            if (topologyDirty)
+                compileTopology();
+            columnsDirty = true;
+            forward<Activation::relu>(0, inputs, activations);
             for (int i=1; i<nLayers-1; ++i)
-                forward<relu>(i, &activations[(i-1)*columns], columns);
+                forward<Activation::relu>(i, &activations[(i-1)*columns], activations);
             // last layer:
             // todo: tahn or softmax?
-            forward<tanh>(nLayers-1, &activations[(nLayers-2)*columns], columns);
+            forward<Activation::tanh>(nLayers-1, &activations[(nLayers-2)*columns], activations);
 
             // Output to last hidden (sigmoid):
             FLOAT squared_error_sum = 0.0f;
-            FLOAT output_delta[columns] = {0.0f};
+            alignas(32) FLOAT output_delta[blocks*8] = {0.0f};
             const int lastLayerIdx = (nLayers-1) * columns;
             for (int j=0; j<OutputSize; ++j)
             {
@@ -424,7 +1164,7 @@ inline float tanh_derivative(float y) { return 1.0f - y * y; }
 
             // Hidden (relu):
             FLOAT *next_layer_deltas = output_delta;
-            FLOAT delta_buffer[columns];
+            alignas(32) FLOAT delta_buffer[blocks*8] = {0.0f};
             for (int l = nLayers-1; l > 1; --l)
             {
                 backward<relu_derivative>(l, delta_buffer, next_layer_deltas, &activations[(l-1)*columns], learning_rate);
@@ -437,40 +1177,1181 @@ inline float tanh_derivative(float y) { return 1.0f - y * y; }
 
 
             // Update weights (hidden to input):
-            for (int hidden_idx = 0; hidden_idx < columns; ++hidden_idx)
-            {
-                const FLOAT common = delta_buffer[hidden_idx] * learning_rate;
-                for (int input_idx = 0; input_idx < InputSize; ++input_idx)
-                {
-                    const int weight_idx = hidden_idx * columns + input_idx;
-                    const auto connected = topologies[0][weight_idx];
-                    weights[weight_idx] += inputs[input_idx] * common * connected;
-                }
-            }
+            alignas(32) FLOAT x[blocks*8];
+            padToTiles(x, inputs, InputSize);
+            for (int rb = 0; rb < blocks; ++rb)
+                kernels->tileBackward(nullptr, rowWeights(rb), rowWeights(rb), stored[rb], x, &delta_buffer[rb*8], learning_rate,
+                                      &tiles[0][rb*blocks], occupied[0][rb], occupiedWords);
             return squared_error_sum / OutputSize; // mean squared error
         }
-    };
-
-
-/****************************************/
-/*           feed forward 16 (IEEE 754) */
-/****************************************/
-template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
-using FeedForward16 = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
-// FLOAT masterCopy
+
+    private:
+        // The gradient of one sample, added to gradW/gradB. Same sign as the
+        // steps train() takes (target - output), but the weights are left
+        // alone, so several threads can do this on one network. 'acts' is
+        // activationSize of scratch. Returns the squared error sum
+        FLOAT gradient(const FLOAT *inputs, const FLOAT *targets, FLOAT *acts, FLOAT *gradW, FLOAT *gradB) const
+        {
+            evaluate(inputs, acts);
+
+            FLOAT squared_error_sum = 0.0f;
+            alignas(32) FLOAT deltaBuffers[2][blocks*8];
+            alignas(32) FLOAT x[blocks*8];
+            FLOAT *deltas = deltaBuffers[0];
+            FLOAT *prevDeltas = deltaBuffers[1];
+            const int lastLayerIdx = (nLayers-1) * columns;
+            for (int i=0; i<blocks*8; ++i)
+                deltas[i] = 0.0f;
+            for (int j=0; j<OutputSize; ++j)
+            {
+                const int o = (columns - OutputSize) + j;
+                const FLOAT output_error = targets[j] - acts[lastLayerIdx + o];
+                deltas[o] = output_error * tanh_derivative(acts[lastLayerIdx + o]);
+                gradB[lastLayerIdx + o] += deltas[o];
+                squared_error_sum += output_error * output_error;
+            }
+
+            for (int l = nLayers-1; l > 0; --l)
+            {
+                const FLOAT *prevActs = &acts[(l-1)*columns];
+                padToTiles(x, prevActs, columns);
+                for (int i=0; i<blocks*8; ++i)
+                    prevDeltas[i] = 0.0f;
+                // Hidden error into prevDeltas, the rows without delta (most
+                // of the output layer) are skipped:
+                for (int rb = 0; rb < blocks; ++rb)
+                    kernels->tileBackward(prevDeltas, &gradW[rowStart[rb] * TileWeights], rowWeights(rb), stored[rb], x, &deltas[rb*8], 1.0f,
+                                          &tiles[l][rb*blocks], occupied[l][rb], occupiedWords);
+                for (int h = 0; h < columns; ++h)
+                {
+                    prevDeltas[h] *= relu_derivative(prevActs[h]);
+                    gradB[(l-1)*columns + h] += prevDeltas[h];
+                }
+                FLOAT *swap = deltas;
+                deltas = prevDeltas;
+                prevDeltas = swap;
+            }
+
+            // Input layer:
+            padToTiles(x, inputs, InputSize);
+            for (int rb = 0; rb < blocks; ++rb)
+                kernels->tileBackward(nullptr, &gradW[rowStart[rb] * TileWeights], rowWeights(rb), stored[rb], x, &deltas[rb*8], 1.0f,
+                                      &tiles[0][rb*blocks], occupied[0][rb], occupiedWords);
+            return squared_error_sum;
+        }
+    };
 
 
 /****************************************/
-/*              "Neural Network" 🙄🙄🙄 */
-/****************************************/
-#if defined(__AVX512FP16__) || defined(__ARM_NEON) || defined(__wasm_simd128__)
-  template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
-  using Neural = FeedForward16<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
-#else
-  // Of course not... 🙄
+/*           feed forward 16 (IEEE 754) */
+/* Inference only. Made from a trained  */
+/* FeedForward32 like FeedForward8, its */
+/* weights are binary16: half the bytes */
+/* of the FP32 network, same topology   */
+/* and tile layout. The FP32 network    */
+/* stays with the training side, call   */
+/* copyFrom() after it trained          */
+/****************************************/
+    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
+    class FeedForward16
+    {
+        using Master = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
+    public:
+        static constexpr int columns = Master::columns;
+    private:
+        static constexpr int nLayers = Max_layers;
+        static constexpr int blocks = Master::blocks;
+        static constexpr int occupiedWords = Master::occupiedWords;
+        static constexpr int BatchTile = Master::BatchTile;
+        static constexpr int TileWeights = Master::TileWeights;
+        std::unique_ptr<UWORD[]> weights; // binary16, the stored tiles of the master, same layout
+        FLOAT biases[columns * Max_layers];
+        UQWORD tiles[Max_layers][blocks * blocks];
+        UQWORD occupied[Max_layers][blocks][occupiedWords];
+        UQWORD stored[blocks][occupiedWords];
+        int rowStart[blocks+1];
+        typename Master::InputColumns firstLayer; // From the half weights, see Master::update()
+        int nEdges = 0;
+        FLOAT activations[columns * Max_layers];
+        const NeuralKernels *kernels = &neuralKernels();
+    private:
+        const UWORD *rowWeights(const int rb) const { return &weights[rowStart[rb] * TileWeights]; }
+
+        void sumEdges(const int layer, const FLOAT *x, FLOAT *out) const
+        {
+            for (int rb = 0; rb < blocks; ++rb)
+            {
+                FLOAT y[8];
+                kernels->tileRowHalf(y, rowWeights(rb), stored[rb], x, &tiles[layer][rb*blocks], occupied[layer][rb], occupiedWords);
+                for (int r = 0; r < 8 && rb*8 + r < columns; ++r)
+                    out[rb*8 + r] = y[r] + biases[(layer*columns) + rb*8 + r];
+            }
+        }
+
+        template <Activation Act>
+        void forward(const int layer, const FLOAT *input, FLOAT *acts) const
+        {
+            alignas(32) FLOAT x[blocks*8];
+            Master::padToTiles(x, input, layer == 0 ? InputSize : columns);
+            FLOAT *row = &acts[layer*columns];
+            sumEdges(layer, x, row);
+            kernels->activate(Act, row, columns);
+        }
+
+        // See Master::forwardBatch():
+        template <Activation Act>
+        void forwardBatch(const int layer, const FLOAT *const *inputs, FLOAT *const *scratch, const int n) const
+        {
+            alignas(32) FLOAT x[BatchTile][blocks*8];
+            for (int s = 0; s < n; ++s)
+            {
+                if (layer == 0)
+                    Master::padToTiles(x[s], inputs[s], InputSize);
+                else
+                    Master::padToTiles(x[s], &scratch[s][(layer-1)*columns], columns);
+            }
+            for (int rb = 0; rb < blocks; ++rb)
+            {
+                for (int s = 0; s < n; ++s)
+                {
+                    FLOAT y[8];
+                    kernels->tileRowHalf(y, rowWeights(rb), stored[rb], x[s], &tiles[layer][rb*blocks], occupied[layer][rb], occupiedWords);
+                    for (int r = 0; r < 8 && rb*8 + r < columns; ++r)
+                        scratch[s][(layer*columns) + rb*8 + r] = y[r] + biases[(layer*columns) + rb*8 + r];
+                }
+            }
+            for (int s = 0; s < n; ++s)
+                kernels->activate(Act, &scratch[s][layer*columns], columns);
+        }
+
+        FLOAT *forwardHidden(FLOAT *scratch) const
+        {
+            for (int i=1; i<nLayers-1; ++i)
+                forward<Activation::relu>(i, &scratch[(i-1)*columns], scratch);
+            forward<Activation::tanh>(nLayers-1, &scratch[(nLayers-2)*columns], scratch);
+            return &scratch[(nLayers-1)*columns];
+        }
+
+    public:
+        explicit FeedForward16(const Master& trained) { copyFrom(trained); }
+
+        // Quantize 'trained' again, e.g. after the training side took some
+        // steps. Its topology must be compiled (trained.prepare()):
+        void copyFrom(const Master& trained)
+        {
+            assert(!trained.topologyDirty && "call prepare() on the FP32 network first");
+            const int n = trained.rowStart[blocks] * TileWeights;
+            if (!weights || rowStart[blocks] != trained.rowStart[blocks])
+                weights = std::make_unique_for_overwrite<UWORD[]>(n > 0 ? n : 1);
+            for (int i = 0; i < n; ++i)
+                weights[i] = halfFromFloat(trained.weights[i]);
+            for (int i=0; i<columns * Max_layers; ++i)
+                biases[i] = trained.biases[i];
+            for (int layer=0; layer<nLayers; ++layer)
+                for (int t=0; t<blocks*blocks; ++t)
+                    tiles[layer][t] = trained.tiles[layer][t];
+            for (int layer=0; layer<nLayers; ++layer)
+                for (int rb=0; rb<blocks; ++rb)
+                    for (int k=0; k<occupiedWords; ++k)
+                        occupied[layer][rb][k] = trained.occupied[layer][rb][k];
+            for (int rb=0; rb<blocks; ++rb)
+                for (int k=0; k<occupiedWords; ++k)
+                    stored[rb][k] = trained.stored[rb][k];
+            for (int rb=0; rb<=blocks; ++rb)
+                rowStart[rb] = trained.rowStart[rb];
+            nEdges = trained.nEdges;
+            // Same tiles, so the master can lay out the columns:
+            trained.transposeFirstLayer(firstLayer, [this](const int rb, const int cb, const int bit)
+            {
+                return floatFromHalf(weights[(rowStart[rb] + storedTileRank(stored[rb], cb))*TileWeights + bit]);
+            });
+        }
+
+        bool isConnected(const int layer, const int dst, const int src) const
+        {
+            return (tiles[layer][(dst/8)*blocks + src/8] >> ((dst%8)*8 + src%8)) & 1;
+        }
+
+        int countEdges() const { return nEdges; }
+
+        // Bytes of weights, half of the FP32 network's:
+        UQWORD weightBytes() const { return UQWORD(rowStart[blocks]) * TileWeights * sizeof(UWORD); }
+
+        void setKernels(const NeuralKernels& k) { kernels = &k; }
+
+        void prepare() {} // Never changes after quantization
+
+        static constexpr int activationSize = columns * Max_layers;
+        static constexpr int inputSize = InputSize;
+        static constexpr int outputSize = OutputSize;
+
+        FLOAT *evaluate(const FLOAT *inputs, FLOAT *scratch) const
+        {
+            forward<Activation::relu>(0, inputs, scratch);
+            return forwardHidden(scratch);
+        }
+
+        using Accumulator = typename Master::Accumulator;
+
+        void refresh(Accumulator& acc, const FLOAT *inputs) const
+        {
+            alignas(32) FLOAT x[blocks*8];
+            Master::padToTiles(x, inputs, InputSize);
+            sumEdges(0, x, acc.sums);
+        }
+
+        void update(Accumulator& acc, const NetworkInputDelta *deltas, const int n) const
+        {
+            Master::applyDeltas(*kernels, firstLayer, acc.sums, deltas, n);
+        }
+
+        FLOAT *evaluate(const Accumulator& acc, FLOAT *scratch) const
+        {
+            for (int dst = 0; dst < columns; ++dst)
+                scratch[dst] = acc.sums[dst];
+            kernels->reluRow(scratch, columns);
+            return forwardHidden(scratch);
+        }
+
+        FLOAT *evaluate(const FLOAT *inputs) { return evaluate(inputs, activations); }
+
+        // evaluate(inputs[s], scratch[s]) for 'n' samples, BatchTile at a
+        // time like FeedForward32::evaluateBatch():
+        void evaluateBatch(const FLOAT *const *inputs, FLOAT *const *scratch, const int n) const
+        {
+            for (int first = 0; first < n; first += BatchTile)
+            {
+                const int m = n - first < BatchTile ? n - first : BatchTile;
+                forwardBatch<Activation::relu>(0, &inputs[first], &scratch[first], m);
+                for (int i=1; i<nLayers-1; ++i)
+                    forwardBatch<Activation::relu>(i, nullptr, &scratch[first], m);
+                forwardBatch<Activation::tanh>(nLayers-1, nullptr, &scratch[first], m);
+            }
+        }
+    };
+
+
+/****************************************/
+/*                feed forward 8 (int8) */
+/* Inference only. Made from a trained  */
+/* FeedForward32 by quantize-on-copy:   */
+/* - weights: int8, one scale per row   */
+/* - inputs of each layer: 7 bit, one   */
+/*   scale per vector, stored +64 as    */
+/*   unsigned (pmaddubsw takes u8 x s8) */
+/*   the +64 is taken back out with a   */
+/*   precomputed 64*sum(row) per row    */
+/* - accumulation: int32                */
+/* Each layer gets its own dense int8   */
+/* matrix (absent edges are 0), rows    */
+/* padded to 64 bytes                   */
+/****************************************/
+    template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
+    class FeedForward8
+    {
+        using Master = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
+    public:
+        static constexpr int columns = Master::columns;
+    private:
+        static constexpr int nLayers = Max_layers;
+        static constexpr int stride = (columns + 63) & ~63;
+        static constexpr int inputStride = (InputSize + 63) & ~63;
+        static constexpr int ActMax = 63;
+        static constexpr int ActOffset = 64;
+        alignas(64) SBYTE weights[Max_layers][columns][stride];
+        FLOAT rowScale[columns];
+        SDWORD rowOffset[Max_layers][columns]; // ActOffset * sum(row)
+        FLOAT biases[columns * Max_layers];
+        FLOAT activations[columns * Max_layers];
+        const NeuralKernels *kernels = &neuralKernels();
+    private:
+        template <Activation Act>
+        void forward(const int layer, const FLOAT *input, const int inputSize, const int rowLen, FLOAT *acts) const
+        {
+            FLOAT maxAbs = 0.0f;
+            for (int i=0; i<inputSize; ++i)
+            {
+                const FLOAT a = std::fabs(input[i]);
+                maxAbs = a > maxAbs ? a : maxAbs;
+            }
+            const FLOAT inScale = maxAbs > 0.0f ? maxAbs / ActMax : 1.0f;
+            const FLOAT toInt = 1.0f / inScale;
+            alignas(64) UBYTE q[stride];
+            for (int i=0; i<inputSize; ++i)
+            {
+                // |input/inScale| <= ActMax by construction, round half away from zero:
+                const FLOAT v = input[i] * toInt;
+                q[i] = static_cast<UBYTE>(static_cast<int>(v + (v < 0.0f ? -0.5f : 0.5f)) + ActOffset);
+            }
+            for (int i=inputSize; i<rowLen; ++i)
+                q[i] = ActOffset;
+            FLOAT *row = &acts[layer*columns];
+            for (int dst = 0; dst < columns; ++dst)
+            {
+                const SDWORD acc = kernels->dotU8S8(q, weights[layer][dst], rowLen) - rowOffset[layer][dst];
+                row[dst] = (acc-0.f) * inScale * rowScale[dst] + biases[(layer*columns) + dst];
+            }
+            kernels->activate(Act, row, columns);
+        }
+
+    public:
+        explicit FeedForward8(const Master& trained)
+        {
+            for (int dst=0; dst<columns; ++dst)
+            {
+                FLOAT maxAbs = 0.0f;
+                for (int src=0; src<columns; ++src)
+                    maxAbs = std::fmax(maxAbs, std::fabs(trained.weightAt(dst, src)));
+                rowScale[dst] = maxAbs > 0.0f ? maxAbs / 127.0f : 1.0f;
+            }
+            for (int layer=0; layer<nLayers; ++layer)
+            {
+                const int inputSize = layer == 0 ? InputSize : columns;
+                for (int dst=0; dst<columns; ++dst)
+                {
+                    SDWORD rowSum = 0;
+                    for (int src=0; src<stride; ++src)
+                    {
+                        SBYTE w = 0;
+                        if (src < inputSize && trained.isConnected(layer, dst, src))
+                            w = static_cast<SBYTE>(std::lround(trained.weightAt(dst, src) / rowScale[dst]));
+                        weights[layer][dst][src] = w;
+                        rowSum += w;
+                    }
+                    rowOffset[layer][dst] = ActOffset * rowSum;
+                }
+            }
+            for (int i=0; i<columns * Max_layers; ++i)
+                biases[i] = trained.biases[i];
+        }
+
+        void setKernels(const NeuralKernels& k) { kernels = &k; }
+
+        void prepare() {} // Never changes after quantization
+
+        static constexpr int activationSize = columns * Max_layers;
+
+        FLOAT *evaluate(const FLOAT *inputs, FLOAT *scratch) const
+        {
+            forward<Activation::relu>(0, inputs, InputSize, inputStride, scratch);
+            for (int i=1; i<nLayers-1; ++i)
+                forward<Activation::relu>(i, &scratch[(i-1)*columns], columns, stride, scratch);
+            forward<Activation::tanh>(nLayers-1, &scratch[(nLayers-2)*columns], columns, stride, scratch);
+            return &scratch[(nLayers-1)*columns];
+        }
+
+        FLOAT *evaluate(const FLOAT *inputs) { return evaluate(inputs, activations); }
+    };
+
+
+/****************************************/
+/*                            Evaluator */
+/* Per-thread activations for a network */
+/* that is shared read-only, e.g. one   */
+/* model for all players/search threads */
+/* Call net.prepare() after changing    */
+/* the network, before evaluating it    */
+/****************************************/
+    template <typename Net>
+    class Evaluator
+    {
+    private:
+        const Net *net;
+        FLOAT activations[Net::activationSize];
+    public:
+        explicit Evaluator(const Net& network) : net(&network) {}
+
+        FLOAT *evaluate(const FLOAT *inputs) { return net->evaluate(inputs, activations); }
+
+        void setNetwork(const Net& network) { net = &network; }
+
+        const Net& network() const { return *net; }
+    };
+
+
+/****************************************/
+/*                Incremental evaluator */
+/* An Evaluator that keeps the first    */
+/* layer (Accumulator) of the previous  */
+/* position. evaluate(inputs) compares  */
+/* the inputs with the previous ones    */
+/* and only applies the differences,    */
+/* consecutive mcts leaves are mostly   */
+/* close relatives. Games that know     */
+/* what their move changed can report   */
+/* it via update() instead, or relative */
+/* to a base position (mcts: the root)  */
+/* via evaluateFromBase()               */
+/* Call invalidate() after the network  */
+/* changed (training, load())           */
+/****************************************/
+    template <typename Net>
+    class IncrementalEvaluator
+    {
+    private:
+        static constexpr int MaxDeltas = Net::inputSize / 4; // More changes: cheaper to start over
+        static constexpr int RefreshInterval = 256; // Updates in a row, bounds the rounding drift
+        const Net *net;
+        typename Net::Accumulator accumulator;
+        typename Net::Accumulator baseAccumulator; // See setBase()
+        FLOAT lastInputs[Net::inputSize];
+        FLOAT baseInputs[Net::inputSize];
+        FLOAT activations[Net::activationSize];
+        int updatesLeft = 0; // Until the next refresh
+        bool valid = false;  // 'accumulator' and 'lastInputs' belong together
+    public:
+        explicit IncrementalEvaluator(const Net& network) : net(&network) {}
+
+        FLOAT *evaluate(const FLOAT *inputs)
+        {
+            NetworkInputDelta deltas[MaxDeltas];
+            int n = 0;
+            bool incremental = valid && updatesLeft > 0;
+            for (int i=0; incremental && i<Net::inputSize; ++i)
+            {
+                if (inputs[i] == lastInputs[i])
+                    continue;
+                if (n == MaxDeltas)
+                {
+                    incremental = false;
+                    break;
+                }
+                deltas[n++] = { i, inputs[i] - lastInputs[i] };
+            }
+            if (incremental)
+            {
+                net->update(accumulator, deltas, n);
+                updatesLeft -= 1;
+            }
+            else
+            {
+                net->refresh(accumulator, inputs);
+                updatesLeft = RefreshInterval;
+                valid = true;
+            }
+            for (int i=0; i<Net::inputSize; ++i)
+                lastInputs[i] = inputs[i];
+            return net->evaluate(accumulator, activations);
+        }
+
+        // Changes reported by the game since the last evaluation, then
+        // evaluate() without inputs. Only after a first evaluate(inputs):
+        void update(const NetworkInputDelta *deltas, const int n)
+        {
+            assert(valid && "evaluate(inputs) first");
+            net->update(accumulator, deltas, n);
+            for (int d=0; d<n; ++d)
+                lastInputs[deltas[d].input] += deltas[d].change;
+            updatesLeft -= 1;
+        }
+
+        FLOAT *evaluate() { return net->evaluate(accumulator, activations); }
+
+        // The position evaluateFromBase() starts from, e.g. the root of a
+        // search. Its first layer is computed in full here, set it again
+        // after the network changed:
+        void setBase(const FLOAT *inputs)
+        {
+            net->refresh(baseAccumulator, inputs);
+            for (int i=0; i<Net::inputSize; ++i)
+                baseInputs[i] = inputs[i];
+        }
+
+        // The base position changed by 'deltas' (all changes since the
+        // base, not since the last evaluation). Starts over from the base
+        // each time, so there is no drift and other evaluations in between
+        // do not matter:
+        FLOAT *evaluateFromBase(const NetworkInputDelta *deltas, const int n)
+        {
+            accumulator = baseAccumulator;
+            net->update(accumulator, deltas, n);
+            for (int i=0; i<Net::inputSize; ++i)
+                lastInputs[i] = baseInputs[i];
+            for (int d=0; d<n; ++d)
+                lastInputs[deltas[d].input] += deltas[d].change;
+            updatesLeft = RefreshInterval;
+            valid = true;
+            return net->evaluate(accumulator, activations);
+        }
+
+        void invalidate() { valid = false; }
+
+        void setNetwork(const Net& network)
+        {
+            net = &network;
+            valid = false;
+        }
+
+        const Net& network() const { return *net; }
+    };
+
+
+/****************************************/
+/*                     Inference server */
+/* Search threads that each evaluate    */
+/* one leaf run the network at batch    */
+/* size 1. Here they hand their inputs  */
+/* to one server thread and park: it    */
+/* waits for up to batchSize requests   */
+/* (at most timeoutMicros after it saw  */
+/* the first one), evaluates them all   */
+/* with one evaluateBatch() and wakes   */
+/* their threads. An InferenceClient is */
+/* the per-thread side, used like an    */
+/* Evaluator                            */
+/****************************************/
+    template <typename Net, int MaxBatch = 32>
+    class InferenceServer
+    {
+    public:
+        // One in flight per client, it also holds the result:
+        struct Request
+        {
+            const FLOAT *inputs = nullptr;
+            FLOAT *scratch = nullptr; // Net::activationSize
+            FLOAT *result = nullptr;
+            Request *next = nullptr;
+            bool done = true;
+            std::condition_variable answered; // Signalled with the server's mutex held
+        };
+        static constexpr int activationSize = Net::activationSize;
+    private:
+        const Net *net;
+        const int batchSize;     // 1..MaxBatch
+        const int timeoutMicros; // The longest a request waits for others
+        std::mutex mutex;
+        std::condition_variable queued;
+        Request *head = nullptr, *tail = nullptr;
+        int nQueued = 0;
+        bool running = false, stopping = false;
+        std::thread thread;
+        UQWORD batches = 0, served = 0;
+    private:
+        void run(Request *const *batch, const int n) const
+        {
+            const FLOAT *inputs[MaxBatch];
+            FLOAT *scratch[MaxBatch];
+            for (int i=0; i<n; ++i)
+            {
+                inputs[i] = batch[i]->inputs;
+                scratch[i] = batch[i]->scratch;
+            }
+            if constexpr (requires { net->evaluateBatch(inputs, scratch, n); })
+                net->evaluateBatch(inputs, scratch, n);
+            else
+                for (int i=0; i<n; ++i)
+                    net->evaluate(inputs[i], scratch[i]);
+        }
+
+        void loop()
+        {
+            Request *batch[MaxBatch];
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                queued.wait(lock, [&] { return stopping || head; });
+                if (!head)
+                    return; // Stopping, and all answered
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutMicros);
+                queued.wait_until(lock, deadline, [&] { return stopping || nQueued >= batchSize; });
+                int n = 0;
+                for (; head && n < batchSize; head = head->next)
+                    batch[n++] = head;
+                if (!head)
+                    tail = nullptr;
+                nQueued -= n;
+
+                lock.unlock();
+                run(batch, n);
+                lock.lock();
+                for (int i=0; i<n; ++i)
+                {
+                    batch[i]->result = &batch[i]->scratch[Net::activationSize - Net::columns]; // As evaluate() returns
+                    batch[i]->done = true;
+                    batch[i]->answered.notify_one();
+                }
+                batches += 1;
+                served += n;
+            }
+        }
+    public:
+        // 'network' prepared, and unchanged while the server runs. Batches
+        // of up to 'maxRequests' (at most MaxBatch):
+        explicit InferenceServer(const Net& network, const int maxRequests = MaxBatch, const int timeout = 200)
+          : net(&network), batchSize(maxRequests < 1 ? 1 : maxRequests < MaxBatch ? maxRequests : MaxBatch), timeoutMicros(timeout)
+        {}
+        ~InferenceServer() { stop(); }
+        InferenceServer(const InferenceServer&) = delete;
+        InferenceServer& operator=(const InferenceServer&) = delete;
+
+        void start()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (running)
+                return;
+            running = true;
+            stopping = false;
+            thread = std::thread([this] { loop(); });
+        }
+
+        // Answers what is queued, then joins the thread:
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            queued.notify_one();
+            if (thread.joinable())
+                thread.join();
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+
+        // Queues 'request' and returns at once. While the server is not
+        // running it is evaluated right here instead:
+        void submit(Request& request, const FLOAT *inputs, FLOAT *scratch)
+        {
+            assert(request.done && "one request at a time");
+            request.inputs = inputs;
+            request.scratch = scratch;
+            request.next = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (running && !stopping)
+                {
+                    request.done = false;
+                    (tail ? tail->next : head) = &request;
+                    tail = &request;
+                    nQueued += 1;
+                    if (nQueued == 1 || nQueued >= batchSize)
+                        queued.notify_one();
+                    return;
+                }
+            }
+            request.result = net->evaluate(inputs, scratch);
+        }
+
+        bool ready(const Request& request)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return request.done;
+        }
+
+        // Parks until the server answered 'request', returns the result:
+        FLOAT *wait(Request& request)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            request.answered.wait(lock, [&] { return request.done; });
+            return request.result;
+        }
+
+        const Net& network() const { return *net; }
+
+        // Mean batch size = requestsServed() / batchesRun():
+        UQWORD batchesRun()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return batches;
+        }
+        UQWORD requestsServed()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return served;
+        }
+    };
+
+    template <typename Server>
+    class InferenceClient
+    {
+    private:
+        Server *server;
+        typename Server::Request request;
+        FLOAT activations[Server::activationSize];
+    public:
+        explicit InferenceClient(Server& s) : server(&s) {}
+        ~InferenceClient() { server->wait(request); }
+        InferenceClient(const InferenceClient&) = delete;
+        InferenceClient& operator=(const InferenceClient&) = delete;
+
+        // Blocks until the server evaluated it:
+        FLOAT *evaluate(const FLOAT *inputs)
+        {
+            server->submit(request, inputs, activations);
+            return server->wait(request);
+        }
+
+        // Or do other work in between; 'inputs' must stay valid until
+        // result() returns:
+        void submit(const FLOAT *inputs) { server->submit(request, inputs, activations); }
+        bool ready() { return server->ready(request); }
+        FLOAT *result() { return server->wait(request); }
+    };
+
+
+/****************************************/
+/*                              Trainer */
+/* Mini-batch training of FeedForward32 */
+/* The batch is split over the threads  */
+/* of a WorkerPool, each one sums the   */
+/* gradients of its samples into its    */
+/* own buffer (no sharing, no locks).   */
+/* Then every thread reduces a slice of */
+/* the parameters over all the buffers  */
+/* and takes the optimiser step for it  */
+/* The Trainer holds the optimiser      */
+/* state, keep one per network. Large,  */
+/* allocate it like the network itself  */
+/****************************************/
+    enum class Optimiser { sgd, momentum, adam };
+
+    template <typename Net, int MaxThreads = 8>
+    class Trainer
+    {
+    private:
+        static constexpr int nBiases = Net::columns * Net::nLayers;
+        static constexpr int SliceAlign = 16; // Floats per cache line
+        struct alignas(64) Gradients
+        {
+            std::unique_ptr<FLOAT[]> params; // Weights, then biases
+            FLOAT activations[Net::activationSize];
+            FLOAT squaredErrors;
+        };
+        Net *net;
+        // The weights follow the stored tiles of the network, see reset():
+        int nWeights = 0;
+        int nParams = 0;
+        UQWORD layout[Net::blocks][Net::occupiedWords] = {};
+        Gradients grads[MaxThreads];
+        std::unique_ptr<FLOAT[]> moment1; // Momentum, or Adam's mean
+        std::unique_ptr<FLOAT[]> moment2; // Adam's uncentered variance
+        UQWORD steps = 0;
+    private:
+        void step(const int begin, const int end, const int nThreads, const FLOAT scale)
+        {
+            // Adam bias correction folded into the step size:
+            const FLOAT t = static_cast<FLOAT>(steps);
+            const FLOAT adamRate = learningRate * std::sqrt(1.0f - std::pow(beta2, t)) / (1.0f - std::pow(beta1, t));
+            for (int i = begin; i < end; ++i)
+            {
+                FLOAT g = grads[0].params[i];
+                for (int w = 1; w < nThreads; ++w)
+                    g += grads[w].params[i];
+                g *= scale; // Mean over the batch
+                FLOAT& param = i < nWeights ? net->weights[i] : net->biases[i - nWeights];
+                switch (optimiser)
+                {
+                case Optimiser::sgd:
+                    param += learningRate * g;
+                    break;
+                case Optimiser::momentum:
+                    moment1[i] = beta1 * moment1[i] + g;
+                    param += learningRate * moment1[i];
+                    break;
+                case Optimiser::adam:
+                    moment1[i] = beta1 * moment1[i] + (1.0f - beta1) * g;
+                    moment2[i] = beta2 * moment2[i] + (1.0f - beta2) * g * g;
+                    param += adamRate * moment1[i] / (std::sqrt(moment2[i]) + epsilon);
+                    break;
+                }
+            }
+        }
+
+    public:
+        Optimiser optimiser = Optimiser::adam;
+        FLOAT learningRate = 0.001f;
+        FLOAT beta1 = 0.9f;    // Momentum / Adam first moment decay
+        FLOAT beta2 = 0.999f;  // Adam second moment decay
+        FLOAT epsilon = 1e-8f;
+
+        explicit Trainer(Net& network) : net(&network)
+        {
+            reset();
+        }
+
+        // Forget the optimiser state. trainBatch() does this by itself when
+        // the topology changed which tiles have weights:
+        void reset()
+        {
+            if (net->topologyDirty)
+                net->compileTopology();
+            nWeights = net->rowStart[Net::blocks] * Net::TileWeights;
+            nParams = nWeights + nBiases;
+            for (int rb=0; rb<Net::blocks; ++rb)
+                for (int k=0; k<Net::occupiedWords; ++k)
+                    layout[rb][k] = net->stored[rb][k];
+            for (Gradients& g : grads)
+                g.params = std::make_unique_for_overwrite<FLOAT[]>(nParams);
+            moment1 = std::make_unique<FLOAT[]>(nParams);
+            moment2 = std::make_unique<FLOAT[]>(nParams);
+            steps = 0;
+        }
+
+        // One optimiser step on the mean gradient of 'n' samples, using up
+        // to MaxThreads threads of 'pool'. Returns the mean squared error
+        // of the batch (before the step)
+        FLOAT trainBatch(const FLOAT *const *inputs, const FLOAT *const *targets, const int n, WorkerPool& pool)
+        {
+            assert(n > 0);
+            if (net->topologyDirty)
+                net->compileTopology();
+            bool sameLayout = true;
+            for (int rb=0; rb<Net::blocks; ++rb)
+                for (int k=0; k<Net::occupiedWords; ++k)
+                    sameLayout = sameLayout && layout[rb][k] == net->stored[rb][k];
+            if (!sameLayout)
+                reset();
+            const int nThreads = pool.size() < MaxThreads ? pool.size() : MaxThreads;
+            ++steps;
+
+            auto accumulate = [&](const int workerIdx)
+            {
+                if (workerIdx >= nThreads)
+                    return;
+                Gradients& g = grads[workerIdx];
+                for (int i=0; i<nParams; ++i)
+                    g.params[i] = 0.0f;
+                g.squaredErrors = 0.0f;
+                const int first = n * workerIdx / nThreads;
+                const int last  = n * (workerIdx+1) / nThreads;
+                for (int s = first; s < last; ++s)
+                    g.squaredErrors += net->gradient(inputs[s], targets[s], g.activations, g.params.get(), &g.params[nWeights]);
+            };
+            pool.run(accumulate);
+
+            auto reduce = [&](const int workerIdx)
+            {
+                if (workerIdx >= nThreads)
+                    return;
+                const int slices = (nParams + SliceAlign - 1) / SliceAlign;
+                const int begin = slices * workerIdx / nThreads * SliceAlign;
+                const int end   = workerIdx == nThreads-1 ? nParams : slices * (workerIdx+1) / nThreads * SliceAlign;
+                step(begin, end, nThreads, 1.0f / n);
+            };
+            pool.run(reduce);
+            net->columnsDirty = true;
+
+            FLOAT squaredErrors = 0.0f;
+            for (int w=0; w<nThreads; ++w)
+                squaredErrors += grads[w].squaredErrors;
+            return squaredErrors / (n * Net::outputSize);
+        }
+    };
+
+
+/****************************************/
+/*                        Replay buffer */
+/* The last 'Capacity' training samples */
+/* (ring, the oldest are overwritten).  */
+/* Any number of threads push, trainers */
+/* copy out random mini-batches         */
+/****************************************/
+    template <int InputSize, int OutputSize, int Capacity>
+    class ReplayBuffer
+    {
+    private:
+        FLOAT inputs[Capacity][InputSize];
+        FLOAT targets[Capacity][OutputSize];
+        UQWORD pushed = 0;
+        bool closed = false;
+        mutable std::mutex mutex;
+        std::condition_variable grown;
+    public:
+        static constexpr int inputSize = InputSize;
+        static constexpr int outputSize = OutputSize;
+        static constexpr int capacity = Capacity;
+
+        void push(const FLOAT *sampleInputs, const FLOAT *sampleTargets)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                const int slot = static_cast<int>(pushed % Capacity);
+                for (int i=0; i<InputSize; ++i)
+                    inputs[slot][i] = sampleInputs[i];
+                for (int i=0; i<OutputSize; ++i)
+                    targets[slot][i] = sampleTargets[i];
+                pushed += 1;
+            }
+            grown.notify_all();
+        }
+
+        int size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return pushed < Capacity ? static_cast<int>(pushed) : Capacity;
+        }
+
+        UQWORD totalPushed() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return pushed;
+        }
+
+        // Blocks until 'n' samples were pushed in all (see totalPushed()) or
+        // close() was called. False if closed:
+        bool waitFor(const UQWORD n)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            grown.wait(lock, [&] { return closed || pushed >= n; });
+            return !closed;
+        }
+
+        // Wakes up and fails all waitFor() until open() again:
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+            }
+            grown.notify_all();
+        }
+
+        void open()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = false;
+        }
+
+        // Copies 'n' samples drawn uniformly (with replacement) into the
+        // caller's arrays, 'rng.nextInt(max)' is uniform in [0,max) like
+        // Xoroshiro128Plus::nextInt. Returns the number copied, 0 while empty
+        template <typename Rng>
+        int sample(Rng& rng, const int n, FLOAT (*batchInputs)[InputSize], FLOAT (*batchTargets)[OutputSize]) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const UQWORD available = pushed < Capacity ? pushed : Capacity;
+            if (available == 0)
+                return 0;
+            for (int s=0; s<n; ++s)
+            {
+                const UDWORD slot = rng.nextInt(static_cast<UDWORD>(available));
+                for (int i=0; i<InputSize; ++i)
+                    batchInputs[s][i] = inputs[slot][i];
+                for (int i=0; i<OutputSize; ++i)
+                    batchTargets[s][i] = targets[slot][i];
+            }
+            return n;
+        }
+    };
+
+
+/****************************************/
+/*                       Model exchange */
+/* The trainer publishes a copy of its  */
+/* network, players pick up the newest  */
+/* one with an atomic pointer load and  */
+/* hold it (reader count) until done.   */
+/* publish() writes into a slot that is */
+/* neither current nor held, then swaps */
+/* the pointer. With Slots = players+2  */
+/* there always is such a slot          */
+/****************************************/
+    template <typename Net, int Slots = 3>
+    class ModelExchange
+    {
+        static_assert(Slots >= 2);
+    private:
+        struct Slot
+        {
+            Net net;
+            std::atomic<int> readers{0};
+            template <typename Rng>
+            explicit Slot(Rng& rng) : net(rng, false) {}
+        };
+        Slot slots[Slots];
+        std::atomic<Slot *> current;
+        std::atomic<UQWORD> published{0};
+    private:
+        template <typename Rng, std::size_t... I>
+        ModelExchange(const Net& initial, Rng& rng, std::index_sequence<I...>)
+          : slots{ Slot(((void)I, rng))... }
+        {
+            slots[0].net.copyFrom(initial);
+            current.store(&slots[0]);
+        }
+    public:
+        // 'rng' only to construct the slots, they are overwritten with 'initial':
+        template <typename Rng>
+        ModelExchange(const Net& initial, Rng& rng)
+          : ModelExchange(initial, rng, std::make_index_sequence<Slots>{})
+        {}
+
+        // The newest network, valid until release()
+        const Net& acquire()
+        {
+            for (;;)
+            {
+                Slot *slot = current.load();
+                slot->readers.fetch_add(1);
+                if (slot == current.load())
+                    return slot->net;
+                slot->readers.fetch_sub(1); // Swapped in between, try the new one
+            }
+        }
+
+        void release(const Net& net)
+        {
+            for (Slot& slot : slots)
+                if (&slot.net == &net)
+                    slot.readers.fetch_sub(1);
+        }
+
+        // Copies 'trained' (prepared) into a free slot and makes it current.
+        // False if every slot is current or held:
+        bool publish(const Net& trained)
+        {
+            Slot *const active = current.load();
+            for (Slot& slot : slots)
+            {
+                if (&slot == active || slot.readers.load() != 0)
+                    continue;
+                slot.net.copyFrom(trained);
+                current.store(&slot);
+                published.fetch_add(1);
+                return true;
+            }
+            return false;
+        }
+
+        // Bumped by every publish(), to see cheaply whether to acquire() again:
+        UQWORD version() const { return published.load(); }
+    };
+
+
+/****************************************/
+/*                   Background trainer */
+/* The consumer side of self-play: one  */
+/* thread that draws mini-batches from  */
+/* a ReplayBuffer, takes Trainer steps  */
+/* (on the threads of its own pool) and */
+/* publishes the network every few      */
+/* steps. Producers (threads playing    */
+/* mcts games, see selfPlayGame() in    */
+/* ai.hpp) only push to the buffer and  */
+/* acquire() from the exchange          */
+/****************************************/
+    template <typename Net, typename Buffer, typename Exchange, int Batch = 64, int MaxThreads = 8>
+    class BackgroundTrainer
+    {
+        static_assert(Buffer::inputSize == Net::inputSize && Buffer::outputSize == Net::outputSize);
+    public:
+        // Fixed at construction, the thread reads them:
+        struct Schedule
+        {
+            int minSamples = 4 * Batch;  // Before the first step
+            int newSamples = Batch / 4;  // Pushed since the previous step, before the next one
+            int publishEvery = 16;       // Steps
+        };
+    private:
+        Net *net;
+        Buffer *buffer;
+        Exchange *exchange;
+        Trainer<Net, MaxThreads> trainer;
+        WorkerPool pool;
+        const Schedule schedule; // Each at least 1 (newSamples at least 0)
+        std::thread thread;
+        std::atomic<bool> stopping{false};
+        std::atomic<UQWORD> steps{0};
+        std::atomic<FLOAT> lastMse{0.0f};
+        FLOAT batchInputs[Batch][Net::inputSize];
+        FLOAT batchTargets[Batch][Net::outputSize];
+        // splitmix64 (Xoroshiro128Plus lives in ai.hpp, which includes this file)
+        struct SampleRng
+        {
+            UQWORD state = 0x9e3779b97f4a7c15ull;
+
+            UQWORD operator()()
+            {
+                UQWORD z = (state += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                return z ^ (z >> 31);
+            }
+
+            // Lemire's multiply-shift, see Xoroshiro128Plus::nextInt:
+            UDWORD nextInt(const UDWORD max)
+            {
+                UQWORD m = (operator()() >> 32) * max;
+                if (static_cast<UDWORD>(m) < max)
+                {
+                    const UDWORD threshold = static_cast<UDWORD>(-max) % max;
+                    while (static_cast<UDWORD>(m) < threshold)
+                        m = (operator()() >> 32) * max;
+                }
+                return static_cast<UDWORD>(m >> 32);
+            }
+        } sampleRng;
+
+        void loop()
+        {
+            const FLOAT *inputPtrs[Batch], *targetPtrs[Batch];
+            for (int s=0; s<Batch; ++s)
+            {
+                inputPtrs[s] = batchInputs[s];
+                targetPtrs[s] = batchTargets[s];
+            }
+            // Every step waits for newSamples pushes since the previous one,
+            // so it does not keep training on the same samples when the
+            // producers are slow:
+            UQWORD wanted = static_cast<UQWORD>(schedule.minSamples);
+            while (!stopping.load() && buffer->waitFor(wanted))
+            {
+                wanted = buffer->totalPushed() + static_cast<UQWORD>(schedule.newSamples);
+                if (buffer->sample(sampleRng, Batch, batchInputs, batchTargets) == 0)
+                    continue;
+                lastMse.store(trainer.trainBatch(inputPtrs, targetPtrs, Batch, pool));
+                const UQWORD done = steps.fetch_add(1) + 1;
+                if (done % static_cast<UQWORD>(schedule.publishEvery) == 0)
+                    exchange->publish(*net);
+            }
+        }
+
+        static Schedule validated(const Schedule& s)
+        {
+            Schedule v = s;
+            v.minSamples = s.minSamples < 1 ? 1 : s.minSamples;
+            v.newSamples = s.newSamples < 0 ? 0 : s.newSamples;
+            v.publishEvery = s.publishEvery < 1 ? 1 : s.publishEvery;
+            return v;
+        }
+    public:
+        // 'network' is the trainer's own copy, 'threads' for the gradients:
+        BackgroundTrainer(Net& network, Buffer& replay, Exchange& models, const int threads = 0, const Schedule& when = Schedule{})
+          : net(&network), buffer(&replay), exchange(&models), trainer(network), pool(threads), schedule(validated(when))
+        {}
+
+        ~BackgroundTrainer() { stop(); }
+
+        Trainer<Net, MaxThreads>& settings() { return trainer; } // Optimiser, learning rate, ...
+
+        void start()
+        {
+            stopping.store(false);
+            buffer->open();
+            thread = std::thread([this] { loop(); });
+        }
+
+        // Wakes the thread (closes the buffer for waiting) and joins it:
+        void stop()
+        {
+            stopping.store(true);
+            buffer->close();
+            if (thread.joinable())
+                thread.join();
+        }
+
+        UQWORD stepsDone() const { return steps.load(); }
+        FLOAT meanSquaredError() const { return lastMse.load(); }
+    };
+
+
+/****************************************/
+/*              "Neural Network" 🙄🙄🙄 */
+/****************************************/
+  // Of course not... 🙄 It trains, so FP32. FeedForward16/FeedForward8
+  // are made from it for inference
   template <int InputSize, int OutputSize, int Max_layers, int HiddenWidth, typename Rng>
   using Neural = FeedForward32<InputSize, OutputSize, Max_layers, HiddenWidth, Rng>;
-#endif
 
 
 
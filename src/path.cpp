@@ -43,6 +43,42 @@
                   }()
                  );
 
+    static_assert([]
+                  {
+                      // Bucket queue against the linear scan: same costs for every target,
+                      // also with free edges and a MaxDistance that cuts the search short:
+                      TestBoard testBoard;
+                      for (int i=0; i<TestBoard::MAX_AREA; ++i)
+                          testBoard.board[i] = (i * 7) % 5;
+                      bool ok = true;
+                      PathEngine<36, TestBoard, short, 99> buckets;
+                      PathEngine<36, TestBoard, short, 99, PathQueue::linearScan> scan;
+                      PathEngine<4, TestBoard, short, 99> shortBuckets;
+                      PathEngine<4, TestBoard, short, 99, PathQueue::linearScan> shortScan;
+                      buckets.precompute(testBoard);
+                      scan.precompute(testBoard);
+                      shortBuckets.precompute(testBoard);
+                      shortScan.precompute(testBoard);
+                      for (short target=0; target<TestBoard::MAX_AREA; ++target)
+                      {
+                          ok = ok && buckets.dijkstra(14, target, testBoard) == scan.dijkstra(14, target, testBoard);
+                          ok = ok && shortBuckets.dijkstra(14, target, testBoard) == shortScan.dijkstra(14, target, testBoard);
+                      }
+                      buckets.floodFill(0, testBoard);
+                      scan.floodFill(0, testBoard);
+                      shortBuckets.floodFill(0, testBoard);
+                      shortScan.floodFill(0, testBoard);
+                      int unreached = 0;
+                      for (short node=0; node<TestBoard::MAX_AREA; ++node)
+                      {
+                          ok = ok && buckets.getExploredCost(node) == scan.getExploredCost(node);
+                          ok = ok && shortBuckets.getExploredCost(node) == shortScan.getExploredCost(node);
+                          unreached += shortBuckets.getExploredCost(node) == 99;
+                      }
+                      return ok && unreached > 0 && buckets.getExploredCost(35) < 99;
+                  }()
+                 );
+
     static_assert([]
                   {
                       int dist[36] = {
@@ -7,8 +7,20 @@
 /*                           PathEngine */
 /* Cache efficient, ultra-fast          */
 /* "Dijkstra" for small graphs.         */
+/*                                      */
+/* The open set is a bucket queue       */
+/* (Dial): one list per cost 0 ..       */
+/* MaxDistance, popped in cost order,   */
+/* so push, pop and decrease are O(1).  */
+/* Nodes costlier than MaxDistance are  */
+/* never expanded and so never queued.  */
+/* PathQueue::linearScan is the former  */
+/* scan of an array for the cheapest    */
+/* node, without the bucket lists       */
 /****************************************/
-    template <int MaxDistance, class Board, std::signed_integral IntType = int, IntType InfCost = 99>
+    enum class PathQueue { buckets, linearScan };
+
+    template <int MaxDistance, class Board, std::signed_integral IntType = int, IntType InfCost = 99, PathQueue Queue = PathQueue::buckets>
     class PathEngine
     {
     private:
@@ -20,6 +32,117 @@
         IntType predecessor[Board::MAX_AREA]; // for path reconstruction
         int generation[Board::MAX_AREA] = {0};
         int current_generation = 0;
+        IntType bucket_next[Board::MAX_AREA]; // Bucket lists, only valid while a node is queued
+        IntType bucket_prev[Board::MAX_AREA];
+
+        // Relaxes the edges out of 'current', calls improved(neighbor,
+        // unvisited, old_cost) for every neighbor that got cheaper:
+        template <typename Improved>
+        constexpr void relax(const IntType current, const Board& board, Improved&& improved)
+        {
+            for (int i=0; i<4; ++i)
+            {
+                const IntType neighbor = cached_neighbors[current][i];
+                if (neighbor == -1) continue; // Out of bounds.
+
+                const IntType next_cost = costs[current] + board.getCost(neighbor, current);
+                const bool unvisited = (generation[neighbor] != current_generation);
+                if (unvisited || next_cost < costs[neighbor])
+                {
+                    const IntType old_cost = costs[neighbor];
+                    costs[neighbor] = next_cost;
+                    predecessor[neighbor] = current;
+                    generation[neighbor] = current_generation;
+                    improved(neighbor, unvisited, old_cost);
+                }
+            }
+        }
+
+        constexpr IntType dijkstraLinearScan(IntType start, IntType target, const Board& board)
+        {
+            IntType queue[QUEUE_SIZE];
+            IntType head = 0, tail = 0;
+            queue[tail++] = start;
+            while (head != tail)
+            {
+                IntType lowest_idx = head;
+                for (IntType i=head+1; i<tail; ++i)
+                {
+                    if (costs[queue[i]] < costs[queue[lowest_idx]])
+                        lowest_idx = i;
+                }
+                // Swap lowest to front and pop:
+                const IntType current = queue[lowest_idx];
+                queue[lowest_idx] = queue[head];
+                ++head;
+
+                if (current == target)
+                    return costs[current];  // Dijkstras first pop of target is optimal
+
+                if (costs[current] > MaxDistance)
+                    continue; // Prune...
+
+                relax(current, board, [&](const IntType neighbor, const bool unvisited, IntType)
+                                      {
+                                          if (unvisited)
+                                              queue[tail++] = neighbor;
+                                      });
+            }
+            return InfCost;
+        }
+
+        constexpr IntType dijkstraBuckets(IntType start, IntType target, const Board& board)
+        {
+            IntType bucket_head[MaxDistance+1];
+            for (int c=0; c<=MaxDistance; ++c)
+                bucket_head[c] = -1;
+            auto push = [&](const IntType node, const IntType cost)
+            {
+                if (cost > MaxDistance)
+                    return; // Prune...
+                bucket_prev[node] = -1;
+                bucket_next[node] = bucket_head[cost];
+                if (bucket_head[cost] != -1)
+                    bucket_prev[bucket_head[cost]] = node;
+                bucket_head[cost] = node;
+            };
+            auto unlink = [&](const IntType node, const IntType cost)
+            {
+                if (cost > MaxDistance)
+                    return;
+                if (bucket_prev[node] != -1)
+                    bucket_next[bucket_prev[node]] = bucket_next[node];
+                else
+                    bucket_head[cost] = bucket_next[node];
+                if (bucket_next[node] != -1)
+                    bucket_prev[bucket_next[node]] = bucket_prev[node];
+            };
+            push(start, 0);
+            for (int cursor=0; cursor<=MaxDistance;)
+            {
+                const IntType current = bucket_head[cursor];
+                if (current == -1)
+                {
+                    ++cursor; // Settled nodes never get cheaper, costs only grow from here
+                    continue;
+                }
+                unlink(current, cursor);
+
+                if (current == target)
+                    return costs[current];  // Dijkstras first pop of target is optimal
+
+                relax(current, board, [&](const IntType neighbor, const bool unvisited, const IntType old_cost)
+                                      {
+                                          if (!unvisited)
+                                              unlink(neighbor, old_cost);
+                                          push(neighbor, costs[neighbor]);
+                                      });
+            }
+            // A target beyond MaxDistance is final once everything within it is expanded:
+            if (target >= 0 && generation[target] == current_generation)
+                return costs[target];
+            return InfCost;
+        }
     public:
         PathEngine() = default;
         PathEngine(const PathEngine&) = delete;
@@ -55,52 +178,13 @@
         constexpr IntType dijkstra(IntType start, IntType target, const Board& board)
         {
             current_generation++; // Increment generation to avoid clearing 'costs' and 'generation' arrays.
-
-            IntType queue[QUEUE_SIZE];
-            IntType head = 0, tail = 0;
-            queue[tail++] = start;
             generation[start] = current_generation;
             costs[start] = 0;
             predecessor[start] = -1;
-            while (head != tail)
-            {
-                IntType lowest_idx = head;
-                for (IntType i=head+1; i<tail; ++i)
-                {
-                    if (costs[queue[i]] < costs[queue[lowest_idx]])
-                        lowest_idx = i;
-                }
-                // Swap lowest to front and pop:
-                const IntType current = queue[lowest_idx];
-                queue[lowest_idx] = queue[head];
-                ++head;
-
-                if (current == target)
-                    return costs[current];  // Dijkstras first pop of target is optimal
-
-                if (costs[current] > MaxDistance)
-                    continue; // Prune...
-
-                for (int i=0; i<4; ++i)
-                {
-                    const IntType neighbor = cached_neighbors[current][i];
-                    if (neighbor == -1) continue; // Out of bounds.
-
-                    const IntType next_cost = costs[current] + board.getCost(neighbor, current);
-                    const bool unvisited = (generation[neighbor] != current_generation);
-                    if (unvisited || next_cost < costs[neighbor])
-                    {
-                        costs[neighbor] = next_cost;
-                        predecessor[neighbor] = current;
-                        if (unvisited)
-                        {
-                            generation[neighbor] = current_generation;
-                            queue[tail++] = neighbor;
-                        }
-                    }
-                }
-            }
-            return InfCost;
+            if constexpr (Queue == PathQueue::linearScan)
+                return dijkstraLinearScan(start, target, board);
+            else
+                return dijkstraBuckets(start, target, board);
         }
 
         constexpr int reconstruct(IntType start, IntType target, IntType *out_path) const
@@ -0,0 +1,123 @@
+#include "workers.hpp"
+#include <assert.h>
+
+
+/****************************************/
+/*                          Worker pool */
+/****************************************/
+    WorkerPool::WorkerPool(const int workers)
+    {
+        int n = workers > 0 ? workers : static_cast<int>(std::thread::hardware_concurrency());
+        n = n < 1 ? 1 : (n > MaxWorkers ? MaxWorkers : n);
+        nWorkers = n;
+        for (int i=1; i<nWorkers; ++i)
+            threads[i] = std::thread([this, i] { loop(i); });
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (int i=1; i<nWorkers; ++i)
+            threads[i].join();
+    }
+
+    void WorkerPool::loop(const int workerIdx)
+    {
+        unsigned long long seen = 0;
+        while (true)
+        {
+            Job fn;
+            void *ctx;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen] { return quit || generation != seen; });
+                if (quit)
+                    return;
+                seen = generation;
+                fn  = job;
+                ctx = jobCtx;
+            }
+            fn(ctx, workerIdx);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending -= 1;
+            }
+            finished.notify_one();
+        }
+    }
+
+    void WorkerPool::dispatch(const Job fn, void *ctx)
+    {
+        if (nWorkers > 1)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job = fn;
+                jobCtx = ctx;
+                pending = nWorkers - 1;
+                generation += 1;
+            }
+            wake.notify_all();
+        }
+        fn(ctx, 0); // The caller pulls its weight too
+        if (nWorkers > 1)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [this] { return pending == 0; });
+        }
+    }
+
+
+
+/****************************************/
+/*                                Tests */
+/* Threads can't run at compile time,   */
+/* these run at start-up in builds that */
+/* define INCLUDEAI__RUNTIME_TESTS      */
+/****************************************/
+  #ifdef INCLUDEAI__RUNTIME_TESTS
+    [[maybe_unused]] static const bool workerPoolChecked = []
+    {
+        bool ok = true;
+        {
+            // Caller only, no threads are started:
+            WorkerPool pool(1);
+            const std::thread::id caller = std::this_thread::get_id();
+            int calls = 0;
+            auto job = [&](const int workerIdx)
+            {
+                ok = ok && workerIdx == 0 && std::this_thread::get_id() == caller;
+                calls += 1;
+            };
+            pool.run(job);
+            pool.run(job);
+            ok = ok && pool.size() == 1 && calls == 2;
+        }
+        {
+            // The same threads pick up job after job, every worker exactly once per job:
+            WorkerPool pool(4);
+            int runs[WorkerPool::MaxWorkers] = {0};
+            bool sameThread[WorkerPool::MaxWorkers] = {false};
+            std::thread::id ids[WorkerPool::MaxWorkers];
+            for (int generation=1; generation<=100; ++generation)
+            {
+                auto job = [&](const int workerIdx) // Every worker only touches its own slots
+                {
+                    sameThread[workerIdx] = generation == 1 || ids[workerIdx] == std::this_thread::get_id();
+                    ids[workerIdx] = std::this_thread::get_id();
+                    runs[workerIdx] += 1;
+                };
+                pool.run(job);
+                for (int w=0; w<WorkerPool::MaxWorkers; ++w)
+                    ok = ok && runs[w] == (w < pool.size() ? generation : 0) && sameThread[w] == (w < pool.size());
+            }
+            ok = ok && pool.size() == 4;
+        }
+        assert(ok);
+        return ok;
+    }();
+  #endif // INCLUDEAI__RUNTIME_TESTS
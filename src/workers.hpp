@@ -0,0 +1,55 @@
+#ifndef WORKERS_HPP
+#define WORKERS_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+/****************************************/
+/*                          Worker pool */
+/* A fixed set of threads that all work */
+/* on the same job: run(job) calls      */
+/* job(workerIdx) once on every worker  */
+/* (the calling thread is worker 0) and */
+/* returns when all of them are done.   */
+/* The threads are started once and     */
+/* then sleep in between jobs.          */
+/****************************************/
+    class WorkerPool
+    {
+    public:
+        static constexpr int MaxWorkers = 64;
+    private:
+        using Job = void (*)(void *, int);
+        std::thread threads[MaxWorkers];
+        std::mutex mutex;
+        std::condition_variable wake, finished;
+        Job job = nullptr;
+        void *jobCtx = nullptr;
+        unsigned long long generation = 0;
+        int pending = 0;
+        int nWorkers = 1;
+        bool quit = false;
+    private:
+        void loop(int workerIdx);
+        void dispatch(Job fn, void *ctx);
+    public:
+        explicit WorkerPool(int workers = 0); // 0 = one per hardware thread
+        ~WorkerPool();
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        int size() const { return nWorkers; }
+
+        template <typename F>
+        void run(F& fn)
+        {
+            dispatch([](void *ctx, int workerIdx) { (*static_cast<F *>(ctx))(workerIdx); }, &fn);
+        }
+    };
+
+
+#else // WORKERS_HPP
+  #error "double include"
+#endif // WORKERS_HPP